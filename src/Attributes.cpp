@@ -25,4 +25,34 @@ const model::Attribute kSendTime { "deadbeef-dead-beef-dead-beefdeadbeef"_uuid,
 
 const model::Attribute kError { model::Attribute::kError, model::Attribute::Access::ReadOnly, data::DataType::kErrorCode };
 
+/// @todo assign a unique UUID
+const model::Attribute kConnectionGeneration { "deadbeef-dead-beef-dead-beefdeadbeef"_uuid, "connectionGeneration"sv, model::Attribute::Access::ReadOnly, data::DataType::kInteger };
+
+/// @todo assign a unique UUID
+const model::Attribute kActiveEndpoint { "deadbeef-dead-beef-dead-beefdeadbeef"_uuid, "activeEndpoint"sv, model::Attribute::Access::ReadOnly, data::DataType::kInteger };
+
+/// @todo assign a unique UUID
+const model::Attribute kFailoverCount { "deadbeef-dead-beef-dead-beefdeadbeef"_uuid, "failoverCount"sv, model::Attribute::Access::ReadOnly, data::DataType::kInteger };
+
+/// @todo assign a unique UUID
+const model::Attribute kThrottleTime { "deadbeef-dead-beef-dead-beefdeadbeef"_uuid, "throttleTime"sv, model::Attribute::Access::ReadOnly, data::DataType::kFloatingPoint };
+
+/// @todo assign a unique UUID
+const model::Attribute kQueueDepth { "deadbeef-dead-beef-dead-beefdeadbeef"_uuid, "queueDepth"sv, model::Attribute::Access::ReadOnly, data::DataType::kInteger };
+
+/// @todo assign a unique UUID
+const model::Attribute kWaitTime { "deadbeef-dead-beef-dead-beefdeadbeef"_uuid, "waitTime"sv, model::Attribute::Access::ReadOnly, data::DataType::kFloatingPoint };
+
+/// @todo assign a unique UUID
+const model::Attribute kBatchSizeTarget { "deadbeef-dead-beef-dead-beefdeadbeef"_uuid, "batchSizeTarget"sv, model::Attribute::Access::ReadOnly, data::DataType::kInteger };
+
+/// @todo assign a unique UUID
+const model::Attribute kHotPathAllocations { "deadbeef-dead-beef-dead-beefdeadbeef"_uuid, "hotPathAllocations"sv, model::Attribute::Access::ReadOnly, data::DataType::kInteger };
+
+/// @todo assign a unique UUID
+const model::Attribute kExpiredSegments { "deadbeef-dead-beef-dead-beefdeadbeef"_uuid, "expiredSegments"sv, model::Attribute::Access::ReadOnly, data::DataType::kInteger };
+
+/// @todo assign a unique UUID
+const model::Attribute kDroppedCommands { "deadbeef-dead-beef-dead-beefdeadbeef"_uuid, "droppedCommands"sv, model::Attribute::Access::ReadOnly, data::DataType::kInteger };
+
 } // namespace xentara::plugins::templateUplink::attributes
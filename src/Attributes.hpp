@@ -20,4 +20,28 @@ extern const model::Attribute kSendTime;
 /// @brief A Xentara attribute containing an error code for a client connection
 extern const model::Attribute kError;
 
+/// @brief A Xentara attribute containing the generation of a client connection, which is incremented on every reconnect
+extern const model::Attribute kConnectionGeneration;
+
+/// @brief A Xentara attribute containing the index of the endpoint a client is connected to, in order of preference
+extern const model::Attribute kActiveEndpoint;
+/// @brief A Xentara attribute containing the number of times a client has switched to a different endpoint
+extern const model::Attribute kFailoverCount;
+
+/// @brief A Xentara attribute containing the total time transactions have been held back by the traffic shaper of a client
+extern const model::Attribute kThrottleTime;
+/// @brief A Xentara attribute containing the number of transactions currently waiting for the traffic shaper of a client
+extern const model::Attribute kQueueDepth;
+/// @brief A Xentara attribute containing the time the last batch of a transaction had to wait for other transactions
+extern const model::Attribute kWaitTime;
+/// @brief A Xentara attribute containing the batch size the adaptive batching of a transaction is currently aiming for
+extern const model::Attribute kBatchSizeTarget;
+/// @brief A Xentara attribute containing the number of allocations a transaction or client made on the hot path in real-time
+/// memory mode
+extern const model::Attribute kHotPathAllocations;
+/// @brief A Xentara attribute containing the number of segments a transaction dropped because they outlived their time to live
+extern const model::Attribute kExpiredSegments;
+/// @brief A Xentara attribute containing the number of commands a client dropped because its command queue was full
+extern const model::Attribute kDroppedCommands;
+
 } // namespace xentara::plugins::templateUplink::attributes
\ No newline at end of file
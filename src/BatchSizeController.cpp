@@ -0,0 +1,52 @@
+// Copyright (c) embedded ocean GmbH
+#include "BatchSizeController.hpp"
+
+#include <algorithm>
+
+namespace xentara::plugins::templateUplink
+{
+
+auto BatchSizeController::shouldFlush(std::size_t pendingSize, std::chrono::nanoseconds age) noexcept -> bool
+{
+	// Without the controller, everything is sent right away
+	if (!_enabled || pendingSize >= _target)
+	{
+		return true;
+	}
+
+	// Hold the data back until it is too old
+	if (age < _config._maxDelay)
+	{
+		return false;
+	}
+
+	// The data does not come in fast enough to fill batches of the target size in time
+	decrease();
+	return true;
+}
+
+auto BatchSizeController::batchCompleted(std::size_t size, std::chrono::nanoseconds duration) noexcept -> void
+{
+	if (!_enabled)
+	{
+		return;
+	}
+
+	// Back off if the batch took too long
+	if (duration > _config._latencyTarget)
+	{
+		decrease();
+	}
+	// Probe for a larger target only if the current one was actually used
+	else if (size >= _target)
+	{
+		_target = std::min(_target + _config._increase, _config._maxSize);
+	}
+}
+
+auto BatchSizeController::decrease() noexcept -> void
+{
+	_target = std::max(std::size_t(double(_target) * _config._decrease), _config._minSize);
+}
+
+} // namespace xentara::plugins::templateUplink
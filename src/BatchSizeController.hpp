@@ -0,0 +1,91 @@
+// Copyright (c) embedded ocean GmbH
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+namespace xentara::plugins::templateUplink
+{
+
+/// @brief Adapts the size of the batches a transaction sends to the measured send latency.
+///
+/// The controller keeps a target batch size that is raised additively as long as batches of that size are written within the
+/// latency target, and lowered multiplicatively when a batch takes too long, or when data had to be held back for the maximum
+/// delay without reaching the target (AIMD). Pending data is only sent once it reaches the target size, so that small batches
+/// do not waste round trips, or once the oldest data has waited for the maximum delay.
+///
+/// @note This class is not thread safe. The transaction protects it using a mutex.
+class BatchSizeController final
+{
+public:
+	/// @brief The configuration of the controller
+	struct Config final
+	{
+		/// @brief The smallest target batch size, in bytes
+		std::size_t _minSize { 4096 };
+		/// @brief The largest target batch size, in bytes
+		std::size_t _maxSize { 1024 * 1024 };
+		/// @brief The time a batch may take to be written before the target is lowered
+		std::chrono::nanoseconds _latencyTarget { std::chrono::milliseconds(50) };
+		/// @brief The longest time data is held back waiting for the target size to be reached
+		std::chrono::nanoseconds _maxDelay { std::chrono::milliseconds(100) };
+		/// @brief The amount the target is raised by after each batch that was written in time, in bytes
+		std::size_t _increase { 4096 };
+		/// @brief The factor the target is multiplied by when it is lowered
+		double _decrease { 0.5 };
+	};
+
+	/// @brief Enables the controller
+	/// @pre The configuration must be consistent, i.e. 0 < _minSize <= _maxSize, and 0 < _decrease < 1
+	auto configure(const Config &config) noexcept -> void
+	{
+		_config = config;
+		_target = config._minSize;
+		_enabled = true;
+	}
+
+	/// @brief Checks whether the controller is enabled
+	auto enabled() const noexcept -> bool
+	{
+		return _enabled;
+	}
+
+	/// @brief Gets the current target batch size, in bytes
+	auto target() const noexcept -> std::size_t
+	{
+		return _target;
+	}
+
+	/// @brief Gets the longest time data is held back
+	auto maxDelay() const noexcept -> std::chrono::nanoseconds
+	{
+		return _config._maxDelay;
+	}
+
+	/// @brief Decides whether pending data should be sent now.
+	///
+	/// If this function returns true because the data has waited for the maximum delay without reaching the target size,
+	/// the target is lowered.
+	///
+	/// @param pendingSize The amount of data waiting to be sent, in bytes. This must not be 0.
+	/// @param age How long the oldest pending data has been waiting
+	auto shouldFlush(std::size_t pendingSize, std::chrono::nanoseconds age) noexcept -> bool;
+
+	/// @brief Reports that a batch was written completely
+	/// @param size The size of the batch, in bytes
+	/// @param duration The time from starting the batch until the last byte was written
+	auto batchCompleted(std::size_t size, std::chrono::nanoseconds duration) noexcept -> void;
+
+private:
+	/// @brief Lowers the target
+	auto decrease() noexcept -> void;
+
+	/// @brief The configuration
+	Config _config;
+	/// @brief Whether the controller is enabled
+	bool _enabled { false };
+	/// @brief The current target batch size
+	std::size_t _target { 0 };
+};
+
+} // namespace xentara::plugins::templateUplink
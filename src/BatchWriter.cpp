@@ -0,0 +1,49 @@
+// Copyright (c) embedded ocean GmbH
+#include "BatchWriter.hpp"
+
+namespace xentara::plugins::templateUplink
+{
+
+auto BatchWriter::start(std::span<const Buffer> buffers) -> void
+{
+	// Note: assign() reuses the existing capacity, so this does not allocate once the vectors have grown large enough
+	_original.assign(buffers.begin(), buffers.end());
+	rewind();
+}
+
+auto BatchWriter::rewind() -> void
+{
+	_buffers.assign(_original.begin(), _original.end());
+	_next = 0;
+
+	// Skip empty buffers
+	advance(0);
+}
+
+auto BatchWriter::reset() noexcept -> void
+{
+	_original.clear();
+	_buffers.clear();
+	_next = 0;
+}
+
+auto BatchWriter::advance(std::size_t size) noexcept -> void
+{
+	while (_next < _buffers.size())
+	{
+		auto &buffer = _buffers[_next];
+
+		// If the write ended in the middle of this buffer, trim it and stop
+		if (size < buffer.size())
+		{
+			buffer = buffer.subspan(size);
+			return;
+		}
+
+		// The buffer is complete
+		size -= buffer.size();
+		++_next;
+	}
+}
+
+} // namespace xentara::plugins::templateUplink
@@ -0,0 +1,81 @@
+// Copyright (c) embedded ocean GmbH
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace xentara::plugins::templateUplink
+{
+
+/// @brief Writes a batch of buffers to a non-blocking connection, keeping track of how much has been written.
+///
+/// If the connection cannot take all the data at once, the writer remembers its position, and the write can be resumed
+/// later, e.g. when the connection signals that it is ready for writing again. The writer does not own the data; the
+/// caller must keep the buffers alive until the batch is complete or abandoned.
+class BatchWriter final
+{
+public:
+	/// @brief A single buffer
+	using Buffer = std::span<const std::byte>;
+
+	/// @brief Starts writing a new batch
+	/// @pre No batch must be pending
+	auto start(std::span<const Buffer> buffers) -> void;
+
+	/// @brief Checks whether part of the batch still needs to be written
+	auto pending() const noexcept -> bool
+	{
+		return _next < _buffers.size();
+	}
+
+	/// @brief Gets the part of the batch that still needs to be written
+	auto remaining() const noexcept -> std::span<const Buffer>
+	{
+		return std::span<const Buffer>(_buffers).subspan(_next);
+	}
+
+	/// @brief Advances the position after part of the batch was written by other means, e.g. asynchronously
+	auto advance(std::size_t size) noexcept -> void;
+
+	/// @brief Goes back to the beginning of the batch, e.g. because the data must be resent on a new connection
+	auto rewind() -> void;
+
+	/// @brief Abandons the batch
+	auto reset() noexcept -> void;
+
+	/// @brief Writes as much of the batch as possible.
+	///
+	/// @param write A function that writes a list of buffers without blocking. The function must return the number of bytes
+	/// written, or std::nullopt if the connection is not ready, and must throw an exception on error.
+	/// @return Returns true if the batch is complete, or false if the write must be resumed later.
+	template <std::invocable<std::span<const Buffer>> Write>
+	auto resume(Write &&write) -> bool
+	{
+		while (pending())
+		{
+			// Write as much as the connection will take
+			const std::optional<std::size_t> written = write(remaining());
+			if (!written || *written == 0)
+			{
+				return false;
+			}
+
+			advance(*written);
+		}
+
+		return true;
+	}
+
+private:
+	/// @brief The buffers of the batch as originally passed to start()
+	std::vector<Buffer> _original;
+	/// @brief The buffers of the batch. The first unwritten buffer is trimmed to the part not yet written.
+	std::vector<Buffer> _buffers;
+	/// @brief The index of the first buffer that has not been completely written
+	std::size_t _next { 0 };
+};
+
+} // namespace xentara::plugins::templateUplink
@@ -0,0 +1,221 @@
+// Copyright (c) embedded ocean GmbH
+#include "CommandReceiver.hpp"
+
+#include "CustomError.hpp"
+#include "RealTimeMemory.hpp"
+
+#include <xentara/utils/json/decoder/Errors.hpp>
+
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+namespace xentara::plugins::templateUplink
+{
+
+namespace
+{
+
+	/// @brief The size of the length field of a message
+	constexpr std::size_t kLengthSize = sizeof(std::uint32_t);
+	/// @brief The size of the ID length field of a message
+	constexpr std::size_t kIdLengthSize = sizeof(std::uint16_t);
+
+	/// @brief The largest message accepted, not including the length field.
+	///
+	/// Larger messages are treated as a protocol error, so that a corrupt length field cannot make us allocate arbitrary amounts
+	/// of memory.
+	constexpr std::size_t kMaxMessageSize = 1024 * 1024;
+
+	/// @brief The minimum free space in the receive buffer for each read
+	constexpr std::size_t kMinReadSize = 64 * 1024;
+
+	/// @brief The maximum number of reads per call to receive(), so that a busy connection cannot starve the other clients
+	constexpr std::size_t kMaxReadsPerReceive = 16;
+
+	/// @brief The number of queued commands room is made for by preallocate()
+	constexpr std::size_t kPreallocatedCommands = 1024;
+
+	/// @brief The maximum number of queued commands.
+	///
+	/// Commands received while the queue is full are dropped, so that a remote service sending faster than the "write" task
+	/// writes cannot make us allocate arbitrary amounts of memory.
+	constexpr std::size_t kMaxPendingCommands = 64 * kPreallocatedCommands;
+
+} // namespace
+
+auto CommandReceiver::load(utils::json::decoder::Value &value, config::Context &context) -> void
+{
+	// Go through all the elements
+	for (auto &&element : value.asArray())
+	{
+		// Add a command
+		auto &command = _commands.emplace_front();
+		// Load it
+		command.load(element, context);
+
+		// Add it to the index
+		if (!_index.try_emplace(command.remoteId(), std::cref(command)).second)
+		{
+			utils::json::decoder::throwWithLocation(element, std::runtime_error("duplicate remote ID for template client command"));
+		}
+	}
+}
+
+auto CommandReceiver::prepare() -> void
+{
+	for (auto &&command : _commands)
+	{
+		command.resolveHandles();
+	}
+}
+
+auto CommandReceiver::preallocate() -> void
+{
+	if (!enabled())
+	{
+		return;
+	}
+
+	// Make room for the largest message, plus the free space needed for a read after a partial message
+	_buffer.resize(kLengthSize + kMaxMessageSize + kMinReadSize);
+	lockAndPrefault(_buffer.data(), _buffer.size());
+
+	// Make room for queued commands. String values may still allocate memory for their text.
+	_pending.reserve(kPreallocatedCommands);
+	lockAndPrefault(_pending.data(), _pending.capacity() * sizeof(PendingCommand));
+	_batch.reserve(kPreallocatedCommands);
+	lockAndPrefault(_batch.data(), _batch.capacity() * sizeof(PendingCommand));
+
+	// Count any further growth of the queues
+	_hotPathMemory.arm();
+}
+
+auto CommandReceiver::receive(const Socket &socket) -> void
+{
+	std::scoped_lock lock { _receiveMutex };
+
+	for (std::size_t reads = 0; reads < kMaxReadsPerReceive; ++reads)
+	{
+		// Make sure there is enough room in the buffer
+		if (_buffer.size() - _received < kMinReadSize)
+		{
+			_buffer.resize(_received + kMinReadSize);
+		}
+
+		// Read as much as we can
+		const auto received = socket.readSome(std::span(_buffer).subspan(_received));
+		if (!received)
+		{
+			return;
+		}
+		if (*received == 0)
+		{
+			throw std::system_error(CustomError::NotConnected, "the remote service closed the connection");
+		}
+		_received += *received;
+
+		// Queue the commands right away, so that they can be written without waiting for more data
+		decodeMessages();
+	}
+}
+
+auto CommandReceiver::decodeMessages() -> void
+{
+	// Decode all complete messages
+	std::size_t position = 0;
+	while (_received - position >= kLengthSize)
+	{
+		const auto size = getLittleEndian<std::uint32_t>(_buffer.data() + position);
+		if (size > kMaxMessageSize)
+		{
+			throw std::system_error(CustomError::ProtocolError, "the remote service sent a command message that is too large");
+		}
+
+		// Stop at incomplete messages
+		if (_received - position - kLengthSize < size)
+		{
+			break;
+		}
+
+		decodeMessage(std::span(_buffer).subspan(position + kLengthSize, size));
+		position += kLengthSize + size;
+	}
+
+	// Move any partial message to the start of the buffer
+	if (position != 0)
+	{
+		std::memmove(_buffer.data(), _buffer.data() + position, _received - position);
+		_received -= position;
+	}
+}
+
+auto CommandReceiver::decodeMessage(std::span<const std::byte> message) -> void
+{
+	// Get the ID
+	if (message.size() < kIdLengthSize)
+	{
+		return;
+	}
+	const auto idSize = getLittleEndian<std::uint16_t>(message.data());
+	if (message.size() - kIdLengthSize < idSize)
+	{
+		return;
+	}
+	const std::string_view id(reinterpret_cast<const char *>(message.data() + kIdLengthSize), idSize);
+
+	// Find the command
+	const auto found = _index.find(id);
+	if (found == _index.end())
+	{
+		/// @todo report unknown commands to the remote service, if the protocol supports this
+		return;
+	}
+	const auto &command = found->second.get();
+
+	// Decode the value
+	auto value = command.decode(message.subspan(kIdLengthSize + idSize));
+	if (!value)
+	{
+		/// @todo report invalid values to the remote service, if the protocol supports this
+		return;
+	}
+
+	// Queue the command, unless the queue is full
+	std::scoped_lock lock { _pendingMutex };
+	if (_pending.size() >= kMaxPendingCommands)
+	{
+		/// @todo report dropped commands to the remote service, if the protocol supports this
+		_droppedCommands.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	const auto capacity = _pending.capacity();
+	_pending.push_back({ command, std::move(*value) });
+	_hotPathMemory.recordGrowth(capacity, _pending.capacity());
+}
+
+auto CommandReceiver::applyPending() -> void
+{
+	// Take all the pending commands, leaving our empty batch vector in their place so that its capacity is reused
+	{
+		std::scoped_lock lock { _pendingMutex };
+		if (_pending.empty())
+		{
+			return;
+		}
+		std::swap(_batch, _pending);
+	}
+
+	// Write the values
+	for (auto &&pending : _batch)
+	{
+		if (auto error = pending._command.get().write(pending._value))
+		{
+			/// @todo report write errors to the remote service, if the protocol supports this
+		}
+	}
+
+	_batch.clear();
+}
+
+} // namespace xentara::plugins::templateUplink
@@ -0,0 +1,153 @@
+// Copyright (c) embedded ocean GmbH
+#pragma once
+
+#include "RealTimeMemory.hpp"
+#include "Socket.hpp"
+#include "TemplateCommand.hpp"
+
+#include <xentara/config/Context.hpp>
+#include <xentara/utils/json/decoder/Value.hpp>
+#include <xentara/utils/tools/Unique.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <forward_list>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace xentara::plugins::templateUplink
+{
+
+/// @brief Receives commands from the remote service and writes their values to the corresponding data points.
+///
+/// Commands are received on a thread of the I/O reactor, and queued. The queued commands are then written in a single batch by
+/// the "write" task of the client.
+///
+/// Each command message is framed like this, with all integers in little endian byte order:
+///
+/// Field     | Size                    | Contents
+/// :-------- | :---------------------- | :----------------------------------------------
+/// length    | 4 bytes                 | the number of bytes in the rest of the message
+/// ID length | 2 bytes                 | the number of bytes in the remote ID
+/// ID        | as given by *ID length* | the remote ID of the command
+/// value     | the rest of the message | the value, as described in TemplateCommand::decode()
+///
+/// Messages with an unknown ID or an invalid value are skipped. Commands received while the queue is full are dropped and
+/// counted.
+class CommandReceiver final : private utils::tools::Unique
+{
+public:
+	/// @brief Loads the commands from a JSON array
+	auto load(utils::json::decoder::Value &value, config::Context &context) -> void;
+
+	/// @brief Checks whether any commands are configured
+	auto enabled() const noexcept -> bool
+	{
+		return !_index.empty();
+	}
+
+	/// @brief Resolves the write handles of all commands
+	/// @throw std::system_error A handle could not be resolved
+	auto prepare() -> void;
+
+	/// @brief Allocates the buffers for the largest possible message and for a fixed number of queued commands up front, and
+	/// locks them into RAM, so that receiving commands does not allocate memory or cause page faults. Any growth of the queues
+	/// after this is counted in hotPathAllocations().
+	/// @throw std::system_error The memory could not be locked
+	auto preallocate() -> void;
+
+	/// @brief Reads all available data from a connection, and queues the commands it contains.
+	///
+	/// Calls to this function and to reset() are serialised using _receiveMutex, so they can be made from different threads.
+	/// Only one connection should be received from at a time, however, and reset() must be called when the connection is
+	/// replaced, as the receive buffer is shared.
+	///
+	/// @throw std::system_error The connection was closed or failed, or the remote service sent an invalid message frame
+	auto receive(const Socket &socket) -> void;
+
+	/// @brief Discards any partially received message, e.g. because the connection was replaced
+	auto reset() noexcept -> void
+	{
+		std::scoped_lock lock { _receiveMutex };
+		_received = 0;
+	}
+
+	/// @brief Writes all the queued commands to their data points
+	auto applyPending() -> void;
+
+	/// @brief Gets the number of commands dropped because the queue was full
+	auto droppedCommands() const noexcept -> std::uint64_t
+	{
+		return _droppedCommands.load(std::memory_order_relaxed);
+	}
+
+	/// @brief Gets the number of times the queues had to grow after preallocate() was called
+	auto hotPathAllocations() const noexcept -> std::uint64_t
+	{
+		return _hotPathMemory.allocations();
+	}
+
+private:
+	/// @brief A received command waiting to be written
+	struct PendingCommand final
+	{
+		/// @brief The command
+		std::reference_wrapper<const TemplateCommand> _command;
+		/// @brief The value to write
+		TemplateCommand::Value _value;
+	};
+
+	/// @brief A hash function for strings that also accepts string views, so that lookups need not construct a string
+	struct StringHash final
+	{
+		using is_transparent = void;
+
+		auto operator()(std::string_view text) const noexcept -> std::size_t
+		{
+			return std::hash<std::string_view>()(text);
+		}
+	};
+
+	/// @brief Decodes and queues all the complete messages in the receive buffer, and removes them from it
+	/// @pre _receiveMutex must be locked
+	/// @throw std::system_error A message frame is invalid
+	auto decodeMessages() -> void;
+
+	/// @brief Decodes and queues a single message, without the length field
+	auto decodeMessage(std::span<const std::byte> message) -> void;
+
+	/// @brief The commands
+	std::forward_list<TemplateCommand> _commands;
+	/// @brief The commands by remote ID. This allows each command to be found in constant time, regardless of the number of commands.
+	std::unordered_map<std::string, std::reference_wrapper<const TemplateCommand>, StringHash, std::equal_to<>> _index;
+
+	/// @brief A mutex protecting _buffer and _received.
+	///
+	/// The I/O reactor never calls receive() concurrently for the same connection, so this is normally uncontended. It
+	/// guards against a receive still in progress while the connection is being replaced.
+	std::mutex _receiveMutex;
+	/// @brief The receive buffer. Only the first _received bytes are valid.
+	std::vector<std::byte> _buffer;
+	/// @brief The number of bytes in the receive buffer
+	std::size_t _received { 0 };
+
+	/// @brief A mutex protecting _pending
+	std::mutex _pendingMutex;
+	/// @brief The commands received since the last batch was written
+	std::vector<PendingCommand> _pending;
+	/// @brief The batch currently being written. This is kept as a member so that its capacity is reused.
+	std::vector<PendingCommand> _batch;
+	/// @brief The number of commands dropped because the queue was full
+	std::atomic<std::uint64_t> _droppedCommands { 0 };
+
+	/// @brief Counts the growth of the queues once they have been preallocated. No memory is allocated from this resource.
+	RealTimeMemoryResource _hotPathMemory;
+};
+
+} // namespace xentara::plugins::templateUplink
@@ -0,0 +1,403 @@
+// Copyright (c) embedded ocean GmbH
+#include "ConnectionManager.hpp"
+
+#include <xentara/utils/eh/currentErrorCode.hpp>
+
+#include <algorithm>
+#include <utility>
+
+#ifdef _WIN32
+#	include <Windows.h>
+#else
+#	include <errno.h>
+#endif
+
+namespace xentara::plugins::templateUplink
+{
+
+auto ConnectionManager::configure(Config config) -> void
+{
+	_config = std::move(config);
+
+	// Prefer the endpoints in the order they were given
+	_endpointOrder.resize(_config._endpoints.size());
+	std::ranges::generate(_endpointOrder, [next = std::size_t(0)]() mutable { return next++; });
+}
+
+auto ConnectionManager::requestConnect(std::chrono::system_clock::time_point timeStamp) -> void
+{
+	// increment the count
+	const auto oldCount = _requestCount++;
+
+	// connect if the old count was 0
+	if (oldCount == 0)
+	{
+		connect(timeStamp);
+	}
+}
+
+auto ConnectionManager::requestDisconnect(std::chrono::system_clock::time_point timeStamp) -> void
+{
+	// decrement the count
+	const auto newCount = --_requestCount;
+
+	// disconnect if the new count is 0
+	if (newCount == 0)
+	{
+		disconnect(timeStamp);
+	}
+}
+
+auto ConnectionManager::connect(std::chrono::system_clock::time_point timeStamp) -> void
+{
+	// If we are not disconnected, or someone else is busy changing the state, there is nothing to do. Don't connect if nobody
+	// needs the connection, either. This can happen if we are called from the worker pool.
+	const auto oldState = state();
+	if (oldState.phase() != ConnectionState::Phase::Disconnected || !requested())
+	{
+		return;
+	}
+
+	/// @todo check the last error to see if a reconnect can succeed at all, and bail if it can't.
+	// A reconnect need not be attempted if it requires non-existent hardware, like a missing network adapter or I/O card, for example.
+	// see isConnectionError() for an example on how to check error codes.
+
+	// Open the connection without owning the state, like failback() does, as this may take up to the connect timeout.
+	// Otherwise, disconnect() would be blocked for that long.
+	const auto attemptStart = std::chrono::steady_clock::now();
+	Handle handle;
+	std::error_code error;
+	try
+	{
+		// Use the standby connection if we have one, so we don't have to wait for a handshake
+		handle = takeStandby();
+		if (!handle)
+		{
+			handle = openHandle(_endpointOrder);
+		}
+	}
+	/// @todo if your connection function throws exceptions that are not derived from std::system_error, but that
+	// still provide some sort of error code, you should catch those exceptions separately and wrap the error code in a custom
+	// error category.
+	catch (const std::exception &)
+	{
+		// Get the error from the current exception using this special utility function
+		error = utils::eh::currentErrorCode();
+	}
+	_listener.connectionAttempted(attemptStart, handle.endpoint(), error);
+
+	// Take ownership of the connection state to publish the result. If the state was changed in the meantime, e.g. by
+	// disconnect() or by another connection attempt, the result is stale, and the new connection is simply closed again.
+	if (!_state.tryBegin(oldState))
+	{
+		return;
+	}
+	// Don't connect if the last request was withdrawn in the meantime
+	if (!requested())
+	{
+		_state.end(oldState);
+		return;
+	}
+
+	// If the attempt failed, we are still disconnected
+	if (error)
+	{
+		_listener.stateChanged(timeStamp, error, oldState.generation(), nullptr);
+		_state.end(oldState);
+		return;
+	}
+
+	// The connection was successful. Publish it under a new generation
+	const auto newState = oldState.nextGeneration(ConnectionState::Phase::Connected);
+	publishHandle(std::move(handle), newState.generation());
+	handlePublished();
+	_listener.stateChanged(timeStamp, std::error_code(), newState.generation(), nullptr);
+	_state.end(newState);
+}
+
+auto ConnectionManager::disconnect(std::chrono::system_clock::time_point timeStamp) -> void
+{
+	// Take ownership of the connection state, waiting for any reconnect or error handling in progress
+	const auto oldState = _state.begin();
+
+	// Reset the handles in any case, even if we fail, because the connection state should be false after this
+	_listener.releasingHandle();
+	auto handle = publishHandle(Handle(), oldState.generation());
+	auto standbyHandle = takeStandby();
+
+	/// @todo close the connection, ignoring any errors. If the disconnect function can throw exceptions,
+	// these shoudl be caucht and ignored.
+
+	// This is always a graceful disconnect, regardless of what happened, so never include an error code.
+	_listener.stateChanged(timeStamp, CustomError::NotConnected, oldState.generation(), nullptr);
+	_state.end(oldState.withPhase(ConnectionState::Phase::Disconnected));
+}
+
+auto ConnectionManager::handleError(std::chrono::system_clock::time_point timeStamp,
+	std::error_code error,
+	std::uint64_t generation,
+	const void *origin) -> void
+{
+	// Ignore any new errors if we are not connected (the first error always wins), or if the error belongs to an older
+	// connection that has already been replaced.
+	const ConnectionState expectedState { generation, ConnectionState::Phase::Connected };
+	if (state().word() != expectedState.word())
+	{
+		return;
+	}
+	_listener.connectionErrorReported(error, generation);
+	// Check if this error affects the connection as a whole, and bail if it doesn't.
+	if (!isConnectionError(error))
+	{
+		return;
+	}
+
+	// Take ownership of the connection state. If this fails, the connection was closed or replaced in the meantime, or another
+	// thread is already handling an error.
+	if (!_state.tryBegin(expectedState))
+	{
+		return;
+	}
+
+	// Swap in the standby connection, if we have one. The connection gets a new generation, so that any late results from
+	// the old connection are discarded.
+	/// @todo gracefully close the old handle, if this is necessary
+	_listener.releasingHandle();
+	const auto newState = expectedState.nextGeneration(ConnectionState::Phase::Connected);
+	publishHandle(takeStandby(), newState.generation());
+	if (handle())
+	{
+		handlePublished();
+		_listener.stateChanged(timeStamp, std::error_code(), newState.generation(), origin);
+		_state.end(newState);
+		return;
+	}
+
+	// update the error state
+	_listener.stateChanged(timeStamp, error, generation, origin);
+	_state.end(expectedState.withPhase(ConnectionState::Phase::Disconnected));
+
+	// If there are other endpoints, fail over right away instead of waiting for the next reconnect
+	if (_config._endpoints.size() > 1)
+	{
+		_listener.reconnectRequested();
+	}
+}
+
+auto ConnectionManager::failbackDue(std::chrono::steady_clock::time_point now) noexcept -> bool
+{
+	// Only fail back if we are not connected to the most preferred endpoint already
+	if (activeEndpoint() == 0 || _config._failbackInterval.count() <= 0 || now < _nextFailback)
+	{
+		return false;
+	}
+
+	_nextFailback = now + _config._failbackInterval;
+	return true;
+}
+
+auto ConnectionManager::failback() -> void
+{
+	// Try the endpoints that are preferred to the current one
+	const auto activeEndpoint = this->activeEndpoint();
+	if (activeEndpoint == 0)
+	{
+		return;
+	}
+	Handle handle;
+	try
+	{
+		handle = openHandle(std::span(_endpointOrder).first(activeEndpoint));
+	}
+	catch (const std::exception &)
+	{
+		// The preferred endpoints are still unreachable
+		return;
+	}
+
+	// Take ownership of the connection state, unless the connection was closed or replaced in the meantime. In that case, the
+	// new connection is simply closed again.
+	const auto oldState = state();
+	if (!oldState.connected() || this->activeEndpoint() != activeEndpoint || !_state.tryBegin(oldState))
+	{
+		return;
+	}
+
+	// Switch over under a new generation, so that any late results from the old connection are discarded. Transactions
+	// that are still writing to the old handle keep it open until they are done, and then notice the new generation.
+	/// @todo gracefully close the old handle, if this is necessary
+	_listener.releasingHandle();
+	const auto newState = oldState.nextGeneration(ConnectionState::Phase::Connected);
+	publishHandle(std::move(handle), newState.generation());
+	handlePublished();
+
+	const auto timeStamp = std::chrono::system_clock::now();
+	_listener.stateChanged(timeStamp, std::error_code(), newState.generation(), nullptr);
+	_state.end(newState);
+}
+
+auto ConnectionManager::prepareStandby() -> void
+{
+	if (!_config._warmStandby)
+	{
+		return;
+	}
+
+	// Check if we already have a standby connection
+	{
+		std::scoped_lock lock { _standbyMutex };
+		if (_standbyHandle)
+		{
+			return;
+		}
+	}
+
+	// Open the connection without holding the lock, as this may take a while. Other endpoints are preferred to the active
+	// one, so that the standby connection survives if the active endpoint fails as a whole.
+	try
+	{
+		auto endpointOrder = _endpointOrder;
+		const auto activeEndpoint = this->activeEndpoint();
+		std::ranges::stable_partition(endpointOrder, [&](std::size_t endpoint) { return endpoint != activeEndpoint; });
+		auto handle = openHandle(endpointOrder);
+
+		std::scoped_lock lock { _standbyMutex };
+		_standbyHandle = std::move(handle);
+	}
+	catch (const std::exception &)
+	{
+		// Just try again next time. The main connection is still up, so this is not an error as far as the state is concerned.
+	}
+}
+
+auto ConnectionManager::isConnectionError(std::error_code error) noexcept -> bool
+{
+	/// @todo check if this error affects the connection as a whole, and bail if it doesn't.
+	// This function should return true on errors that signal that the entire client has stopped working,
+	// like timeouts and network errors, and false on errors thst only affect some inputs and/or outputs, such as
+	// unknown input or output, type mismatch, range errors etc.
+
+	// Example code suitable for socket errors:
+
+	// Check system errors
+	if (error.category() == std::system_category())
+	{
+		switch (error.value())
+		{
+	#ifdef _WIN32
+		case WSAEBADF:
+		case WSAENOTSOCK:
+		case ERROR_INVALID_HANDLE:
+		case WSAECONNRESET:
+		case WSAECONNABORTED:
+		case WSAENETRESET:
+		case WSAESHUTDOWN:
+		case WSAENETUNREACH:
+		case WSAEHOSTUNREACH:
+		case WSAEHOSTDOWN:
+		case WSAENOTCONN:
+		case ERROR_BROKEN_PIPE:
+	#else // _WIN32
+		case EBADF:
+		case ECONNRESET:
+		case ECONNABORTED:
+		case ENETRESET:
+		case ESHUTDOWN:
+		case ENETUNREACH:
+		case EHOSTUNREACH:
+		case EHOSTDOWN:
+		case ENOTCONN:
+		case EPIPE:
+	#endif // _WIN32
+			return true;
+
+		default:
+			return false;
+		}
+	}
+
+	// Check custom errors:
+	if (error.category() == customErrorCategory())
+	{
+		switch (CustomError(error.value()))
+		{
+		case CustomError::NotConnected:
+		case CustomError::ProtocolError:
+		case CustomError::UnknownError:
+			/// @todo add case statements for other relevant custom errors (like e.g. timeout) here
+			return true;
+
+		case CustomError::NoError:
+		case CustomError::Pending:
+		default:
+			return false;
+		}
+	}
+
+	// No other categories need apply
+	else
+	{
+		return false;
+	}
+}
+
+auto ConnectionManager::openHandle(std::span<const std::size_t> endpointOrder) -> Handle
+{
+	// Connect to the first endpoint that answers, racing the attempts. The socket is already in non-blocking mode, as
+	// transactions must never block when sending.
+	auto [socket, endpoint] = connectToFirst(_config._endpoints, endpointOrder, _config._connectionRace);
+
+	// Note: If your protocol needs a handshake after connecting, and uses its own error codes, you should define a custom
+	// error category.
+
+	// Enable keep-alive probes, so that a dead connection is detected before the next send fails
+	if (_config._keepAlive)
+	{
+		socket.setKeepAlive(*_config._keepAlive);
+	}
+
+	/// @todo if the service instance uses TLS, perform the TLS handshake here. To make reconnects cheaper, keep the session
+	// ticket the server sends, and pass it to the TLS library on the next connection to resume the session.
+
+	return Handle(std::move(socket), endpoint);
+}
+
+auto ConnectionManager::takeStandby() noexcept -> Handle
+{
+	std::scoped_lock lock { _standbyMutex };
+	return std::exchange(_standbyHandle, Handle());
+}
+
+auto ConnectionManager::publishHandle(Handle handle, std::uint64_t generation) -> std::shared_ptr<const Handle>
+{
+	if (!handle)
+	{
+		return _handle.exchange(nullptr, std::memory_order_acq_rel);
+	}
+
+	handle.setGeneration(generation);
+	return _handle.exchange(std::make_shared<const Handle>(std::move(handle)), std::memory_order_acq_rel);
+}
+
+auto ConnectionManager::handlePublished() noexcept -> void
+{
+	const auto handle = this->handle();
+	if (!handle)
+	{
+		return;
+	}
+
+	// Count the switch if the connection went to a different endpoint than last time
+	const auto endpoint = handle->endpoint();
+	const auto failover = _hadEndpoint && endpoint != activeEndpoint();
+	if (failover)
+	{
+		++_failoverCount;
+	}
+	_hadEndpoint = true;
+	_activeEndpoint.store(endpoint, std::memory_order_relaxed);
+
+	_listener.handlePublished(*handle, failover);
+}
+
+} // namespace xentara::plugins::templateUplink
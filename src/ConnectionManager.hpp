@@ -0,0 +1,307 @@
+// Copyright (c) embedded ocean GmbH
+#pragma once
+
+#include "ConnectionState.hpp"
+#include "CustomError.hpp"
+#include "Endpoint.hpp"
+#include "Socket.hpp"
+
+#include <xentara/utils/tools/Unique.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <system_error>
+#include <vector>
+
+namespace xentara::plugins::templateUplink
+{
+
+/// @brief Establishes, replaces and closes the connection of a client.
+///
+/// This class contains the connection logic of the client: racing the endpoints, keeping a standby connection, swapping it
+/// in on connection errors, failing over to other endpoints and back, and publishing the current handle under a new
+/// generation every time. It does not depend on the Xentara runtime, so that it can be tested on its own. Everything the
+/// client does in response, like updating its attributes and watching the handle, is done by a Listener.
+class ConnectionManager final
+{
+public:
+	/// @brief A handle used to access the client
+	/// @todo implement a proper handle
+	class Handle final : private utils::tools::Unique
+	{
+	public:
+		/// @brief Default constructor. Creates a handle that is not connected.
+		Handle() noexcept = default;
+
+		/// @brief Constructor that takes ownership of a connected socket
+		/// @param endpoint The index of the endpoint the socket is connected to
+		explicit Handle(Socket socket, std::size_t endpoint = 0) noexcept : _socket(std::move(socket)), _endpoint(endpoint)
+		{
+		}
+
+		// determines of the client is connected
+		explicit operator bool() const noexcept
+		{
+			return bool(_socket);
+		}
+
+		/// @brief Gets the socket
+		auto socket() const noexcept -> const Socket &
+		{
+			return _socket;
+		}
+
+		/// @brief Gets the index of the endpoint the handle is connected to
+		auto endpoint() const noexcept -> std::size_t
+		{
+			return _endpoint;
+		}
+
+		/// @brief Gets the connection generation the handle was published under
+		auto generation() const noexcept -> std::uint64_t
+		{
+			return _generation;
+		}
+
+		/// @brief Sets the connection generation the handle is published under
+		auto setGeneration(std::uint64_t generation) noexcept -> void
+		{
+			_generation = generation;
+		}
+
+	private:
+		/// @brief The socket connected to the service instance
+		Socket _socket;
+		/// @brief The index of the endpoint the socket is connected to
+		std::size_t _endpoint { 0 };
+		/// @brief The connection generation the handle was published under
+		std::uint64_t _generation { 0 };
+
+		/// @todo add the session object of the TLS library, if the service instance uses TLS
+	};
+
+	/// @brief The connection settings
+	struct Config final
+	{
+		/// @brief The endpoints of the service instance, in order of preference
+		std::vector<Endpoint> _endpoints;
+		/// @brief The settings for racing connection attempts to the endpoints
+		ConnectionRace _connectionRace;
+		/// @brief The keep-alive settings, or std::nullopt to leave keep-alive off
+		std::optional<KeepAlive> _keepAlive;
+		/// @brief Whether a standby connection should be kept open
+		bool _warmStandby { false };
+		/// @brief The interval at which a connection to a more preferred endpoint is attempted, or 0 to never fail back
+		std::chrono::nanoseconds _failbackInterval { std::chrono::seconds(30) };
+	};
+
+	/// @brief Interface for the object that is notified of connection changes
+	class Listener
+	{
+	public:
+		/// @brief Virtual destructor
+		/// @note The destructor is pure virtual (= 0) to ensure that this class will remain abstract, even if we should remove all
+		/// other pure virtual functions later. This is not necessary, of course, but prevents the abstract class from becoming
+		/// instantiable by accident as a result of refactoring.
+		virtual ~Listener() = 0;
+
+		/// @brief Called after every connection attempt made by ConnectionManager::connect()
+		/// @param start The time the attempt was started
+		/// @param endpoint The endpoint that was connected to, if the attempt succeeded
+		/// @param error The error, or a default constructed std::error_code object if the attempt succeeded
+		virtual auto connectionAttempted(
+			std::chrono::steady_clock::time_point start, std::size_t endpoint, std::error_code error) noexcept -> void = 0;
+
+		/// @brief Called when an error is reported for the current connection, before it is classified
+		virtual auto connectionErrorReported(std::error_code error, std::uint64_t generation) noexcept -> void = 0;
+
+		/// @brief Called before the current handle is replaced or cleared.
+		/// @pre The caller owns the connection state
+		virtual auto releasingHandle() noexcept -> void = 0;
+
+		/// @brief Called after a new handle has been published
+		/// @pre The caller owns the connection state
+		/// @param failover Whether the handle is connected to a different endpoint than the previous one
+		virtual auto handlePublished(const Handle &handle, bool failover) noexcept -> void = 0;
+
+		/// @brief Called to publish a change in the connection state
+		/// @pre The caller owns the connection state
+		/// @param error The error, CustomError::NotConnected for a graceful disconnect, or a default constructed std::error_code
+		/// object if the client is connected
+		/// @param origin The object that reported the error to ConnectionManager::handleError(), if any
+		virtual auto stateChanged(std::chrono::system_clock::time_point timeStamp,
+			std::error_code error,
+			std::uint64_t generation,
+			const void *origin) -> void = 0;
+
+		/// @brief Called when the connection was lost, and another endpoint should be tried right away.
+		///
+		/// The listener should call ConnectionManager::connect() in the background.
+		virtual auto reconnectRequested() noexcept -> void = 0;
+	};
+
+	/// @brief Constructor
+	explicit ConnectionManager(Listener &listener) noexcept : _listener(listener)
+	{
+	}
+
+	/// @brief Sets the connection settings
+	/// @pre This function must only be called while the model is being loaded, before the first connection is requested.
+	auto configure(Config config) -> void;
+
+	/// @brief Gets the connection settings
+	auto config() const noexcept -> const Config &
+	{
+		return _config;
+	}
+
+	/// @brief Gets the current connection state
+	auto state() const noexcept -> ConnectionState
+	{
+		return _state.load();
+	}
+
+	/// @brief Checks whether the client is up.
+	///
+	/// This function is wait-free, and can be called from any thread.
+	auto connected() const noexcept -> bool
+	{
+		return state().connected();
+	}
+
+	/// @brief Pins the current handle
+	/// @return The current handle, or nullptr if the client is not connected
+	auto handle() const noexcept -> std::shared_ptr<const Handle>
+	{
+		return _handle.load(std::memory_order_acquire);
+	}
+
+	/// @brief Gets the index of the endpoint of the current connection
+	auto activeEndpoint() const noexcept -> std::size_t
+	{
+		return _activeEndpoint.load(std::memory_order_relaxed);
+	}
+
+	/// @brief Gets the number of times the client has switched to a different endpoint.
+	/// @pre The caller must own the connection state
+	auto failoverCount() const noexcept -> std::uint64_t
+	{
+		return _failoverCount;
+	}
+
+	/// @brief Checks whether anyone has requested the connection
+	auto requested() const noexcept -> bool
+	{
+		return _requestCount.load(std::memory_order_relaxed) != 0;
+	}
+
+	/// @brief Request that the client be connected, connecting if this is the first request
+	auto requestConnect(std::chrono::system_clock::time_point timeStamp) -> void;
+
+	/// @brief Request that the client be disconnected, disconnecting if this is the last request
+	auto requestDisconnect(std::chrono::system_clock::time_point timeStamp) -> void;
+
+	/// @brief Attempts to establish a connection if the client is disconnected, and updates the state accordingly.
+	///
+	/// The connection is opened before taking ownership of the connection state, so that disconnect() does not have to wait
+	/// for the attempt. If the state changes in the meantime, the new connection is discarded.
+	auto connect(std::chrono::system_clock::time_point timeStamp) -> void;
+
+	/// @brief Terminates the connection and updates the state accordingly.
+	auto disconnect(std::chrono::system_clock::time_point timeStamp) -> void;
+
+	/// @brief Handles an error that was detected while using a connection.
+	///
+	/// The error is ignored if it does not affect the connection as a whole, or if it belongs to an older connection. Otherwise,
+	/// the standby connection is swapped in, if there is one. If there is not, the client is disconnected, and if there are
+	/// other endpoints, Listener::reconnectRequested() is called.
+	///
+	/// @param generation The connection generation the failed request was sent on
+	/// @param origin An opaque pointer that is passed on to Listener::stateChanged()
+	auto handleError(std::chrono::system_clock::time_point timeStamp,
+		std::error_code error,
+		std::uint64_t generation,
+		const void *origin = nullptr) -> void;
+
+	/// @brief Checks whether a failback attempt is due, and schedules the next one if it is
+	/// @return Returns true if failback() should be called
+	auto failbackDue(std::chrono::steady_clock::time_point now) noexcept -> bool;
+
+	/// @brief Connects to a more preferred endpoint if one has become reachable again, and switches over to it
+	auto failback() -> void;
+
+	/// @brief Opens a standby connection, if configured and not already open, so that it can be swapped in if the main
+	/// connection fails.
+	auto prepareStandby() -> void;
+
+	/// @brief Checks whether an error is the result of a lost connection
+	static auto isConnectionError(std::error_code error) noexcept -> bool;
+
+private:
+	/// @brief Opens a new connection, without changing the state
+	/// @param endpointOrder The indices of the endpoints to try, in order of preference
+	/// @throw std::exception The connection could not be established
+	auto openHandle(std::span<const std::size_t> endpointOrder) -> Handle;
+
+	/// @brief Takes the standby connection, if one is available
+	auto takeStandby() noexcept -> Handle;
+
+	/// @brief Installs a new handle under the given generation, or clears the handle if @p handle is not connected
+	/// @pre The caller must own the connection state
+	/// @return The old handle. It is closed once this pointer and any writers still using it have released it.
+	auto publishHandle(Handle handle, std::uint64_t generation) -> std::shared_ptr<const Handle>;
+
+	/// @brief Records the endpoint of the newly published handle, and notifies the listener
+	/// @pre The caller must own the connection state
+	auto handlePublished() noexcept -> void;
+
+	/// @brief The listener
+	Listener &_listener;
+
+	/// @brief The connection settings
+	Config _config;
+	/// @brief The indices of all the endpoints, in order of preference
+	std::vector<std::size_t> _endpointOrder;
+
+	/// @brief The number of people who would like the client to be connected
+	std::atomic<std::size_t> _requestCount { 0 };
+
+	/// @brief The connection state
+	AtomicConnectionState _state;
+
+	/// @brief The current handle, or nullptr if not connected.
+	///
+	/// This may only be changed by the thread that owns the connection state. Other threads must pin the handle using handle()
+	/// for as long as they use it.
+	std::atomic<std::shared_ptr<const Handle>> _handle;
+
+	/// @brief A standby connection that has already been established, or an empty handle for none.
+	Handle _standbyHandle;
+	/// @brief A mutex protecting the standby handle
+	std::mutex _standbyMutex;
+
+	/// @brief The index of the endpoint of the current connection.
+	///
+	/// This may only be changed by the thread that owns the connection state, but may be read by any thread.
+	std::atomic<std::size_t> _activeEndpoint { 0 };
+	/// @brief Whether a connection has been established before, so that the first connection does not count as a failover.
+	///
+	/// This may only be accessed by the thread that owns the connection state.
+	bool _hadEndpoint { false };
+	/// @brief The number of times the client has switched to a different endpoint.
+	///
+	/// This may only be accessed by the thread that owns the connection state.
+	std::uint64_t _failoverCount { 0 };
+	/// @brief The time the next failback attempt is due. This is only used by failbackDue().
+	std::chrono::steady_clock::time_point _nextFailback;
+};
+
+inline ConnectionManager::Listener::~Listener() = default;
+
+} // namespace xentara::plugins::templateUplink
@@ -0,0 +1,186 @@
+// Copyright (c) embedded ocean GmbH
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+
+namespace xentara::plugins::templateUplink
+{
+
+/// @brief The connection state of a client, packed into a single word so that it can be published atomically.
+///
+/// The state consists of a phase and a generation. The generation is incremented every time a new connection is established.
+class ConnectionState final
+{
+public:
+	/// @brief The phase of the connection
+	enum class Phase : std::uint64_t
+	{
+		/// @brief The client is not connected
+		Disconnected = 0,
+		/// @brief The client is connected
+		Connected = 1,
+		/// @brief A thread is currently connecting or disconnecting the client.
+		///
+		/// Only the thread that set this phase may change the connection handle or the error state.
+		Changing = 2
+	};
+
+	/// @brief Default constructor. Creates a disconnected state with generation 0.
+	constexpr ConnectionState() noexcept = default;
+
+	/// @brief Constructor
+	constexpr ConnectionState(std::uint64_t generation, Phase phase) noexcept :
+		_word((generation << kPhaseBits) | std::uint64_t(phase))
+	{
+	}
+
+	/// @brief Creates a state from its packed representation
+	static constexpr auto fromWord(std::uint64_t word) noexcept -> ConnectionState
+	{
+		ConnectionState state;
+		state._word = word;
+		return state;
+	}
+
+	/// @brief Gets the packed representation
+	constexpr auto word() const noexcept -> std::uint64_t
+	{
+		return _word;
+	}
+
+	/// @brief Gets the generation
+	constexpr auto generation() const noexcept -> std::uint64_t
+	{
+		return _word >> kPhaseBits;
+	}
+
+	/// @brief Gets the phase
+	constexpr auto phase() const noexcept -> Phase
+	{
+		return Phase(_word & kPhaseMask);
+	}
+
+	/// @brief Checks whether the client is connected
+	constexpr auto connected() const noexcept -> bool
+	{
+		return phase() == Phase::Connected;
+	}
+
+	/// @brief Returns a state with the same generation, but a different phase
+	constexpr auto withPhase(Phase phase) const noexcept -> ConnectionState
+	{
+		return { generation(), phase };
+	}
+
+	/// @brief Returns a state with the next generation
+	constexpr auto nextGeneration(Phase phase) const noexcept -> ConnectionState
+	{
+		return { generation() + 1, phase };
+	}
+
+private:
+	/// @brief The number of bits used for the phase
+	static constexpr unsigned kPhaseBits = 2;
+	/// @brief The mask for the phase
+	static constexpr std::uint64_t kPhaseMask = (std::uint64_t(1) << kPhaseBits) - 1;
+
+	/// @brief The packed state
+	std::uint64_t _word { 0 };
+};
+
+/// @brief A connection state that can be changed by several threads.
+///
+/// A thread that wants to change the state must first take ownership of it by setting the phase to
+/// ConnectionState::Phase::Changing, and then publish the new state using end(). The state is a single word, so that all of
+/// this is lock-free.
+class AtomicConnectionState final
+{
+public:
+	/// @brief Gets the current state
+	auto load() const noexcept -> ConnectionState
+	{
+		return ConnectionState::fromWord(_word.load(std::memory_order_acquire));
+	}
+
+	/// @brief Tries to take ownership of the state in order to change it.
+	///
+	/// This will only succeed if the connection is currently in the given phase. On success, the phase is set to
+	/// ConnectionState::Phase::Changing, and the caller must call end() when it is done.
+	///
+	/// @return The previous state on success, or std::nullopt if the connection is not in the required phase.
+	auto tryBegin(ConnectionState::Phase from) noexcept -> std::optional<ConnectionState>
+	{
+		auto word = _word.load(std::memory_order_acquire);
+		for (;;)
+		{
+			const auto oldState = ConnectionState::fromWord(word);
+			// Fail if we are not in the correct phase
+			if (oldState.phase() != from)
+			{
+				return std::nullopt;
+			}
+
+			// Try to take ownership. On failure, word is updated, and we try again
+			if (_word.compare_exchange_weak(word, oldState.withPhase(ConnectionState::Phase::Changing).word(),
+					std::memory_order_acq_rel, std::memory_order_acquire))
+			{
+				return oldState;
+			}
+		}
+	}
+
+	/// @brief Tries to take ownership of the state in order to change it, if it has a specific value.
+	///
+	/// This will only succeed if the state is exactly equal to @p expected, including the generation. On success, the
+	/// caller must call end() when it is done.
+	auto tryBegin(ConnectionState expected) noexcept -> bool
+	{
+		auto word = expected.word();
+		return _word.compare_exchange_strong(word, expected.withPhase(ConnectionState::Phase::Changing).word(),
+			std::memory_order_acq_rel, std::memory_order_acquire);
+	}
+
+	/// @brief Takes ownership of the state in order to change it, waiting for any other thread to finish its change.
+	///
+	/// The caller must call end() when it is done.
+	///
+	/// @return The previous state
+	auto begin() noexcept -> ConnectionState
+	{
+		auto word = _word.load(std::memory_order_acquire);
+		for (;;)
+		{
+			const auto oldState = ConnectionState::fromWord(word);
+			// If another thread is currently changing the state, block until it publishes the new state. A change can take a
+			// while, e.g. if the owner is waiting for the reactor to release the old handle, so we must not spin.
+			if (oldState.phase() == ConnectionState::Phase::Changing)
+			{
+				_word.wait(word, std::memory_order_acquire);
+				word = _word.load(std::memory_order_acquire);
+				continue;
+			}
+
+			// Try to take ownership. On failure, word is updated, and we try again
+			if (_word.compare_exchange_weak(word, oldState.withPhase(ConnectionState::Phase::Changing).word(),
+					std::memory_order_acq_rel, std::memory_order_acquire))
+			{
+				return oldState;
+			}
+		}
+	}
+
+	/// @brief Publishes a new state, releasing ownership, and wakes up any threads waiting in begin()
+	auto end(ConnectionState state) noexcept -> void
+	{
+		_word.store(state.word(), std::memory_order_release);
+		_word.notify_all();
+	}
+
+private:
+	/// @brief The state, as returned by ConnectionState::word()
+	std::atomic<std::uint64_t> _word { ConnectionState().word() };
+};
+
+} // namespace xentara::plugins::templateUplink
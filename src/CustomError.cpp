@@ -49,6 +49,9 @@ namespace
 			/// @todo Make error more descriptive
 			return "the transaction has not been sent yet"s;
 
+		case CustomError::ProtocolError:
+			return "the remote service sent an invalid message"s;
+
 		/// @todo Add messages for other error codes
 
 		case CustomError::UnknownError:
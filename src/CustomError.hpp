@@ -20,6 +20,8 @@ enum class CustomError
 
 	/// @brief A transaction has not been sent yet.
 	Pending,
+	/// @brief The remote service sent a message that could not be understood
+	ProtocolError,
 
 	/// @brief An unknown error occurred
 	UnknownError = 999
@@ -0,0 +1,66 @@
+// Copyright (c) embedded ocean GmbH
+#include "DataPointCache.hpp"
+
+#include <xentara/model/Attribute.hpp>
+
+#include <format>
+#include <system_error>
+
+namespace xentara::plugins::templateUplink
+{
+
+auto DataPointCache::entry(const model::Element &dataPoint) -> Reference
+{
+	// Check if the handles were already resolved
+	{
+		std::scoped_lock lock { _mutex };
+		if (auto found = _entries.find(&dataPoint); found != _entries.end())
+		{
+			++_sharedLookups;
+			++found->second->_users;
+			return Reference(*found->second);
+		}
+	}
+
+	// Resolve the handles without holding the lock, so that other threads can resolve other data points at the same time
+	auto resolved = std::make_unique<Entry>(resolve(dataPoint));
+
+	// Insert the entry. If another thread resolved the same data point in the meantime, we simply use its entry.
+	std::scoped_lock lock { _mutex };
+	auto [position, inserted] = _entries.try_emplace(&dataPoint, std::move(resolved));
+	if (!inserted)
+	{
+		++_sharedLookups;
+	}
+	++position->second->_users;
+	return Reference(*position->second);
+}
+
+auto DataPointCache::resolve(const model::Element &dataPoint) -> Handles
+{
+	Handles handles;
+
+	// Get the value read handle
+	handles._value = dataPoint.attributeReadHandle(model::Attribute::kValue);
+	// Check it
+	if (auto error = handles._value.hardError())
+	{
+		throw std::system_error(
+			error, std::format("could not construct read handle for the value of {} for template transaction record", dataPoint));
+	}
+
+	// Get the quality read handle
+	handles._quality = dataPoint.attributeReadHandle(model::Attribute::kQuality);
+	// Check it
+	if (auto error = handles._quality.hardError())
+	{
+		throw std::system_error(
+			error, std::format("could not construct read handle for the quality of {} for template transaction record", dataPoint));
+	}
+
+	/// @todo resolve read handles for other attributes that should be sent
+
+	return handles;
+}
+
+} // namespace xentara::plugins::templateUplink
@@ -0,0 +1,241 @@
+// Copyright (c) embedded ocean GmbH
+#pragma once
+
+#include "Encoding.hpp"
+
+#include <xentara/data/ReadHandle.hpp>
+#include <xentara/model/Element.hpp>
+#include <xentara/utils/core/RawDataBlock.hpp>
+#include <xentara/utils/tools/Unique.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace xentara::plugins::templateUplink
+{
+
+/// @brief Information about data points that is shared between all records of all transactions of the skill.
+///
+/// If several records refer to the same data point, its read handles are only resolved once, and its value is only read and
+/// encoded once per collect cycle. The cache may be used from several threads at once, so that the transactions can resolve
+/// their handles in parallel, and collect their data concurrently.
+class DataPointCache final : private utils::tools::Unique
+{
+public:
+	/// @brief The read handles of a data point
+	struct Handles final
+	{
+		/// @brief The read handle for the value
+		data::ReadHandle _value;
+		/// @brief The read handle for the quality
+		data::ReadHandle _quality;
+
+		/// @todo add read handles for other attributes that should be sent
+	};
+
+	/// @brief The cached information about a single data point
+	class Entry final : private utils::tools::Unique
+	{
+	public:
+		/// @brief Constructor
+		explicit Entry(Handles handles) noexcept : _handles(std::move(handles))
+		{
+		}
+
+		/// @brief Gets the read handles
+		auto handles() const noexcept -> const Handles &
+		{
+			return _handles;
+		}
+
+		/// @brief Checks whether the data point is used by more than one record.
+		///
+		/// Only values of shared data points are worth caching, the others are read and encoded directly.
+		auto shared() const noexcept -> bool
+		{
+			return _users.load(std::memory_order_relaxed) > 1;
+		}
+
+		/// @brief Appends the encoded value of the data point for a certain collect cycle.
+		///
+		/// If another record already encoded the value the same way in the same cycle, the cached encoding is appended.
+		/// Otherwise, the value is encoded by calling the supplied function, and the result is cached for the other records.
+		///
+		/// @param encoding The identifier of the encoding, as returned by encodingId()
+		/// @param cycle The time stamp of the collect cycle
+		/// @param data The data block to append the encoded value to
+		/// @param encode A function that reads and encodes the value, and appends it to the data block. It must return false if
+		/// the value could not be read, in which case nothing must be appended.
+		/// @return The return value of the encode function, or the cached equivalent
+		template <std::invocable<> Encode>
+		auto encode(std::uint8_t encoding, std::chrono::system_clock::time_point cycle, utils::core::RawDataBlock &data, Encode &&encode)
+			-> bool;
+
+	private:
+		/// @brief A value encoded in a certain way
+		struct Slot final
+		{
+			/// @brief The identifier of the encoding
+			std::uint8_t _encoding;
+			/// @brief The collect cycle the value was encoded for
+			std::chrono::system_clock::time_point _cycle {};
+			/// @brief Whether the value could be read
+			bool _valid { false };
+			/// @brief The encoded value. The capacity is kept between cycles.
+			std::vector<std::byte> _bytes {};
+		};
+
+		/// @brief The read handles
+		Handles _handles;
+		/// @brief The number of references to the entry held by records
+		std::atomic<std::size_t> _users { 0 };
+
+		/// @brief A mutex protecting the slots
+		std::mutex _mutex;
+		/// @brief The cached encodings. There is usually only one, so a vector is fastest.
+		std::vector<Slot> _slots;
+
+		friend class DataPointCache;
+	};
+
+	/// @brief A reference to an entry held by a record, which counts the record as a user of the data point.
+	///
+	/// The record stops counting as a user when the reference is destroyed, e.g. when a reload replaces the record, so that
+	/// Entry::shared() reflects the records that currently exist.
+	class Reference final
+	{
+	public:
+		/// @brief Default constructor. Creates an empty reference.
+		Reference() noexcept = default;
+
+		/// @brief Move constructor
+		Reference(Reference &&other) noexcept : _entry(std::exchange(other._entry, nullptr))
+		{
+		}
+
+		/// @brief Move assignment operator
+		auto operator=(Reference &&rhs) noexcept -> Reference &
+		{
+			if (this != &rhs)
+			{
+				reset();
+				_entry = std::exchange(rhs._entry, nullptr);
+			}
+			return *this;
+		}
+
+		/// @brief Destructor. Stops counting as a user of the data point.
+		~Reference()
+		{
+			reset();
+		}
+
+		/// @brief Stops counting as a user of the data point early
+		auto reset() noexcept -> void
+		{
+			if (auto entry = std::exchange(_entry, nullptr))
+			{
+				entry->_users.fetch_sub(1, std::memory_order_relaxed);
+			}
+		}
+
+		/// @brief Checks whether the reference refers to an entry
+		explicit operator bool() const noexcept
+		{
+			return _entry != nullptr;
+		}
+
+		/// @brief Accesses the entry
+		auto operator->() const noexcept -> Entry *
+		{
+			return _entry;
+		}
+
+		/// @brief Accesses the entry
+		auto operator*() const noexcept -> Entry &
+		{
+			return *_entry;
+		}
+
+	private:
+		/// @brief Constructor used by the cache. The caller must already have counted the user.
+		explicit Reference(Entry &entry) noexcept : _entry(&entry)
+		{
+		}
+
+		/// @brief The entry, or nullptr if the reference is empty
+		Entry *_entry { nullptr };
+
+		friend class DataPointCache;
+	};
+
+	/// @brief Gets the entry of a data point, resolving its handles if this has not been done yet.
+	///
+	/// The entry stays valid until the cache is destroyed. Each reference counts as a separate user of the data point for as
+	/// long as it exists.
+	///
+	/// @throw std::system_error A handle could not be resolved
+	auto entry(const model::Element &dataPoint) -> Reference;
+
+	/// @brief Gets the number of lookups that were answered from the cache, i.e. for data points used by more than one record
+	auto sharedLookups() const noexcept -> std::size_t
+	{
+		std::scoped_lock lock { _mutex };
+		return _sharedLookups;
+	}
+
+private:
+	/// @brief Resolves the handles for a data point
+	/// @throw std::system_error A handle could not be resolved
+	static auto resolve(const model::Element &dataPoint) -> Handles;
+
+	/// @brief A mutex protecting the remaining members
+	mutable std::mutex _mutex;
+	/// @brief The entries by data point. The entries are allocated separately so that their addresses don't change.
+	std::unordered_map<const model::Element *, std::unique_ptr<Entry>> _entries;
+	/// @brief The number of lookups answered from the cache
+	std::size_t _sharedLookups { 0 };
+};
+
+template <std::invocable<> Encode>
+auto DataPointCache::Entry::encode(
+	std::uint8_t encoding, std::chrono::system_clock::time_point cycle, utils::core::RawDataBlock &data, Encode &&encode) -> bool
+{
+	// Hold the lock while encoding, so that other records wait for the result instead of reading the value themselves
+	std::scoped_lock lock { _mutex };
+
+	// Find the slot for the encoding
+	auto slot = std::ranges::find(_slots, encoding, &Slot::_encoding);
+	if (slot == _slots.end())
+	{
+		slot = _slots.insert(_slots.end(), Slot { encoding });
+	}
+	// Use the cached value if it is from the same cycle
+	else if (slot->_cycle == cycle)
+	{
+		if (slot->_valid)
+		{
+			appendBytes(data, slot->_bytes);
+		}
+		return slot->_valid;
+	}
+
+	// Encode the value and remember the result. The slot is only marked as belonging to this cycle once it is complete, so that
+	// if encoding throws, the next record encodes the value again instead of using a stale or partial result.
+	const auto offset = data.size();
+	const auto valid = encode();
+	slot->_bytes.assign(bytes(data) + offset, bytes(data) + data.size());
+	slot->_valid = valid;
+	slot->_cycle = cycle;
+	return valid;
+}
+
+} // namespace xentara::plugins::templateUplink
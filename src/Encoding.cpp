@@ -0,0 +1,289 @@
+// Copyright (c) embedded ocean GmbH
+#include "Encoding.hpp"
+
+#include <array>
+#include <format>
+#include <tuple>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	include <emmintrin.h>
+#	define TEMPLATE_UPLINK_HAVE_SSE2
+#endif
+
+namespace xentara::plugins::templateUplink
+{
+
+namespace
+{
+
+	/// @brief The decimal representations of all numbers from 0 to 99, so that two digits can be converted at once
+	constexpr auto kDigitPairs = [] {
+		std::array<char, 200> digitPairs {};
+		for (std::size_t number = 0; number < 100; ++number)
+		{
+			digitPairs[number * 2] = char('0' + number / 10);
+			digitPairs[number * 2 + 1] = char('0' + number % 10);
+		}
+		return digitPairs;
+	}();
+
+	/// @brief Writes a number from 0 to 99 as two decimal digits
+	auto putTwoDigits(char *target, unsigned number) noexcept -> char *
+	{
+		std::memcpy(target, &kDigitPairs[number * 2], 2);
+		return target + 2;
+	}
+
+	/// @brief The hexadecimal digits, used to escape control characters
+	constexpr std::string_view kHexDigits = "0123456789abcdef";
+
+	/// @brief Checks whether a character must be escaped in a JSON string
+	constexpr auto needsEscape(char character) noexcept -> bool
+	{
+		return character == '"' || character == '\\' || static_cast<unsigned char>(character) < 0x20;
+	}
+
+	/// @brief Whether JSON strings are scanned using SIMD instructions
+#ifdef TEMPLATE_UPLINK_HAVE_SSE2
+	constexpr bool kVectorizedEscape = true;
+#else
+	constexpr bool kVectorizedEscape = false;
+#endif
+
+	/// @brief Finds the first character that must be escaped in a JSON string
+	/// @tparam kVectorized Whether to check 16 characters at a time using SIMD instructions, if available
+	/// @return The position of the character, or end if there is none
+	template <bool kVectorized>
+	auto findEscape(const char *position, const char *end) noexcept -> const char *
+	{
+#ifdef TEMPLATE_UPLINK_HAVE_SSE2
+		if constexpr (kVectorized)
+		{
+			// Check 16 characters at a time
+			const auto quotes = _mm_set1_epi8('"');
+			const auto backslashes = _mm_set1_epi8('\\');
+			const auto lastControlCharacter = _mm_set1_epi8(0x1f);
+			for (; end - position >= 16; position += 16)
+			{
+				const auto characters = _mm_loadu_si128(reinterpret_cast<const __m128i *>(position));
+
+				// Unsigned comparison for control characters: max(c, 0x1f) == 0x1f exactly if c <= 0x1f
+				const auto isControl = _mm_cmpeq_epi8(_mm_max_epu8(characters, lastControlCharacter), lastControlCharacter);
+				const auto isSpecial = _mm_or_si128(
+					_mm_or_si128(_mm_cmpeq_epi8(characters, quotes), _mm_cmpeq_epi8(characters, backslashes)), isControl);
+
+				if (const auto mask = unsigned(_mm_movemask_epi8(isSpecial)); mask != 0)
+				{
+					return position + std::countr_zero(mask);
+				}
+			}
+		}
+#endif
+
+		// Check the remaining characters one by one
+		for (; position != end; ++position)
+		{
+			if (needsEscape(*position))
+			{
+				return position;
+			}
+		}
+
+		return end;
+	}
+
+	/// @brief Writes the escape sequence for a character
+	/// @return The position after the escape sequence
+	auto putEscape(char *target, char character) noexcept -> char *
+	{
+		*target++ = '\\';
+		switch (character)
+		{
+		case '"':
+			*target++ = '"';
+			break;
+		case '\\':
+			*target++ = '\\';
+			break;
+		case '\n':
+			*target++ = 'n';
+			break;
+		case '\r':
+			*target++ = 'r';
+			break;
+		case '\t':
+			*target++ = 't';
+			break;
+		default:
+			// Other control characters must be escaped using their code
+			{
+				const auto code = static_cast<unsigned char>(character);
+				*target++ = 'u';
+				*target++ = '0';
+				*target++ = '0';
+				*target++ = kHexDigits[code >> 4];
+				*target++ = kHexDigits[code & 0xf];
+			}
+			break;
+		}
+		return target;
+	}
+
+	/// @brief The longest escape sequence for a single character
+	constexpr std::size_t kMaxEscapeSize = 6;
+
+	/// @brief Writes a JSON string literal, including the quotes
+	/// @param target The target. This must have room for text.size() * kMaxEscapeSize + 2 characters.
+	/// @tparam kVectorized Whether to use SIMD instructions, if available
+	/// @return The position after the literal
+	template <bool kVectorized = kVectorizedEscape>
+	auto putJsonString(char *target, std::string_view text) noexcept -> char *
+	{
+		*target++ = '"';
+
+		// Copy runs of characters that need no escaping in one go
+		auto position = text.data();
+		const auto end = text.data() + text.size();
+		for (;;)
+		{
+			const auto special = findEscape<kVectorized>(position, end);
+			std::memcpy(target, position, std::size_t(special - position));
+			target += special - position;
+			if (special == end)
+			{
+				break;
+			}
+
+			target = putEscape(target, *special);
+			position = special + 1;
+		}
+
+		*target++ = '"';
+		return target;
+	}
+
+	/// @brief Converts a number of days since the epoch to a civil date.
+	///
+	/// This uses the algorithm by Howard Hinnant, which is also used by the standard library.
+	constexpr auto civilFromDays(std::int64_t days) noexcept -> std::tuple<std::int64_t, unsigned, unsigned>
+	{
+		days += 719468;
+		const auto era = (days >= 0 ? days : days - 146096) / 146097;
+		const auto dayOfEra = unsigned(days - era * 146097);
+		const auto yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+		const auto dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+		const auto shiftedMonth = (5 * dayOfYear + 2) / 153;
+		const auto day = dayOfYear - (153 * shiftedMonth + 2) / 5 + 1;
+		const auto month = shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9;
+		return { std::int64_t(yearOfEra) + era * 400 + (month <= 2), month, day };
+	}
+
+	/// @brief The characters used by base64 encoding
+	constexpr std::string_view kBase64Digits = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	/// @brief The size of a time stamp in JSON, like "2024-01-31T12:34:56.123456Z", including the quotes
+	constexpr std::size_t kJsonTimeStampSize = 29;
+
+} // namespace
+
+auto jsonStringLiteral(std::string_view text) -> std::string
+{
+	std::string literal(text.size() * kMaxEscapeSize + 2, '\0');
+	literal.resize(std::size_t(putJsonString(literal.data(), text) - literal.data()));
+	return literal;
+}
+
+auto jsonStringLiteralScalar(std::string_view text) -> std::string
+{
+	std::string literal(text.size() * kMaxEscapeSize + 2, '\0');
+	literal.resize(std::size_t(putJsonString<false>(literal.data(), text) - literal.data()));
+	return literal;
+}
+
+auto appendJsonString(utils::core::RawDataBlock &data, std::string_view text) -> void
+{
+	// Reserve room for the worst case, and then cut off the unused space
+	const auto offset = data.size();
+	data.resize(offset + text.size() * kMaxEscapeSize + 2);
+	const auto target = reinterpret_cast<char *>(bytes(data) + offset);
+	data.resize(offset + std::size_t(putJsonString(target, text) - target));
+}
+
+auto appendJsonBase64(utils::core::RawDataBlock &data, std::span<const std::byte> source) -> void
+{
+	// Each group of three bytes becomes four characters, and the last group is padded
+	const auto offset = data.size();
+	data.resize(offset + (source.size() + 2) / 3 * 4 + 2);
+	auto target = reinterpret_cast<char *>(bytes(data) + offset);
+
+	*target++ = '"';
+	std::size_t index = 0;
+	for (; index + 3 <= source.size(); index += 3)
+	{
+		const auto group = std::to_integer<unsigned>(source[index]) << 16 | std::to_integer<unsigned>(source[index + 1]) << 8 |
+			std::to_integer<unsigned>(source[index + 2]);
+		*target++ = kBase64Digits[group >> 18];
+		*target++ = kBase64Digits[group >> 12 & 0x3f];
+		*target++ = kBase64Digits[group >> 6 & 0x3f];
+		*target++ = kBase64Digits[group & 0x3f];
+	}
+	if (const auto remaining = source.size() - index; remaining > 0)
+	{
+		auto group = std::to_integer<unsigned>(source[index]) << 16;
+		if (remaining > 1)
+		{
+			group |= std::to_integer<unsigned>(source[index + 1]) << 8;
+		}
+		*target++ = kBase64Digits[group >> 18];
+		*target++ = kBase64Digits[group >> 12 & 0x3f];
+		*target++ = remaining > 1 ? kBase64Digits[group >> 6 & 0x3f] : '=';
+		*target++ = '=';
+	}
+	*target++ = '"';
+}
+
+auto appendJsonTimeStamp(utils::core::RawDataBlock &data, std::chrono::system_clock::time_point timeStamp) -> void
+{
+	// Split the time stamp into days, seconds within the day, and microseconds
+	const auto microseconds = std::chrono::floor<std::chrono::microseconds>(timeStamp).time_since_epoch();
+	const auto days = std::chrono::floor<std::chrono::days>(microseconds);
+	const auto timeOfDay = microseconds - days;
+	const auto [year, month, day] = civilFromDays(days.count());
+
+	// Fall back to the general formatting code for years that do not have exactly four digits
+	if (year < 0 || year > 9999)
+	{
+		appendText(data, std::format("\"{:%FT%TZ}\"", std::chrono::floor<std::chrono::microseconds>(timeStamp)));
+		return;
+	}
+
+	const auto secondsOfDay = unsigned(std::chrono::floor<std::chrono::seconds>(timeOfDay).count());
+	const auto fraction = unsigned((timeOfDay % std::chrono::seconds(1)).count());
+
+	// Write the time stamp directly into the data block
+	const auto offset = data.size();
+	data.resize(offset + kJsonTimeStampSize);
+	auto target = reinterpret_cast<char *>(bytes(data) + offset);
+
+	*target++ = '"';
+	target = putTwoDigits(target, unsigned(year / 100));
+	target = putTwoDigits(target, unsigned(year % 100));
+	*target++ = '-';
+	target = putTwoDigits(target, month);
+	*target++ = '-';
+	target = putTwoDigits(target, day);
+	*target++ = 'T';
+	target = putTwoDigits(target, secondsOfDay / 3600);
+	*target++ = ':';
+	target = putTwoDigits(target, secondsOfDay / 60 % 60);
+	*target++ = ':';
+	target = putTwoDigits(target, secondsOfDay % 60);
+	*target++ = '.';
+	target = putTwoDigits(target, fraction / 10000);
+	target = putTwoDigits(target, fraction / 100 % 100);
+	target = putTwoDigits(target, fraction % 100);
+	*target++ = 'Z';
+	*target++ = '"';
+}
+
+} // namespace xentara::plugins::templateUplink
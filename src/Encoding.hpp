@@ -0,0 +1,161 @@
+// Copyright (c) embedded ocean GmbH
+#pragma once
+
+#include <xentara/utils/core/RawDataBlock.hpp>
+
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace xentara::plugins::templateUplink
+{
+
+/// @brief The data type a record is sent as
+enum class RecordDataType : std::uint8_t
+{
+	/// @brief A boolean value
+	Boolean,
+	/// @brief A signed 64 bit integer
+	Integer,
+	/// @brief An unsigned 64 bit integer
+	Unsigned,
+	/// @brief A double precision floating point value
+	FloatingPoint,
+	/// @brief A string
+	String,
+	/// @brief An array of double precision floating point values
+	FloatingPointArray,
+	/// @brief An array of signed 64 bit integers
+	IntegerArray,
+	/// @brief A block of raw bytes
+	Blob,
+};
+
+/// @brief The number of different record data types
+constexpr std::size_t kRecordDataTypeCount = std::size_t(RecordDataType::Blob) + 1;
+
+/// @brief Checks whether a record data type is an array or a blob.
+///
+/// Values of these types can be large, so they are split into chunks in the binary wire format.
+constexpr auto isArrayType(RecordDataType dataType) noexcept -> bool
+{
+	return dataType == RecordDataType::FloatingPointArray || dataType == RecordDataType::IntegerArray ||
+		dataType == RecordDataType::Blob;
+}
+
+/// @brief The format records are encoded in
+enum class WireFormat : std::uint8_t
+{
+	/// @brief A compact binary format with little endian numbers and length prefixed strings
+	Binary,
+	/// @brief One JSON object per record, each followed by a line feed
+	Json,
+};
+
+/// @brief Which time stamp is sent with each record
+enum class TimeStampMode : std::uint8_t
+{
+	/// @brief Records are sent without a time stamp
+	None,
+	/// @brief Records are sent with the time they were collected
+	Collect,
+};
+
+/// @brief Gets a unique identifier for a combination of encoding parameters, used to cache encoded values
+constexpr auto encodingId(RecordDataType dataType, WireFormat wireFormat, TimeStampMode timeStampMode) noexcept -> std::uint8_t
+{
+	return std::uint8_t((std::size_t(timeStampMode) * 2 + std::size_t(wireFormat)) * kRecordDataTypeCount + std::size_t(dataType));
+}
+
+/// @brief Gets a pointer to the bytes of a raw data block
+inline auto bytes(utils::core::RawDataBlock &data) noexcept -> std::byte *
+{
+	return static_cast<std::byte *>(static_cast<void *>(data.data()));
+}
+
+/// @brief Appends bytes to a raw data block
+inline auto appendBytes(utils::core::RawDataBlock &data, std::span<const std::byte> source) -> void
+{
+	const auto offset = data.size();
+	data.resize(offset + source.size());
+	std::memcpy(bytes(data) + offset, source.data(), source.size());
+}
+
+/// @brief Appends text to a raw data block
+inline auto appendText(utils::core::RawDataBlock &data, std::string_view text) -> void
+{
+	appendBytes(data, std::as_bytes(std::span(text)));
+}
+
+/// @brief Writes an integer in little endian byte order
+/// @return The position after the integer
+template <std::integral Integer>
+inline auto putLittleEndian(std::byte *target, Integer value) noexcept -> std::byte *
+{
+	auto bits = std::make_unsigned_t<Integer>(value);
+	for (std::size_t index = 0; index < sizeof(Integer); ++index)
+	{
+		target[index] = std::byte(bits & 0xff);
+		bits >>= 8;
+	}
+	return target + sizeof(Integer);
+}
+
+/// @brief Reads an unsigned integer in little endian byte order
+template <std::unsigned_integral Integer>
+inline auto getLittleEndian(const std::byte *source) noexcept -> Integer
+{
+	Integer value = 0;
+	for (std::size_t index = sizeof(Integer); index > 0; --index)
+	{
+		value = Integer(value << 8) | std::to_integer<Integer>(source[index - 1]);
+	}
+	return value;
+}
+
+/// @brief Converts a time stamp to microseconds since the epoch
+inline auto microsecondsSinceEpoch(std::chrono::system_clock::time_point timeStamp) noexcept -> std::int64_t
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(timeStamp.time_since_epoch()).count();
+}
+
+/// @brief Converts a string to a JSON string literal, including the quotes
+auto jsonStringLiteral(std::string_view text) -> std::string;
+
+/// @brief Converts a string to a JSON string literal like jsonStringLiteral(), but without using SIMD instructions.
+///
+/// This is the code path used on platforms without SSE2. It is available everywhere, so that the two can be compared.
+auto jsonStringLiteralScalar(std::string_view text) -> std::string;
+
+/// @brief Appends a string to a raw data block as a JSON string literal, including the quotes
+auto appendJsonString(utils::core::RawDataBlock &data, std::string_view text) -> void;
+
+/// @brief Appends binary data to a raw data block as a JSON string containing the data in base64 encoding
+auto appendJsonBase64(utils::core::RawDataBlock &data, std::span<const std::byte> source) -> void;
+
+/// @brief Appends a time stamp to a raw data block as a JSON string containing an ISO 8601 UTC date and time
+auto appendJsonTimeStamp(utils::core::RawDataBlock &data, std::chrono::system_clock::time_point timeStamp) -> void;
+
+/// @brief Appends a number to a raw data block as text, in the shortest representation that can be read back exactly
+template <typename Number>
+auto appendNumberText(utils::core::RawDataBlock &data, Number number) -> void
+{
+	// This is large enough for any 64 bit integer or double in shortest representation
+	constexpr std::size_t kMaxSize = 32;
+
+	// Format the number directly into the data block, and then cut off the unused space
+	const auto offset = data.size();
+	data.resize(offset + kMaxSize);
+	const auto target = reinterpret_cast<char *>(bytes(data) + offset);
+	const auto result = std::to_chars(target, target + kMaxSize, number);
+	data.resize(offset + std::size_t(result.ptr - target));
+}
+
+} // namespace xentara::plugins::templateUplink
@@ -0,0 +1,328 @@
+// Copyright (c) embedded ocean GmbH
+#include "Endpoint.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#ifdef _WIN32
+#	include <WinSock2.h>
+#	include <WS2tcpip.h>
+#else
+#	include <errno.h>
+#	include <netdb.h>
+#	include <poll.h>
+#	include <sys/socket.h>
+#	include <sys/types.h>
+#endif
+
+namespace xentara::plugins::templateUplink
+{
+
+namespace
+{
+
+	/// @brief Gets the error code for the last socket error
+	auto lastSocketError() noexcept -> std::error_code
+	{
+#ifdef _WIN32
+		return { WSAGetLastError(), std::system_category() };
+#else
+		return { errno, std::system_category() };
+#endif
+	}
+
+#ifndef _WIN32
+	/// @brief The error category for the error codes returned by getaddrinfo()
+	class ResolverErrorCategory final : public std::error_category
+	{
+	public:
+		auto name() const noexcept -> const char * final
+		{
+			return "getaddrinfo";
+		}
+
+		auto message(int error) const -> std::string final
+		{
+			return ::gai_strerror(error);
+		}
+	};
+
+	/// @brief Gets the error category for the error codes returned by getaddrinfo()
+	auto resolverErrorCategory() noexcept -> const std::error_category &
+	{
+		static const ResolverErrorCategory kCategory;
+		return kCategory;
+	}
+#endif
+
+	/// @brief An address to attempt a connection to
+	struct Candidate final
+	{
+		/// @brief The index of the endpoint the address belongs to
+		std::size_t _endpoint { 0 };
+		/// @brief The parameters for creating the socket
+		int _family { 0 };
+		int _type { 0 };
+		int _protocol { 0 };
+		/// @brief The address
+		sockaddr_storage _address {};
+		/// @brief The size of the address
+		socklen_t _addressSize { 0 };
+	};
+
+	/// @brief Resolves the addresses of an endpoint, and appends them to a list of candidates
+	auto resolve(const Endpoint &endpoint, std::size_t index, std::vector<Candidate> &candidates) -> void
+	{
+		addrinfo hints {};
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags = AI_NUMERICSERV;
+
+		addrinfo *addresses = nullptr;
+		const auto port = std::to_string(endpoint._port);
+		if (const auto result = ::getaddrinfo(endpoint._host.c_str(), port.c_str(), &hints, &addresses); result != 0)
+		{
+#ifdef _WIN32
+			throw std::system_error(result, std::system_category(), "could not resolve " + endpoint._host);
+#else
+			// With EAI_SYSTEM, the actual error is in errno
+			if (result == EAI_SYSTEM)
+			{
+				throw std::system_error(lastSocketError(), "could not resolve " + endpoint._host);
+			}
+			throw std::system_error(result, resolverErrorCategory(), "could not resolve " + endpoint._host);
+#endif
+		}
+
+		for (auto address = addresses; address; address = address->ai_next)
+		{
+			if (address->ai_addrlen > sizeof(sockaddr_storage))
+			{
+				continue;
+			}
+
+			auto &candidate = candidates.emplace_back();
+			candidate._endpoint = index;
+			candidate._family = address->ai_family;
+			candidate._type = address->ai_socktype;
+			candidate._protocol = address->ai_protocol;
+			std::memcpy(&candidate._address, address->ai_addr, address->ai_addrlen);
+			candidate._addressSize = socklen_t(address->ai_addrlen);
+		}
+
+		::freeaddrinfo(addresses);
+	}
+
+	/// @brief Checks whether a socket is connected to itself.
+	///
+	/// This can happen when connecting to a local port nobody is listening on, if the port is also given to the socket as its
+	/// own local port (TCP simultaneous open). Such a connection would swallow all data, and must be treated as refused.
+	auto connectedToItself(const Socket &socket) noexcept -> bool
+	{
+		sockaddr_storage local {};
+		sockaddr_storage peer {};
+		socklen_t localSize = sizeof(local);
+		socklen_t peerSize = sizeof(peer);
+#ifdef _WIN32
+		const auto native = SOCKET(socket.native());
+#else
+		const auto native = socket.native();
+#endif
+		if (::getsockname(native, reinterpret_cast<sockaddr *>(&local), &localSize) != 0 ||
+			::getpeername(native, reinterpret_cast<sockaddr *>(&peer), &peerSize) != 0)
+		{
+			return false;
+		}
+
+		return localSize == peerSize && std::memcmp(&local, &peer, std::size_t(localSize)) == 0;
+	}
+
+	/// @brief Gets the error code for a connection that was refused
+	auto connectionRefused() noexcept -> std::error_code
+	{
+#ifdef _WIN32
+		return { WSAECONNREFUSED, std::system_category() };
+#else
+		return { ECONNREFUSED, std::system_category() };
+#endif
+	}
+
+	/// @brief Starts a non-blocking connection attempt
+	/// @return The socket, and whether the connection was established immediately
+	/// @throw std::system_error The attempt failed right away
+	auto startAttempt(const Candidate &candidate) -> std::pair<Socket, bool>
+	{
+		Socket socket { NativeSocket(::socket(candidate._family, candidate._type, candidate._protocol)) };
+		if (!socket)
+		{
+			throw std::system_error(lastSocketError(), "could not create socket");
+		}
+		socket.setNonBlocking();
+
+#ifdef _WIN32
+		if (::connect(SOCKET(socket.native()), reinterpret_cast<const sockaddr *>(&candidate._address), candidate._addressSize) == 0)
+		{
+			if (connectedToItself(socket))
+			{
+				throw std::system_error(connectionRefused(), "could not connect");
+			}
+			return { std::move(socket), true };
+		}
+		if (const auto error = lastSocketError(); error.value() != WSAEWOULDBLOCK)
+		{
+			throw std::system_error(error, "could not connect");
+		}
+#else
+		if (::connect(socket.native(), reinterpret_cast<const sockaddr *>(&candidate._address), candidate._addressSize) == 0)
+		{
+			if (connectedToItself(socket))
+			{
+				throw std::system_error(connectionRefused(), "could not connect");
+			}
+			return { std::move(socket), true };
+		}
+		if (const auto error = lastSocketError(); error.value() != EINPROGRESS && error.value() != EINTR)
+		{
+			throw std::system_error(error, "could not connect");
+		}
+#endif
+
+		return { std::move(socket), false };
+	}
+
+	/// @brief Gets the result of a connection attempt that has finished
+	auto attemptResult(const Socket &socket) noexcept -> std::error_code
+	{
+		int error = 0;
+		socklen_t size = sizeof(error);
+#ifdef _WIN32
+		if (::getsockopt(SOCKET(socket.native()), SOL_SOCKET, SO_ERROR, reinterpret_cast<char *>(&error), &size) != 0)
+#else
+		if (::getsockopt(socket.native(), SOL_SOCKET, SO_ERROR, &error, &size) != 0)
+#endif
+		{
+			return lastSocketError();
+		}
+		if (error == 0 && connectedToItself(socket))
+		{
+			return connectionRefused();
+		}
+		return { error, std::system_category() };
+	}
+
+} // namespace
+
+auto connectToFirst(std::span<const Endpoint> endpoints, std::span<const std::size_t> order, const ConnectionRace &settings)
+	-> std::pair<Socket, std::size_t>
+{
+	// Nothing connected is reported as a timeout
+	std::error_code lastError = std::make_error_code(std::errc::timed_out);
+
+	// Resolve all the endpoints up front, so that name lookups do not distort the timing of the attempts. Endpoints that
+	// cannot be resolved are skipped.
+	std::vector<Candidate> candidates;
+	for (auto &&index : order)
+	{
+		try
+		{
+			resolve(endpoints[index], index, candidates);
+		}
+		catch (const std::system_error &error)
+		{
+			lastError = error.code();
+		}
+	}
+
+	// The pending attempts, and the corresponding entries for poll()
+	std::vector<std::pair<Socket, std::size_t>> attempts;
+	std::vector<pollfd> pollEntries;
+
+	const auto deadline = std::chrono::steady_clock::now() + settings._timeout;
+	auto nextCandidate = candidates.begin();
+	auto nextStart = std::chrono::steady_clock::now();
+	for (;;)
+	{
+		auto now = std::chrono::steady_clock::now();
+
+		// Start the next attempt if it is due, or if there is nothing else to wait for
+		if (nextCandidate != candidates.end() && (attempts.empty() || now >= nextStart))
+		{
+			const auto &candidate = *nextCandidate++;
+			try
+			{
+				auto [socket, connected] = startAttempt(candidate);
+				if (connected)
+				{
+					return { std::move(socket), candidate._endpoint };
+				}
+
+				pollEntries.push_back({ socket.native(), POLLOUT, 0 });
+				attempts.emplace_back(std::move(socket), candidate._endpoint);
+				nextStart = now + settings._attemptDelay;
+			}
+			catch (const std::system_error &error)
+			{
+				// Go on to the next candidate right away
+				lastError = error.code();
+				nextStart = now;
+			}
+			continue;
+		}
+
+		// Give up if there is nothing left to try, or if we have run out of time
+		if (attempts.empty())
+		{
+			throw std::system_error(lastError, "could not connect to any endpoint");
+		}
+		if (now >= deadline)
+		{
+			throw std::system_error(std::make_error_code(std::errc::timed_out), "could not connect to any endpoint");
+		}
+
+		// Wait until an attempt finishes, or until the next attempt is due
+		const auto wakeUp = nextCandidate != candidates.end() ? std::min(nextStart, deadline) : deadline;
+		const auto timeout = int(std::chrono::ceil<std::chrono::milliseconds>(wakeUp - now).count());
+#ifdef _WIN32
+		const auto ready = ::WSAPoll(pollEntries.data(), ULONG(pollEntries.size()), timeout);
+#else
+		const auto ready = ::poll(pollEntries.data(), nfds_t(pollEntries.size()), timeout);
+#endif
+		if (ready < 0)
+		{
+			const auto error = lastSocketError();
+#ifndef _WIN32
+			if (error.value() == EINTR)
+			{
+				continue;
+			}
+#endif
+			throw std::system_error(error, "could not wait for connection attempts");
+		}
+
+		// Check the attempts that have finished, in order of preference
+		for (std::size_t index = 0; index < attempts.size();)
+		{
+			if (pollEntries[index].revents == 0)
+			{
+				++index;
+				continue;
+			}
+
+			// Return the first successful connection. The other attempts are abandoned when their sockets are destroyed.
+			const auto error = attemptResult(attempts[index].first);
+			if (!error)
+			{
+				return std::move(attempts[index]);
+			}
+
+			lastError = error;
+			attempts.erase(attempts.begin() + std::ptrdiff_t(index));
+			pollEntries.erase(pollEntries.begin() + std::ptrdiff_t(index));
+		}
+	}
+}
+
+} // namespace xentara::plugins::templateUplink
@@ -0,0 +1,49 @@
+// Copyright (c) embedded ocean GmbH
+#pragma once
+
+#include "Socket.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <utility>
+
+namespace xentara::plugins::templateUplink
+{
+
+/// @brief An address of a service instance a client can connect to
+struct Endpoint final
+{
+	/// @brief The host name or IP address
+	std::string _host;
+	/// @brief The TCP port
+	std::uint16_t _port { 0 };
+};
+
+/// @brief Settings for racing connection attempts to several endpoints
+struct ConnectionRace final
+{
+	/// @brief The time to wait for an attempt before starting the next one in parallel
+	std::chrono::milliseconds _attemptDelay { 250 };
+	/// @brief The time after which all attempts are abandoned
+	std::chrono::milliseconds _timeout { 5000 };
+};
+
+/// @brief Connects to the first of a selection of endpoints that accepts a connection.
+///
+/// The endpoints are tried in the order given by @p order. If an attempt has not succeeded after the attempt delay, the next
+/// one is started in parallel, so that an unreachable endpoint does not hold up the others for long (see "happy eyeballs",
+/// RFC 8305). Each address a host name resolves to is treated as a separate attempt. The first attempt to succeed wins, and
+/// all others are abandoned.
+///
+/// @param endpoints All the endpoints
+/// @param order The indices of the endpoints to try, in order of preference
+/// @param settings The delay between attempts and the overall timeout
+/// @return The connected socket in non-blocking mode, and the index of the endpoint in @p endpoints it is connected to
+/// @throw std::system_error No connection could be established. The error is that of the last attempt that failed.
+auto connectToFirst(std::span<const Endpoint> endpoints, std::span<const std::size_t> order, const ConnectionRace &settings)
+	-> std::pair<Socket, std::size_t>;
+
+} // namespace xentara::plugins::templateUplink
@@ -0,0 +1,136 @@
+// Copyright (c) embedded ocean GmbH
+#include "FaultInjector.hpp"
+
+#include <algorithm>
+#include <system_error>
+#include <thread>
+
+#ifdef _WIN32
+#	include <Windows.h>
+#else
+#	include <errno.h>
+#endif
+
+namespace xentara::plugins::templateUplink
+{
+
+namespace
+{
+
+	/// @brief The error code for a connection reset by the peer
+#ifdef _WIN32
+	constexpr int kConnectionReset = WSAECONNRESET;
+#else
+	constexpr int kConnectionReset = ECONNRESET;
+#endif
+
+	/// @brief The error code for a connection closed by the peer
+#ifdef _WIN32
+	constexpr int kBrokenPipe = ERROR_BROKEN_PIPE;
+#else
+	constexpr int kBrokenPipe = EPIPE;
+#endif
+
+	/// @brief The size of a TCP segment on an Ethernet link, used to simulate packet loss
+	constexpr std::size_t kSegmentSize = 1460;
+
+} // namespace
+
+auto FaultInjector::configure(const Config &config) -> void
+{
+	std::scoped_lock lock { _mutex };
+
+	_config = config;
+	_random.seed(config._seed);
+	_enabled = config._latency.count() > 0 || config._bytesPerSecond > 0 || config._connectionResetProbability > 0 ||
+		config._brokenPipeProbability > 0 || config._partialWriteProbability > 0 || config._packetLossProbability > 0;
+}
+
+auto FaultInjector::beforeWrite(std::size_t size) -> std::size_t
+{
+	if (!_enabled)
+	{
+		return size;
+	}
+
+	// Roll the dice under the lock, so the sequence of faults is reproducible
+	std::unique_lock lock { _mutex };
+
+	// Simulate connection errors
+	if (happens(_config._connectionResetProbability))
+	{
+		throw std::system_error(kConnectionReset, std::system_category(), "injected connection reset");
+	}
+	if (happens(_config._brokenPipeProbability))
+	{
+		throw std::system_error(kBrokenPipe, std::system_category(), "injected broken pipe");
+	}
+
+	// Simulate a partial write
+	auto written = size;
+	if (size > 1 && happens(_config._partialWriteProbability))
+	{
+		written = std::uniform_int_distribution<std::size_t>(1, size - 1)(_random);
+	}
+
+	// Compute the delay
+	auto delay = std::chrono::duration<double>(_config._latency);
+	if (_config._bytesPerSecond > 0)
+	{
+		delay += std::chrono::duration<double>(double(written) / _config._bytesPerSecond);
+	}
+
+	// Every lost segment holds up the data until it has been retransmitted
+	if (_config._packetLossProbability > 0)
+	{
+		const auto segments = (written + kSegmentSize - 1) / kSegmentSize;
+		const auto lost = std::binomial_distribution<std::size_t>(segments, _config._packetLossProbability)(_random);
+		delay += std::chrono::duration<double>(_config._retransmissionDelay) * double(lost);
+	}
+
+	// Wait without holding the lock
+	lock.unlock();
+	std::this_thread::sleep_for(delay);
+
+	return written;
+}
+
+auto FaultInjector::truncate(
+	std::span<const std::span<const std::byte>> buffers, std::vector<std::span<const std::byte>> &truncated)
+	-> std::span<const std::span<const std::byte>>
+{
+	std::size_t size = 0;
+	for (auto &&buffer : buffers)
+	{
+		size += buffer.size();
+	}
+
+	// Use the buffers as they are unless a partial write is simulated
+	const auto limit = beforeWrite(size);
+	if (limit >= size)
+	{
+		return buffers;
+	}
+
+	// Cut the buffers short after the given number of bytes
+	truncated.clear();
+	auto remaining = limit;
+	for (auto &&buffer : buffers)
+	{
+		if (remaining == 0)
+		{
+			break;
+		}
+		truncated.push_back(buffer.first(std::min(remaining, buffer.size())));
+		remaining -= truncated.back().size();
+	}
+
+	return truncated;
+}
+
+auto FaultInjector::happens(double probability) -> bool
+{
+	return probability > 0 && std::bernoulli_distribution(probability)(_random);
+}
+
+} // namespace xentara::plugins::templateUplink
@@ -0,0 +1,87 @@
+// Copyright (c) embedded ocean GmbH
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <span>
+#include <vector>
+
+namespace xentara::plugins::templateUplink
+{
+
+/// @brief Simulates a bad network connection by injecting faults into the send path.
+///
+/// The faults are generated using a pseudo-random number generator with a fixed seed, so a test run can be reproduced
+/// exactly. This class is only used if the plugin was built with the CMake option TEMPLATE_UPLINK_FAULT_INJECTION.
+class FaultInjector final
+{
+public:
+	/// @brief The configuration of the injected faults
+	struct Config final
+	{
+		/// @brief The seed for the pseudo-random number generator
+		std::uint64_t _seed { 0 };
+		/// @brief A delay added to every write
+		std::chrono::microseconds _latency { 0 };
+		/// @brief The simulated bandwidth in bytes per second, or 0 for unlimited
+		double _bytesPerSecond { 0 };
+		/// @brief The probability that a write fails because the connection was reset
+		double _connectionResetProbability { 0 };
+		/// @brief The probability that a write fails because the connection was closed by the peer
+		double _brokenPipeProbability { 0 };
+		/// @brief The probability that a write only transmits part of the data
+		double _partialWriteProbability { 0 };
+		/// @brief The probability that a TCP segment is lost, and must be retransmitted
+		double _packetLossProbability { 0 };
+		/// @brief The time it takes to retransmit a lost segment
+		std::chrono::microseconds _retransmissionDelay { std::chrono::milliseconds(200) };
+	};
+
+	/// @brief Sets the configuration and resets the pseudo-random number generator
+	auto configure(const Config &config) -> void;
+
+	/// @brief Checks whether any faults are injected
+	auto enabled() const noexcept -> bool
+	{
+		return _enabled;
+	}
+
+	/// @brief Simulates the network effects on a write of a certain size.
+	///
+	/// This function blocks for the configured latency, for the time the data would take at the configured bandwidth, and for
+	/// the retransmission of any segments that are lost.
+	///
+	/// @return The number of bytes that should be written. If this is less than @p size, a partial write must be simulated.
+	/// @throw std::system_error The write should fail with a connection error
+	auto beforeWrite(std::size_t size) -> std::size_t;
+
+	/// @brief Simulates the network effects on a write of a list of buffers.
+	///
+	/// This calls beforeWrite() with the total size of the buffers, and cuts the list short if a partial write is simulated.
+	///
+	/// @param truncated Storage for the shortened list of buffers, if needed
+	/// @return The buffers that should be written. This is either @p buffers itself, or refers to @p truncated.
+	/// @throw std::system_error The write should fail with a connection error
+	auto truncate(std::span<const std::span<const std::byte>> buffers, std::vector<std::span<const std::byte>> &truncated)
+		-> std::span<const std::span<const std::byte>>;
+
+private:
+	/// @brief Rolls the dice for a fault with a certain probability
+	/// @pre _mutex must be locked
+	auto happens(double probability) -> bool;
+
+	/// @brief Whether any faults are injected
+	bool _enabled { false };
+	/// @brief The configuration
+	Config _config;
+
+	/// @brief A mutex protecting the pseudo-random number generator
+	std::mutex _mutex;
+	/// @brief The pseudo-random number generator
+	std::mt19937_64 _random;
+};
+
+} // namespace xentara::plugins::templateUplink
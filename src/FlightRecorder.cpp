@@ -0,0 +1,170 @@
+// Copyright (c) embedded ocean GmbH
+#include "FlightRecorder.hpp"
+
+#include "Encoding.hpp"
+
+#include <xentara/model/Element.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <format>
+#include <fstream>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace xentara::plugins::templateUplink
+{
+
+using namespace std::literals;
+
+namespace
+{
+
+	/// @brief Gets the name of an event in the trace
+	constexpr auto eventName(FlightEvent event) noexcept -> std::string_view
+	{
+		switch (event)
+		{
+		case FlightEvent::Collect:
+			return "collect"sv;
+		case FlightEvent::Batch:
+			return "batch"sv;
+		case FlightEvent::SendError:
+			return "sendError"sv;
+		case FlightEvent::ClientError:
+			return "clientError"sv;
+		case FlightEvent::StateChange:
+			return "stateChange"sv;
+		case FlightEvent::Connect:
+			return "connect"sv;
+		case FlightEvent::Failover:
+			return "failover"sv;
+		}
+		return "unknown"sv;
+	}
+
+	/// @brief A copy of a recorded event
+	struct Event final
+	{
+		FlightEvent _event { FlightEvent::Collect };
+		const model::Element *_source { nullptr };
+		FlightRecorder::Clock::duration _start {};
+		FlightRecorder::Clock::duration _duration {};
+		std::uint64_t _value { 0 };
+		std::error_code _error;
+	};
+
+	/// @brief Converts a duration to microseconds, which is the unit used by the trace event format
+	auto microseconds(FlightRecorder::Clock::duration duration) noexcept -> double
+	{
+		return std::chrono::duration<double, std::micro>(duration).count();
+	}
+
+} // namespace
+
+auto FlightRecorder::configure(std::size_t capacity) -> void
+{
+	const auto size = std::bit_ceil(std::max<std::size_t>(capacity, 1));
+	_slots = std::make_unique<Slot[]>(size);
+	_mask = size - 1;
+}
+
+auto FlightRecorder::dump(const std::filesystem::path &path) const -> void
+{
+	// Copy the events that are complete. Events that are overwritten while we read them are skipped.
+	std::vector<Event> events;
+	if (_slots)
+	{
+		const auto end = _next.load(std::memory_order_acquire);
+		const auto begin = end > _mask + 1 ? end - (_mask + 1) : 0;
+		events.reserve(std::size_t(end - begin));
+		for (auto index = begin; index < end; ++index)
+		{
+			const auto &slot = _slots[index & _mask];
+			const auto sequence = slot._sequence.load(std::memory_order_acquire);
+			if (sequence != index * 2 + 2)
+			{
+				continue;
+			}
+
+			const auto errorWord = slot._error.load(std::memory_order_relaxed);
+			const auto errorCategory = slot._errorCategory.load(std::memory_order_relaxed);
+			Event event;
+			event._event = FlightEvent(errorWord & 0xff);
+			event._source = slot._source.load(std::memory_order_relaxed);
+			event._start = Clock::duration(slot._start.load(std::memory_order_relaxed));
+			event._duration = Clock::duration(slot._duration.load(std::memory_order_relaxed));
+			event._value = slot._value.load(std::memory_order_relaxed);
+			if (errorCategory)
+			{
+				event._error = std::error_code(int(errorWord >> 8), *errorCategory);
+			}
+
+			// Check that the slot was not overwritten while we were reading it
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot._sequence.load(std::memory_order_relaxed) == sequence)
+			{
+				events.push_back(event);
+			}
+		}
+	}
+
+	// Events are recorded when they end, so sort them by their start time
+	std::ranges::stable_sort(events, {}, &Event::_start);
+	const auto origin = events.empty() ? Clock::duration::zero() : events.front()._start;
+
+	std::ofstream file(path, std::ios::trunc);
+	if (!file)
+	{
+		throw std::system_error(errno != 0 ? errno : EIO, std::generic_category(), "could not create flight recorder file");
+	}
+
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+	// Give each element its own track, named after the element
+	std::unordered_map<const model::Element *, std::size_t> tracks;
+	auto separator = ""sv;
+	for (auto &&event : events)
+	{
+		const auto [track, inserted] = tracks.try_emplace(event._source, tracks.size() + 1);
+		if (inserted)
+		{
+			file << separator
+				 << std::format(R"({{"name":"thread_name","ph":"M","pid":1,"tid":{},"args":{{"name":{}}}}})", track->second,
+						jsonStringLiteral(std::format("{}", *event._source)));
+			separator = ","sv;
+		}
+
+		// Events with a duration are shown as spans, the others as instants
+		file << separator << std::format(R"({{"name":"{}","pid":1,"tid":{},"ts":{:.3f})", eventName(event._event), track->second,
+								 microseconds(event._start - origin));
+		if (event._duration > Clock::duration::zero())
+		{
+			file << std::format(R"(,"ph":"X","dur":{:.3f})", microseconds(event._duration));
+		}
+		else
+		{
+			file << R"(,"ph":"i","s":"t")";
+		}
+		file << std::format(R"(,"args":{{"value":{})", event._value);
+		if (event._error)
+		{
+			file << std::format(R"(,"error":{},"category":{},"message":{})", event._error.value(),
+				jsonStringLiteral(event._error.category().name()), jsonStringLiteral(event._error.message()));
+		}
+		file << "}}";
+		separator = ","sv;
+	}
+
+	file << "]}\n";
+
+	file.flush();
+	if (!file)
+	{
+		throw std::system_error(errno != 0 ? errno : EIO, std::generic_category(), "could not write flight recorder file");
+	}
+}
+
+} // namespace xentara::plugins::templateUplink
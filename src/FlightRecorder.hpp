@@ -0,0 +1,128 @@
+// Copyright (c) embedded ocean GmbH
+#pragma once
+
+#include <xentara/utils/tools/Unique.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <system_error>
+
+namespace xentara::model
+{
+class Element;
+} // namespace xentara::model
+
+namespace xentara::plugins::templateUplink
+{
+
+/// @brief The kinds of events recorded by a flight recorder
+enum class FlightEvent : std::uint8_t
+{
+	/// @brief A transaction collected a segment. The value is the size of the segment in bytes.
+	Collect,
+	/// @brief A transaction finished writing a batch. The value is the size of the batch in bytes.
+	Batch,
+	/// @brief A transaction failed to send a batch
+	SendError,
+	/// @brief An error was reported to the client
+	ClientError,
+	/// @brief The published state of the client changed
+	StateChange,
+	/// @brief The client attempted to connect. The value is the index of the endpoint on success.
+	Connect,
+	/// @brief The client switched to a different endpoint. The value is the index of the new endpoint.
+	Failover,
+};
+
+/// @brief A fixed-size in-memory log of recent events, used to find out what happened when an uplink misbehaves.
+///
+/// Events are recorded into a ring buffer without locking, so that recording is cheap enough to be done on the hot path.
+/// Once the ring is full, the oldest events are overwritten. The ring can be dumped to a file in the Chrome trace event
+/// format at any time, e.g. for viewing in Perfetto or chrome://tracing.
+class FlightRecorder final : private utils::tools::Unique
+{
+public:
+	/// @brief The clock used for the time stamps of the events
+	using Clock = std::chrono::steady_clock;
+
+	/// @brief Enables recording
+	/// @param capacity The number of events to keep. This is rounded up to the next power of two.
+	/// @pre This function must only be called while the model is being loaded.
+	auto configure(std::size_t capacity) -> void;
+
+	/// @brief Checks whether recording is enabled
+	auto enabled() const noexcept -> bool
+	{
+		return _slots != nullptr;
+	}
+
+	/// @brief Records an event. This does nothing if recording is not enabled.
+	/// @param source The element the event belongs to, used to group the events in the dump
+	/// @param start The time the event started
+	/// @param duration How long the event took, or 0 for events that only happen at a single point in time
+	auto record(FlightEvent event,
+		const model::Element &source,
+		Clock::time_point start,
+		Clock::duration duration = Clock::duration::zero(),
+		std::uint64_t value = 0,
+		std::error_code error = std::error_code()) noexcept -> void
+	{
+		if (!_slots)
+		{
+			return;
+		}
+
+		// Claim a slot, and mark it as being written, so that dump() does not use it until it is complete
+		const auto index = _next.fetch_add(1, std::memory_order_relaxed);
+		auto &slot = _slots[index & _mask];
+		slot._sequence.store(index * 2 + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		slot._start.store(start.time_since_epoch().count(), std::memory_order_relaxed);
+		slot._duration.store(duration.count(), std::memory_order_relaxed);
+		slot._value.store(value, std::memory_order_relaxed);
+		slot._source.store(&source, std::memory_order_relaxed);
+		slot._error.store((std::int64_t(error.value()) << 8) | std::int64_t(event), std::memory_order_relaxed);
+		slot._errorCategory.store(error ? &error.category() : nullptr, std::memory_order_relaxed);
+
+		// Mark the slot as complete
+		slot._sequence.store(index * 2 + 2, std::memory_order_release);
+	}
+
+	/// @brief Writes the recorded events to a file in the Chrome trace event format
+	/// @throw std::system_error The file could not be written
+	auto dump(const std::filesystem::path &path) const -> void;
+
+private:
+	/// @brief A recorded event. Each slot fills a cache line, so that threads recording at the same time do not interfere.
+	struct alignas(64) Slot final
+	{
+		/// @brief Twice the index of the event plus one while it is being written, and twice the index plus two once it is complete
+		std::atomic<std::uint64_t> _sequence { 0 };
+		/// @brief The start time, in ticks of the clock
+		std::atomic<Clock::rep> _start { 0 };
+		/// @brief The duration, in ticks of the clock
+		std::atomic<Clock::rep> _duration { 0 };
+		/// @brief The value, depending on the kind of event
+		std::atomic<std::uint64_t> _value { 0 };
+		/// @brief The element the event belongs to
+		std::atomic<const model::Element *> _source { nullptr };
+		/// @brief The value of the error code shifted left by 8 bits, combined with the kind of event in the lower 8 bits
+		std::atomic<std::int64_t> _error { 0 };
+		/// @brief The category of the error code, or nullptr for none
+		std::atomic<const std::error_category *> _errorCategory { nullptr };
+	};
+
+	/// @brief The slots
+	std::unique_ptr<Slot[]> _slots;
+	/// @brief The number of slots minus one, used to wrap the index around
+	std::uint64_t _mask { 0 };
+	/// @brief The index of the next event
+	std::atomic<std::uint64_t> _next { 0 };
+};
+
+} // namespace xentara::plugins::templateUplink
@@ -0,0 +1,477 @@
+// Copyright (c) embedded ocean GmbH
+#include "Reactor.hpp"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <system_error>
+
+#ifdef __linux__
+#	include <errno.h>
+#	include <sys/epoll.h>
+#	include <sys/eventfd.h>
+#	include <unistd.h>
+#endif
+
+namespace xentara::plugins::templateUplink
+{
+
+namespace
+{
+
+	/// @brief The maximum number of threads chosen automatically
+	constexpr std::size_t kMaxDefaultThreads = 4;
+
+	/// @brief The number of CPU cores served by each automatically chosen thread
+	constexpr std::size_t kCoresPerThread = 4;
+
+	/// @brief The ID used for the wakeup file descriptor
+	constexpr std::uint64_t kWakeupId = 0;
+
+#ifdef __linux__
+	/// @brief Converts events to native epoll events
+	auto nativeEvents(Reactor::Events events) noexcept -> std::uint32_t
+	{
+		std::uint32_t nativeEvents = EPOLLONESHOT;
+		if (events & Reactor::kReadable)
+		{
+			nativeEvents |= EPOLLIN;
+		}
+		if (events & Reactor::kWritable)
+		{
+			nativeEvents |= EPOLLOUT;
+		}
+		return nativeEvents;
+	}
+
+	/// @brief Converts native epoll events to events
+	auto fromNativeEvents(std::uint32_t nativeEvents) noexcept -> Reactor::Events
+	{
+		Reactor::Events events = 0;
+		if (nativeEvents & EPOLLIN)
+		{
+			events |= Reactor::kReadable;
+		}
+		if (nativeEvents & EPOLLOUT)
+		{
+			events |= Reactor::kWritable;
+		}
+		if (nativeEvents & (EPOLLERR | EPOLLHUP))
+		{
+			events |= Reactor::kError;
+		}
+		return events;
+	}
+
+	/// @brief Converts a deadline to an epoll timeout in milliseconds
+	auto epollTimeout(std::chrono::steady_clock::time_point deadline) noexcept -> int
+	{
+		if (deadline == std::chrono::steady_clock::time_point::max())
+		{
+			return -1;
+		}
+
+		// Round up, so we don't wake up too early and spin
+		const auto remaining =
+			std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+		return int(std::clamp<decltype(remaining)>(remaining, 0, std::numeric_limits<int>::max()));
+	}
+#endif
+
+} // namespace
+
+Reactor::Reactor(std::size_t threadCount) noexcept :
+	_threadCount(threadCount != 0 ?
+		threadCount :
+		std::clamp<std::size_t>(std::thread::hardware_concurrency() / kCoresPerThread, 1, kMaxDefaultThreads))
+{
+#ifdef __linux__
+	// If anything fails, we simply leave socket notifications unsupported
+	_epoll = ::epoll_create1(EPOLL_CLOEXEC);
+	if (_epoll < 0)
+	{
+		return;
+	}
+
+	_wakeup = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	epoll_event event {};
+	event.events = EPOLLIN;
+	event.data.u64 = kWakeupId;
+	if (_wakeup < 0 || ::epoll_ctl(_epoll, EPOLL_CTL_ADD, _wakeup, &event) != 0)
+	{
+		if (_wakeup >= 0)
+		{
+			::close(_wakeup);
+			_wakeup = -1;
+		}
+		::close(_epoll);
+		_epoll = -1;
+	}
+#endif
+}
+
+Reactor::~Reactor()
+{
+	// Tell the threads to stop. This must be done under the timer mutex, so threads waiting for timers don't miss it.
+	{
+		std::scoped_lock lock { _timerMutex };
+		_stopping = true;
+	}
+	wake();
+
+	// Join the threads
+	_threads.clear();
+
+#ifdef __linux__
+	if (_epoll >= 0)
+	{
+		::close(_wakeup);
+		::close(_epoll);
+	}
+#endif
+}
+
+auto Reactor::start() -> void
+{
+	std::call_once(_started, [this] {
+		_threads.reserve(_threadCount);
+		for (std::size_t index = 0; index < _threadCount; ++index)
+		{
+			_threads.emplace_back([this] { run(); });
+		}
+	});
+}
+
+auto Reactor::watch(NativeSocket nativeSocket, WatchCallback callback) -> Watch
+{
+	if (!watchesSupported())
+	{
+		return {};
+	}
+
+	start();
+
+	auto entry = std::make_shared<WatchEntry>(nativeSocket, std::move(callback));
+	std::uint64_t id = 0;
+	{
+		std::scoped_lock lock { _watchMutex };
+		id = _nextWatchId++;
+		_watches.emplace(id, entry);
+	}
+
+#ifdef __linux__
+	// Register the socket without any events. It will be armed later.
+	epoll_event event {};
+	event.events = EPOLLONESHOT;
+	event.data.u64 = id;
+	if (::epoll_ctl(_epoll, EPOLL_CTL_ADD, entry->_socket, &event) != 0)
+	{
+		const std::error_code error { errno, std::system_category() };
+		{
+			std::scoped_lock lock { _watchMutex };
+			_watches.erase(id);
+		}
+		throw std::system_error(error, "could not register file descriptor with the I/O reactor");
+	}
+#endif
+
+	return { *this, id };
+}
+
+auto Reactor::arm(std::uint64_t id, Events events) -> void
+{
+	std::shared_ptr<WatchEntry> entry;
+	{
+		std::scoped_lock lock { _watchMutex };
+		const auto found = _watches.find(id);
+		if (found == _watches.end())
+		{
+			return;
+		}
+		entry = found->second;
+	}
+
+	std::scoped_lock lock { entry->_mutex };
+	if (entry->_cancelled)
+	{
+		return;
+	}
+
+	// If the callback is running, arm the watch once it returns, so that the callback cannot be called again in the meantime
+	if (entry->_running)
+	{
+		entry->_deferredArm |= events;
+		return;
+	}
+
+	if (const auto error = armNative(id, entry->_socket, events))
+	{
+		throw std::system_error(error, "could not arm socket notification");
+	}
+}
+
+auto Reactor::armNative(std::uint64_t id, NativeSocket socket, Events events) noexcept -> std::error_code
+{
+#ifdef __linux__
+	epoll_event event {};
+	event.events = nativeEvents(events);
+	event.data.u64 = id;
+	if (::epoll_ctl(_epoll, EPOLL_CTL_MOD, socket, &event) != 0)
+	{
+		return { errno, std::system_category() };
+	}
+#else
+	(void)id;
+	(void)socket;
+	(void)events;
+#endif
+
+	return {};
+}
+
+auto Reactor::unwatch(std::uint64_t id) noexcept -> void
+{
+	std::shared_ptr<WatchEntry> entry;
+	{
+		std::scoped_lock lock { _watchMutex };
+		const auto found = _watches.find(id);
+		if (found == _watches.end())
+		{
+			return;
+		}
+		entry = std::move(found->second);
+		_watches.erase(found);
+	}
+
+#ifdef __linux__
+	// Ignore errors, the socket is removed automatically if it was closed anyway
+	::epoll_ctl(_epoll, EPOLL_CTL_DEL, entry->_socket, nullptr);
+#endif
+
+	// Wait for a running callback to finish, unless we are being called from within the callback
+	std::unique_lock lock { entry->_mutex };
+	entry->_cancelled = true;
+	entry->_finished.wait(
+		lock, [&] { return !entry->_running || entry->_runner == std::this_thread::get_id(); });
+}
+
+auto Reactor::dispatch(std::uint64_t id, Events events) -> void
+{
+	// Keep the entry alive while we are using it, even if it is removed concurrently
+	std::shared_ptr<WatchEntry> entry;
+	{
+		std::scoped_lock lock { _watchMutex };
+		const auto found = _watches.find(id);
+		if (found == _watches.end())
+		{
+			return;
+		}
+		entry = found->second;
+	}
+
+	std::unique_lock lock { entry->_mutex };
+	if (entry->_cancelled)
+	{
+		return;
+	}
+	// If the callback is already running on another thread, leave the events to that thread
+	if (entry->_running)
+	{
+		entry->_deferredEvents |= events;
+		return;
+	}
+	entry->_running = true;
+	entry->_runner = std::this_thread::get_id();
+
+	// Run the callback until no more events arrived while it was running
+	while (events != 0 && !entry->_cancelled)
+	{
+		lock.unlock();
+		// Callbacks must handle their own errors. There is no one to report them to here.
+		try
+		{
+			entry->_callback(events);
+		}
+		catch (...)
+		{
+		}
+		lock.lock();
+
+		events = std::exchange(entry->_deferredEvents, 0);
+	}
+
+	// Arm the watch if the callback asked for it. This is done while we still hold the lock, so that another thread that
+	// receives the resulting event waits for us to finish here. Errors are ignored, as there is no one to report them to,
+	// and they only occur if the socket was closed anyway.
+	if (const auto armEvents = std::exchange(entry->_deferredArm, 0); armEvents != 0 && !entry->_cancelled)
+	{
+		armNative(id, entry->_socket, armEvents);
+	}
+
+	entry->_running = false;
+	entry->_runner = {};
+	lock.unlock();
+	entry->_finished.notify_all();
+}
+
+auto Reactor::schedule(std::chrono::steady_clock::time_point deadline, std::function<void()> function) -> TimerId
+{
+	start();
+
+	TimerId id = 0;
+	bool earliest = false;
+	{
+		std::scoped_lock lock { _timerMutex };
+		id = _nextTimerId++;
+		const auto inserted = _timers.emplace(std::pair { deadline, id }, std::move(function)).first;
+		_timerDeadlines.emplace(id, deadline);
+		earliest = inserted == _timers.begin();
+	}
+
+	// Only wake up the threads if their timeout has become too long
+	if (earliest)
+	{
+		wake();
+	}
+
+	return id;
+}
+
+auto Reactor::cancel(TimerId timer) noexcept -> void
+{
+	std::unique_lock lock { _timerMutex };
+	if (const auto deadline = _timerDeadlines.find(timer); deadline != _timerDeadlines.end())
+	{
+		_timers.erase({ deadline->second, timer });
+		_timerDeadlines.erase(deadline);
+		return;
+	}
+
+	// If the function is running on another thread, wait for it, so that the caller can safely destroy what it uses
+	const auto running = _runningTimers.find(timer);
+	if (running == _runningTimers.end() || running->second == std::this_thread::get_id())
+	{
+		return;
+	}
+	_timerFinished.wait(lock, [&] { return !_runningTimers.contains(timer); });
+}
+
+auto Reactor::runDueTimers() -> std::chrono::steady_clock::time_point
+{
+	for (;;)
+	{
+		std::function<void()> function;
+		TimerId id = 0;
+		{
+			std::scoped_lock lock { _timerMutex };
+			if (_timers.empty())
+			{
+				return std::chrono::steady_clock::time_point::max();
+			}
+
+			const auto next = _timers.begin();
+			const auto deadline = next->first.first;
+			if (deadline > std::chrono::steady_clock::now())
+			{
+				return deadline;
+			}
+
+			function = std::move(next->second);
+			id = next->first.second;
+			_timerDeadlines.erase(id);
+			_timers.erase(next);
+			_runningTimers.emplace(id, std::this_thread::get_id());
+		}
+
+		// Timer functions must handle their own errors, like watch callbacks
+		try
+		{
+			function();
+		}
+		catch (...)
+		{
+		}
+
+		// Destroy the function before anyone waiting in cancel() is woken up, as it may hold references to their objects
+		function = nullptr;
+		{
+			std::scoped_lock lock { _timerMutex };
+			_runningTimers.erase(id);
+		}
+		_timerFinished.notify_all();
+	}
+}
+
+auto Reactor::wake() noexcept -> void
+{
+#ifdef __linux__
+	if (_wakeup >= 0)
+	{
+		const std::uint64_t increment = 1;
+		// This can only fail if the counter overflows, in which case the threads are woken up anyway
+		[[maybe_unused]] const auto result = ::write(_wakeup, &increment, sizeof(increment));
+		return;
+	}
+#endif
+
+	_timerCondition.notify_all();
+}
+
+auto Reactor::run() -> void
+{
+#ifdef __linux__
+	if (_epoll >= 0)
+	{
+		std::array<epoll_event, 16> events;
+		while (!_stopping)
+		{
+			const auto nextTimer = runDueTimers();
+
+			const auto count = ::epoll_wait(_epoll, events.data(), int(events.size()), epollTimeout(nextTimer));
+			if (count < 0)
+			{
+				// Anything other than EINTR means the epoll file descriptor is broken, which cannot happen
+				continue;
+			}
+
+			for (int index = 0; index < count; ++index)
+			{
+				const auto &event = events[std::size_t(index)];
+				if (event.data.u64 == kWakeupId)
+				{
+					// Reset the wakeup counter, unless we are stopping. In that case, we leave the event signalled, so that
+					// all the other threads will wake up, too.
+					if (!_stopping)
+					{
+						std::uint64_t counter = 0;
+						[[maybe_unused]] const auto result = ::read(_wakeup, &counter, sizeof(counter));
+					}
+					continue;
+				}
+
+				dispatch(event.data.u64, fromNativeEvents(event.events));
+			}
+		}
+		return;
+	}
+#endif
+
+	// Without epoll, we only handle timers
+	while (!_stopping)
+	{
+		const auto nextTimer = runDueTimers();
+
+		std::unique_lock lock { _timerMutex };
+		const auto changed = [&] { return _stopping || (!_timers.empty() && _timers.begin()->first.first < nextTimer); };
+		if (nextTimer == std::chrono::steady_clock::time_point::max())
+		{
+			_timerCondition.wait(lock, changed);
+		}
+		else
+		{
+			_timerCondition.wait_until(lock, nextTimer, changed);
+		}
+	}
+}
+
+} // namespace xentara::plugins::templateUplink
@@ -0,0 +1,270 @@
+// Copyright (c) embedded ocean GmbH
+#pragma once
+
+#include "Socket.hpp"
+
+#include <xentara/utils/tools/Unique.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace xentara::plugins::templateUplink
+{
+
+/// @brief An I/O reactor shared by all the clients of the skill.
+///
+/// The reactor uses a small, fixed number of threads to wait for sockets to become ready, and to execute timers.
+/// The number of threads depends on the number of CPU cores, and not on the number of clients.
+///
+/// Socket notifications are only supported on Linux, where they are implemented using epoll. On other platforms,
+/// watch() returns an empty watch, and callers must fall back to polling the socket in their tasks. Timers are supported
+/// on all platforms.
+///
+/// The threads are started the first time the reactor is used.
+class Reactor final : private utils::tools::Unique
+{
+public:
+	/// @brief A combination of socket events
+	using Events = std::uint32_t;
+	/// @brief The socket is ready for reading
+	static constexpr Events kReadable = 1;
+	/// @brief The socket is ready for writing
+	static constexpr Events kWritable = 2;
+	/// @brief An error or hangup occurred on the socket
+	static constexpr Events kError = 4;
+
+	/// @brief A callback for socket events
+	using WatchCallback = std::function<void(Events events)>;
+
+	/// @brief The ID of a timer
+	using TimerId = std::uint64_t;
+
+	/// @brief A registration of a socket with the reactor.
+	///
+	/// The socket is unregistered when this object is destroyed. Notifications are one-shot: after each notification, the
+	/// watch must be armed again using arm().
+	class Watch final
+	{
+	public:
+		/// @brief Default constructor. Creates an empty watch.
+		Watch() noexcept = default;
+
+		/// @brief Move constructor
+		Watch(Watch &&other) noexcept :
+			_reactor(std::exchange(other._reactor, nullptr)), _id(other._id)
+		{
+		}
+
+		/// @brief Move assignment operator
+		auto operator=(Watch &&rhs) noexcept -> Watch &
+		{
+			if (this != &rhs)
+			{
+				reset();
+				_reactor = std::exchange(rhs._reactor, nullptr);
+				_id = rhs._id;
+			}
+			return *this;
+		}
+
+		/// @brief Destructor. Unregisters the socket.
+		~Watch()
+		{
+			reset();
+		}
+
+		/// @brief Checks whether the watch is registered
+		explicit operator bool() const noexcept
+		{
+			return _reactor != nullptr;
+		}
+
+		/// @brief Requests a single notification when the socket becomes ready for any of the given events
+		///
+		/// If the callback is currently running, the watch is only armed once it returns, so that the callback is never
+		/// called concurrently with itself.
+		auto arm(Events events) -> void
+		{
+			if (_reactor)
+			{
+				_reactor->arm(_id, events);
+			}
+		}
+
+		/// @brief Unregisters the socket.
+		///
+		/// This function waits for any callback in progress to finish, unless it is called from within the callback itself.
+		auto reset() noexcept -> void
+		{
+			if (auto reactor = std::exchange(_reactor, nullptr))
+			{
+				reactor->unwatch(_id);
+			}
+		}
+
+	private:
+		/// @brief Constructor used by the reactor
+		Watch(Reactor &reactor, std::uint64_t id) noexcept : _reactor(&reactor), _id(id)
+		{
+		}
+
+		/// @brief The reactor, or nullptr for an empty watch
+		Reactor *_reactor { nullptr };
+		/// @brief The ID of the registration
+		std::uint64_t _id { 0 };
+
+		friend class Reactor;
+	};
+
+	/// @brief Constructor
+	/// @param threadCount The number of threads to use, or 0 to choose it based on the number of CPU cores
+	explicit Reactor(std::size_t threadCount = 0) noexcept;
+
+	/// @brief Destructor. Stops all threads.
+	~Reactor();
+
+	/// @brief Checks whether socket notifications are supported
+	auto watchesSupported() const noexcept -> bool
+	{
+		return _epoll >= 0;
+	}
+
+	/// @brief Registers a socket.
+	///
+	/// The callback is called on one of the reactor threads. It is never called concurrently for the same socket: the watch
+	/// is not armed again until the callback has returned, and any events that arrive while it is running anyway are passed
+	/// to it afterwards on the same thread. The watch must be reset before the socket is closed.
+	///
+	/// @return A watch for the socket, or an empty watch if socket notifications are not supported
+	/// @throw std::system_error The socket could not be registered
+	auto watch(const Socket &socket, WatchCallback callback) -> Watch
+	{
+		return watch(socket.native(), std::move(callback));
+	}
+
+	/// @brief Registers a native socket or other file descriptor, like an eventfd.
+	///
+	/// This works just like watch(const Socket &, WatchCallback).
+	auto watch(NativeSocket nativeSocket, WatchCallback callback) -> Watch;
+
+	/// @brief Calls a function on one of the reactor threads at a certain time
+	auto schedule(std::chrono::steady_clock::time_point deadline, std::function<void()> function) -> TimerId;
+
+	/// @brief Calls a function on one of the reactor threads as soon as possible
+	auto post(std::function<void()> function) -> void
+	{
+		schedule(std::chrono::steady_clock::time_point::min(), std::move(function));
+	}
+
+	/// @brief Cancels a timer.
+	///
+	/// If the function of the timer is currently running, this waits for it to finish, unless it is called from within the
+	/// function itself. Once this function returns, the object the function uses can be destroyed. This has no effect if the
+	/// function has already finished.
+	///
+	/// @note Timer functions must not wait for locks that are held while their timer is cancelled.
+	auto cancel(TimerId timer) noexcept -> void;
+
+private:
+	/// @brief A registered socket
+	struct WatchEntry final
+	{
+		/// @brief Constructor
+		WatchEntry(NativeSocket socket, WatchCallback &&callback) : _socket(socket), _callback(std::move(callback))
+		{
+		}
+
+		/// @brief The socket
+		NativeSocket _socket;
+		/// @brief The callback. This is never changed after construction.
+		const WatchCallback _callback;
+
+		/// @brief A mutex protecting the remaining members
+		std::mutex _mutex;
+		/// @brief Used to wait for a running callback to finish
+		std::condition_variable _finished;
+		/// @brief Whether the socket has been unregistered
+		bool _cancelled { false };
+		/// @brief Whether the callback is currently running
+		bool _running { false };
+		/// @brief The thread running the callback
+		std::thread::id _runner;
+		/// @brief Events that arrived while the callback was running, to be passed to it once it returns
+		Events _deferredEvents { 0 };
+		/// @brief Events the watch was armed for while the callback was running, to be armed once it returns
+		Events _deferredArm { 0 };
+	};
+
+	/// @brief Starts the threads, if they are not already running
+	auto start() -> void;
+
+	/// @brief The main loop of a reactor thread
+	auto run() -> void;
+
+	/// @brief Wakes up the threads, so they notice new timers or a stop request
+	auto wake() noexcept -> void;
+
+	/// @brief Arms a socket registration
+	auto arm(std::uint64_t id, Events events) -> void;
+	/// @brief Arms a native socket with epoll
+	/// @pre The mutex of the registration must be locked, and its callback must not be running
+	auto armNative(std::uint64_t id, NativeSocket socket, Events events) noexcept -> std::error_code;
+	/// @brief Removes a socket registration
+	auto unwatch(std::uint64_t id) noexcept -> void;
+	/// @brief Calls the callback for a socket registration
+	auto dispatch(std::uint64_t id, Events events) -> void;
+
+	/// @brief Runs all due timers
+	/// @return The time the next timer is due, or std::chrono::steady_clock::time_point::max() if there are none
+	auto runDueTimers() -> std::chrono::steady_clock::time_point;
+
+	/// @brief The number of threads
+	std::size_t _threadCount;
+	/// @brief Used to start the threads only once
+	std::once_flag _started;
+	/// @brief The threads
+	std::vector<std::jthread> _threads;
+
+	/// @brief The native epoll file descriptor, or -1 if not supported
+	int _epoll { -1 };
+	/// @brief A native event file descriptor used to wake up the threads, or -1 if not supported
+	int _wakeup { -1 };
+
+	/// @brief A mutex protecting the registrations
+	std::mutex _watchMutex;
+	/// @brief The registrations by ID
+	std::unordered_map<std::uint64_t, std::shared_ptr<WatchEntry>> _watches;
+	/// @brief The next registration ID to use. IDs start at 1, because 0 is used for the wakeup file descriptor.
+	std::uint64_t _nextWatchId { 1 };
+
+	/// @brief A mutex protecting the timers
+	std::mutex _timerMutex;
+	/// @brief Used to wait for timers on platforms without epoll
+	std::condition_variable _timerCondition;
+	/// @brief The pending timers, ordered by deadline
+	std::map<std::pair<std::chrono::steady_clock::time_point, TimerId>, std::function<void()>> _timers;
+	/// @brief The deadlines of the pending timers by ID
+	std::unordered_map<TimerId, std::chrono::steady_clock::time_point> _timerDeadlines;
+	/// @brief The threads running the functions of the timers that have fired, by ID
+	std::unordered_map<TimerId, std::thread::id> _runningTimers;
+	/// @brief Used to wait for the function of a timer to finish
+	std::condition_variable _timerFinished;
+	/// @brief The next timer ID to use
+	TimerId _nextTimerId { 1 };
+	/// @brief Whether the threads should stop
+	std::atomic<bool> _stopping { false };
+};
+
+} // namespace xentara::plugins::templateUplink
@@ -0,0 +1,86 @@
+// Copyright (c) embedded ocean GmbH
+#include "RealTimeMemory.hpp"
+
+#include <system_error>
+
+#ifdef _WIN32
+#	include <Windows.h>
+#else
+#	include <errno.h>
+#	include <sys/mman.h>
+#	include <unistd.h>
+#endif
+
+namespace xentara::plugins::templateUplink
+{
+
+namespace
+{
+
+	/// @brief Gets the size of a memory page
+	auto pageSize() noexcept -> std::size_t
+	{
+#ifdef _WIN32
+		SYSTEM_INFO systemInfo;
+		::GetSystemInfo(&systemInfo);
+		return std::size_t(systemInfo.dwPageSize);
+#else
+		const auto size = ::sysconf(_SC_PAGESIZE);
+		return size > 0 ? std::size_t(size) : 4096;
+#endif
+	}
+
+} // namespace
+
+auto lockAndPrefault(void *data, std::size_t size) -> void
+{
+	if (size == 0)
+	{
+		return;
+	}
+
+#ifdef _WIN32
+	if (!::VirtualLock(data, size))
+	{
+		throw std::system_error(int(::GetLastError()), std::system_category(), "could not lock memory");
+	}
+#else
+	if (::mlock(data, size) != 0)
+	{
+		throw std::system_error(errno, std::system_category(), "could not lock memory");
+	}
+#endif
+
+	// Touch every page. Locking already maps the pages on most systems, but this makes sure the page tables are filled in, too.
+	// The bytes are read and written back, so that the contents are preserved.
+	static const auto kPageSize = pageSize();
+	const auto bytes = static_cast<volatile unsigned char *>(data);
+	for (std::size_t offset = 0; offset < size; offset += kPageSize)
+	{
+		bytes[offset] = bytes[offset];
+	}
+	bytes[size - 1] = bytes[size - 1];
+}
+
+auto RealTimeMemoryResource::do_allocate(std::size_t bytes, std::size_t alignment) -> void *
+{
+	recordAllocation();
+
+	auto pointer = _upstream->allocate(bytes, alignment);
+	if (_enabled)
+	{
+		try
+		{
+			lockAndPrefault(pointer, bytes);
+		}
+		catch (...)
+		{
+			_upstream->deallocate(pointer, bytes, alignment);
+			throw;
+		}
+	}
+
+	return pointer;
+}
+
+} // namespace xentara::plugins::templateUplink
@@ -0,0 +1,103 @@
+// Copyright (c) embedded ocean GmbH
+#pragma once
+
+#include <xentara/utils/tools/Unique.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+namespace xentara::plugins::templateUplink
+{
+
+/// @brief Locks memory into RAM and touches every page of it, so that accessing it later never causes a page fault.
+/// @throw std::system_error The memory could not be locked, e.g. because the limit for locked memory was reached
+auto lockAndPrefault(void *data, std::size_t size) -> void;
+
+/// @brief A memory resource for buffers that are used on the hot path in real-time memory mode.
+///
+/// Once enabled, all memory obtained from the upstream resource is locked into RAM and prefaulted. Once armed, every
+/// allocation is counted, as it means that the buffers were not large enough. Allocations made by containers that do not use
+/// this resource can be counted using recordAllocation().
+class RealTimeMemoryResource final : public std::pmr::memory_resource, private utils::tools::Unique
+{
+public:
+	/// @brief Constructor
+	/// @param upstream The resource to get the memory from
+	explicit RealTimeMemoryResource(std::pmr::memory_resource *upstream = std::pmr::new_delete_resource()) noexcept :
+		_upstream(upstream)
+	{
+	}
+
+	/// @brief Locks and prefaults all memory allocated from now on
+	auto enable() noexcept -> void
+	{
+		_enabled = true;
+	}
+
+	/// @brief Checks whether real-time memory mode is enabled
+	auto enabled() const noexcept -> bool
+	{
+		return _enabled;
+	}
+
+	/// @brief Counts all allocations from now on. This is called once all the buffers have been preallocated.
+	auto arm() noexcept -> void
+	{
+		_armed.store(true, std::memory_order_relaxed);
+	}
+
+	/// @brief Counts an allocation made outside this resource, if the resource is armed
+	auto recordAllocation() noexcept -> void
+	{
+		if (_armed.load(std::memory_order_relaxed))
+		{
+			_allocations.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	/// @brief Counts an allocation if a container outside this resource had to grow, if the resource is armed
+	auto recordGrowth(std::size_t oldCapacity, std::size_t newCapacity) noexcept -> void
+	{
+		if (newCapacity != oldCapacity)
+		{
+			recordAllocation();
+		}
+	}
+
+	/// @brief Gets the number of allocations made since the resource was armed
+	auto allocations() const noexcept -> std::uint64_t
+	{
+		return _allocations.load(std::memory_order_relaxed);
+	}
+
+private:
+	/// @name Virtual Overrides for std::pmr::memory_resource
+	/// @{
+
+	auto do_allocate(std::size_t bytes, std::size_t alignment) -> void * final;
+
+	auto do_deallocate(void *pointer, std::size_t bytes, std::size_t alignment) -> void final
+	{
+		_upstream->deallocate(pointer, bytes, alignment);
+	}
+
+	auto do_is_equal(const std::pmr::memory_resource &other) const noexcept -> bool final
+	{
+		return this == &other;
+	}
+
+	/// @}
+
+	/// @brief The resource the memory is obtained from
+	std::pmr::memory_resource *_upstream;
+	/// @brief Whether memory is locked and prefaulted. This is only set while the model is being prepared.
+	bool _enabled { false };
+	/// @brief Whether allocations are counted
+	std::atomic<bool> _armed { false };
+	/// @brief The number of allocations since the resource was armed
+	std::atomic<std::uint64_t> _allocations { 0 };
+};
+
+} // namespace xentara::plugins::templateUplink
@@ -0,0 +1,140 @@
+// Copyright (c) embedded ocean GmbH
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace xentara::plugins::templateUplink
+{
+
+/// @brief Carries unchanged records over into a reloaded list of records.
+///
+/// Every record in @p records that is configured exactly like one of the @p current records is replaced by that current
+/// record, so that it keeps its handles and aggregates. Each current record is only used once, in case the same record appears
+/// more than once in the new list.
+///
+/// @tparam Record The type of the records. This must have a remoteId() function, and a sameConfiguration() function that
+/// compares the configuration of two records.
+/// @return The records that are new, and still need to be prepared
+template <typename Record>
+auto carryOverRecords(std::span<const std::shared_ptr<Record>> current, std::span<std::shared_ptr<Record>> records)
+	-> std::vector<std::shared_ptr<Record>>
+{
+	// Index the current records by remote ID
+	std::unordered_multimap<std::string_view, std::shared_ptr<Record>> currentRecords;
+	for (auto &&record : current)
+	{
+		currentRecords.emplace(record->remoteId(), record);
+	}
+
+	// Keep the current record in place of every record that is unchanged, and collect the ones that are new
+	std::vector<std::shared_ptr<Record>> newRecords;
+	for (auto &&record : records)
+	{
+		auto [first, last] = currentRecords.equal_range(record->remoteId());
+		auto match = std::find_if(first, last, [&](const auto &candidate) { return candidate.second->sameConfiguration(*record); });
+		if (match != last)
+		{
+			record = std::move(match->second);
+			currentRecords.erase(match);
+		}
+		else
+		{
+			newRecords.push_back(record);
+		}
+	}
+
+	return newRecords;
+}
+
+/// @brief Carries the schedule of sample groups over into the groups of a reloaded table.
+///
+/// Groups whose interval still exists are due at the same time as before, so that reloading does not cause extra sends.
+///
+/// @tparam Group The type of the groups. This must have an _interval member and a _nextDue member.
+template <typename Group>
+auto carryOverSchedule(std::span<const Group> previous, std::span<Group> groups) noexcept -> void
+{
+	for (auto &&group : groups)
+	{
+		if (auto match = std::ranges::find(previous, group._interval, &Group::_interval); match != previous.end())
+		{
+			group._nextDue = match->_nextDue;
+		}
+	}
+}
+
+/// @brief Hands reloaded tables from the thread that reloads them over to the thread that uses them.
+///
+/// The thread using the table only checks an atomic counter in each cycle, so that it does not need to lock unless a new table
+/// has actually been published.
+///
+/// @tparam Table The type of the tables
+template <typename Table>
+class TableExchange final
+{
+public:
+	/// @brief Sets the initial table, before the exchange is used by any other thread
+	auto reset(std::shared_ptr<Table> table) -> void
+	{
+		std::scoped_lock lock { _mutex };
+		_latest = std::move(table);
+		_published = nullptr;
+	}
+
+	/// @brief Gets the most recently published table, which reloads are compared against
+	auto latest() const -> std::shared_ptr<Table>
+	{
+		std::scoped_lock lock { _mutex };
+		return _latest;
+	}
+
+	/// @brief Publishes a new table
+	auto publish(std::shared_ptr<Table> table) -> void
+	{
+		std::scoped_lock lock { _mutex };
+		_latest = table;
+		_published = std::move(table);
+		_publishCount.fetch_add(1, std::memory_order_release);
+	}
+
+	/// @brief Takes the table published since the last call, if any.
+	///
+	/// This must only be called by the thread that uses the tables.
+	///
+	/// @return The new table, or nullptr if none has been published since the last call
+	auto take() -> std::shared_ptr<Table>
+	{
+		// This is checked without locking, as reloads are rare
+		if (_publishCount.load(std::memory_order_acquire) == _takenCount)
+		{
+			return nullptr;
+		}
+
+		std::scoped_lock lock { _mutex };
+		_takenCount = _publishCount.load(std::memory_order_relaxed);
+		return std::move(_published);
+	}
+
+private:
+	/// @brief A mutex protecting the tables
+	mutable std::mutex _mutex;
+	/// @brief The most recently published table
+	std::shared_ptr<Table> _latest;
+	/// @brief A published table that has not been taken yet, or nullptr for none
+	std::shared_ptr<Table> _published;
+	/// @brief The number of tables published
+	std::atomic<std::uint64_t> _publishCount { 0 };
+	/// @brief The number of published tables seen by take(). This is only accessed by the thread using the tables.
+	std::uint64_t _takenCount { 0 };
+};
+
+} // namespace xentara::plugins::templateUplink
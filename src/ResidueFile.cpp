@@ -0,0 +1,186 @@
+// Copyright (c) embedded ocean GmbH
+#include "ResidueFile.hpp"
+
+#include "Encoding.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <fstream>
+#include <string_view>
+#include <system_error>
+
+#ifdef _WIN32
+#	include <Windows.h>
+#else
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+
+namespace xentara::plugins::templateUplink
+{
+
+using namespace std::literals;
+
+namespace
+{
+
+	/// @brief The signature at the start of the file, including a version number
+	constexpr auto kSignature = "XTUPRES1"sv;
+
+	/// @brief The size of the header of each block
+	constexpr std::size_t kBlockHeaderSize = sizeof(std::int64_t) + sizeof(std::uint64_t);
+
+	/// @brief Gets the error for the last failed stream operation
+	auto lastFileError() noexcept -> std::error_code
+	{
+		return { errno != 0 ? errno : EIO, std::generic_category() };
+	}
+
+	/// @brief Flushes a file or directory to the storage device, so that it survives a power loss
+	/// @throw std::system_error The file could not be flushed
+	auto syncToDisk(const std::filesystem::path &path, bool directory) -> void
+	{
+#ifdef _WIN32
+		// Directory entries are flushed along with the file on Windows
+		if (directory)
+		{
+			return;
+		}
+
+		const auto handle =
+			::CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (handle == INVALID_HANDLE_VALUE)
+		{
+			throw std::system_error(int(::GetLastError()), std::system_category(), "could not open residue file for flushing");
+		}
+		const auto flushed = ::FlushFileBuffers(handle);
+		const auto error = ::GetLastError();
+		::CloseHandle(handle);
+		if (!flushed)
+		{
+			throw std::system_error(int(error), std::system_category(), "could not flush residue file");
+		}
+#else
+		const auto fd = ::open(path.c_str(), (directory ? O_RDONLY | O_DIRECTORY : O_WRONLY) | O_CLOEXEC);
+		if (fd < 0)
+		{
+			throw std::system_error(errno, std::generic_category(), "could not open residue file for flushing");
+		}
+		const auto result = ::fsync(fd);
+		const auto error = errno;
+		::close(fd);
+		if (result != 0)
+		{
+			throw std::system_error(error, std::generic_category(), "could not flush residue file");
+		}
+#endif
+	}
+
+} // namespace
+
+auto ResidueFile::save(std::span<const Block> blocks) const -> void
+{
+	auto temporaryPath = _path;
+	temporaryPath += ".tmp";
+
+	{
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+		if (!file)
+		{
+			throw std::system_error(lastFileError(), "could not create residue file");
+		}
+
+		file.write(kSignature.data(), std::streamsize(kSignature.size()));
+		for (auto &&block : blocks)
+		{
+			std::array<std::byte, kBlockHeaderSize> header;
+			auto position = putLittleEndian(header.data(), microsecondsSinceEpoch(block._timeStamp));
+			putLittleEndian(position, std::uint64_t(block._data.size() + block._payload.size()));
+
+			file.write(reinterpret_cast<const char *>(header.data()), std::streamsize(header.size()));
+			file.write(reinterpret_cast<const char *>(block._data.data()), std::streamsize(block._data.size()));
+			file.write(reinterpret_cast<const char *>(block._payload.data()), std::streamsize(block._payload.size()));
+		}
+
+		file.flush();
+		if (!file)
+		{
+			throw std::system_error(lastFileError(), "could not write residue file");
+		}
+	}
+
+	// Make sure the data is on the disk before the file replaces the old one. Otherwise, a power loss right after the rename could
+	// leave an empty or partial file behind, even though the rename itself went through.
+	syncToDisk(temporaryPath, false);
+
+	// Replace the old file in one step, and make the rename itself durable as well
+	std::filesystem::rename(temporaryPath, _path);
+	const auto directory = _path.parent_path();
+	syncToDisk(directory.empty() ? std::filesystem::path(".") : directory, true);
+}
+
+auto ResidueFile::take() const -> std::vector<LoadedBlock>
+{
+	std::vector<LoadedBlock> blocks;
+
+	{
+		std::ifstream file(_path, std::ios::binary);
+		if (!file)
+		{
+			// No residue was left
+			if (!std::filesystem::exists(_path))
+			{
+				return blocks;
+			}
+			throw std::system_error(lastFileError(), "could not open residue file");
+		}
+
+		const auto fileSize = std::uint64_t(std::filesystem::file_size(_path));
+
+		// Check the signature
+		std::array<char, kSignature.size()> signature;
+		if (!file.read(signature.data(), std::streamsize(signature.size())) ||
+			!std::ranges::equal(signature, kSignature))
+		{
+			throw std::system_error(std::make_error_code(std::errc::illegal_byte_sequence), "invalid residue file");
+		}
+
+		// Read the blocks until the end of the file, or until a block is incomplete
+		for (;;)
+		{
+			std::array<std::byte, kBlockHeaderSize> header;
+			if (!file.read(reinterpret_cast<char *>(header.data()), std::streamsize(header.size())))
+			{
+				break;
+			}
+			const auto microseconds = std::int64_t(getLittleEndian<std::uint64_t>(header.data()));
+			const auto size = getLittleEndian<std::uint64_t>(header.data() + sizeof(std::int64_t));
+
+			// Don't trust the size of an incomplete block, as it may be garbage
+			if (size > fileSize - std::uint64_t(file.tellg()))
+			{
+				break;
+			}
+
+			LoadedBlock block;
+			block._timeStamp = std::chrono::system_clock::time_point(
+				std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::microseconds(microseconds)));
+			block._data.resize(std::size_t(size));
+			if (!file.read(reinterpret_cast<char *>(block._data.data()), std::streamsize(size)))
+			{
+				break;
+			}
+
+			blocks.push_back(std::move(block));
+		}
+	}
+
+	// The data now belongs to the caller
+	std::filesystem::remove(_path);
+
+	return blocks;
+}
+
+} // namespace xentara::plugins::templateUplink
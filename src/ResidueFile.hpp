@@ -0,0 +1,66 @@
+// Copyright (c) embedded ocean GmbH
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+namespace xentara::plugins::templateUplink
+{
+
+/// @brief A file used to keep data that could not be sent before shutdown, so that it can be sent after the next startup.
+///
+/// The file consists of a signature, followed by blocks of data, each consisting of a 64 bit time stamp in microseconds since
+/// the epoch, a 64 bit size, and the data itself. All integers are in little endian byte order.
+class ResidueFile final
+{
+public:
+	/// @brief A block of data to save
+	struct Block final
+	{
+		/// @brief The time stamp of the data
+		std::chrono::system_clock::time_point _timeStamp;
+		/// @brief The data
+		std::span<const std::byte> _data;
+		/// @brief More data that is saved directly after _data, as part of the same block
+		std::span<const std::byte> _payload {};
+	};
+
+	/// @brief A block of data that was loaded
+	struct LoadedBlock final
+	{
+		/// @brief The time stamp of the data
+		std::chrono::system_clock::time_point _timeStamp;
+		/// @brief The data
+		std::vector<std::byte> _data;
+	};
+
+	/// @brief Constructor
+	explicit ResidueFile(std::filesystem::path path) : _path(std::move(path))
+	{
+	}
+
+	/// @brief Saves blocks of data, replacing the file.
+	///
+	/// The file is written under a temporary name first, and flushed to the disk before it replaces the old file, so that neither
+	/// a crash nor a power loss during the write can leave a corrupt file behind.
+	///
+	/// @throw std::system_error The file could not be written
+	auto save(std::span<const Block> blocks) const -> void;
+
+	/// @brief Loads the saved blocks of data and deletes the file.
+	///
+	/// If the file is truncated, the blocks that are complete are still returned.
+	///
+	/// @return The blocks, or an empty vector if there is no file
+	/// @throw std::system_error The file could not be read or deleted, or is not a residue file
+	auto take() const -> std::vector<LoadedBlock>;
+
+private:
+	/// @brief The path of the file
+	std::filesystem::path _path;
+};
+
+} // namespace xentara::plugins::templateUplink
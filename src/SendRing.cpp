@@ -0,0 +1,422 @@
+// Copyright (c) embedded ocean GmbH
+#include "SendRing.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <tuple>
+#include <utility>
+
+#ifdef TEMPLATE_UPLINK_IO_URING
+#	include <errno.h>
+#	include <liburing.h>
+#	include <sys/eventfd.h>
+#	include <sys/socket.h>
+#	include <sys/uio.h>
+#	include <unistd.h>
+
+// Zero copy sends from registered buffers require liburing 2.3 or newer
+#	ifdef IORING_RECVSEND_FIXED_BUF
+#		define TEMPLATE_UPLINK_IO_URING_FIXED_BUFFERS
+#	endif
+#endif
+
+namespace xentara::plugins::templateUplink
+{
+
+#ifdef TEMPLATE_UPLINK_IO_URING
+
+namespace
+{
+
+	/// @brief The number of entries in the submission queue
+	constexpr unsigned kQueueDepth = 256;
+
+	/// @brief The maximum number of buffers in a single write
+	constexpr std::size_t kMaxBuffersPerWrite = 64;
+
+	/// @brief The maximum number of completions reaped at once
+	constexpr unsigned kMaxCompletionsPerReap = 64;
+
+	/// @brief The size of each registered buffer
+	constexpr std::size_t kRegisteredBufferSize = 256 * 1024;
+
+	/// @brief The number of registered buffers
+	constexpr unsigned kRegisteredBufferCount = 16;
+
+	/// @brief The smallest write that is sent from a registered buffer.
+	///
+	/// Zero copy sends have a fixed overhead for pinning and notification, so they only pay off for larger writes.
+	constexpr std::size_t kMinRegisteredWriteSize = 16 * 1024;
+
+} // namespace
+
+struct SendRing::Ring final
+{
+	/// @brief The liburing instance
+	io_uring _ring {};
+
+	/// @brief The memory of the registered buffers, or nullptr if no buffers are registered
+	std::unique_ptr<std::byte[]> _bufferMemory;
+	/// @brief The indices of the registered buffers that are not in use
+	std::vector<unsigned> _freeBuffers;
+	/// @brief Whether a socket has refused a zero copy send, in which case the registered buffers are no longer used
+	bool _zeroCopyRefused { false };
+};
+
+struct SendRing::Operation final
+{
+	/// @brief The message passed to the kernel
+	msghdr _message {};
+	/// @brief The buffers of the message
+	std::array<iovec, kMaxBuffersPerWrite> _buffers {};
+	/// @brief The socket being written to, which must stay open until the write completes
+	std::shared_ptr<const Socket> _socket;
+	/// @brief The completion function
+	Completion _completion;
+	/// @brief The index of the registered buffer the data was copied to, or -1 if the data is sent from the caller's buffers
+	int _registeredBuffer { -1 };
+};
+
+SendRing::SendRing(Reactor &reactor) noexcept : _reactor(reactor)
+{
+	// io_uring is only worth it if the reactor can tell us about completions
+	if (!_reactor.watchesSupported())
+	{
+		return;
+	}
+
+	// Set up the ring. If anything fails, we simply leave io_uring unavailable, e.g. if the kernel is too old, or io_uring was
+	// disabled by the administrator.
+	auto ring = std::make_unique<Ring>();
+	if (::io_uring_queue_init(kQueueDepth, &ring->_ring, 0) < 0)
+	{
+		return;
+	}
+
+	// Have the ring signal completions using an eventfd, which the reactor can wait for
+	_completionEvent = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (_completionEvent < 0 || ::io_uring_register_eventfd(&ring->_ring, _completionEvent) < 0)
+	{
+		if (_completionEvent >= 0)
+		{
+			::close(_completionEvent);
+			_completionEvent = -1;
+		}
+		::io_uring_queue_exit(&ring->_ring);
+		return;
+	}
+
+	// Register buffers for zero copy sends. This is optional, e.g. the amount of memory a process may lock may be too small.
+	registerBuffers(*ring);
+
+	// Reap completions on the reactor
+	_ring = std::move(ring);
+	try
+	{
+		_completionWatch = _reactor.watch(_completionEvent, [this](Reactor::Events) { reap(); });
+		_completionWatch.arm(Reactor::kReadable);
+	}
+	catch (const std::exception &)
+	{
+		_completionWatch.reset();
+		::io_uring_queue_exit(&_ring->_ring);
+		_ring.reset();
+		::close(_completionEvent);
+		_completionEvent = -1;
+	}
+}
+
+SendRing::~SendRing()
+{
+	// Stop reaping completions before we tear down the ring
+	_completionWatch.reset();
+
+	if (_ring)
+	{
+		::io_uring_queue_exit(&_ring->_ring);
+		::close(_completionEvent);
+	}
+}
+
+auto SendRing::write(std::shared_ptr<const Socket> socket, std::span<const Buffer> buffers, Completion completion) -> bool
+{
+	if (!_ring)
+	{
+		return false;
+	}
+
+	std::scoped_lock lock { _mutex };
+
+	// Get a free operation, or make a new one
+	if (_freeOperations.empty())
+	{
+		_freeOperations.push_back(_operations.emplace_back(std::make_unique<Operation>()).get());
+	}
+	auto &operation = *_freeOperations.back();
+
+	// Fill in the message
+	const auto count = std::min(buffers.size(), kMaxBuffersPerWrite);
+	for (std::size_t index = 0; index < count; ++index)
+	{
+		operation._buffers[index].iov_base = const_cast<std::byte *>(buffers[index].data());
+		operation._buffers[index].iov_len = buffers[index].size();
+	}
+	operation._message = {};
+	operation._message.msg_iov = operation._buffers.data();
+	operation._message.msg_iovlen = decltype(operation._message.msg_iovlen)(count);
+
+	// Get a submission queue entry. If the queue is full, submit what we have to make room.
+	auto entry = ::io_uring_get_sqe(&_ring->_ring);
+	if (!entry)
+	{
+		if (const auto result = ::io_uring_submit(&_ring->_ring); result < 0)
+		{
+			throw std::system_error(-result, std::system_category(), "could not submit writes to io_uring");
+		}
+		entry = ::io_uring_get_sqe(&_ring->_ring);
+		if (!entry)
+		{
+			throw std::system_error(std::make_error_code(std::errc::resource_unavailable_try_again),
+				"io_uring submission queue is full");
+		}
+	}
+
+	// Never block, just like Socket::writeSome(), so that a full socket cannot hold up the ring
+	constexpr int kFlags = MSG_NOSIGNAL | MSG_DONTWAIT;
+
+	// Send larger writes from a registered buffer without copying them into the kernel, if possible. Gathering the buffers into
+	// a registered buffer also saves the kernel from pinning the pages of every buffer for every write.
+	operation._registeredBuffer = -1;
+#ifdef TEMPLATE_UPLINK_IO_URING_FIXED_BUFFERS
+	const auto size = std::accumulate(operation._buffers.begin(),
+		operation._buffers.begin() + std::ptrdiff_t(count),
+		std::size_t(0),
+		[](std::size_t total, const iovec &buffer) { return total + buffer.iov_len; });
+	if (size >= kMinRegisteredWriteSize && !_ring->_freeBuffers.empty())
+	{
+		const auto bufferIndex = _ring->_freeBuffers.back();
+		_ring->_freeBuffers.pop_back();
+		operation._registeredBuffer = int(bufferIndex);
+
+		// Copy as much as fits. Whatever is left over is written by the next call, just like after a short write.
+		const auto target = _ring->_bufferMemory.get() + std::size_t(bufferIndex) * kRegisteredBufferSize;
+		std::size_t copied = 0;
+		for (std::size_t index = 0; index < count && copied < kRegisteredBufferSize; ++index)
+		{
+			const auto chunk = std::min(buffers[index].size(), kRegisteredBufferSize - copied);
+			std::memcpy(target + copied, buffers[index].data(), chunk);
+			copied += chunk;
+		}
+
+		::io_uring_prep_send_zc_fixed(entry, socket->native(), target, copied, kFlags, 0, bufferIndex);
+	}
+	else
+#endif
+	{
+		::io_uring_prep_sendmsg(entry, socket->native(), &operation._message, kFlags);
+	}
+	::io_uring_sqe_set_data(entry, &operation);
+
+	// The operation is now in use
+	operation._socket = std::move(socket);
+	operation._completion = std::move(completion);
+	_freeOperations.pop_back();
+
+	// Have the reactor submit everything queued until it gets round to it using a single system call
+	if (!std::exchange(_submitPending, true))
+	{
+		_reactor.post([this] { submit(); });
+	}
+
+	return true;
+}
+
+auto SendRing::submit() -> void
+{
+	std::scoped_lock lock { _mutex };
+	_submitPending = false;
+
+	// Errors are not reported here. Entries that could not be submitted stay in the queue and are submitted next time.
+	::io_uring_submit(&_ring->_ring);
+}
+
+auto SendRing::reap() -> void
+{
+	// Reset the eventfd before looking for completions, so that we don't miss any completions that arrive while we are busy
+	std::uint64_t counter = 0;
+	[[maybe_unused]] const auto readResult = ::read(_completionEvent, &counter, sizeof(counter));
+
+	for (;;)
+	{
+		// Take a batch of completions. Only one reactor thread reaps at a time, because the watch is one-shot.
+		std::array<io_uring_cqe *, kMaxCompletionsPerReap> completions;
+		const auto count = ::io_uring_peek_batch_cqe(&_ring->_ring, completions.data(), unsigned(completions.size()));
+		if (count == 0)
+		{
+			break;
+		}
+
+		std::array<std::tuple<Operation *, int, unsigned>, kMaxCompletionsPerReap> results;
+		for (unsigned index = 0; index < count; ++index)
+		{
+			results[index] = { static_cast<Operation *>(::io_uring_cqe_get_data(completions[index])),
+				completions[index]->res,
+				completions[index]->flags };
+		}
+		::io_uring_cq_advance(&_ring->_ring, count);
+
+		// Call the completion functions without holding the lock, as they will usually queue more writes
+		for (unsigned index = 0; index < count; ++index)
+		{
+			[[maybe_unused]] auto [operation, result, flags] = results[index];
+
+#ifdef TEMPLATE_UPLINK_IO_URING_FIXED_BUFFERS
+			// A zero copy send reports a second time once the kernel no longer needs the registered buffer
+			if ((flags & IORING_CQE_F_NOTIF) != 0)
+			{
+				releaseOperation(*operation);
+				continue;
+			}
+
+			// Some sockets do not support zero copy sends. Stop using them, and have the caller try again.
+			if (result == -EOPNOTSUPP && operation->_registeredBuffer >= 0)
+			{
+				std::scoped_lock lock { _mutex };
+				_ring->_zeroCopyRefused = true;
+				_ring->_freeBuffers.clear();
+				result = -EAGAIN;
+			}
+#endif
+
+			auto completion = std::exchange(operation->_completion, nullptr);
+			// The socket may be closed now, if the connection was replaced in the meantime
+			auto socket = std::exchange(operation->_socket, nullptr);
+			// If a notification follows, the operation stays in use until then, as it is identified by its address
+#ifdef TEMPLATE_UPLINK_IO_URING_FIXED_BUFFERS
+			const auto notificationFollows = (flags & IORING_CQE_F_MORE) != 0;
+#else
+			constexpr bool notificationFollows = false;
+#endif
+			if (!notificationFollows)
+			{
+				releaseOperation(*operation);
+			}
+
+			if (result < 0)
+			{
+				completion(std::error_code(-result, std::system_category()), 0);
+			}
+			else
+			{
+				completion(std::error_code(), std::size_t(result));
+			}
+		}
+	}
+
+	_completionWatch.arm(Reactor::kReadable);
+}
+
+auto SendRing::registerBuffers([[maybe_unused]] Ring &ring) noexcept -> void
+{
+#ifdef TEMPLATE_UPLINK_IO_URING_FIXED_BUFFERS
+	// Zero copy sends require Linux 6.0
+	const auto probe = ::io_uring_get_probe_ring(&ring._ring);
+	const auto supported = probe && ::io_uring_opcode_supported(probe, IORING_OP_SEND_ZC);
+	if (probe)
+	{
+		::io_uring_free_probe(probe);
+	}
+	if (!supported)
+	{
+		return;
+	}
+
+	try
+	{
+		auto memory = std::make_unique_for_overwrite<std::byte[]>(kRegisteredBufferSize * kRegisteredBufferCount);
+		std::array<iovec, kRegisteredBufferCount> buffers;
+		for (unsigned index = 0; index < kRegisteredBufferCount; ++index)
+		{
+			buffers[index].iov_base = memory.get() + std::size_t(index) * kRegisteredBufferSize;
+			buffers[index].iov_len = kRegisteredBufferSize;
+		}
+		if (::io_uring_register_buffers(&ring._ring, buffers.data(), kRegisteredBufferCount) < 0)
+		{
+			return;
+		}
+
+		// Hand out the buffers with the lowest indices first
+		ring._freeBuffers.reserve(kRegisteredBufferCount);
+		for (unsigned index = kRegisteredBufferCount; index > 0; --index)
+		{
+			ring._freeBuffers.push_back(index - 1);
+		}
+		ring._bufferMemory = std::move(memory);
+	}
+	catch (const std::exception &)
+	{
+		// Without the buffers, everything is sent using sendmsg()
+		ring._freeBuffers.clear();
+	}
+#endif
+}
+
+auto SendRing::releaseOperation(Operation &operation) -> void
+{
+	std::scoped_lock lock { _mutex };
+	if (operation._registeredBuffer >= 0)
+	{
+		// Once a socket has refused a zero copy send, the buffers are no longer handed out
+		if (!_ring->_zeroCopyRefused)
+		{
+			_ring->_freeBuffers.push_back(unsigned(operation._registeredBuffer));
+		}
+		operation._registeredBuffer = -1;
+	}
+	_freeOperations.push_back(&operation);
+}
+
+#else
+
+struct SendRing::Ring final
+{
+};
+
+struct SendRing::Operation final
+{
+};
+
+SendRing::SendRing(Reactor &reactor) noexcept : _reactor(reactor)
+{
+}
+
+SendRing::~SendRing() = default;
+
+auto SendRing::write(std::shared_ptr<const Socket>, std::span<const Buffer>, Completion) -> bool
+{
+	// io_uring support was not compiled in
+	return false;
+}
+
+auto SendRing::submit() -> void
+{
+}
+
+auto SendRing::reap() -> void
+{
+}
+
+auto SendRing::registerBuffers(Ring &) noexcept -> void
+{
+}
+
+auto SendRing::releaseOperation(Operation &) -> void
+{
+}
+
+#endif
+
+} // namespace xentara::plugins::templateUplink
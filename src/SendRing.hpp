@@ -0,0 +1,102 @@
+// Copyright (c) embedded ocean GmbH
+#pragma once
+
+#include "Reactor.hpp"
+#include "Socket.hpp"
+
+#include <xentara/utils/tools/Unique.hpp>
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <system_error>
+#include <vector>
+
+namespace xentara::plugins::templateUplink
+{
+
+/// @brief Submits writes from all clients of the skill to the kernel in batches, using io_uring.
+///
+/// Writes are collected until the I/O reactor gets round to submitting them, so that all the writes queued in the
+/// meantime are submitted using a single system call. Completions are reaped in batches on a reactor thread.
+///
+/// Larger writes are copied into buffers registered with the kernel, and sent from there without the kernel copying them
+/// again (zero copy), if the kernel and liburing support it. Other writes are sent directly from the caller's buffers.
+///
+/// io_uring is only used if the plugin was built with the TEMPLATE_UPLINK_IO_URING CMake option, and if the kernel
+/// supports it. Otherwise, available() returns false, and callers must write to their sockets directly.
+class SendRing final : private utils::tools::Unique
+{
+public:
+	/// @brief A single buffer
+	using Buffer = std::span<const std::byte>;
+
+	/// @brief A function called on a reactor thread when a write completes.
+	///
+	/// The error code is std::errc::resource_unavailable_try_again if the socket was not ready for writing.
+	using Completion = std::function<void(std::error_code error, std::size_t written)>;
+
+	/// @brief Constructor
+	/// @param reactor The reactor used to submit writes and to reap completions
+	explicit SendRing(Reactor &reactor) noexcept;
+
+	/// @brief Destructor. Pending completions are discarded without being called.
+	~SendRing();
+
+	/// @brief Checks whether io_uring is being used
+	auto available() const noexcept -> bool
+	{
+		return _ring != nullptr;
+	}
+
+	/// @brief Queues a write of as many of the given buffers as the socket will take without blocking.
+	///
+	/// The buffers themselves need not be kept alive, but the data they point to must be kept alive until the completion
+	/// function has been called. The socket is kept open until then, so that its descriptor cannot be reused for another
+	/// connection while the write is still queued.
+	///
+	/// @return Returns false if io_uring is not available, in which case the completion function is not called.
+	/// @throw std::system_error The write could not be queued
+	auto write(std::shared_ptr<const Socket> socket, std::span<const Buffer> buffers, Completion completion) -> bool;
+
+private:
+	/// @brief The io_uring instance. This is defined in the source file, so that this header does not depend on liburing.
+	struct Ring;
+	/// @brief A write operation. This is defined in the source file, because it uses system types.
+	struct Operation;
+
+	/// @brief Submits all queued writes
+	auto submit() -> void;
+
+	/// @brief Reaps all completions and calls the completion functions
+	auto reap() -> void;
+
+	/// @brief Registers the buffers used for zero copy sends with a ring, if supported
+	static auto registerBuffers(Ring &ring) noexcept -> void;
+
+	/// @brief Makes an operation and its registered buffer, if any, available for reuse
+	auto releaseOperation(Operation &operation) -> void;
+
+	/// @brief The reactor
+	Reactor &_reactor;
+
+	/// @brief The io_uring instance, or nullptr if io_uring is not available
+	std::unique_ptr<Ring> _ring;
+	/// @brief The eventfd signalled by io_uring when completions are available, or -1 if not available
+	int _completionEvent { -1 };
+	/// @brief The registration of _completionEvent with the reactor
+	Reactor::Watch _completionWatch;
+
+	/// @brief A mutex protecting the submission queue, the free operations and the free registered buffers
+	std::mutex _mutex;
+	/// @brief Whether a call to submit() has already been posted to the reactor
+	bool _submitPending { false };
+	/// @brief All the operations that were ever created
+	std::vector<std::unique_ptr<Operation>> _operations;
+	/// @brief Operations that can be reused, so that writing does not allocate memory once enough operations exist
+	std::vector<Operation *> _freeOperations;
+};
+
+} // namespace xentara::plugins::templateUplink
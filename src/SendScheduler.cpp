@@ -0,0 +1,112 @@
+// Copyright (c) embedded ocean GmbH
+#include "SendScheduler.hpp"
+
+#include <algorithm>
+
+namespace xentara::plugins::templateUplink
+{
+
+SendScheduler::SendScheduler() noexcept
+{
+	// By default, each priority gets one share more than the one below it
+	for (std::size_t lane = 0; lane < _weights.size(); ++lane)
+	{
+		_weights[lane] = double(lane + 1);
+	}
+}
+
+auto SendScheduler::setWeight(Priority priority, double weight) noexcept -> void
+{
+	_weights[std::min<std::size_t>(priority, TrafficShaper::kMaxPriority)] = weight;
+}
+
+auto SendScheduler::acquire(Priority priority, std::size_t size) -> Slot
+{
+	const auto lane = std::min<std::size_t>(priority, TrafficShaper::kMaxPriority);
+	const auto waitStart = std::chrono::steady_clock::now();
+
+	std::unique_lock lock { _mutex };
+
+	// Wait for our turn
+	if (_busy || !preferred(lane))
+	{
+		++_waiting[lane];
+		_condition.wait(lock, [&] { return _parked || (!_busy && preferred(lane)); });
+		--_waiting[lane];
+
+		// Don't wait for a parked slot, as that may take a long time
+		if (_busy)
+		{
+			return { nullptr, std::chrono::steady_clock::now() - waitStart };
+		}
+	}
+
+	// Take the slot
+	_busy = true;
+
+	// Advance the virtual time
+	const auto start = startTag(lane);
+	_virtualTime = start;
+	_finishTags[lane] = start + double(size) / _weights[lane];
+
+	return { this, std::chrono::steady_clock::now() - waitStart };
+}
+
+auto SendScheduler::release() noexcept -> void
+{
+	{
+		std::scoped_lock lock { _mutex };
+		_busy = false;
+		_parked = false;
+	}
+
+	// Wake up all waiting transactions, so the preferred one can go. We have to wake up all of them, because we don't know which one is preferred.
+	_condition.notify_all();
+}
+
+auto SendScheduler::park(bool parked) noexcept -> void
+{
+	{
+		std::scoped_lock lock { _mutex };
+		_parked = parked;
+	}
+
+	// Wake up all waiting transactions, so they can give up
+	if (parked)
+	{
+		_condition.notify_all();
+	}
+}
+
+auto SendScheduler::preferred(std::size_t lane) const noexcept -> bool
+{
+	switch (_policy)
+	{
+	case Policy::StrictPriority:
+		// No one with a higher priority may be waiting
+		return std::all_of(_waiting.begin() + lane + 1, _waiting.end(), [](std::size_t count) { return count == 0; });
+
+	case Policy::WeightedFair:
+	default:
+		{
+			// No one with an earlier start tag may be waiting. Ties go to the higher priority
+			const auto ownTag = startTag(lane);
+			for (std::size_t other = 0; other < _waiting.size(); ++other)
+			{
+				if (other == lane || _waiting[other] == 0)
+				{
+					continue;
+				}
+
+				const auto otherTag = startTag(other);
+				if (otherTag < ownTag || (otherTag == ownTag && other > lane))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+	}
+}
+
+} // namespace xentara::plugins::templateUplink
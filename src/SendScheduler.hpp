@@ -0,0 +1,194 @@
+// Copyright (c) embedded ocean GmbH
+#pragma once
+
+#include "TrafficShaper.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+
+namespace xentara::plugins::templateUplink
+{
+
+/// @brief Arbitrates access to the connection of a client between the transactions that want to send data.
+///
+/// Only one transaction can send at a time. If several transactions are waiting, the next one is selected according to the
+/// configured policy, based on the priority of the transactions.
+///
+/// A transaction whose batch could only be written partially can park its slot. This keeps other transactions from writing
+/// into the middle of the batch, but does not make them wait: they get an empty slot instead, and must try again later.
+class SendScheduler final
+{
+public:
+	/// @brief The policy used to select the next transaction
+	enum class Policy
+	{
+		/// @brief Transactions with a higher priority always go first
+		StrictPriority,
+		/// @brief Each priority gets a share of the bandwidth proportional to its weight
+		WeightedFair
+	};
+
+	/// @brief Exclusive permission to send data using the connection.
+	///
+	/// The permission is returned to the scheduler when this object is destroyed.
+	class Slot final
+	{
+	public:
+		/// @brief Default constructor
+		Slot() noexcept = default;
+
+		/// @brief Move constructor
+		Slot(Slot &&other) noexcept :
+			_scheduler(std::exchange(other._scheduler, nullptr)), _waitTime(other._waitTime)
+		{
+		}
+
+		/// @brief Move assignment operator
+		auto operator=(Slot &&rhs) noexcept -> Slot &
+		{
+			if (this != &rhs)
+			{
+				reset();
+				_scheduler = std::exchange(rhs._scheduler, nullptr);
+				_waitTime = rhs._waitTime;
+			}
+			return *this;
+		}
+
+		/// @brief Destructor. Returns the permission to the scheduler.
+		~Slot()
+		{
+			reset();
+		}
+
+		/// @brief Returns the permission to the scheduler early
+		auto reset() noexcept -> void
+		{
+			if (auto scheduler = std::exchange(_scheduler, nullptr))
+			{
+				scheduler->release();
+			}
+		}
+
+		/// @brief Checks whether the slot holds a permission
+		explicit operator bool() const noexcept
+		{
+			return _scheduler != nullptr;
+		}
+
+		/// @brief Keeps the permission while the transaction is waiting for the connection to become ready.
+		///
+		/// Other transactions calling acquire() while the slot is parked will not wait, but will get an empty slot.
+		auto park() noexcept -> void
+		{
+			if (_scheduler)
+			{
+				_scheduler->park(true);
+			}
+		}
+
+		/// @brief Resumes using the permission after park() was called
+		auto unpark() noexcept -> void
+		{
+			if (_scheduler)
+			{
+				_scheduler->park(false);
+			}
+		}
+
+		/// @brief Gets the time the transaction had to wait for its turn
+		auto waitTime() const noexcept -> std::chrono::nanoseconds
+		{
+			return _waitTime;
+		}
+
+	private:
+		/// @brief Constructor used by the scheduler
+		Slot(SendScheduler *scheduler, std::chrono::nanoseconds waitTime) noexcept :
+			_scheduler(scheduler), _waitTime(waitTime)
+		{
+		}
+
+		/// @brief The scheduler, or nullptr if the slot is empty
+		SendScheduler *_scheduler { nullptr };
+		/// @brief The time the transaction had to wait
+		std::chrono::nanoseconds _waitTime { 0 };
+
+		friend class SendScheduler;
+	};
+
+	/// @brief Constructor
+	SendScheduler() noexcept;
+
+	/// @brief Gets the policy
+	auto policy() const noexcept -> Policy
+	{
+		return _policy;
+	}
+
+	/// @brief Sets the policy
+	/// @pre This function must not be called while any transactions are sending
+	auto setPolicy(Policy policy) noexcept -> void
+	{
+		_policy = policy;
+	}
+
+	/// @brief Sets the weight of a priority for the weighted fair policy
+	/// @pre This function must not be called while any transactions are sending
+	auto setWeight(Priority priority, double weight) noexcept -> void;
+
+	/// @brief Waits until it is the turn of a transaction to send.
+	///
+	/// This function blocks until no other transaction is sending, and no other transaction with precedence is waiting.
+	/// If another transaction has parked its slot, this function returns an empty slot instead.
+	///
+	/// @param priority The priority of the transaction
+	/// @param size The size of the data the transaction intends to send. This is used by the weighted fair policy.
+	auto acquire(Priority priority, std::size_t size) -> Slot;
+
+private:
+	/// @brief Returns the permission to send
+	auto release() noexcept -> void;
+
+	/// @brief Parks or unparks the current slot
+	auto park(bool parked) noexcept -> void;
+
+	/// @brief Checks whether a transaction with a specific priority may go next
+	/// @pre _mutex must be locked
+	auto preferred(std::size_t lane) const noexcept -> bool;
+
+	/// @brief Gets the virtual time at which the next data of a lane will start sending under the weighted fair policy
+	/// @pre _mutex must be locked
+	auto startTag(std::size_t lane) const noexcept -> double
+	{
+		return std::max(_finishTags[lane], _virtualTime);
+	}
+
+	/// @brief The policy
+	Policy _policy { Policy::StrictPriority };
+	/// @brief The weights for the weighted fair policy
+	std::array<double, TrafficShaper::kPriorityLevels> _weights;
+
+	/// @brief A mutex protecting the state
+	std::mutex _mutex;
+	/// @brief A condition variable used to wake up waiting transactions
+	std::condition_variable _condition;
+	/// @brief Whether a transaction is currently sending
+	bool _busy { false };
+	/// @brief Whether the current slot is parked
+	bool _parked { false };
+	/// @brief The number of transactions waiting in each lane
+	std::array<std::size_t, TrafficShaper::kPriorityLevels> _waiting {};
+
+	/// @brief The virtual time at which the data last sent for each lane finished, for the weighted fair policy
+	std::array<double, TrafficShaper::kPriorityLevels> _finishTags {};
+	/// @brief The current virtual time for the weighted fair policy
+	double _virtualTime { 0 };
+};
+
+} // namespace xentara::plugins::templateUplink
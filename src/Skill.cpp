@@ -14,7 +14,7 @@ auto Skill::createElement(const skill::Element::Class &elementClass, skill::Elem
 {
 	if (&elementClass == &TemplateClient::Class::instance())
 	{
-		return factory.makeShared<TemplateClient>();
+		return factory.makeShared<TemplateClient>(_reactor, _sendRing, _workerPool, _dataPointCache);
 	}
 
 	/// @todo handle any additional top-level microservice classes
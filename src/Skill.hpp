@@ -1,8 +1,12 @@
 // Copyright (c) embedded ocean GmbH
 #pragma once
 
+#include "DataPointCache.hpp"
+#include "Reactor.hpp"
+#include "SendRing.hpp"
 #include "TemplateClient.hpp"
 #include "TemplateTransaction.hpp"
+#include "WorkerPool.hpp"
 
 #include <xentara/skill/Skill.hpp>
 #include <xentara/utils/core/Uuid.hpp>
@@ -44,6 +48,15 @@ private:
 
 	/// @brief The skill class object
 	static Class _class;
+
+	/// @brief The I/O reactor shared by all clients
+	Reactor _reactor;
+	/// @brief The io_uring send ring shared by all clients
+	SendRing _sendRing { _reactor };
+	/// @brief The worker pool used to prepare the transactions in parallel
+	WorkerPool _workerPool;
+	/// @brief The data point cache shared by all transactions
+	DataPointCache _dataPointCache;
 };
 
 } // namespace xentara::plugins::templateUplink
\ No newline at end of file
@@ -0,0 +1,220 @@
+// Copyright (c) embedded ocean GmbH
+#include "Socket.hpp"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <system_error>
+
+#ifdef _WIN32
+#	include <WinSock2.h>
+#	include <WS2tcpip.h>
+#else
+#	include <errno.h>
+#	include <fcntl.h>
+#	include <netinet/in.h>
+#	include <netinet/tcp.h>
+#	include <sys/socket.h>
+#	include <sys/uio.h>
+#	include <unistd.h>
+#endif
+
+namespace xentara::plugins::templateUplink
+{
+
+namespace
+{
+
+	/// @brief Gets the error code for the last socket error
+	auto lastSocketError() noexcept -> std::error_code
+	{
+#ifdef _WIN32
+		return { WSAGetLastError(), std::system_category() };
+#else
+		return { errno, std::system_category() };
+#endif
+	}
+
+	/// @brief Sets an integer socket option
+	auto setOption(NativeSocket socket, int level, int option, int value) -> void
+	{
+#ifdef _WIN32
+		const auto result = ::setsockopt(SOCKET(socket), level, option, reinterpret_cast<const char *>(&value), sizeof(value));
+#else
+		const auto result = ::setsockopt(socket, level, option, &value, sizeof(value));
+#endif
+		if (result != 0)
+		{
+			throw std::system_error(lastSocketError(), "could not set socket option");
+		}
+	}
+
+	/// @brief The maximum number of buffers passed to the operating system in a single call
+	constexpr std::size_t kMaxBuffersPerWrite = 64;
+
+	/// @brief Checks whether an error signals that the socket is not ready for reading or writing
+	auto wouldBlock(const std::error_code &error) noexcept -> bool
+	{
+#ifdef _WIN32
+		return error.value() == WSAEWOULDBLOCK;
+#else
+		return error.value() == EAGAIN || error.value() == EWOULDBLOCK;
+#endif
+	}
+
+} // namespace
+
+auto Socket::close() noexcept -> void
+{
+	if (_socket == kInvalidSocket)
+	{
+		return;
+	}
+
+#ifdef _WIN32
+	::closesocket(SOCKET(_socket));
+#else
+	::close(_socket);
+#endif
+
+	_socket = kInvalidSocket;
+}
+
+auto Socket::setNonBlocking() const -> void
+{
+#ifdef _WIN32
+	u_long nonBlocking = 1;
+	if (::ioctlsocket(SOCKET(_socket), FIONBIO, &nonBlocking) != 0)
+	{
+		throw std::system_error(lastSocketError(), "could not put socket into non-blocking mode");
+	}
+#else
+	const auto flags = ::fcntl(_socket, F_GETFL);
+	if (flags < 0 || ::fcntl(_socket, F_SETFL, flags | O_NONBLOCK) < 0)
+	{
+		throw std::system_error(lastSocketError(), "could not put socket into non-blocking mode");
+	}
+#endif
+}
+
+auto Socket::writeSome(std::span<const std::span<const std::byte>> buffers) const -> std::optional<std::size_t>
+{
+	// Limit the number of buffers
+	const auto count = std::min(buffers.size(), kMaxBuffersPerWrite);
+
+#ifdef _WIN32
+	std::array<WSABUF, kMaxBuffersPerWrite> nativeBuffers;
+	for (std::size_t index = 0; index < count; ++index)
+	{
+		nativeBuffers[index].buf = const_cast<char *>(reinterpret_cast<const char *>(buffers[index].data()));
+		nativeBuffers[index].len = ULONG(buffers[index].size());
+	}
+
+	DWORD written = 0;
+	if (::WSASend(SOCKET(_socket), nativeBuffers.data(), DWORD(count), &written, 0, nullptr, nullptr) != 0)
+	{
+		const auto error = lastSocketError();
+		if (wouldBlock(error))
+		{
+			return std::nullopt;
+		}
+		throw std::system_error(error, "could not write to socket");
+	}
+
+	return std::size_t(written);
+#else
+	std::array<iovec, kMaxBuffersPerWrite> nativeBuffers;
+	for (std::size_t index = 0; index < count; ++index)
+	{
+		nativeBuffers[index].iov_base = const_cast<std::byte *>(buffers[index].data());
+		nativeBuffers[index].iov_len = buffers[index].size();
+	}
+
+	msghdr message {};
+	message.msg_iov = nativeBuffers.data();
+	message.msg_iovlen = decltype(message.msg_iovlen)(count);
+
+	// Don't raise SIGPIPE if the connection was closed, and never block, even if the socket is in blocking mode.
+#	ifdef MSG_NOSIGNAL
+	constexpr int kFlags = MSG_NOSIGNAL | MSG_DONTWAIT;
+#	else
+	constexpr int kFlags = MSG_DONTWAIT;
+#	endif
+
+	for (;;)
+	{
+		const auto written = ::sendmsg(_socket, &message, kFlags);
+		if (written >= 0)
+		{
+			return std::size_t(written);
+		}
+
+		const auto error = lastSocketError();
+		// Retry if we were interrupted by a signal
+		if (error.value() == EINTR)
+		{
+			continue;
+		}
+		if (wouldBlock(error))
+		{
+			return std::nullopt;
+		}
+		throw std::system_error(error, "could not write to socket");
+	}
+#endif
+}
+
+auto Socket::readSome(std::span<std::byte> buffer) const -> std::optional<std::size_t>
+{
+#ifdef _WIN32
+	const auto size = int(std::min<std::size_t>(buffer.size(), std::size_t(std::numeric_limits<int>::max())));
+	const auto received = ::recv(SOCKET(_socket), reinterpret_cast<char *>(buffer.data()), size, 0);
+	if (received == SOCKET_ERROR)
+	{
+		const auto error = lastSocketError();
+		if (wouldBlock(error))
+		{
+			return std::nullopt;
+		}
+		throw std::system_error(error, "could not read from socket");
+	}
+
+	return std::size_t(received);
+#else
+	for (;;)
+	{
+		// Never block, even if the socket is in blocking mode.
+		const auto received = ::recv(_socket, buffer.data(), buffer.size(), MSG_DONTWAIT);
+		if (received >= 0)
+		{
+			return std::size_t(received);
+		}
+
+		const auto error = lastSocketError();
+		// Retry if we were interrupted by a signal
+		if (error.value() == EINTR)
+		{
+			continue;
+		}
+		if (wouldBlock(error))
+		{
+			return std::nullopt;
+		}
+		throw std::system_error(error, "could not read from socket");
+	}
+#endif
+}
+
+auto Socket::setKeepAlive(const KeepAlive &keepAlive) const -> void
+{
+	setOption(_socket, SOL_SOCKET, SO_KEEPALIVE, 1);
+#ifdef __APPLE__
+	setOption(_socket, IPPROTO_TCP, TCP_KEEPALIVE, int(keepAlive._idleTime.count()));
+#else
+	setOption(_socket, IPPROTO_TCP, TCP_KEEPIDLE, int(keepAlive._idleTime.count()));
+#endif
+	setOption(_socket, IPPROTO_TCP, TCP_KEEPINTVL, int(keepAlive._interval.count()));
+	setOption(_socket, IPPROTO_TCP, TCP_KEEPCNT, keepAlive._probeCount);
+}
+
+} // namespace xentara::plugins::templateUplink
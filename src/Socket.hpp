@@ -0,0 +1,113 @@
+// Copyright (c) embedded ocean GmbH
+#pragma once
+
+#include <xentara/utils/tools/Unique.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <utility>
+
+namespace xentara::plugins::templateUplink
+{
+
+/// @brief The native socket type of the operating system
+#ifdef _WIN32
+using NativeSocket = std::uintptr_t;
+#else
+using NativeSocket = int;
+#endif
+
+/// @brief The value of an invalid native socket
+#ifdef _WIN32
+inline constexpr NativeSocket kInvalidSocket = ~NativeSocket(0);
+#else
+inline constexpr NativeSocket kInvalidSocket = -1;
+#endif
+
+/// @brief Settings for TCP keep-alive probes
+struct KeepAlive final
+{
+	/// @brief The time a connection must be idle before the first probe is sent
+	std::chrono::seconds _idleTime { 60 };
+	/// @brief The interval between probes
+	std::chrono::seconds _interval { 10 };
+	/// @brief The number of unanswered probes after which the connection is considered dead
+	int _probeCount { 3 };
+};
+
+/// @brief A class that owns a native socket, and closes it when it is destroyed
+class Socket final : private utils::tools::Unique
+{
+public:
+	/// @brief Default constructor. Creates an invalid socket.
+	Socket() noexcept = default;
+
+	/// @brief Constructor that takes ownership of a native socket
+	explicit Socket(NativeSocket socket) noexcept : _socket(socket)
+	{
+	}
+
+	/// @brief Move constructor
+	Socket(Socket &&other) noexcept : _socket(std::exchange(other._socket, kInvalidSocket))
+	{
+	}
+
+	/// @brief Move assignment operator
+	auto operator=(Socket &&rhs) noexcept -> Socket &
+	{
+		if (this != &rhs)
+		{
+			close();
+			_socket = std::exchange(rhs._socket, kInvalidSocket);
+		}
+		return *this;
+	}
+
+	/// @brief Destructor. Closes the socket.
+	~Socket()
+	{
+		close();
+	}
+
+	/// @brief Checks whether the socket is valid
+	explicit operator bool() const noexcept
+	{
+		return _socket != kInvalidSocket;
+	}
+
+	/// @brief Gets the native socket
+	auto native() const noexcept -> NativeSocket
+	{
+		return _socket;
+	}
+
+	/// @brief Closes the socket, ignoring any errors
+	auto close() noexcept -> void;
+
+	/// @brief Puts the socket into non-blocking mode
+	/// @throw std::system_error The mode could not be set
+	auto setNonBlocking() const -> void;
+
+	/// @brief Writes as much data as possible from a list of buffers without blocking.
+	/// @return The number of bytes written, or std::nullopt if the socket is not ready for writing
+	/// @throw std::system_error An error occurred
+	auto writeSome(std::span<const std::span<const std::byte>> buffers) const -> std::optional<std::size_t>;
+
+	/// @brief Reads as much data as is available without blocking.
+	/// @return The number of bytes read, 0 if the connection was closed by the peer, or std::nullopt if no data is available
+	/// @throw std::system_error An error occurred
+	auto readSome(std::span<std::byte> buffer) const -> std::optional<std::size_t>;
+
+	/// @brief Enables TCP keep-alive probes, so that dead connections are detected even if no data is being sent.
+	/// @throw std::system_error The options could not be set
+	auto setKeepAlive(const KeepAlive &keepAlive) const -> void;
+
+private:
+	/// @brief The native socket
+	NativeSocket _socket { kInvalidSocket };
+};
+
+} // namespace xentara::plugins::templateUplink
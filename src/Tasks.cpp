@@ -17,4 +17,16 @@ const process::Task::Role kCollect { "deadbeef-dead-beef-dead-beefdeadbeef"_uuid
 /// @todo assign a unique UUID
 const process::Task::Role kSend { "deadbeef-dead-beef-dead-beefdeadbeef"_uuid, "send"sv };
 
+/// @todo assign a unique UUID
+const process::Task::Role kCollectAndSend { "deadbeef-dead-beef-dead-beefdeadbeef"_uuid, "collectAndSend"sv };
+
+/// @todo assign a unique UUID
+const process::Task::Role kWrite { "deadbeef-dead-beef-dead-beefdeadbeef"_uuid, "write"sv };
+
+/// @todo assign a unique UUID
+const process::Task::Role kDumpFlightRecorder { "deadbeef-dead-beef-dead-beefdeadbeef"_uuid, "dumpFlightRecorder"sv };
+
+/// @todo assign a unique UUID
+const process::Task::Role kReloadRecords { "deadbeef-dead-beef-dead-beefdeadbeef"_uuid, "reloadRecords"sv };
+
 } // namespace xentara::plugins::templateUplink::tasks
\ No newline at end of file
@@ -12,4 +12,16 @@ extern const process::Task::Role kCollect;
 /// @brief A Xentara task used to send a transaction
 extern const process::Task::Role kSend;
 
+/// @brief A Xentara task used to collect records and send them right away, for transactions that need low latency
+extern const process::Task::Role kCollectAndSend;
+
+/// @brief A Xentara task used to write the values of commands received by a client
+extern const process::Task::Role kWrite;
+
+/// @brief A Xentara task used to dump the flight recorder of a client to a file
+extern const process::Task::Role kDumpFlightRecorder;
+
+/// @brief A Xentara task used to switch a transaction over to records staged while it is running
+extern const process::Task::Role kReloadRecords;
+
 } // namespace xentara::plugins::templateUplink::tasks
\ No newline at end of file
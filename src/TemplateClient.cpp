@@ -2,6 +2,7 @@
 #include "TemplateClient.hpp"
 
 #include "Attributes.hpp"
+#include "Tasks.hpp"
 #include "TemplateTransaction.hpp"
 
 #include <xentara/config/Errors.hpp>
@@ -19,26 +20,89 @@
 #include <xentara/utils/json/decoder/Errors.hpp>
 #include <xentara/utils/json/decoder/Object.hpp>
 
+#include <algorithm>
+#include <optional>
+#include <string>
 #include <string_view>
-
-#ifdef _WIN32
-#	include <Windows.h>
-#else
-#	include <errno.h>
-#endif
+#include <utility>
+#include <vector>
 
 namespace xentara::plugins::templateUplink
 {
 
 using namespace std::literals;
 
+TemplateClient::~TemplateClient()
+{
+	// Stop the reconnect timer first, because it starts connection jobs, and the connection jobs start it again
+	Reactor::TimerId reconnectTimer = 0;
+	{
+		std::scoped_lock lock { _reconnectTimerMutex };
+		_reconnectTimerStopped = true;
+		reconnectTimer = _reconnectTimer;
+	}
+	_reactor.cancel(reconnectTimer);
+
+	// The connection job uses this object, so we must wait for it to finish
+	std::scoped_lock lock { _connectionJobMutex };
+	if (_connectionJob.valid())
+	{
+		_connectionJob.wait();
+	}
+}
+
 auto TemplateClient::load(utils::json::decoder::Object &jsonObject, config::Context &context) -> void
 {
+	// The connection settings are collected here, and handed to the connection manager at the end
+	ConnectionManager::Config connectionConfig;
+
 	// Go through all the members of the JSON object that represents this object
 	for (auto && [name, value] : jsonObject)
     {
+		if (name == "trafficShaping"sv)
+		{
+			loadTrafficShaping(value);
+		}
+		else if (name == "scheduling"sv)
+		{
+			loadScheduling(value);
+		}
+		else if (name == "keepAlive"sv)
+		{
+			loadKeepAlive(value, connectionConfig);
+		}
+		else if (name == "warmStandby"sv)
+		{
+			connectionConfig._warmStandby = value.asBool();
+		}
+		else if (name == "realTimeMemory"sv)
+		{
+			_realTimeMemory = value.asBool();
+		}
+		else if (name == "endpoints"sv)
+		{
+			loadEndpoints(value, connectionConfig);
+		}
+		else if (name == "failover"sv)
+		{
+			loadFailover(value, connectionConfig);
+		}
+		else if (name == "flightRecorder"sv)
+		{
+			loadFlightRecorder(value);
+		}
+		else if (name == "commands"sv)
+		{
+			_commandReceiver.load(value, context);
+		}
+#ifdef TEMPLATE_UPLINK_FAULT_INJECTION
+		else if (name == "faultInjection"sv)
+		{
+			loadFaultInjection(value);
+		}
+#endif
 		/// @todo load configuration parameters
-		if (name == "TODO"sv)
+		else if (name == "TODO"sv)
 		{
 			/// @todo parse the value correctly
 			auto todo = value.asNumber<std::uint64_t>();
@@ -58,84 +122,555 @@ auto TemplateClient::load(utils::json::decoder::Object &jsonObject, config::Cont
 		}
     }
 
+	// We need something to connect to
+	if (connectionConfig._endpoints.empty())
+	{
+		utils::json::decoder::throwWithLocation(jsonObject, std::runtime_error("no endpoints specified for template client"));
+	}
+
 	/// @todo perform consistency and completeness checks
 	if (!"TODO")
 	{
 		/// @todo use an error message that tells the user exactly what is wrong
 		utils::json::decoder::throwWithLocation(jsonObject, std::runtime_error("TODO is wrong with template client"));
 	}
+
+	_connection.configure(std::move(connectionConfig));
+}
+
+auto TemplateClient::loadTrafficShaping(utils::json::decoder::Value &value) -> void
+{
+	// Interpret the value as an object
+	auto jsonObject = value.asObject();
+
+	// Go through all the members of the JSON object
+	double bytesPerSecond = 0;
+	std::optional<double> burstBytes;
+	double messagesPerSecond = 0;
+	std::optional<double> burstMessages;
+	for (auto && [name, value] : jsonObject)
+	{
+		// All the parameters are positive numbers
+		const auto number = value.asNumber<double>();
+		if (number <= 0)
+		{
+			utils::json::decoder::throwWithLocation(value,
+				std::runtime_error("traffic shaping parameters of template client must be greater than zero"));
+		}
+
+		if (name == "bytesPerSecond"sv)
+		{
+			bytesPerSecond = number;
+		}
+		else if (name == "burstBytes"sv)
+		{
+			burstBytes = number;
+		}
+		else if (name == "messagesPerSecond"sv)
+		{
+			messagesPerSecond = number;
+		}
+		else if (name == "burstMessages"sv)
+		{
+			burstMessages = number;
+		}
+		else
+		{
+			config::throwUnknownParameterError(name);
+		}
+	}
+
+	// A burst size without a rate makes no sense
+	if ((burstBytes && bytesPerSecond == 0) || (burstMessages && messagesPerSecond == 0))
+	{
+		utils::json::decoder::throwWithLocation(jsonObject,
+			std::runtime_error("burst size specified without corresponding rate in traffic shaping parameters of template client"));
+	}
+
+	// The burst size defaults to one second's worth of data
+	_trafficShaper.setByteRate(bytesPerSecond, burstBytes.value_or(bytesPerSecond));
+	_trafficShaper.setMessageRate(messagesPerSecond, burstMessages.value_or(messagesPerSecond));
+}
+
+auto TemplateClient::loadScheduling(utils::json::decoder::Value &value) -> void
+{
+	// Interpret the value as an object
+	auto jsonObject = value.asObject();
+
+	// Go through all the members of the JSON object
+	for (auto && [name, value] : jsonObject)
+	{
+		if (name == "policy"sv)
+		{
+			const auto policy = value.asString<std::string>();
+			if (policy == "strictPriority"sv)
+			{
+				_sendScheduler.setPolicy(SendScheduler::Policy::StrictPriority);
+			}
+			else if (policy == "weightedFair"sv)
+			{
+				_sendScheduler.setPolicy(SendScheduler::Policy::WeightedFair);
+			}
+			else
+			{
+				utils::json::decoder::throwWithLocation(value,
+					std::runtime_error("unknown scheduling policy for template client. Must be \"strictPriority\" or \"weightedFair\""));
+			}
+		}
+		else if (name == "weights"sv)
+		{
+			// The weights are given in order of priority, starting with priority 0
+			std::size_t priority = 0;
+			for (auto &&element : value.asArray())
+			{
+				if (priority > TrafficShaper::kMaxPriority)
+				{
+					utils::json::decoder::throwWithLocation(element, std::runtime_error("too many scheduling weights for template client"));
+				}
+
+				const auto weight = element.asNumber<double>();
+				if (weight <= 0)
+				{
+					utils::json::decoder::throwWithLocation(element, std::runtime_error("scheduling weights of template client must be greater than zero"));
+				}
+
+				_sendScheduler.setWeight(Priority(priority++), weight);
+			}
+		}
+		else
+		{
+			config::throwUnknownParameterError(name);
+		}
+	}
+
+	// With weighted fair scheduling, the traffic shaper must not let higher priorities starve lower ones
+	_trafficShaper.setStrictPriority(_sendScheduler.policy() == SendScheduler::Policy::StrictPriority);
 }
 
+auto TemplateClient::loadKeepAlive(utils::json::decoder::Value &value, ConnectionManager::Config &config) -> void
+{
+	// Interpret the value as an object
+	auto jsonObject = value.asObject();
+
+	// Go through all the members of the JSON object
+	KeepAlive keepAlive;
+	for (auto && [name, value] : jsonObject)
+	{
+		// All the parameters are positive integers
+		const auto number = value.asNumber<int>();
+		if (number <= 0)
+		{
+			utils::json::decoder::throwWithLocation(value,
+				std::runtime_error("keep-alive parameters of template client must be greater than zero"));
+		}
+
+		if (name == "idleTime"sv)
+		{
+			keepAlive._idleTime = std::chrono::seconds(number);
+		}
+		else if (name == "interval"sv)
+		{
+			keepAlive._interval = std::chrono::seconds(number);
+		}
+		else if (name == "probeCount"sv)
+		{
+			keepAlive._probeCount = number;
+		}
+		else
+		{
+			config::throwUnknownParameterError(name);
+		}
+	}
+
+	config._keepAlive = keepAlive;
+}
+
+auto TemplateClient::loadEndpoints(utils::json::decoder::Value &value, ConnectionManager::Config &config) -> void
+{
+	// The endpoints are given in order of preference, starting with the primary
+	for (auto &&element : value.asArray())
+	{
+		Endpoint endpoint;
+		bool hasPort = false;
+		for (auto && [name, value] : element.asObject())
+		{
+			if (name == "host"sv)
+			{
+				endpoint._host = value.asString<std::string>();
+				if (endpoint._host.empty())
+				{
+					utils::json::decoder::throwWithLocation(value, std::runtime_error("empty host name in endpoint of template client"));
+				}
+			}
+			else if (name == "port"sv)
+			{
+				const auto port = value.asNumber<std::uint64_t>();
+				if (port == 0 || port > 65535)
+				{
+					utils::json::decoder::throwWithLocation(value, std::runtime_error("invalid port in endpoint of template client"));
+				}
+				endpoint._port = std::uint16_t(port);
+				hasPort = true;
+			}
+			else
+			{
+				config::throwUnknownParameterError(name);
+			}
+		}
+
+		if (endpoint._host.empty() || !hasPort)
+		{
+			utils::json::decoder::throwWithLocation(element, std::runtime_error("endpoint of template client needs a host and a port"));
+		}
+
+		config._endpoints.push_back(std::move(endpoint));
+	}
+}
+
+auto TemplateClient::loadFailover(utils::json::decoder::Value &value, ConnectionManager::Config &config) -> void
+{
+	// Interpret the value as an object
+	auto jsonObject = value.asObject();
+
+	// Go through all the members of the JSON object
+	for (auto && [name, value] : jsonObject)
+	{
+		// All the parameters are given in milliseconds
+		const auto milliseconds = value.asNumber<std::int64_t>();
+		if (milliseconds < 0)
+		{
+			utils::json::decoder::throwWithLocation(value,
+				std::runtime_error("failover parameters of template client must not be negative"));
+		}
+
+		if (name == "attemptDelay"sv)
+		{
+			config._connectionRace._attemptDelay = std::chrono::milliseconds(milliseconds);
+		}
+		else if (name == "connectTimeout"sv)
+		{
+			if (milliseconds == 0)
+			{
+				utils::json::decoder::throwWithLocation(value, std::runtime_error("connect timeout of template client must not be zero"));
+			}
+			config._connectionRace._timeout = std::chrono::milliseconds(milliseconds);
+		}
+		else if (name == "failbackInterval"sv)
+		{
+			config._failbackInterval = std::chrono::milliseconds(milliseconds);
+		}
+		else
+		{
+			config::throwUnknownParameterError(name);
+		}
+	}
+}
+
+auto TemplateClient::loadFlightRecorder(utils::json::decoder::Value &value) -> void
+{
+	// Interpret the value as an object
+	auto jsonObject = value.asObject();
+
+	// Go through all the members of the JSON object
+	std::size_t capacity = 0;
+	for (auto && [name, value] : jsonObject)
+	{
+		if (name == "capacity"sv)
+		{
+			capacity = value.asNumber<std::size_t>();
+			if (capacity == 0)
+			{
+				utils::json::decoder::throwWithLocation(value, std::runtime_error("flight recorder capacity of template client must not be zero"));
+			}
+		}
+		else if (name == "file"sv)
+		{
+			_flightRecorderFile = value.asString<std::string>();
+		}
+		else
+		{
+			config::throwUnknownParameterError(name);
+		}
+	}
+
+	// Both parameters are required
+	if (capacity == 0 || _flightRecorderFile.empty())
+	{
+		utils::json::decoder::throwWithLocation(value, std::runtime_error("flight recorder of template client needs a capacity and a file"));
+	}
+
+	_flightRecorder.configure(capacity);
+}
+
+#ifdef TEMPLATE_UPLINK_FAULT_INJECTION
+auto TemplateClient::loadFaultInjection(utils::json::decoder::Value &value) -> void
+{
+	// Interpret the value as an object
+	auto jsonObject = value.asObject();
+
+	// Go through all the members of the JSON object
+	FaultInjector::Config config;
+	for (auto && [name, value] : jsonObject)
+	{
+		if (name == "seed"sv)
+		{
+			config._seed = value.asNumber<std::uint64_t>();
+		}
+		else if (name == "latency"sv)
+		{
+			// The latency is given in milliseconds
+			config._latency = std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::duration<double, std::milli>(value.asNumber<double>()));
+		}
+		else if (name == "bytesPerSecond"sv)
+		{
+			config._bytesPerSecond = value.asNumber<double>();
+		}
+		else if (name == "retransmissionDelay"sv)
+		{
+			// The retransmission delay is given in milliseconds
+			config._retransmissionDelay = std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::duration<double, std::milli>(value.asNumber<double>()));
+		}
+		else if (name == "connectionResetProbability"sv || name == "brokenPipeProbability"sv ||
+			name == "partialWriteProbability"sv || name == "packetLossProbability"sv)
+		{
+			const auto probability = value.asNumber<double>();
+			if (probability < 0 || probability > 1)
+			{
+				utils::json::decoder::throwWithLocation(value,
+					std::runtime_error("fault probabilities of template client must be between 0 and 1"));
+			}
+
+			if (name == "connectionResetProbability"sv)
+			{
+				config._connectionResetProbability = probability;
+			}
+			else if (name == "brokenPipeProbability"sv)
+			{
+				config._brokenPipeProbability = probability;
+			}
+			else if (name == "partialWriteProbability"sv)
+			{
+				config._partialWriteProbability = probability;
+			}
+			else
+			{
+				config._packetLossProbability = probability;
+			}
+		}
+		else
+		{
+			config::throwUnknownParameterError(name);
+		}
+	}
+
+	_faultInjector.configure(config);
+}
+#endif
+
 auto TemplateClient::performReconnectTask(const process::ExecutionContext &context) -> void
 {
 	// Only perform the reconnect if we are supposed to be connected in the first place
-	if (_connectionRequestCount.load(std::memory_order_relaxed) == 0)
+	if (!_connection.requested())
 	{
 		return;
 	}
-	// Also don't reconnect if we are already connected
-	if (_handle)
+	// Don't reconnect if we are already connected, but make sure we have a standby connection
+	if (connected())
 	{
+		_connection.prepareStandby();
+
+		// Check whether a more preferred endpoint is reachable again from time to time. This is done on the worker pool, so
+		// that an unreachable endpoint does not hold up the task.
+		if (_connection.failbackDue(std::chrono::steady_clock::now()))
+		{
+			scheduleConnectionJob([this] { _connection.failback(); });
+		}
 		return;
 	}
 
-	/// @todo check _lastError to see if a reconnect can succeed at all, and bail if it can't. A reconnect need not be attempted
-	// if it requires non-existent hardware, like a missing network adapter or I/O card, for example.
-	// see isConnectionError() for an example on how to check error codes.
-
 	// Attempt a connection
-	connect(context.scheduledTime());
+	_connection.connect(context.scheduledTime());
 }
 
-auto TemplateClient::connect(std::chrono::system_clock::time_point timeStamp) -> void
+auto TemplateClient::scheduleConnectionJob(std::function<void()> job) noexcept -> void
 {
+	std::scoped_lock lock { _connectionJobMutex };
+
+	// Only run one job at a time
+	if (_connectionJob.valid() && _connectionJob.wait_for(0s) != std::future_status::ready)
+	{
+		return;
+	}
+
 	try
 	{
-		/// @todo try to establish the connection, and set the _handle object
+		_connectionJob = _workerPool.submit(std::move(job));
+	}
+	catch (const std::exception &)
+	{
+		// The "reconnect" task will try again
+	}
+}
 
-		/// @todo if the connect function does not throw errors, but uses return types or internal handle state,
-		// throw an std::system_error here on failure, or call updateState() directly.
-		
-		// Note: If your connect function uses normal system error codes (errno on Linux or GetLastError() on Windows), you
-		// should create std::error_codes using std::system_category(). If you are using a library and/or protocol that provides
-		// its own error codes, you should define a custom error category.
+auto TemplateClient::scheduleReconnect(std::chrono::nanoseconds delay) noexcept -> void
+{
+	std::scoped_lock lock { _reconnectTimerMutex };
+	if (_reconnectTimerPending || _reconnectTimerStopped)
+	{
+		return;
+	}
 
-		// The connection was successful
-		updateState(timeStamp, std::error_code());
+	try
+	{
+		_reconnectTimer = _reactor.schedule(std::chrono::steady_clock::now() + delay, [this] { reconnectTimerExpired(); });
+		_reconnectTimerPending = true;
 	}
-	/// @todo if your connection function throws exceptions that are not derived from std::system_error, but that
-	// still provide some sort of error code, you should catch those exceptions separately and wrap the error code in a custom
-	// error category.
 	catch (const std::exception &)
 	{
-		// Get the error from the current exception using this special utility function
-		const auto error = utils::eh::currentErrorCode();
-		
-		// Update the state
-		updateState(timeStamp, error);
+		// The "reconnect" task will try again
+	}
+}
+
+auto TemplateClient::reconnectTimerExpired() noexcept -> void
+{
+	{
+		std::scoped_lock lock { _reconnectTimerMutex };
+		_reconnectTimerPending = false;
 	}
+
+	// Connecting can take a while, so it is done on the worker pool, and not on the reactor thread
+	scheduleConnectionJob([this] { _connection.connect(std::chrono::system_clock::now()); });
 }
 
-auto TemplateClient::disconnect(std::chrono::system_clock::time_point timeStamp) -> void
+auto TemplateClient::watchHandle() noexcept -> void
 {
-	// Reset the handle in any case, even if we fail, because the connection state should be false after this
-	auto handle = std::exchange(_handle, Handle());
+	const auto handle = this->handle();
+	if (!handle)
+	{
+		return;
+	}
+
+	// Discard any partial command message from the previous connection
+	_commandReceiver.reset();
 
-	/// @todo close the connection, ignoring any errors. If the disconnect function can throw exceptions,
-	// these shoudl be caucht and ignored.
+	try
+	{
+		auto watch = _reactor.watch(handle->socket(), [this](Reactor::Events events) { handleReady(events); });
+
+		std::scoped_lock lock { _writableMutex };
+		_handleWatch = std::move(watch);
+		armHandleWatch();
+	}
+	catch (const std::exception &)
+	{
+		// Without a watch, transactions simply retry unfinished writes in their next send cycle
+		/// @todo report that commands cannot be received
+	}
+}
+
+auto TemplateClient::unwatchHandle() noexcept -> void
+{
+	Reactor::Watch watch;
+	{
+		std::scoped_lock lock { _writableMutex };
+		watch = std::move(_handleWatch);
+		_writableCallback = nullptr;
+	}
 
-	// This is always a graceful disconnect, regardless of what happened, so never include an error code.
-	updateState(timeStamp, CustomError::NotConnected);
+	// Reset the watch without holding the lock, because this waits for handleReady() to finish
+	watch.reset();
 }
 
-auto TemplateClient::updateState(std::chrono::system_clock::time_point timeStamp, std::error_code error, const ErrorSink *excludeErrorSink)
-	-> void
+auto TemplateClient::notifyWhenWritable(std::function<void()> callback) -> bool
+{
+	std::scoped_lock lock { _writableMutex };
+	if (!_handleWatch)
+	{
+		return false;
+	}
+
+	_writableCallback = std::move(callback);
+	armHandleWatch();
+
+	return true;
+}
+
+auto TemplateClient::handleReady(Reactor::Events events) -> void
+{
+	// Receive commands. Errors are also handled here, so that a broken connection is detected even if nothing is being sent.
+	if (_commandReceiver.enabled() && (events & (Reactor::kReadable | Reactor::kError)) != 0)
+	{
+		try
+		{
+			// The reactor never runs us concurrently, so commands are only received on one thread at a time. The handle cannot be
+			// replaced while we are running, either, because that unregisters it from the reactor first.
+			if (const auto handle = this->handle())
+			{
+				_commandReceiver.receive(handle->socket());
+			}
+		}
+		catch (const std::exception &)
+		{
+			// This replaces the watch, so we must not arm it again
+			handleError(std::chrono::system_clock::now(), utils::eh::currentErrorCode(), connectionGeneration());
+			return;
+		}
+	}
+
+	// Take the callback if the connection is writable, as notifications are one-shot. Errors are also passed on, so that the
+	// next write can report them.
+	std::function<void()> callback;
+	if ((events & (Reactor::kWritable | Reactor::kError)) != 0)
+	{
+		std::scoped_lock lock { _writableMutex };
+		callback = std::exchange(_writableCallback, nullptr);
+	}
+
+	if (callback)
+	{
+		callback();
+	}
+
+	// Wait for more commands
+	if (_commandReceiver.enabled())
+	{
+		std::scoped_lock lock { _writableMutex };
+		armHandleWatch();
+	}
+}
+
+auto TemplateClient::armHandleWatch() -> void
+{
+	Reactor::Events events = 0;
+	if (_commandReceiver.enabled())
+	{
+		events |= Reactor::kReadable;
+	}
+	if (_writableCallback)
+	{
+		events |= Reactor::kWritable;
+	}
+
+	if (events != 0)
+	{
+		_handleWatch.arm(events);
+	}
+}
+
+auto TemplateClient::updateState(std::chrono::system_clock::time_point timeStamp,
+	std::error_code error,
+	std::uint64_t generation,
+	const ErrorSink *excludeErrorSink) -> void
 {
 	// First, check if anything changed
-	if (error == _lastError)
+	const auto errorChanged = error != _lastError;
+	if (!errorChanged && generation == _publishedGeneration)
 	{
 		return;
 	}
+	_flightRecorder.record(FlightEvent::StateChange, *this, FlightRecorder::Clock::now(), {}, generation, error);
 
 	// Get the old and new state
 	const auto wasConnected = !_lastError;
@@ -155,6 +690,15 @@ auto TemplateClient::updateState(std::chrono::system_clock::time_point timeStamp
 
 	// Update the error code
 	state._error = error;
+	_lastError = error;
+
+	// Update the generation
+	state._generation = generation;
+	_publishedGeneration = generation;
+
+	// Update the endpoint
+	state._activeEndpoint = _connection.activeEndpoint();
+	state._failoverCount = _connection.failoverCount();
 
 	// Collect the events to raise
 	process::StaticEventList<1> events;
@@ -170,8 +714,12 @@ auto TemplateClient::updateState(std::chrono::system_clock::time_point timeStamp
 	// Commit the data and raise the events
 	sentinel.commit(timeStamp, events);
 
-	// Notify all error sinks
-	for (auto &&sink : _errorSinks)
+	// Notify all error sinks, unless only the generation changed
+	if (!errorChanged)
+	{
+		return;
+	}
+	for (auto &&sink : _errorSinkArray)
 	{
 		if (&sink.get() != excludeErrorSink)
 		{
@@ -180,119 +728,187 @@ auto TemplateClient::updateState(std::chrono::system_clock::time_point timeStamp
 	}
 }
 
-auto TemplateClient::isConnectionError(std::error_code error) noexcept -> bool
+auto TemplateClient::acquireSendBudget(
+	TrafficShaper::Request &request, std::size_t size, std::chrono::system_clock::time_point timeStamp) -> bool
 {
-	/// @todo check if this error affects the connection as a whole, and bail if it doesn't.
-	// This function should return true on errors that signal that the entire client has stopped working,
-	// like timeouts and network errors, and false on errors thst only affect some inputs and/or outputs, such as
-	// unknown input or output, type mismatch, range errors etc.
+	// If no limits were configured, everything may be sent right away
+	if (!_trafficShaper.enabled())
+	{
+		return true;
+	}
 
-	// Example code suitable for socket errors:
+	std::scoped_lock lock { _trafficShaperMutex };
 
-	// Check system errors
-	if (error.category() == std::system_category())
-	{
-		switch (error.value())
-		{
-	#ifdef _WIN32
-		case WSAEBADF:
-		case WSAENOTSOCK:
-		case ERROR_INVALID_HANDLE:
-		case WSAECONNRESET:
-		case WSAECONNABORTED:
-		case WSAENETRESET:
-		case WSAESHUTDOWN:
-		case WSAENETUNREACH:
-		case WSAEHOSTUNREACH:
-		case WSAEHOSTDOWN:
-		case WSAENOTCONN:
-		case ERROR_BROKEN_PIPE:
-	#else // _WIN32
-		case EBADF:
-		case ECONNRESET:
-		case ECONNABORTED:
-		case ENETRESET:
-		case ESHUTDOWN:
-		case ENETUNREACH:
-		case EHOSTUNREACH:
-		case EHOSTDOWN:
-		case ENOTCONN:
-		case EPIPE:
-	#endif // _WIN32
-			return true;
+	// Ask the traffic shaper
+	const auto wasQueued = request.queued();
+	const auto granted = _trafficShaper.tryAcquire(request, size, timeStamp);
 
-		default:
-			return false;
-		}
+	// Publish the statistics if the queue changed
+	if (request.queued() != wasQueued)
+	{
+		updateTrafficState(timeStamp);
 	}
 
-	// Check custom errors:
-	if (error.category() == customErrorCategory())
+	return granted;
+}
+
+auto TemplateClient::cancelSendRequest(TrafficShaper::Request &request, std::chrono::system_clock::time_point timeStamp) -> void
+{
+	// Only queued requests need to be cancelled
+	if (!request.queued())
 	{
-		switch (CustomError(error.value()))
-		{
-		case CustomError::NotConnected:
-		case CustomError::UnknownError:
-			/// @todo add case statements for other relevant custom errors (like e.g. timeout) here
-			return true;
+		return;
+	}
 
-		case CustomError::NoError:
-		case CustomError::Pending:
-		default:
-			return false;
-		}
+	std::scoped_lock lock { _trafficShaperMutex };
+
+	_trafficShaper.cancel(request, timeStamp);
+	updateTrafficState(timeStamp);
+}
+
+auto TemplateClient::write(const Handle &handle, std::span<const std::span<const std::byte>> buffers)
+	-> std::optional<std::size_t>
+{
+#ifdef TEMPLATE_UPLINK_FAULT_INJECTION
+	// Simulate network faults for testing. Only part of the data is written if a partial write is simulated.
+	if (_faultInjector.enabled())
+	{
+		std::vector<std::span<const std::byte>> truncated;
+		return handle.socket().writeSome(_faultInjector.truncate(buffers, truncated));
 	}
+#endif
 
-	// No other categories need apply
-	else
+	/// @todo if the service instance uses TLS, write the data through the TLS session instead
+	return handle.socket().writeSome(buffers);
+}
+
+auto TemplateClient::writeAsync(const std::shared_ptr<const Handle> &handle,
+	std::span<const std::span<const std::byte>> buffers,
+	SendRing::Completion completion) -> bool
+{
+#ifdef TEMPLATE_UPLINK_FAULT_INJECTION
+	// Simulated faults are injected by write(), so we must not bypass it
+	if (_faultInjector.enabled())
 	{
 		return false;
 	}
+#endif
+
+	/// @todo if the service instance uses TLS, return false here, as the data must be written through the TLS session
+	// The send ring keeps the handle open until the write completes, so that its descriptor cannot be reused in the meantime
+	return _sendRing.write(std::shared_ptr<const Socket>(handle, &handle->socket()), buffers, std::move(completion));
 }
 
-auto TemplateClient::requestConnect(std::chrono::system_clock::time_point timeStamp) noexcept -> void
+auto TemplateClient::updateTrafficState(std::chrono::system_clock::time_point timeStamp) -> void
 {
-	// increment the count
-	const auto oldCount = _connectionRequestCount++;
+	// Make a write sentinel
+	memory::WriteSentinel sentinel { _trafficStateDataBlock };
+	auto &state = *sentinel;
+
+	// Update the state
+	state._throttleTime = std::chrono::duration<double>(_trafficShaper.throttleTime()).count();
+	state._queueDepth = _trafficShaper.queueDepth();
+
+	// Commit the data
+	sentinel.commit(timeStamp);
+}
 
-	// connect if the old count was 0
-	if (oldCount == 0)
+auto TemplateClient::updateCommandState(std::chrono::system_clock::time_point timeStamp) -> void
+{
+	// Only publish the statistics if they have changed, as they normally stay at zero
+	const CommandState current { _commandReceiver.droppedCommands(), _commandReceiver.hotPathAllocations() };
+	if (current == _publishedCommandState)
 	{
-		connect(timeStamp);
+		return;
 	}
+	_publishedCommandState = current;
+
+	// Make a write sentinel
+	memory::WriteSentinel sentinel { _commandStateDataBlock };
+	auto &state = *sentinel;
+
+	// Update the state
+	state = current;
+
+	// Commit the data
+	sentinel.commit(timeStamp);
+}
+
+auto TemplateClient::requestConnect(std::chrono::system_clock::time_point timeStamp) noexcept -> void
+{
+	_connection.requestConnect(timeStamp);
 }
 
 auto TemplateClient::requestDisconnect(std::chrono::system_clock::time_point timeStamp) noexcept -> void
 {
-	// decrement the count
-	const auto newCount = --_connectionRequestCount;
+	_connection.requestDisconnect(timeStamp);
+}
 
-	// disconnect if the new count is 0
-	if (newCount == 0)
-	{
-		disconnect(timeStamp);
-	}
+auto TemplateClient::handleError(std::chrono::system_clock::time_point timeStamp,
+	std::error_code error,
+	std::uint64_t generation,
+	const ErrorSink *sender) noexcept -> void
+{
+	_connection.handleError(timeStamp, error, generation, sender);
 }
 
-auto TemplateClient::handleError(std::chrono::system_clock::time_point timeStamp, std::error_code error, const ErrorSink *sender) noexcept -> void
+auto TemplateClient::connectionAttempted(
+	std::chrono::steady_clock::time_point start, std::size_t endpoint, std::error_code error) noexcept -> void
 {
-	// Ignore any new errors if we already have an error (the first error always wins).
-	if (_lastError)
+	_flightRecorder.record(FlightEvent::Connect, *this, start, FlightRecorder::Clock::now() - start, endpoint, error);
+
+	// Back off exponentially while the connection keeps failing. Failed attempts to open a standby connection or to fail back
+	// don't count, because the client is still connected.
+	std::chrono::nanoseconds delay { 0 };
 	{
-		return;
+		std::scoped_lock lock { _reconnectTimerMutex };
+		if (!error)
+		{
+			_reconnectDelay = kMinReconnectDelay;
+			return;
+		}
+		if (!_connection.requested() || _connection.connected())
+		{
+			return;
+		}
+		delay = _reconnectDelay;
+		_reconnectDelay = std::min<std::chrono::nanoseconds>(_reconnectDelay * 2, kMaxReconnectDelay);
 	}
-	// Check if this error affects the connection as a whole, and bail if it doesn't. This function shoudl
-	if (!isConnectionError(error))
+	scheduleReconnect(delay);
+}
+
+auto TemplateClient::connectionErrorReported(std::error_code error, std::uint64_t generation) noexcept -> void
+{
+	_flightRecorder.record(FlightEvent::ClientError, *this, FlightRecorder::Clock::now(), {}, generation, error);
+}
+
+auto TemplateClient::releasingHandle() noexcept -> void
+{
+	unwatchHandle();
+}
+
+auto TemplateClient::handlePublished(const Handle &handle, bool failover) noexcept -> void
+{
+	if (failover)
 	{
-		return;
+		_flightRecorder.record(FlightEvent::Failover, *this, FlightRecorder::Clock::now(), {}, handle.endpoint());
 	}
+	watchHandle();
+}
 
-	// Reset the handle
-	/// @todo gracefully close the handle, if this is necessary
-	_handle = Handle();
+auto TemplateClient::stateChanged(std::chrono::system_clock::time_point timeStamp,
+	std::error_code error,
+	std::uint64_t generation,
+	const void *origin) -> void
+{
+	// The origin is always the error sink that was passed to handleError()
+	updateState(timeStamp, error, generation, static_cast<const ErrorSink *>(origin));
+}
 
-	// update the error state
-	updateState(timeStamp, error, sender);
+auto TemplateClient::reconnectRequested() noexcept -> void
+{
+	// Try the other endpoints right away
+	scheduleReconnect(std::chrono::nanoseconds::zero());
 }
 
 auto TemplateClient::createChildElement(const skill::Element::Class &elementClass, skill::ElementFactory &factory)
@@ -314,7 +930,14 @@ auto TemplateClient::forEachAttribute(const model::ForEachAttributeFunction &fun
 	return
 		function(attributes::kConnectionState) ||
 		function(attributes::kConnectionTime) ||
-		function(attributes::kError);
+		function(attributes::kError) ||
+		function(attributes::kConnectionGeneration) ||
+		function(attributes::kActiveEndpoint) ||
+		function(attributes::kFailoverCount) ||
+		function(attributes::kThrottleTime) ||
+		function(attributes::kQueueDepth) ||
+		function(attributes::kDroppedCommands) ||
+		function(attributes::kHotPathAllocations);
 }
 
 auto TemplateClient::forEachEvent(const model::ForEachEventFunction &function) -> bool
@@ -331,7 +954,9 @@ auto TemplateClient::forEachTask(const model::ForEachTaskFunction &function) ->
 {
 	// Handle all the tasks we support
 	return
-		function(process::Task::kReconnect, sharedFromThis(&_reconnectTask));
+		function(process::Task::kReconnect, sharedFromThis(&_reconnectTask)) ||
+		function(tasks::kWrite, sharedFromThis(&_writeTask)) ||
+		function(tasks::kDumpFlightRecorder, sharedFromThis(&_dumpFlightRecorderTask));
 
 	/// @todo handle any additional tasks this class supports
 }
@@ -351,6 +976,34 @@ auto TemplateClient::makeReadHandle(const model::Attribute &attribute) const noe
 	{
 		return _stateDataBlock.member(&State::_error);
 	}
+	else if (attribute == attributes::kConnectionGeneration)
+	{
+		return _stateDataBlock.member(&State::_generation);
+	}
+	else if (attribute == attributes::kActiveEndpoint)
+	{
+		return _stateDataBlock.member(&State::_activeEndpoint);
+	}
+	else if (attribute == attributes::kFailoverCount)
+	{
+		return _stateDataBlock.member(&State::_failoverCount);
+	}
+	else if (attribute == attributes::kThrottleTime)
+	{
+		return _trafficStateDataBlock.member(&TrafficState::_throttleTime);
+	}
+	else if (attribute == attributes::kQueueDepth)
+	{
+		return _trafficStateDataBlock.member(&TrafficState::_queueDepth);
+	}
+	else if (attribute == attributes::kDroppedCommands)
+	{
+		return _commandStateDataBlock.member(&CommandState::_droppedCommands);
+	}
+	else if (attribute == attributes::kHotPathAllocations)
+	{
+		return _commandStateDataBlock.member(&CommandState::_hotPathAllocations);
+	}
 
 	/// @todo add support for any additional attributes
 
@@ -360,8 +1013,26 @@ auto TemplateClient::makeReadHandle(const model::Attribute &attribute) const noe
 
 auto TemplateClient::realize() -> void
 {
-	// Create the data block
+	// Create the data blocks
 	_stateDataBlock.create(memory::memoryResources::data());
+	_trafficStateDataBlock.create(memory::memoryResources::data());
+	_commandStateDataBlock.create(memory::memoryResources::data());
+
+	// Allocate the receive buffers up front, so that receiving commands does not cause page faults
+	if (_realTimeMemory)
+	{
+		_commandReceiver.preallocate();
+	}
+}
+
+auto TemplateClient::prepare() -> void
+{
+	// Freeze the error sinks, so they can be accessed from any thread without locking
+	_errorSinkArray.assign(_errorSinks.begin(), _errorSinks.end());
+	_errorSinks.clear();
+
+	// Resolve the handles of the commands
+	_commandReceiver.prepare();
 }
 
 auto TemplateClient::ReconnectTask::preparePreOperational(const process::ExecutionContext &context) -> Status
@@ -394,4 +1065,26 @@ auto TemplateClient::ReconnectTask::preparePostOperational(const process::Execut
 	return Status::Completed;
 }
 
-} // namespace xentara::plugins::templateUplink
\ No newline at end of file
+auto TemplateClient::WriteTask::operational(const process::ExecutionContext &context) -> void
+{
+	// Write the commands received since the last cycle
+	auto &client = _target.get();
+	client._commandReceiver.applyPending();
+
+	// Publish any dropped commands or allocations
+	client.updateCommandState(context.scheduledTime());
+}
+
+auto TemplateClient::DumpFlightRecorderTask::operational([[maybe_unused]] const process::ExecutionContext &context) -> void
+{
+	auto &client = _target.get();
+	if (!client._flightRecorder.enabled())
+	{
+		return;
+	}
+
+	// If the file cannot be written, the exception is passed on to the scheduler, which reports the task as failed
+	client._flightRecorder.dump(client._flightRecorderFile);
+}
+
+} // namespace xentara::plugins::templateUplink
@@ -2,7 +2,22 @@
 #pragma once
 
 #include "Attributes.hpp"
+#include "CommandReceiver.hpp"
+#include "ConnectionManager.hpp"
+#include "ConnectionState.hpp"
 #include "CustomError.hpp"
+#include "DataPointCache.hpp"
+#include "Endpoint.hpp"
+#ifdef TEMPLATE_UPLINK_FAULT_INJECTION
+#	include "FaultInjector.hpp"
+#endif
+#include "FlightRecorder.hpp"
+#include "Reactor.hpp"
+#include "SendRing.hpp"
+#include "SendScheduler.hpp"
+#include "Socket.hpp"
+#include "TrafficShaper.hpp"
+#include "WorkerPool.hpp"
 
 #include <xentara/memory/ObjectBlock.hpp>
 #include <xentara/model/ElementCategory.hpp>
@@ -11,11 +26,20 @@
 #include <xentara/skill/Element.hpp>
 #include <xentara/skill/EnableSharedFromThis.hpp>
 #include <xentara/utils/core/Uuid.hpp>
+#include <xentara/utils/json/decoder/Value.hpp>
 #include <xentara/utils/tools/Unique.hpp>
 
+#include <atomic>
+#include <filesystem>
 #include <string_view>
 #include <functional>
 #include <forward_list>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <vector>
 
 namespace xentara::plugins::templateUplink
 {
@@ -24,7 +48,10 @@ using namespace std::literals;
 
 /// @brief A class representing a client for specific type of service that data can be sent to.
 /// @todo rename this class to something more descriptive
-class TemplateClient final : public skill::Element, public skill::EnableSharedFromThis<TemplateClient>
+class TemplateClient final :
+	public skill::Element,
+	public skill::EnableSharedFromThis<TemplateClient>,
+	private ConnectionManager::Listener
 {
 public:
 	/// @brief The class object containing meta-information about this element type
@@ -34,18 +61,21 @@ public:
 	using Class =
 		ConcreteClass<"TemplateClient", "deadbeef-dead-beef-dead-beefdeadbeef"_uuid, "template uplink client">;
 
-	/// @brief A handle used to access the client
-	/// @todo implement a proper handle
-	class Handle final : private utils::tools::Unique
+	/// @brief Constructor
+	/// @param reactor The I/O reactor of the skill, used to wait for the connection to become ready, and for timers
+	/// @param sendRing The send ring of the skill, used to write data asynchronously
+	/// @param workerPool The worker pool of the skill, used by the transactions to prepare in parallel
+	/// @param dataPointCache The data point cache of the skill, used by the transactions to resolve their handles
+	TemplateClient(Reactor &reactor, SendRing &sendRing, WorkerPool &workerPool, DataPointCache &dataPointCache) noexcept :
+		_reactor(reactor), _sendRing(sendRing), _workerPool(workerPool), _dataPointCache(dataPointCache)
 	{
-	public:
-		// determines of the client is connected
-		explicit operator bool() const noexcept
-		{
-			/// @todo return the actual state
-			return false;
-		}
-	};
+	}
+
+	/// @brief Destructor. Cancels the reconnect timer, and waits for any connection attempt still running on the worker pool.
+	~TemplateClient();
+
+	/// @brief A handle used to access the client
+	using Handle = ConnectionManager::Handle;
 
 	// Interface for objects that want to be notified of errors
 	class ErrorSink
@@ -70,6 +100,7 @@ public:
 	};
 
 	/// @brief Adds an error sink
+	/// @pre This function must only be called while the model is being loaded, before prepare() is called.
 	auto addErrorSink(std::reference_wrapper<ErrorSink> sink)
 	{
 		_errorSinks.push_front(sink);
@@ -97,20 +128,125 @@ public:
 	/// 
 	/// If this error affects the client as a whole, error sinks will be notified. If the sender is an error sink itself,
 	/// and does not which to be notified, but intends to handle the error itself instead, it can pass a pointer to itself as the sender parameter. 
-	auto handleError(std::chrono::system_clock::time_point timeStamp, std::error_code error, const ErrorSink *sender = nullptr) noexcept -> void;
+	///
+	/// The error is ignored if it belongs to an older connection, i.e. if the connection was reestablished since the
+	/// request that failed was sent.
+	///
+	/// @param generation The connection generation the failed request was sent on, as returned by connectionGeneration()
+	auto handleError(std::chrono::system_clock::time_point timeStamp,
+		std::error_code error,
+		std::uint64_t generation,
+		const ErrorSink *sender = nullptr) noexcept -> void;
 
-	/// @brief Checks whether the client is up
-	auto connected() const -> bool
+	/// @brief Waits until it is the turn of a transaction to use the connection.
+	///
+	/// The transaction may send data until the returned slot is destroyed.
+	auto acquireSendSlot(Priority priority, std::size_t size) -> SendScheduler::Slot
 	{
-		return bool(_handle);
+		return _sendScheduler.acquire(priority, size);
 	}
 
-	/// @brief Returns a handle to the client
-	auto handle() const -> const Handle &
+	/// @brief Asks the traffic shaper for permission to send a message.
+	///
+	/// If this function returns false, the message must not be sent yet, and the caller must try again later using the same
+	/// request object. If the caller discards the message instead, it must call cancelSendRequest().
+	auto acquireSendBudget(TrafficShaper::Request &request, std::size_t size, std::chrono::system_clock::time_point timeStamp) -> bool;
+
+	/// @brief Withdraws a request previously rejected by acquireSendBudget()
+	auto cancelSendRequest(TrafficShaper::Request &request, std::chrono::system_clock::time_point timeStamp) -> void;
+
+	/// @brief Checks whether the client is up.
+	///
+	/// This function is wait-free, and can be called from any thread.
+	auto connected() const noexcept -> bool
 	{
-		return _handle;
+		return connectionState().connected();
 	}
 
+	/// @brief Writes as much data as possible to the connection without blocking.
+	///
+	/// The caller must hold a slot from acquireSendSlot().
+	///
+	/// @param handle The connection to write to, as pinned using handle()
+	/// @return The number of bytes written, or std::nullopt if the connection is not ready for writing
+	/// @throw std::system_error An error occurred
+	auto write(const Handle &handle, std::span<const std::span<const std::byte>> buffers) -> std::optional<std::size_t>;
+
+	/// @brief Writes data to the connection asynchronously using the send ring of the skill.
+	///
+	/// The write is submitted to the kernel together with the writes of other transactions and clients. Just like write(),
+	/// this only writes as much data as the connection will take without blocking. The caller must hold a slot from
+	/// acquireSendSlot(), and keep the slot and the data alive until the completion function has been called. The handle is
+	/// kept open until then.
+	///
+	/// @param handle The connection to write to, as pinned using handle()
+	/// @return Returns false if asynchronous writes are not available, in which case the caller must use write() instead.
+	/// @throw std::system_error The write could not be queued
+	auto writeAsync(const std::shared_ptr<const Handle> &handle,
+		std::span<const std::span<const std::byte>> buffers,
+		SendRing::Completion completion) -> bool;
+
+	/// @brief Requests that a function be called when the connection becomes ready for writing again.
+	///
+	/// This is used after write() returned std::nullopt. Only a single function can be pending at a time. The function is
+	/// called on a thread of the I/O reactor, and is discarded if the connection is replaced before it becomes ready.
+	///
+	/// @return Returns false if notifications are not available, in which case the caller must retry the write itself.
+	auto notifyWhenWritable(std::function<void()> callback) -> bool;
+
+	/// @brief Gets the generation of the current connection.
+	///
+	/// The generation is incremented every time a connection is established. Requests should remember the generation they
+	/// were sent on, so that late results from an older connection can be recognized and discarded.
+	auto connectionGeneration() const noexcept -> std::uint64_t
+	{
+		return connectionState().generation();
+	}
+
+	/// @brief Pins the current handle to the client
+	///
+	/// The handle may be replaced by another thread at any time, e.g. when failing over to a standby connection. The returned
+	/// handle stays open as long as the pointer is held, so that writes never go to a closed socket, or to another connection
+	/// that was given the same descriptor. Check Handle::generation() to find out if the handle has been replaced since.
+	///
+	/// @return The current handle, or nullptr if the client is not connected
+	auto handle() const noexcept -> std::shared_ptr<const Handle>
+	{
+		return _connection.handle();
+	}
+
+	/// @brief Gets the I/O reactor of the skill, which the transactions also use for their timers
+	auto reactor() const noexcept -> Reactor &
+	{
+		return _reactor;
+	}
+
+	/// @brief Gets the worker pool of the skill
+	auto workerPool() const noexcept -> WorkerPool &
+	{
+		return _workerPool;
+	}
+
+	/// @brief Gets the data point cache of the skill
+	auto dataPointCache() const noexcept -> DataPointCache &
+	{
+		return _dataPointCache;
+	}
+
+	/// @brief Gets the flight recorder, which the transactions also record their events in
+	auto flightRecorder() noexcept -> FlightRecorder &
+	{
+		return _flightRecorder;
+	}
+
+#ifdef TEMPLATE_UPLINK_FAULT_INJECTION
+	/// @brief Gets the fault injector used to simulate network faults for testing
+	auto faultInjector() noexcept -> FaultInjector &
+	{
+		return _faultInjector;
+	}
+#endif
+
 	/// @name Virtual Overrides for skill::Element
 	/// @{
 
@@ -142,6 +278,33 @@ private:
 		std::chrono::system_clock::time_point _connectionTime { std::chrono::system_clock::time_point::min() };
 		/// @brief The error code when connecting, or a default constructed std::error_code object for none.
 		std::error_code _error { CustomError::NotConnected };
+		/// @brief The generation of the current or last connection
+		std::uint64_t _generation { 0 };
+		/// @brief The index of the endpoint of the current or last connection
+		std::uint64_t _activeEndpoint { 0 };
+		/// @brief The number of times the client has switched to a different endpoint
+		std::uint64_t _failoverCount { 0 };
+	};
+
+	/// @brief This structure represents the current state of the traffic shaper
+	struct TrafficState
+	{
+		/// @brief The total time transactions have been held back, in seconds
+		double _throttleTime { 0 };
+		/// @brief The number of transactions currently waiting to be sent
+		std::uint64_t _queueDepth { 0 };
+	};
+
+	/// @brief This structure represents the current state of the command receiver
+	struct CommandState
+	{
+		/// @brief The number of commands dropped because the command queue was full
+		std::uint64_t _droppedCommands { 0 };
+		/// @brief The number of times the command queues had to grow in real-time memory mode
+		std::uint64_t _hotPathAllocations { 0 };
+
+		/// @brief Compares two states
+		auto operator==(const CommandState &) const noexcept -> bool = default;
 	};
 
 	/// @brief This class providing callbacks for the Xentara scheduler for the "reconnect" task
@@ -176,26 +339,115 @@ private:
 		std::reference_wrapper<TemplateClient> _target;
 	};
 	
+	/// @brief This class providing callbacks for the Xentara scheduler for the "write" task
+	class WriteTask final : public process::Task
+	{
+	public:
+		/// @brief This constuctor attached the task to its target
+		WriteTask(std::reference_wrapper<TemplateClient> target) : _target(target)
+		{
+		}
+
+		/// @name Virtual Overrides for process::Task
+		/// @{
+
+		auto operational(const process::ExecutionContext &context) -> void final;
+
+		/// @}
+
+	private:
+		/// @brief A reference to the target element
+		std::reference_wrapper<TemplateClient> _target;
+	};
+
+	/// @brief This class providing callbacks for the Xentara scheduler for the "dumpFlightRecorder" task
+	class DumpFlightRecorderTask final : public process::Task
+	{
+	public:
+		/// @brief This constuctor attached the task to its target
+		DumpFlightRecorderTask(std::reference_wrapper<TemplateClient> target) : _target(target)
+		{
+		}
+
+		/// @name Virtual Overrides for process::Task
+		/// @{
+
+		auto operational(const process::ExecutionContext &context) -> void final;
+
+		/// @}
+
+	private:
+		/// @brief A reference to the target element
+		std::reference_wrapper<TemplateClient> _target;
+	};
+
 	/// @brief This function is called by the "reconnect" task.
 	///
 	/// This function attempts to reconnect any disconnected I/O components.
 	auto performReconnectTask(const process::ExecutionContext &context) -> void;
 
-	/// @brief Attempts to establish a connection to the client and updates the state accordingly.
-	///
-	/// This function will notify error sinks if anything changes.
-	auto connect(std::chrono::system_clock::time_point timeStamp) -> void;
+	/// @brief Runs a connection attempt on the worker pool, unless one is already running
+	auto scheduleConnectionJob(std::function<void()> job) noexcept -> void;
 
-	/// @brief Terminates the connection to the client and updates the state accordingly.
-	///
-	/// This function will notify error sinks if anything changes.
-	auto disconnect(std::chrono::system_clock::time_point timeStamp) -> void;
+	/// @brief Starts the reconnect timer, unless it is already running or has been stopped
+	/// @param delay The time to wait before attempting to reconnect
+	auto scheduleReconnect(std::chrono::nanoseconds delay) noexcept -> void;
+	/// @brief Called on a reactor thread when the reconnect timer expires
+	auto reconnectTimerExpired() noexcept -> void;
 
-	/// @brief Updates the state and sends events
-	auto updateState(std::chrono::system_clock::time_point timeStamp, std::error_code error, const ErrorSink *excludeErrorSink = nullptr) -> void;
+	/// @brief Registers the current handle with the I/O reactor
+	/// @pre The caller must own the connection state
+	auto watchHandle() noexcept -> void;
+
+	/// @brief Unregisters the current handle from the I/O reactor. This must be done before the handle is closed or replaced.
+	/// @pre The caller must own the connection state
+	auto unwatchHandle() noexcept -> void;
+
+	/// @brief Called by the I/O reactor when the connection becomes ready
+	auto handleReady(Reactor::Events events) -> void;
 
-	/// @brief Checks whether an error is the result of a lost connection
-	static auto isConnectionError(std::error_code error) noexcept -> bool;
+	/// @brief Arms the watch of the current handle for the events we are currently interested in
+	/// @pre The caller must hold _writableMutex
+	auto armHandleWatch() -> void;
+
+	/// @brief Gets the current connection state
+	auto connectionState() const noexcept -> ConnectionState
+	{
+		return _connection.state();
+	}
+
+	/// @brief Updates the state and sends events
+	/// @pre The caller must own the connection state (see ConnectionManager::Listener::stateChanged())
+	/// @param generation The connection generation to publish
+	auto updateState(std::chrono::system_clock::time_point timeStamp,
+		std::error_code error,
+		std::uint64_t generation,
+		const ErrorSink *excludeErrorSink = nullptr) -> void;
+
+	/// @brief Publishes the statistics of the traffic shaper.
+	/// @pre _trafficShaperMutex must be locked
+	auto updateTrafficState(std::chrono::system_clock::time_point timeStamp) -> void;
+
+	/// @brief Publishes the statistics of the command receiver, if they have changed.
+	/// @pre This must only be called by the "write" task
+	auto updateCommandState(std::chrono::system_clock::time_point timeStamp) -> void;
+
+	/// @brief Loads the traffic shaping configuration
+	auto loadTrafficShaping(utils::json::decoder::Value &value) -> void;
+	/// @brief Loads the send scheduling configuration
+	auto loadScheduling(utils::json::decoder::Value &value) -> void;
+	/// @brief Loads the TCP keep-alive configuration
+	auto loadKeepAlive(utils::json::decoder::Value &value, ConnectionManager::Config &config) -> void;
+	/// @brief Loads the list of endpoints
+	auto loadEndpoints(utils::json::decoder::Value &value, ConnectionManager::Config &config) -> void;
+	/// @brief Loads the failover configuration
+	auto loadFailover(utils::json::decoder::Value &value, ConnectionManager::Config &config) -> void;
+	/// @brief Loads the flight recorder configuration
+	auto loadFlightRecorder(utils::json::decoder::Value &value) -> void;
+#ifdef TEMPLATE_UPLINK_FAULT_INJECTION
+	/// @brief Loads the fault injection configuration
+	auto loadFaultInjection(utils::json::decoder::Value &value) -> void;
+#endif
 
 	/// @name Virtual Overrides for skill::Element
 	/// @{
@@ -204,6 +456,29 @@ private:
 
 	auto realize() -> void final;
 
+	auto prepare() -> void final;
+
+	/// @}
+
+	/// @name Virtual Overrides for ConnectionManager::Listener
+	/// @{
+
+	auto connectionAttempted(
+		std::chrono::steady_clock::time_point start, std::size_t endpoint, std::error_code error) noexcept -> void final;
+
+	auto connectionErrorReported(std::error_code error, std::uint64_t generation) noexcept -> void final;
+
+	auto releasingHandle() noexcept -> void final;
+
+	auto handlePublished(const Handle &handle, bool failover) noexcept -> void final;
+
+	auto stateChanged(std::chrono::system_clock::time_point timeStamp,
+		std::error_code error,
+		std::uint64_t generation,
+		const void *origin) -> void final;
+
+	auto reconnectRequested() noexcept -> void final;
+
 	/// @}
 
 	/// @brief A Xentara event that is raised when the connection is established
@@ -213,25 +488,108 @@ private:
 
 	/// @brief The "reconnect" task
 	ReconnectTask _reconnectTask { *this };
+	/// @brief The "write" task
+	WriteTask _writeTask { *this };
+	/// @brief The "dumpFlightRecorder" task
+	DumpFlightRecorderTask _dumpFlightRecorderTask { *this };
 
-	/// @brief A list of objects that want to be notified of errors
+	/// @brief A list of objects that want to be notified of errors.
+	///
+	/// This list is only used while the model is being loaded. It is copied into _errorSinkArray by prepare().
 	std::forward_list<std::reference_wrapper<ErrorSink>> _errorSinks;
+	/// @brief The objects that want to be notified of errors.
+	///
+	/// This array is filled in by prepare() and never changed afterwards, so it can be read from any thread without locking.
+	std::vector<std::reference_wrapper<ErrorSink>> _errorSinkArray;
 
-	/// @brief The number of people who would like this component to be connected
-	std::atomic<std::size_t> _connectionRequestCount { 0 };
+	/// @brief The connection to the service instance.
+	///
+	/// This is declared before _handleWatch, so that the handle is only closed after it has been removed from the I/O reactor.
+	ConnectionManager _connection { *this };
+
+	/// @brief The I/O reactor
+	Reactor &_reactor;
+	/// @brief The send ring
+	SendRing &_sendRing;
+	/// @brief The worker pool
+	WorkerPool &_workerPool;
+	/// @brief The data point cache
+	DataPointCache &_dataPointCache;
+	/// @brief The receiver for commands sent by the remote service. This is used by the I/O reactor.
+	CommandReceiver _commandReceiver;
+	/// @brief A mutex protecting _writableCallback and _handleWatch
+	std::mutex _writableMutex;
+	/// @brief The function to call when the connection becomes ready for writing
+	std::function<void()> _writableCallback;
+	/// @brief The registration of the current handle with the I/O reactor, if any.
+	///
+	/// This is declared after the members used by the reactor callback, so that it is destroyed first.
+	Reactor::Watch _handleWatch;
+
+	/// @brief Whether the buffers used by the I/O reactor are preallocated and locked into RAM
+	bool _realTimeMemory { false };
+
+	/// @brief The connection attempt currently running on the worker pool, if any
+	std::future<void> _connectionJob;
+	/// @brief A mutex protecting _connectionJob
+	std::mutex _connectionJobMutex;
+
+	/// @brief The shortest time to wait before reconnecting after a failed connection attempt
+	static constexpr std::chrono::milliseconds kMinReconnectDelay { 100 };
+	/// @brief The longest time to wait before reconnecting after a failed connection attempt
+	static constexpr std::chrono::seconds kMaxReconnectDelay { 30 };
+
+	/// @brief The ID of the last reconnect timer started with the I/O reactor
+	Reactor::TimerId _reconnectTimer { 0 };
+	/// @brief Whether _reconnectTimer has yet to expire
+	bool _reconnectTimerPending { false };
+	/// @brief Whether the destructor has stopped the reconnect timer for good
+	bool _reconnectTimerStopped { false };
+	/// @brief The time to wait before the next reconnect. This is doubled after every failed attempt, up to kMaxReconnectDelay.
+	std::chrono::nanoseconds _reconnectDelay { kMinReconnectDelay };
+	/// @brief A mutex protecting the reconnect timer and delay
+	std::mutex _reconnectTimerMutex;
 
-	/// @brief A handle to the client
-	Handle _handle;
 	/// @brief The last error we encountered.
+	///
+	/// This may only be accessed by the thread that owns the connection state.
 	/// 
 	/// May have the following values:
 	/// - If the connection is open, this will be a default constructed std::error_code object
 	/// - If the connection was closed gracefully, this will be CustomError::NotConnected;
 	/// - Otherwise, this will contain an appropriate error code
 	std::error_code _lastError { CustomError::NotConnected };
+	/// @brief The connection generation last published in the state data block
+	///
+	/// This may only be accessed by the thread that owns the connection state.
+	std::uint64_t _publishedGeneration { 0 };
+
+	/// @brief The scheduler that decides which transaction may use the connection
+	SendScheduler _sendScheduler;
+
+	/// @brief The traffic shaper that limits the bandwidth of all transactions
+	TrafficShaper _trafficShaper;
+	/// @brief A mutex protecting the traffic shaper
+	std::mutex _trafficShaperMutex;
+
+#ifdef TEMPLATE_UPLINK_FAULT_INJECTION
+	/// @brief The fault injector used to simulate network faults for testing
+	FaultInjector _faultInjector;
+#endif
+
+	/// @brief The flight recorder that keeps the recent events of the client and its transactions
+	FlightRecorder _flightRecorder;
+	/// @brief The file the flight recorder is dumped to by the "dumpFlightRecorder" task
+	std::filesystem::path _flightRecorderFile;
 
 	/// @brief The data block that contains the state
 	memory::ObjectBlock<State> _stateDataBlock;
+	/// @brief The data block that contains the traffic shaper statistics
+	memory::ObjectBlock<TrafficState> _trafficStateDataBlock;
+	/// @brief The data block that contains the command receiver statistics
+	memory::ObjectBlock<CommandState> _commandStateDataBlock;
+	/// @brief The command receiver statistics last published. This is only accessed by the "write" task.
+	CommandState _publishedCommandState;
 };
 
 inline TemplateClient::ErrorSink::~ErrorSink() = default;
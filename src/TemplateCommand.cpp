@@ -0,0 +1,158 @@
+// Copyright (c) embedded ocean GmbH
+#include "TemplateCommand.hpp"
+
+#include <xentara/config/Errors.hpp>
+#include <xentara/model/Attribute.hpp>
+#include <xentara/utils/json/decoder/Object.hpp>
+
+#include <bit>
+#include <format>
+#include <stdexcept>
+#include <string_view>
+
+namespace xentara::plugins::templateUplink
+{
+
+using namespace std::literals;
+
+auto TemplateCommand::load(utils::json::decoder::Value &value, config::Context &context) -> void
+{
+	// Interpret the value as an object
+	auto jsonObject = value.asObject();
+
+	// Go through all the members of the JSON object that represents this object
+	bool dataPointLoaded = false;
+	bool remoteIdLoaded = false;
+	for (auto && [name, value] : jsonObject)
+	{
+		if (name == "dataPoint"sv)
+		{
+			// Resolve the data point
+			context.resolve<model::Element>(value, std::ref(_dataPoint));
+			dataPointLoaded = true;
+		}
+		/// @todo use something specific to the key used by the remote service, like e.g. "objectName"
+		else if (name == "remoteId"sv)
+		{
+			/// @todo load the remote ID using the correct type etc.
+			auto remoteId = value.asString<std::string>();
+
+			if (remoteId.empty())
+			{
+				utils::json::decoder::throwWithLocation(value, std::runtime_error("empty remote ID for template client command"));
+			}
+
+			// Set the key
+			_remoteId = std::move(remoteId);
+			remoteIdLoaded = true;
+		}
+		else if (name == "dataType"sv)
+		{
+			// Get the data type
+			auto dataType = value.asString<std::string>();
+
+			if (dataType == "boolean"sv)
+			{
+				_dataType = RecordDataType::Boolean;
+			}
+			else if (dataType == "integer"sv)
+			{
+				_dataType = RecordDataType::Integer;
+			}
+			else if (dataType == "unsigned"sv)
+			{
+				_dataType = RecordDataType::Unsigned;
+			}
+			else if (dataType == "floatingPoint"sv)
+			{
+				_dataType = RecordDataType::FloatingPoint;
+			}
+			else if (dataType == "string"sv)
+			{
+				_dataType = RecordDataType::String;
+			}
+			else
+			{
+				utils::json::decoder::throwWithLocation(value,
+					std::runtime_error("unknown data type for template client command. Must be \"boolean\", \"integer\", "
+									   "\"unsigned\", \"floatingPoint\", or \"string\""));
+			}
+		}
+		else
+		{
+			config::throwUnknownParameterError(name);
+		}
+	}
+
+	// Check that a data point was specified
+	if (!dataPointLoaded)
+	{
+		utils::json::decoder::throwWithLocation(jsonObject, std::runtime_error("missing data point for template client command"));
+	}
+	// Check that a remote ID was specified
+	if (!remoteIdLoaded)
+	{
+		utils::json::decoder::throwWithLocation(jsonObject, std::runtime_error("missing remote ID for template client command"));
+	}
+}
+
+auto TemplateCommand::resolveHandles() -> void
+{
+	// Get the data point
+	if (auto dataPoint = _dataPoint.lock())
+	{
+		// Get the value write handle
+		_valueWriteHandle = dataPoint->attributeWriteHandle(model::Attribute::kValue);
+		// Check it
+		if (auto error = _valueWriteHandle.hardError())
+		{
+			throw std::system_error(
+				error, std::format("could not construct write handle for the value of {} for template client command", *dataPoint));
+		}
+	}
+}
+
+auto TemplateCommand::decode(std::span<const std::byte> payload) const -> std::optional<Value>
+{
+	switch (_dataType)
+	{
+	case RecordDataType::Boolean:
+		if (payload.size() != 1)
+		{
+			return std::nullopt;
+		}
+		return payload[0] != std::byte(0);
+
+	case RecordDataType::Integer:
+	case RecordDataType::Unsigned:
+	case RecordDataType::FloatingPoint:
+		{
+			if (payload.size() != sizeof(std::uint64_t))
+			{
+				return std::nullopt;
+			}
+			const auto bits = getLittleEndian<std::uint64_t>(payload.data());
+
+			switch (_dataType)
+			{
+			case RecordDataType::Integer:
+				return std::int64_t(bits);
+			case RecordDataType::Unsigned:
+				return bits;
+			default:
+				return std::bit_cast<double>(bits);
+			}
+		}
+
+	case RecordDataType::String:
+	default:
+		return std::string(reinterpret_cast<const char *>(payload.data()), payload.size());
+	}
+}
+
+auto TemplateCommand::write(const Value &value) const -> std::error_code
+{
+	return std::visit([&](const auto &typedValue) { return _valueWriteHandle.write(typedValue); }, value);
+}
+
+} // namespace xentara::plugins::templateUplink
@@ -0,0 +1,70 @@
+// Copyright (c) embedded ocean GmbH
+#pragma once
+
+#include "Encoding.hpp"
+
+#include <xentara/config/Context.hpp>
+#include <xentara/data/WriteHandle.hpp>
+#include <xentara/model/Element.hpp>
+#include <xentara/utils/json/decoder/Value.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <system_error>
+#include <variant>
+
+namespace xentara::plugins::templateUplink
+{
+
+/// @brief A class representing a command that the remote service can send to write a value to a data point.
+/// @todo rename this class to something more descriptive
+class TemplateCommand final
+{
+public:
+	/// @brief A decoded value
+	using Value = std::variant<bool, std::int64_t, std::uint64_t, double, std::string>;
+
+	/// @brief Loads the command from a JSON value
+	auto load(utils::json::decoder::Value &value, config::Context &context) -> void;
+
+	/// @brief Gets the ID of the command in the namespace of the remote service
+	auto remoteId() const noexcept -> const std::string &
+	{
+		return _remoteId;
+	}
+
+	/// @brief Resolves the write handle
+	/// @throw std::system_error The handle could not be resolved
+	auto resolveHandles() -> void;
+
+	/// @brief Decodes the value of a command message.
+	///
+	/// Booleans are encoded as a single byte, numbers as 8 bytes in little endian byte order, and strings as UTF-8 text taking up
+	/// the rest of the message.
+	///
+	/// @return The value, or std::nullopt if the payload does not have the right size for the data type
+	auto decode(std::span<const std::byte> payload) const -> std::optional<Value>;
+
+	/// @brief Writes a value to the data point
+	/// @return The error that occurred, or a default constructed std::error_code object on success
+	auto write(const Value &value) const -> std::error_code;
+
+private:
+	/// @brief The data point
+	std::weak_ptr<const model::Element> _dataPoint;
+	/// @brief The ID of the command in the namespace of the remote service
+	/// @todo use the appropriate type here
+	std::string _remoteId;
+
+	/// @brief The data type of the values sent by the remote service
+	RecordDataType _dataType { RecordDataType::String };
+
+	/// @brief The write handle for the value
+	data::WriteHandle _valueWriteHandle;
+};
+
+} // namespace xentara::plugins::templateUplink
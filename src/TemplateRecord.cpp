@@ -5,15 +5,151 @@
 #include <xentara/config/Errors.hpp>
 #include <xentara/data/Quality.hpp>
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <concepts>
 #include <format>
+#include <limits>
 #include <string_view>
 #include <stdexcept>
+#include <variant>
+#include <vector>
 
 namespace xentara::plugins::templateUplink
 {
 	
 using namespace std::literals;
 
+namespace
+{
+
+	/// @brief Determines the C++ type used to read values of a record data type
+	template <RecordDataType kDataType>
+	struct ValueTypeOf;
+
+	template <>
+	struct ValueTypeOf<RecordDataType::Boolean>
+	{
+		using Type = bool;
+	};
+
+	template <>
+	struct ValueTypeOf<RecordDataType::Integer>
+	{
+		using Type = std::int64_t;
+	};
+
+	template <>
+	struct ValueTypeOf<RecordDataType::Unsigned>
+	{
+		using Type = std::uint64_t;
+	};
+
+	template <>
+	struct ValueTypeOf<RecordDataType::FloatingPoint>
+	{
+		using Type = double;
+	};
+
+	template <>
+	struct ValueTypeOf<RecordDataType::String>
+	{
+		using Type = std::string;
+	};
+
+	template <>
+	struct ValueTypeOf<RecordDataType::FloatingPointArray>
+	{
+		using Type = std::vector<double>;
+	};
+
+	template <>
+	struct ValueTypeOf<RecordDataType::IntegerArray>
+	{
+		using Type = std::vector<std::int64_t>;
+	};
+
+	template <>
+	struct ValueTypeOf<RecordDataType::Blob>
+	{
+		using Type = std::vector<std::byte>;
+	};
+
+	/// @brief Converts an element of an array to the bits sent on the wire
+	template <typename Element>
+	constexpr auto wireBits(Element element) noexcept
+	{
+		if constexpr (std::floating_point<Element>)
+		{
+			return std::bit_cast<std::uint64_t>(element);
+		}
+		else
+		{
+			return element;
+		}
+	}
+
+	/// @brief Gets the bytes of an array value in little endian byte order
+	/// @param value The value. On big endian platforms, the elements are converted in place.
+	template <typename Element>
+	auto littleEndianBytes(std::vector<Element> &value) noexcept -> std::span<const std::byte>
+	{
+		if constexpr (std::endian::native != std::endian::little && sizeof(Element) > 1)
+		{
+			for (auto &element : value)
+			{
+				std::array<std::byte, sizeof(Element)> bytes;
+				putLittleEndian(bytes.data(), wireBits(element));
+				std::memcpy(&element, bytes.data(), bytes.size());
+			}
+		}
+
+		return std::as_bytes(std::span(value));
+	}
+
+	/// @brief The size of the header of a chunk in the binary wire format, not including the remote ID
+	constexpr std::size_t kMaxChunkHeaderSize =
+		sizeof(std::uint32_t) + sizeof(std::uint32_t) + sizeof(std::uint8_t) + sizeof(std::int64_t) + sizeof(std::uint32_t);
+
+} // namespace
+
+auto TemplateRecord::runEncoder(RecordDataType dataType, WireFormat wireFormat, TimeStampMode timeStampMode) noexcept -> RunEncoder
+{
+	const auto index = std::size_t(dataType);
+
+	switch (wireFormat)
+	{
+	case WireFormat::Binary:
+		return timeStampMode == TimeStampMode::None ? runEncoders<WireFormat::Binary, TimeStampMode::None>()[index]
+													: runEncoders<WireFormat::Binary, TimeStampMode::Collect>()[index];
+
+	case WireFormat::Json:
+	default:
+		return timeStampMode == TimeStampMode::None ? runEncoders<WireFormat::Json, TimeStampMode::None>()[index]
+													: runEncoders<WireFormat::Json, TimeStampMode::Collect>()[index];
+	}
+}
+
+template <WireFormat kWireFormat, TimeStampMode kTimeStampMode>
+auto TemplateRecord::runEncoders() noexcept -> const std::array<RunEncoder, kRecordDataTypeCount> &
+{
+	// The order must match the enumerators of RecordDataType
+	static constexpr std::array<RunEncoder, kRecordDataTypeCount> kEncoders {
+		&encodeRun<RecordDataType::Boolean, kWireFormat, kTimeStampMode>,
+		&encodeRun<RecordDataType::Integer, kWireFormat, kTimeStampMode>,
+		&encodeRun<RecordDataType::Unsigned, kWireFormat, kTimeStampMode>,
+		&encodeRun<RecordDataType::FloatingPoint, kWireFormat, kTimeStampMode>,
+		&encodeRun<RecordDataType::String, kWireFormat, kTimeStampMode>,
+		&encodeRun<RecordDataType::FloatingPointArray, kWireFormat, kTimeStampMode>,
+		&encodeRun<RecordDataType::IntegerArray, kWireFormat, kTimeStampMode>,
+		&encodeRun<RecordDataType::Blob, kWireFormat, kTimeStampMode>
+	};
+
+	return kEncoders;
+}
+
 auto TemplateRecord::load(utils::json::decoder::Value &value, config::Context &context) -> void
 {
 	// Interpret the value as an object
@@ -43,10 +179,113 @@ auto TemplateRecord::load(utils::json::decoder::Value &value, config::Context &c
 				utils::json::decoder::throwWithLocation(value, std::runtime_error("empty remote ID for template transaction record"));
 			}
 
+			// The binary wire format uses a 16 bit length
+			if (remoteId.size() > std::numeric_limits<std::uint16_t>::max())
+			{
+				utils::json::decoder::throwWithLocation(value, std::runtime_error("remote ID for template transaction record is too long"));
+			}
+
 			// Set the key
 			_remoteId = std::move(remoteId);
 			remoteIdLoaded = true;
 		}
+		else if (name == "dataType"sv)
+		{
+			// Get the data type
+			auto dataType = value.asString<std::string>();
+
+			if (dataType == "boolean"sv)
+			{
+				_dataType = RecordDataType::Boolean;
+			}
+			else if (dataType == "integer"sv)
+			{
+				_dataType = RecordDataType::Integer;
+			}
+			else if (dataType == "unsigned"sv)
+			{
+				_dataType = RecordDataType::Unsigned;
+			}
+			else if (dataType == "floatingPoint"sv)
+			{
+				_dataType = RecordDataType::FloatingPoint;
+			}
+			else if (dataType == "string"sv)
+			{
+				_dataType = RecordDataType::String;
+			}
+			else if (dataType == "floatingPointArray"sv)
+			{
+				_dataType = RecordDataType::FloatingPointArray;
+			}
+			else if (dataType == "integerArray"sv)
+			{
+				_dataType = RecordDataType::IntegerArray;
+			}
+			else if (dataType == "blob"sv)
+			{
+				_dataType = RecordDataType::Blob;
+			}
+			else
+			{
+				utils::json::decoder::throwWithLocation(value,
+					std::runtime_error("unknown data type for template transaction record. Must be \"boolean\", \"integer\", "
+									   "\"unsigned\", \"floatingPoint\", \"string\", \"floatingPointArray\", "
+									   "\"integerArray\", or \"blob\""));
+			}
+		}
+		else if (name == "chunkSize"sv)
+		{
+			// Get the chunk size in bytes
+			const auto chunkSize = value.asNumber<std::size_t>();
+
+			// The binary wire format uses a 32 bit length for chunks
+			if (chunkSize == 0 || chunkSize > std::numeric_limits<std::uint32_t>::max())
+			{
+				utils::json::decoder::throwWithLocation(value,
+					std::runtime_error("chunk size of template transaction record must be between 1 and 4294967295"));
+			}
+
+			_chunkSize = chunkSize;
+		}
+		else if (name == "sampleInterval"sv)
+		{
+			// The interval is given in milliseconds
+			const auto interval = value.asNumber<double>();
+			if (interval < 0)
+			{
+				utils::json::decoder::throwWithLocation(value, std::runtime_error("sample interval of template transaction record must not be negative"));
+			}
+
+			_sampleInterval = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double, std::milli>(interval));
+		}
+		else if (name == "aggregation"sv)
+		{
+			// Get the aggregation
+			auto aggregation = value.asString<std::string>();
+
+			if (aggregation == "none"sv)
+			{
+				_aggregation = Aggregation::None;
+			}
+			else if (aggregation == "min"sv)
+			{
+				_aggregation = Aggregation::Minimum;
+			}
+			else if (aggregation == "max"sv)
+			{
+				_aggregation = Aggregation::Maximum;
+			}
+			else if (aggregation == "average"sv)
+			{
+				_aggregation = Aggregation::Average;
+			}
+			else
+			{
+				utils::json::decoder::throwWithLocation(value,
+					std::runtime_error("unknown aggregation for template transaction record. Must be \"none\", \"min\", \"max\", or \"average\""));
+			}
+		}
 		/// @todo load additional configuration parameters
 		else if (name == "TODO"sv)
 		{
@@ -78,15 +317,259 @@ auto TemplateRecord::load(utils::json::decoder::Value &value, config::Context &c
 	{
 		utils::json::decoder::throwWithLocation(jsonObject, std::runtime_error("missing remote ID for template transaction record"));
 	}
+	// Check that the aggregation can be used
+	if (_aggregation != Aggregation::None)
+	{
+		if (_dataType == RecordDataType::Boolean || _dataType == RecordDataType::String || isArrayType(_dataType))
+		{
+			utils::json::decoder::throwWithLocation(jsonObject,
+				std::runtime_error("aggregation of template transaction record requires a numeric data type"));
+		}
+		if (_sampleInterval == std::chrono::nanoseconds::zero())
+		{
+			utils::json::decoder::throwWithLocation(jsonObject,
+				std::runtime_error("aggregation of template transaction record requires a sample interval"));
+		}
+	}
 	/// @todo perform additional consistency and completeness checks
 }
 
-auto TemplateRecord::collect(std::chrono::system_clock::time_point timeStamp, utils::core::RawDataBlock &data) const
-	-> void
+auto TemplateRecord::sameConfiguration(const TemplateRecord &other) const noexcept -> bool
+{
+	// Compare the data points by identity, without locking them
+	const auto sameDataPoint = !_dataPoint.owner_before(other._dataPoint) && !other._dataPoint.owner_before(_dataPoint);
+
+	return sameDataPoint && _remoteId == other._remoteId && _dataType == other._dataType &&
+		_sampleInterval == other._sampleInterval && _aggregation == other._aggregation && _chunkSize == other._chunkSize;
+}
+
+auto TemplateRecord::resolveHandles(DataPointCache &cache) -> void
+{
+	// Get the data point
+	if (auto dataPoint = _dataPoint.lock())
+	{
+		// Get the handles from the cache, so that they are only resolved once for data points shared by several records
+		_cacheEntry = cache.entry(*dataPoint);
+		_valueReadHandle = _cacheEntry->handles()._value;
+		_qualityReadHandle = _cacheEntry->handles()._quality;
+
+		/// @todo get read handles for other attributes that should be sent
+	}
+}
+
+auto TemplateRecord::sample() -> void
+{
+	switch (_dataType)
+	{
+	case RecordDataType::Integer:
+		sample<std::int64_t>();
+		break;
+	case RecordDataType::Unsigned:
+		sample<std::uint64_t>();
+		break;
+	case RecordDataType::FloatingPoint:
+		sample<double>();
+		break;
+	default:
+		// Other data types cannot be aggregated
+		break;
+	}
+}
+
+template <typename Value>
+auto TemplateRecord::sample() -> void
+{
+	// Read the data
+	auto value = _valueReadHandle.read<Value>();
+	auto quality = _qualityReadHandle.read<data::Quality>();
+	if (!value || !quality)
+	{
+		// Samples that cannot be read are skipped
+		return;
+	}
+
+	// Update the smallest or largest sample
+	if (_aggregate._count == 0)
+	{
+		_aggregate._extreme = *value;
+		_aggregate._sum = 0;
+	}
+	else if (_aggregation == Aggregation::Minimum)
+	{
+		_aggregate._extreme = std::min(std::get<Value>(_aggregate._extreme), *value);
+	}
+	else if (_aggregation == Aggregation::Maximum)
+	{
+		_aggregate._extreme = std::max(std::get<Value>(_aggregate._extreme), *value);
+	}
+
+	_aggregate._sum += double(*value);
+	_aggregate._quality = *quality;
+	++_aggregate._count;
+}
+
+template <typename Value>
+auto TemplateRecord::aggregatedValue() const noexcept -> Value
+{
+	if (_aggregation != Aggregation::Average)
+	{
+		return std::get<Value>(_aggregate._extreme);
+	}
+
+	const auto average = _aggregate._sum / double(_aggregate._count);
+	if constexpr (std::floating_point<Value>)
+	{
+		return average;
+	}
+	else
+	{
+		// Round integer averages to the nearest integer
+		return Value(std::llround(average));
+	}
+}
+
+auto TemplateRecord::readStreamed() const -> std::optional<StreamedValue>
+{
+	switch (_dataType)
+	{
+	case RecordDataType::FloatingPointArray:
+		return readStreamed<std::vector<double>>();
+	case RecordDataType::IntegerArray:
+		return readStreamed<std::vector<std::int64_t>>();
+	case RecordDataType::Blob:
+		return readStreamed<std::vector<std::byte>>();
+	default:
+		// Other data types are not streamed
+		return std::nullopt;
+	}
+}
+
+template <typename Value>
+auto TemplateRecord::readStreamed() const -> std::optional<StreamedValue>
 {
 	// Read the data
-	auto value = _valueReadHandle.read<std::string>();
-	/// @todo read the value as a more suitable type
+	auto value = _valueReadHandle.read<Value>();
+	auto quality = _qualityReadHandle.read<data::Quality>();
+	if (!value || !quality)
+	{
+		/// @todo do appropriate error handling, like sending an error status for to the remote service
+
+		return std::nullopt;
+	}
+
+	// The binary wire format uses a 32 bit size
+	if (value->size() * sizeof(typename Value::value_type) > std::numeric_limits<std::uint32_t>::max())
+	{
+		/// @todo report values that are too large to the remote service
+
+		return std::nullopt;
+	}
+
+	// Take over the memory of the value, so that the chunks can be sent from it directly
+	auto owner = std::make_shared<Value>(std::move(*value));
+	const auto bytes = littleEndianBytes(*owner);
+	return StreamedValue { std::move(owner), bytes, *quality };
+}
+
+auto TemplateRecord::appendChunkHeader(const StreamedValue &value,
+	std::size_t offset,
+	std::size_t size,
+	TimeStampMode timeStampMode,
+	std::chrono::system_clock::time_point timeStamp,
+	utils::core::RawDataBlock &data) const -> void
+{
+	// Append the remote ID
+	appendText(data, _encodedKey);
+
+	// Append the total size and the offset, so that the remote service can put the chunks together, followed by the quality,
+	// the time stamp, and the size of the chunk, which directly precedes the bytes
+	std::array<std::byte, kMaxChunkHeaderSize> header;
+	auto position = putLittleEndian(header.data(), std::uint32_t(value._bytes.size()));
+	position = putLittleEndian(position, std::uint32_t(offset));
+	*position++ = std::byte(static_cast<std::uint8_t>(value._quality));
+	if (timeStampMode == TimeStampMode::Collect)
+	{
+		position = putLittleEndian(position, microsecondsSinceEpoch(timeStamp));
+	}
+	position = putLittleEndian(position, std::uint32_t(size));
+	appendBytes(data, std::span(header.data(), position));
+}
+
+auto TemplateRecord::prepareEncoding(WireFormat wireFormat) -> void
+{
+	switch (wireFormat)
+	{
+	case WireFormat::Binary:
+		{
+			// The remote ID is prefixed with its length
+			std::array<std::byte, sizeof(std::uint16_t)> length;
+			putLittleEndian(length.data(), std::uint16_t(_remoteId.size()));
+			_encodedKey.assign(reinterpret_cast<const char *>(length.data()), length.size());
+			_encodedKey += _remoteId;
+		}
+		break;
+
+	case WireFormat::Json:
+		_encodedKey = std::format("{{\"id\":{},\"value\":", jsonStringLiteral(_remoteId));
+		break;
+	}
+}
+
+template <RecordDataType kDataType, WireFormat kWireFormat, TimeStampMode kTimeStampMode>
+auto TemplateRecord::encodeRun(std::span<const std::reference_wrapper<const TemplateRecord>> records,
+	std::chrono::system_clock::time_point timeStamp,
+	utils::core::RawDataBlock &data) -> void
+{
+	for (auto &&record : records)
+	{
+		record.get().encode<kDataType, kWireFormat, kTimeStampMode>(timeStamp, data);
+	}
+}
+
+template <RecordDataType kDataType, WireFormat kWireFormat, TimeStampMode kTimeStampMode>
+auto TemplateRecord::encode(std::chrono::system_clock::time_point timeStamp, utils::core::RawDataBlock &data) const -> void
+{
+	// Append the remote ID
+	const auto offset = data.size();
+	appendText(data, _encodedKey);
+
+	// Append the value. If the data point is shared with other records, another record may already have encoded it in this cycle.
+	// Aggregates belong to the record, so they are never shared.
+	const auto encodeDirectly = [&] { return encodeValue<kDataType, kWireFormat, kTimeStampMode>(timeStamp, data); };
+	const auto encoded = _cacheEntry && _aggregation == Aggregation::None && _cacheEntry->shared()
+		? _cacheEntry->encode(encodingId(kDataType, kWireFormat, kTimeStampMode), timeStamp, data, encodeDirectly)
+		: encodeDirectly();
+
+	// Remove the remote ID again if there is no value
+	if (!encoded)
+	{
+		data.resize(offset);
+	}
+}
+
+template <RecordDataType kDataType, WireFormat kWireFormat, TimeStampMode kTimeStampMode>
+auto TemplateRecord::encodeValue(std::chrono::system_clock::time_point timeStamp, utils::core::RawDataBlock &data) const -> bool
+{
+	using Value = typename ValueTypeOf<kDataType>::Type;
+
+	// Use the aggregate if there is one
+	if constexpr (kDataType != RecordDataType::Boolean && kDataType != RecordDataType::String && !isArrayType(kDataType))
+	{
+		if (_aggregation != Aggregation::None)
+		{
+			// If none of the samples could be read, there is nothing to send
+			if (_aggregate._count == 0)
+			{
+				return false;
+			}
+
+			encodeSample<kDataType, kWireFormat, kTimeStampMode>(aggregatedValue<Value>(), _aggregate._quality, timeStamp, data);
+			return true;
+		}
+	}
+
+	// Read the data
+	auto value = _valueReadHandle.read<Value>();
 	auto quality = _qualityReadHandle.read<data::Quality>();
 
 	/// @todo read other attributes that should be sent
@@ -95,36 +578,148 @@ auto TemplateRecord::collect(std::chrono::system_clock::time_point timeStamp, ut
 	{
 		/// @todo do appropriate error handling, like sending an error status for to the remote service
 
-		return;
+		return false;
 	}
 
-	/// @todo encode the record and append it to the data
+	encodeSample<kDataType, kWireFormat, kTimeStampMode>(*value, *quality, timeStamp, data);
+	return true;
 }
 
-auto TemplateRecord::resolveHandles() -> void
+template <RecordDataType kDataType, WireFormat kWireFormat, TimeStampMode kTimeStampMode, typename Value>
+auto TemplateRecord::encodeSample(const Value &value,
+	data::Quality quality,
+	std::chrono::system_clock::time_point timeStamp,
+	utils::core::RawDataBlock &data) -> void
 {
-	// Get the data point
-	if (auto dataPoint = _dataPoint.lock())
+	if constexpr (kWireFormat == WireFormat::Binary && isArrayType(kDataType))
 	{
-		// Get the value read handle
-		_valueReadHandle = dataPoint->attributeReadHandle(model::Attribute::kValue);
-		// Check it
-		if (auto error = _valueReadHandle.hardError())
+		// Arrays and blobs are sent as a single chunk, with the same layout as the chunks appended by appendChunkHeader()
+		const auto size = value.size() * sizeof(typename Value::value_type);
+		std::array<std::byte, kMaxChunkHeaderSize> header;
+		auto position = putLittleEndian(header.data(), std::uint32_t(size));
+		position = putLittleEndian(position, std::uint32_t(0));
+		*position++ = std::byte(static_cast<std::uint8_t>(quality));
+		if constexpr (kTimeStampMode == TimeStampMode::Collect)
+		{
+			position = putLittleEndian(position, microsecondsSinceEpoch(timeStamp));
+		}
+		position = putLittleEndian(position, std::uint32_t(size));
+		appendBytes(data, std::span(header.data(), position));
+
+		// Append the elements in little endian byte order
+		if constexpr (sizeof(typename Value::value_type) == 1 || std::endian::native == std::endian::little)
 		{
-			throw std::system_error(
-				error, std::format("could not construct read handle for the value of {} for template transaction record", *dataPoint));
+			appendBytes(data, std::as_bytes(std::span(value)));
 		}
+		else
+		{
+			const auto offset = data.size();
+			data.resize(offset + size);
+			auto target = bytes(data) + offset;
+			for (auto &&element : value)
+			{
+				target = putLittleEndian(target, wireBits(element));
+			}
+		}
+	}
+	else if constexpr (kWireFormat == WireFormat::Binary)
+	{
+		// Strings have a variable size, and are prefixed with their length
+		if constexpr (kDataType == RecordDataType::String)
+		{
+			std::array<std::byte, sizeof(std::uint32_t)> length;
+			putLittleEndian(length.data(), std::uint32_t(value.size()));
+			appendBytes(data, length);
+			appendText(data, value);
+		}
+
+		// Append all the fixed size fields in one go
+		std::array<std::byte, sizeof(std::uint64_t) + sizeof(std::uint8_t) + sizeof(std::int64_t)> fields;
+		auto position = fields.data();
+		if constexpr (kDataType == RecordDataType::Boolean)
+		{
+			*position++ = std::byte(value ? 1 : 0);
+		}
+		else if constexpr (kDataType == RecordDataType::FloatingPoint)
+		{
+			position = putLittleEndian(position, std::bit_cast<std::uint64_t>(value));
+		}
+		else if constexpr (kDataType != RecordDataType::String)
+		{
+			position = putLittleEndian(position, value);
+		}
+		*position++ = std::byte(static_cast<std::uint8_t>(quality));
+		if constexpr (kTimeStampMode == TimeStampMode::Collect)
+		{
+			position = putLittleEndian(position, microsecondsSinceEpoch(timeStamp));
+		}
+		appendBytes(data, std::span(fields.data(), position));
+	}
+	else
+	{
+		// Append the value
+		if constexpr (kDataType == RecordDataType::Boolean)
+		{
+			appendText(data, value ? "true"sv : "false"sv);
+		}
+		else if constexpr (kDataType == RecordDataType::String)
+		{
+			appendJsonString(data, value);
+		}
+		else if constexpr (kDataType == RecordDataType::Blob)
+		{
+			appendJsonBase64(data, value);
+		}
+		else if constexpr (isArrayType(kDataType))
+		{
+			appendText(data, "["sv);
+			for (auto separator = ""sv; auto &&element : value)
+			{
+				appendText(data, separator);
+				separator = ","sv;
+
+				// JSON has no representation for infinity or NaN
+				if constexpr (std::floating_point<typename Value::value_type>)
+				{
+					if (!std::isfinite(element))
+					{
+						appendText(data, "null"sv);
+						continue;
+					}
+				}
+				appendNumberText(data, element);
+			}
+			appendText(data, "]"sv);
+		}
+		else if constexpr (kDataType == RecordDataType::FloatingPoint)
+		{
+			// JSON has no representation for infinity or NaN
+			if (std::isfinite(value))
+			{
+				appendNumberText(data, value);
+			}
+			else
+			{
+				appendText(data, "null"sv);
+			}
+		}
+		else
+		{
+			appendNumberText(data, value);
+		}
+
+		// Append the quality
+		appendText(data, ",\"quality\":"sv);
+		appendNumberText(data, unsigned(static_cast<std::uint8_t>(quality)));
 
-		// Get the quality read handle
-		_qualityReadHandle = dataPoint->attributeReadHandle(model::Attribute::kValue);
-		// Check it
-		if (auto error = _qualityReadHandle.hardError())
+		// Append the time stamp
+		if constexpr (kTimeStampMode == TimeStampMode::Collect)
 		{
-			throw std::system_error(error,
-				std::format("could not construct read handle for the quality of {} for template transaction record", *dataPoint));
+			appendText(data, ",\"time\":"sv);
+			appendJsonTimeStamp(data, timeStamp);
 		}
 
-		/// @todo resolve read handles for other attributes that should be sent
+		appendText(data, "}\n"sv);
 	}
 }
 
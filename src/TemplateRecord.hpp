@@ -1,15 +1,25 @@
 // Copyright (c) embedded ocean GmbH
 #pragma once
 
+#include "DataPointCache.hpp"
+#include "Encoding.hpp"
+
 #include <xentara/config/Context.hpp>
+#include <xentara/data/Quality.hpp>
 #include <xentara/data/ReadHandle.hpp>
 #include <xentara/model/Element.hpp>
 #include <xentara/utils/core/RawDataBlock.hpp>
 #include <xentara/utils/json/decoder/Value.hpp>
 
+#include <array>
 #include <chrono>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <optional>
+#include <span>
 #include <string>
+#include <variant>
 
 namespace xentara::plugins::templateUplink
 {
@@ -19,14 +29,118 @@ namespace xentara::plugins::templateUplink
 class TemplateRecord final
 {
 public:
+	/// @brief How the samples taken between two sends of a record are combined
+	enum class Aggregation : std::uint8_t
+	{
+		/// @brief Only the current value is sent, and the skipped samples are not read at all
+		None,
+		/// @brief The smallest sample is sent
+		Minimum,
+		/// @brief The largest sample is sent
+		Maximum,
+		/// @brief The average of the samples is sent
+		Average,
+	};
+
+	/// @brief The value of an array or blob record, read for streaming
+	struct StreamedValue final
+	{
+		/// @brief Keeps the value alive for as long as any of its chunks are still waiting to be sent
+		std::shared_ptr<const void> _owner;
+		/// @brief The value in the byte order used on the wire
+		std::span<const std::byte> _bytes;
+		/// @brief The quality of the value
+		data::Quality _quality {};
+	};
+
+	/// @brief The default size of the chunks array and blob records are split into, in bytes
+	static constexpr std::size_t kDefaultChunkSize = 64 * 1024;
+
+	/// @brief A function that collects the data from a run of records with the same data type, and appends it to a data block
+	using RunEncoder = auto (*)(std::span<const std::reference_wrapper<const TemplateRecord>> records,
+		std::chrono::system_clock::time_point timeStamp,
+		utils::core::RawDataBlock &data) -> void;
+
+	/// @brief Gets the encoder for runs of records with a certain data type.
+	///
+	/// There is a separate encoder for each combination of parameters, so that the encoding loop does not need to check them
+	/// for every record.
+	static auto runEncoder(RecordDataType dataType, WireFormat wireFormat, TimeStampMode timeStampMode) noexcept -> RunEncoder;
+
 	/// @brief Loads the record from a JSON value
 	auto load(utils::json::decoder::Value &value, config::Context &context) -> void;
 
-	/// @brief Collects the data from the record and appends it to a data block
-	auto collect(std::chrono::system_clock::time_point timeStamp, utils::core::RawDataBlock &data) const -> void;
+	/// @brief Gets the ID of the record in the namespace of the remote service
+	auto remoteId() const noexcept -> const std::string &
+	{
+		return _remoteId;
+	}
+
+	/// @brief Checks whether another record is configured exactly like this one, so that it can take the place of this one
+	/// when the records are reloaded.
+	auto sameConfiguration(const TemplateRecord &other) const noexcept -> bool;
+
+	/// @brief Gets the data type the record is sent as
+	auto dataType() const noexcept -> RecordDataType
+	{
+		return _dataType;
+	}
+
+	/// @brief Gets the maximum size of the chunks an array or blob record is split into in the binary wire format, in bytes
+	auto chunkSize() const noexcept -> std::size_t
+	{
+		return _chunkSize;
+	}
+
+	/// @brief Gets the interval at which the record is sent, or 0 to send it in every cycle of the "collect" task
+	auto sampleInterval() const noexcept -> std::chrono::nanoseconds
+	{
+		return _sampleInterval;
+	}
+
+	/// @brief Gets how the samples taken between two sends are combined
+	auto aggregation() const noexcept -> Aggregation
+	{
+		return _aggregation;
+	}
+
+	/// @brief Reads the current value and adds it to the aggregate. This is only used if an aggregation is configured.
+	auto sample() -> void;
+
+	/// @brief Clears the aggregate after it has been sent
+	auto resetAggregate() noexcept -> void
+	{
+		_aggregate._count = 0;
+	}
+
+	/// @brief Reads the value of an array or blob record for streaming in the binary wire format.
+	///
+	/// The value is not copied, but kept alive by the returned owner, so that it can be sent directly from where it was read.
+	///
+	/// @return The value, or std::nullopt if it could not be read
+	auto readStreamed() const -> std::optional<StreamedValue>;
+
+	/// @brief Appends the header of a chunk of an array or blob record in the binary wire format to a data block.
+	///
+	/// The header is followed on the wire by the bytes of the chunk, which are not appended.
+	///
+	/// @param value The value the chunk belongs to
+	/// @param offset The offset of the chunk within the value, in bytes
+	/// @param size The size of the chunk, in bytes
+	auto appendChunkHeader(const StreamedValue &value,
+		std::size_t offset,
+		std::size_t size,
+		TimeStampMode timeStampMode,
+		std::chrono::system_clock::time_point timeStamp,
+		utils::core::RawDataBlock &data) const -> void;
 
-	/// @brief Reslves read handles
-	auto resolveHandles() -> void;
+	/// @brief Resolves read handles
+	/// @param cache The cache used to share handles between records that refer to the same data point
+	/// @throw std::system_error A handle could not be resolved
+	auto resolveHandles(DataPointCache &cache) -> void;
+
+	/// @brief Prepares the parts of the encoded record that never change
+	auto prepareEncoding(WireFormat wireFormat) -> void;
 
 private:
 	/// @brief The data point
@@ -36,8 +150,36 @@ private:
 	/// @todo rename the variable into something specific to the key used by the remote service, like e.g. "objectName"
 	std::string _remoteId;
 
+	/// @brief The data type the record is sent as
+	RecordDataType _dataType { RecordDataType::String };
+
+	/// @brief The interval at which the record is sent, or 0 to send it in every cycle
+	std::chrono::nanoseconds _sampleInterval { 0 };
+	/// @brief How the samples taken between two sends are combined
+	Aggregation _aggregation { Aggregation::None };
+	/// @brief The maximum size of the chunks an array or blob record is split into, in bytes
+	std::size_t _chunkSize { kDefaultChunkSize };
+
+	/// @brief The samples taken since the record was last sent
+	struct Aggregate final
+	{
+		/// @brief The number of samples
+		std::uint64_t _count { 0 };
+		/// @brief The smallest or largest sample, in the value type of the record
+		std::variant<std::int64_t, std::uint64_t, double> _extreme {};
+		/// @brief The sum of the samples, used for the average.
+		///
+		/// This is kept in double precision even for integers, so that it cannot overflow.
+		double _sum { 0 };
+		/// @brief The quality of the last sample
+		data::Quality _quality {};
+	};
+
+	/// @brief The samples taken since the record was last sent, if an aggregation is configured
+	Aggregate _aggregate;
+
 	/// @class xentara::plugins::templateUplink::TemplateRecord
-	/// @todo add more properties needed for the record, e.g. data type
+	/// @todo add more properties needed for the record
 
 	/// @brief The read handle for the value
 	data::ReadHandle _valueReadHandle;
@@ -45,6 +187,52 @@ private:
 	data::ReadHandle _qualityReadHandle;
 
 	/// @todo add read handles for other attributes that should be sent
+
+	/// @brief The entry of the data point in the data point cache of the skill, or an empty reference if the data point is gone.
+	///
+	/// This counts the record as a user of the data point until the record is destroyed.
+	DataPointCache::Reference _cacheEntry;
+
+	/// @brief The encoded remote ID, including any punctuation that precedes the value
+	std::string _encodedKey;
+
+	/// @brief Gets the run encoders for all data types for a certain wire format and time stamp mode
+	template <WireFormat kWireFormat, TimeStampMode kTimeStampMode>
+	static auto runEncoders() noexcept -> const std::array<RunEncoder, kRecordDataTypeCount> &;
+
+	/// @brief Collects the data from a run of records and appends it to a data block
+	template <RecordDataType kDataType, WireFormat kWireFormat, TimeStampMode kTimeStampMode>
+	static auto encodeRun(std::span<const std::reference_wrapper<const TemplateRecord>> records,
+		std::chrono::system_clock::time_point timeStamp,
+		utils::core::RawDataBlock &data) -> void;
+
+	/// @brief Collects the data from the record and appends it to a data block
+	template <RecordDataType kDataType, WireFormat kWireFormat, TimeStampMode kTimeStampMode>
+	auto encode(std::chrono::system_clock::time_point timeStamp, utils::core::RawDataBlock &data) const -> void;
+
+	/// @brief Reads the value of the data point, or gets the aggregate, and appends everything that follows the remote ID to a data block
+	/// @return Returns false if there is no value, in which case nothing is appended
+	template <RecordDataType kDataType, WireFormat kWireFormat, TimeStampMode kTimeStampMode>
+	auto encodeValue(std::chrono::system_clock::time_point timeStamp, utils::core::RawDataBlock &data) const -> bool;
+
+	/// @brief Appends a value and a quality to a data block
+	template <RecordDataType kDataType, WireFormat kWireFormat, TimeStampMode kTimeStampMode, typename Value>
+	static auto encodeSample(const Value &value,
+		data::Quality quality,
+		std::chrono::system_clock::time_point timeStamp,
+		utils::core::RawDataBlock &data) -> void;
+
+	/// @brief Reads the current value and adds it to the aggregate
+	template <typename Value>
+	auto sample() -> void;
+
+	/// @brief Reads the value of an array or blob record for streaming
+	template <typename Value>
+	auto readStreamed() const -> std::optional<StreamedValue>;
+
+	/// @brief Gets the aggregated value
+	template <typename Value>
+	auto aggregatedValue() const noexcept -> Value;
 };
 
 } // namespace xentara::plugins::templateUplink
@@ -20,7 +20,18 @@
 #include <xentara/utils/json/decoder/Errors.hpp>
 #include <xentara/utils/eh/currentErrorCode.hpp>
 
+#include <algorithm>
 #include <concepts>
+#include <format>
+#include <iostream>
+#include <iterator>
+#include <ranges>
+#include <span>
+#include <string>
+#include <string_view>
+#include <stdexcept>
+#include <utility>
+#include <vector>
 
 namespace xentara::plugins::templateUplink
 {
@@ -39,113 +50,1176 @@ auto TemplateTransaction::load(utils::json::decoder::Object &jsonObject, config:
 			for (auto &&element : value.asArray())
 			{
 				// Add a record
-				_records.emplace_front();
+				auto &record = _records.emplace_back(std::make_shared<TemplateRecord>());
 				// Load it
-				_records.front().load(element, context);
+				record->load(element, context);
 			}
 		}
+		else if (name == "priority"sv)
+		{
+			// Get the priority
+			auto priority = value.asNumber<std::uint64_t>();
+
+			// Check that the value is valid
+			if (priority > TrafficShaper::kMaxPriority)
+			{
+				utils::json::decoder::throwWithLocation(value,
+					std::runtime_error(std::format("priority of template transaction must not exceed {}", TrafficShaper::kMaxPriority)));
+			}
+
+			_sendRequest.setPriority(Priority(priority));
+		}
+		else if (name == "maxBatchSize"sv)
+		{
+			// Get the batch size
+			auto maxBatchSize = value.asNumber<std::size_t>();
+
+			// Check that the value is valid
+			if (maxBatchSize == 0)
+			{
+				utils::json::decoder::throwWithLocation(value, std::runtime_error("maximum batch size of template transaction must not be zero"));
+			}
+
+			_maxBatchSize = maxBatchSize;
+		}
+		else if (name == "adaptiveBatching"sv)
+		{
+			loadAdaptiveBatching(value);
+		}
+		else if (name == "realTimeMemory"sv)
+		{
+			loadRealTimeMemory(value);
+		}
+		else if (name == "wireFormat"sv)
+		{
+			// Get the wire format
+			auto wireFormat = value.asString<std::string>();
+
+			if (wireFormat == "binary"sv)
+			{
+				_wireFormat = WireFormat::Binary;
+			}
+			else if (wireFormat == "json"sv)
+			{
+				_wireFormat = WireFormat::Json;
+			}
+			else
+			{
+				utils::json::decoder::throwWithLocation(value,
+					std::runtime_error("unknown wire format for template transaction. Must be \"binary\" or \"json\""));
+			}
+		}
+		else if (name == "timeStamps"sv)
+		{
+			// Get the time stamp mode
+			auto timeStampMode = value.asString<std::string>();
+
+			if (timeStampMode == "none"sv)
+			{
+				_timeStampMode = TimeStampMode::None;
+			}
+			else if (timeStampMode == "collect"sv)
+			{
+				_timeStampMode = TimeStampMode::Collect;
+			}
+			else
+			{
+				utils::json::decoder::throwWithLocation(value,
+					std::runtime_error("unknown time stamp mode for template transaction. Must be \"none\" or \"collect\""));
+			}
+		}
+		else if (name == "publishInterval"sv)
+		{
+			// The interval is given in milliseconds
+			const auto interval = value.asNumber<double>();
+			if (interval < 0)
+			{
+				utils::json::decoder::throwWithLocation(value, std::runtime_error("publish interval of template transaction must not be negative"));
+			}
+
+			_publishInterval = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double, std::milli>(interval));
+		}
+		else if (name == "publishOnChange"sv)
+		{
+			_publishOnChange = value.asBool();
+		}
+		else if (name == "drainTimeout"sv)
+		{
+			// The timeout is given in milliseconds
+			const auto timeout = value.asNumber<double>();
+			if (timeout < 0)
+			{
+				utils::json::decoder::throwWithLocation(value, std::runtime_error("drain timeout of template transaction must not be negative"));
+			}
+
+			_drainTimeout = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double, std::milli>(timeout));
+		}
+		else if (name == "timeToLive"sv)
+		{
+			// The time to live is given in milliseconds
+			const auto timeToLive = value.asNumber<double>();
+			if (timeToLive <= 0)
+			{
+				utils::json::decoder::throwWithLocation(value, std::runtime_error("time to live of template transaction must be greater than zero"));
+			}
+
+			_timeToLive = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double, std::milli>(timeToLive));
+		}
+		else if (name == "residueFile"sv)
+		{
+			auto path = value.asString<std::string>();
+			if (path.empty())
+			{
+				utils::json::decoder::throwWithLocation(value, std::runtime_error("empty residue file path for template transaction"));
+			}
+
+			_residueFile.emplace(std::move(path));
+		}
+		else if (name == "logPreparation"sv)
+		{
+			_logPreparation = value.asBool();
+		}
+		else if (name == "sentEventInterval"sv)
+		{
+			// Get the number of sends per event
+			auto sentEventInterval = value.asNumber<std::uint64_t>();
+
+			// Check that the value is valid
+			if (sentEventInterval == 0)
+			{
+				utils::json::decoder::throwWithLocation(value, std::runtime_error("sent event interval of template transaction must not be zero"));
+			}
+
+			_sentEventInterval = sentEventInterval;
+		}
 		/// @todo load custom configuration parameters
 		else if (name == "TODO"sv)
 		{
 			/// @todo parse the value correctly
 			auto todo = value.asNumber<std::uint64_t>();
 
-			/// @todo check that the value is valid
-			if (!"TODO")
-			{
-				/// @todo use an error message that tells the user exactly what is wrong
-				utils::json::decoder::throwWithLocation(value, std::runtime_error("TODO is wrong with TODO parameter of template transaction"));
-			}
+			/// @todo check that the value is valid
+			if (!"TODO")
+			{
+				/// @todo use an error message that tells the user exactly what is wrong
+				utils::json::decoder::throwWithLocation(value, std::runtime_error("TODO is wrong with TODO parameter of template transaction"));
+			}
+
+			/// @todo set the appropriate member variables
+		}
+		else
+		{
+            config::throwUnknownParameterError(name);
+		}
+    }
+
+	// With a time to live, data collected during outages is sent after newer data, so the service instance needs the time
+	// stamps to put it back in order
+	if (_timeToLive > std::chrono::nanoseconds::zero() && _timeStampMode == TimeStampMode::None)
+	{
+		utils::json::decoder::throwWithLocation(jsonObject,
+			std::runtime_error("template transaction with a time to live must send time stamps. Set \"timeStamps\" to \"collect\""));
+	}
+
+	/// @todo perform consistency and completeness checks
+	if (!"TODO")
+	{
+		/// @todo use an error message that tells the user exactly what is wrong
+		utils::json::decoder::throwWithLocation(jsonObject, std::runtime_error("TODO is wrong with template transaction"));
+	}
+}
+
+auto TemplateTransaction::performCollectTask(const process::ExecutionContext &context) -> void
+{
+	// Collect the data
+	collectData(context.scheduledTime());
+}
+
+auto TemplateTransaction::collectData(std::chrono::system_clock::time_point timeStamp) -> void
+{
+	// The "collectAndSend" task may be collecting at the same time, if both tasks are scheduled
+	std::scoped_lock collectLock { _collectMutex };
+	auto segment = collectSegment(timeStamp);
+
+	// The send task, or the "collectAndSend" task, may be working on the pending data at the same time
+	std::scoped_lock lock { _inFlightMutex };
+
+	// Only keep the segment if there actually is any data
+	if (!segment._data.empty())
+	{
+		_pendingData.push_back(std::move(segment));
+	}
+	else
+	{
+		recycleSegments(std::span(&segment, 1));
+	}
+
+	// The chunks of array and blob records follow the other records
+	_pendingData.insert(_pendingData.end(), std::make_move_iterator(_streamedChunks.begin()), std::make_move_iterator(_streamedChunks.end()));
+	_streamedChunks.clear();
+}
+
+auto TemplateTransaction::collectSegment(std::chrono::system_clock::time_point timeStamp) -> Segment
+{
+	// Switch over to reloaded records, if there are any
+	if (auto table = _recordTables.take())
+	{
+		switchRecordTable(std::move(table));
+	}
+
+	// Only read the clock if the flight recorder actually needs it
+	auto &flightRecorder = _client.get().flightRecorder();
+	const auto collectStart = flightRecorder.enabled() ? FlightRecorder::Clock::now() : FlightRecorder::Clock::time_point();
+
+	// Go through all the groups of records that are due, and collect the data into a new segment
+	auto segment = takeSegment(timeStamp);
+	const auto capacity = segment._data.capacity();
+	for (auto &&group : _recordTable->_sampleGroups)
+	{
+		// Aggregating records need all the samples, even if they are not sent in this cycle
+		for (auto &&record : group._aggregatingRecords)
+		{
+			record.get().sample();
+		}
+
+		if (timeStamp < group._nextDue)
+		{
+			continue;
+		}
+
+		// Schedule the next send at the next multiple of the interval, skipping any that were missed
+		if (group._interval > std::chrono::nanoseconds::zero())
+		{
+			const auto sinceEpoch = std::chrono::duration_cast<std::chrono::nanoseconds>(timeStamp.time_since_epoch());
+			group._nextDue = std::chrono::system_clock::time_point(
+				std::chrono::duration_cast<std::chrono::system_clock::duration>(sinceEpoch - sinceEpoch % group._interval + group._interval));
+		}
+
+		for (auto &&run : group._encodingRuns)
+		{
+			run._encoder(run._records, timeStamp, segment._data);
+		}
+
+		for (auto &&record : group._streamedRecords)
+		{
+			streamRecord(record, timeStamp);
+		}
+
+		for (auto &&record : group._aggregatingRecords)
+		{
+			record.get().resetAggregate();
+		}
+	}
+
+	// Count it as an allocation if the segment had to grow
+	_hotPathMemory.recordGrowth(capacity, segment._data.capacity());
+
+	if (flightRecorder.enabled() && !segment._data.empty())
+	{
+		flightRecorder.record(
+			FlightEvent::Collect, *this, collectStart, FlightRecorder::Clock::now() - collectStart, segment._data.size());
+	}
+
+	return segment;
+}
+
+auto TemplateTransaction::streamRecord(const TemplateRecord &record, std::chrono::system_clock::time_point timeStamp) -> void
+{
+	const auto value = record.readStreamed();
+	if (!value)
+	{
+		return;
+	}
+
+	// Make a segment for each chunk that holds only the header, and sends the bytes of the chunk directly from the value.
+	// Even an empty value gets a chunk, so that the remote service is sent the quality and the time stamp.
+	const auto chunksCapacity = _streamedChunks.capacity();
+	std::size_t offset = 0;
+	do
+	{
+		const auto size = std::min(record.chunkSize(), value->_bytes.size() - offset);
+
+		auto chunk = takeSegment(timeStamp);
+		record.appendChunkHeader(*value, offset, size, _timeStampMode, timeStamp, chunk._data);
+		chunk._payload = value->_bytes.subspan(offset, size);
+		chunk._payloadOwner = value->_owner;
+		_streamedChunks.push_back(std::move(chunk));
+
+		offset += size;
+	} while (offset < value->_bytes.size());
+	_hotPathMemory.recordGrowth(chunksCapacity, _streamedChunks.capacity());
+}
+
+auto TemplateTransaction::takeSegment(std::chrono::system_clock::time_point timeStamp) -> Segment
+{
+	if (_hotPathMemory.enabled())
+	{
+		std::scoped_lock lock { _spareSegmentsMutex };
+		if (!_spareSegments.empty())
+		{
+			auto segment = std::move(_spareSegments.back());
+			_spareSegments.pop_back();
+			segment._timeStamp = timeStamp;
+			return segment;
+		}
+
+		// All the preallocated segments are in use, so we need a new one
+		_hotPathMemory.recordAllocation();
+	}
+
+	return Segment { timeStamp };
+}
+
+template <typename Segments>
+auto TemplateTransaction::recycleSegments(Segments &&segments) noexcept -> void
+{
+	if (!_hotPathMemory.enabled())
+	{
+		return;
+	}
+
+	std::scoped_lock lock { _spareSegmentsMutex };
+	for (auto &&segment : segments)
+	{
+		// Never keep more segments than were preallocated, so that the list of spare segments does not have to grow
+		if (_spareSegments.size() == _spareSegments.capacity())
+		{
+			break;
+		}
+
+		// Clearing the data keeps the buffer
+		segment._data.clear();
+		segment._payload = {};
+		segment._payloadOwner.reset();
+		_spareSegments.push_back(std::move(segment));
+	}
+}
+
+auto TemplateTransaction::loadRealTimeMemory(utils::json::decoder::Value &value) -> void
+{
+	// Interpret the value as an object
+	auto jsonObject = value.asObject();
+
+	// Go through all the members of the JSON object
+	for (auto && [name, value] : jsonObject)
+	{
+		// All the parameters are positive integers
+		const auto number = value.asNumber<std::size_t>();
+		if (number == 0)
+		{
+			utils::json::decoder::throwWithLocation(value,
+				std::runtime_error("real-time memory parameters of template transaction must not be zero"));
+		}
+
+		if (name == "segmentCount"sv)
+		{
+			_realTimeSegmentCount = number;
+		}
+		else if (name == "segmentSize"sv)
+		{
+			_realTimeSegmentSize = number;
+		}
+		else
+		{
+			config::throwUnknownParameterError(name);
+		}
+	}
+
+	// We need both limits to size the buffers
+	if (_realTimeSegmentCount == 0 || _realTimeSegmentSize == 0)
+	{
+		utils::json::decoder::throwWithLocation(jsonObject,
+			std::runtime_error("real-time memory mode of template transaction needs a segment count and a segment size"));
+	}
+}
+
+auto TemplateTransaction::prepareRealTimeMemory() -> void
+{
+	if (_realTimeSegmentCount == 0)
+	{
+		return;
+	}
+
+	// Lock all memory allocated for the containers from now on
+	_hotPathMemory.enable();
+
+	// Preallocate the segments, and lock their buffers
+	_spareSegments.reserve(_realTimeSegmentCount);
+	lockAndPrefault(_spareSegments.data(), _spareSegments.capacity() * sizeof(Segment));
+	for (std::size_t index = 0; index < _realTimeSegmentCount; ++index)
+	{
+		Segment segment;
+		segment._data.resize(_realTimeSegmentSize);
+		lockAndPrefault(segment._data.data(), segment._data.size());
+		segment._data.clear();
+		_spareSegments.push_back(std::move(segment));
+	}
+
+	// Make room for sending all the segments in a single batch
+	_inFlight.reserve(_realTimeSegmentCount);
+	lockAndPrefault(_inFlight.data(), _inFlight.capacity() * sizeof(Segment));
+	// Segments holding chunks of array and blob records need a second buffer for the chunk
+	_inFlightBuffers.reserve(_realTimeSegmentCount * 2);
+	lockAndPrefault(_inFlightBuffers.data(), _inFlightBuffers.capacity() * sizeof(BatchWriter::Buffer));
+	_streamedChunks.reserve(_realTimeSegmentCount);
+	lockAndPrefault(_streamedChunks.data(), _streamedChunks.capacity() * sizeof(Segment));
+
+	// Fill the queue once, so that its pool holds enough memory for all the segments. The pool keeps the memory when the
+	// queue is cleared.
+	_pendingData.resize(_realTimeSegmentCount);
+	_pendingData.clear();
+
+	// Any allocation from now on means that the limits were too small
+	_hotPathMemory.arm();
+}
+
+auto TemplateTransaction::loadAdaptiveBatching(utils::json::decoder::Value &value) -> void
+{
+	// Interpret the value as an object
+	auto jsonObject = value.asObject();
+
+	// Go through all the members of the JSON object
+	BatchSizeController::Config config;
+	for (auto && [name, value] : jsonObject)
+	{
+		// All the parameters are positive numbers
+		const auto number = value.asNumber<double>();
+		if (number <= 0)
+		{
+			utils::json::decoder::throwWithLocation(value,
+				std::runtime_error("adaptive batching parameters of template transaction must be greater than zero"));
+		}
+
+		if (name == "minBatchSize"sv)
+		{
+			config._minSize = std::size_t(number);
+		}
+		else if (name == "maxBatchSize"sv)
+		{
+			config._maxSize = std::size_t(number);
+		}
+		else if (name == "latencyTarget"sv)
+		{
+			// The latency is given in milliseconds
+			config._latencyTarget = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double, std::milli>(number));
+		}
+		else if (name == "maxDelay"sv)
+		{
+			// The delay is given in milliseconds
+			config._maxDelay = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double, std::milli>(number));
+		}
+		else if (name == "increase"sv)
+		{
+			config._increase = std::size_t(number);
+		}
+		else if (name == "decreaseFactor"sv)
+		{
+			if (number >= 1)
+			{
+				utils::json::decoder::throwWithLocation(value,
+					std::runtime_error("decrease factor of template transaction must be less than one"));
+			}
+			config._decrease = number;
+		}
+		else
+		{
+			config::throwUnknownParameterError(name);
+		}
+	}
+
+	// Check that the sizes make sense
+	if (config._minSize == 0 || config._minSize > config._maxSize)
+	{
+		utils::json::decoder::throwWithLocation(jsonObject,
+			std::runtime_error("minimum batch size of template transaction must be between 1 and the maximum batch size"));
+	}
+
+	_batchSizeController.configure(config);
+	_batchSizeTarget = _batchSizeController.target();
+}
+
+auto TemplateTransaction::performSendTask(const process::ExecutionContext &context) -> void
+{
+	// Keep the I/O reactor from resuming the current batch while we are working on it
+	std::scoped_lock lock { _inFlightMutex };
+
+	sendOrDiscard(context.scheduledTime());
+}
+
+auto TemplateTransaction::performCollectAndSendTask(const process::ExecutionContext &context) -> void
+{
+	const auto timeStamp = context.scheduledTime();
+
+	// Collect the data. The "collect" task may be collecting at the same time, if both tasks are scheduled.
+	std::scoped_lock collectLock { _collectMutex };
+	auto segment = collectSegment(timeStamp);
+
+	// Keep the I/O reactor from resuming the current batch while we are working on it
+	std::scoped_lock lock { _inFlightMutex };
+
+	// Send the segment directly if possible, and queue it otherwise
+	if (!segment._data.empty())
+	{
+		if (!sendDirectly(segment, timeStamp))
+		{
+			_pendingData.push_back(std::move(segment));
+		}
+	}
+	else
+	{
+		recycleSegments(std::span(&segment, 1));
+	}
+
+	// The chunks of array and blob records are sent after the other records, so that they do not hold them up
+	_pendingData.insert(_pendingData.end(), std::make_move_iterator(_streamedChunks.begin()), std::make_move_iterator(_streamedChunks.end()));
+	_streamedChunks.clear();
+
+	// Send anything else that is pending, like backlog or data held back by adaptive batching
+	sendOrDiscard(timeStamp);
+}
+
+auto TemplateTransaction::sendDirectly(Segment &segment, std::chrono::system_clock::time_point timeStamp) -> bool
+{
+	// Only send the segment directly if it would be sent next anyway, so that the data stays in order. Data from the backlog
+	// is sent after new data anyway, so it does not matter here.
+	if (_writeSubmitted || _writer.pending() || !_pendingData.empty() || !_residue.empty() || !_client.get().connected())
+	{
+		return false;
+	}
+
+	// With adaptive batching, small segments are held back and sent together
+	const auto size = segment.size();
+	if (!_batchSizeController.shouldFlush(size, std::chrono::nanoseconds::zero()))
+	{
+		return false;
+	}
+
+	auto slot = acquireSlot(size, timeStamp);
+	if (!slot)
+	{
+		return false;
+	}
+
+	// The segment becomes the batch, so its buffer is written to the connection without being copied or queued
+	const auto inFlightCapacity = _inFlight.capacity();
+	_inFlight.clear();
+	_inFlight.push_back(std::move(segment));
+	_hotPathMemory.recordGrowth(inFlightCapacity, _inFlight.capacity());
+	startBatch(std::move(slot), size, timeStamp);
+
+	return true;
+}
+
+auto TemplateTransaction::sendOrDiscard(std::chrono::system_clock::time_point timeStamp) -> void
+{
+	// Only perform the read only if the client is connected
+	if (!_client.get().connected())
+	{
+		// Keep the current batch for the next connection, unless the send ring is still writing it. In that case,
+		// completeWrite() will deal with it. This must be done first, because the batch is older than the pending data.
+		if (!_writeSubmitted)
+		{
+			requeueBatch();
+		}
+		// With a time to live, keep the pending data as backlog, to be sent once the connection is back. Otherwise, clear it,
+		// so it doesn't accumulate indefinitely.
+		if (_timeToLive > std::chrono::nanoseconds::zero())
+		{
+			_backlog.insert(_backlog.end(), std::make_move_iterator(_pendingData.begin()), std::make_move_iterator(_pendingData.end()));
+			dropExpired(_backlog, timeStamp);
+		}
+		else
+		{
+			recycleSegments(_pendingData);
+		}
+		_pendingData.clear();
+		// We are no longer waiting to send anything
+		_client.get().cancelSendRequest(_sendRequest, timeStamp);
+
+		return;
+	}
+
+	// Send the data
+	send(timeStamp);
+}
+
+auto TemplateTransaction::send(std::chrono::system_clock::time_point timeStamp, bool flush) -> void
+{
+	// If part of the current batch is still being written by the send ring, completeWrite() will continue it
+	if (_writeSubmitted)
+	{
+		return;
+	}
+
+	// Send any data left over from last time first. With a time to live, it is treated like any other backlog.
+	if (!_residue.empty())
+	{
+		auto &queue = _timeToLive > std::chrono::nanoseconds::zero() ? _backlog : _pendingData;
+		queue.insert(queue.begin(), std::make_move_iterator(_residue.begin()), std::make_move_iterator(_residue.end()));
+		_residue.clear();
+	}
+
+	// Drop any data that is too old to be of use
+	dropExpired(_pendingData, timeStamp);
+	dropExpired(_backlog, timeStamp);
+
+	// Finish writing any batch that could not be written completely last time
+	if (_writer.pending())
+	{
+		_inFlightSlot.unpark();
+		if (!writeBatch(timeStamp))
+		{
+			return;
+		}
+	}
+
+	// Get the amount of pending data for adaptive batching
+	std::size_t pendingSize = 0;
+	if (_batchSizeController.enabled())
+	{
+		for (auto &&segment : _pendingData)
+		{
+			pendingSize += segment.size();
+		}
+	}
+
+	// Send the data in batches, so that other transactions get a chance to go in between
+	while (!_pendingData.empty() && _client.get().connected())
+	{
+		// With adaptive batching, hold the data back until there is enough of it, or until it has waited long enough
+		const auto age = std::chrono::nanoseconds(timeStamp - _pendingData.front()._timeStamp);
+		if (!flush && !_batchSizeController.shouldFlush(pendingSize, age))
+		{
+			// Make sure the data is sent once it has waited for the maximum delay, even if the task does not run again by then
+			scheduleFlush(_batchSizeController.maxDelay() - age);
+			break;
+		}
+		const auto maxBatchSize = batchSizeLimit();
+
+		// Determine which segments go into the next batch. We always send at least one segment, even if it is larger
+		// than the maximum batch size.
+		auto batchEnd = _pendingData.begin();
+		std::size_t batchSize = 0;
+		do
+		{
+			batchSize += batchEnd->size();
+			++batchEnd;
+		} while (batchEnd != _pendingData.end() && batchSize + batchEnd->size() <= maxBatchSize);
+
+		if (!sendBatch(_pendingData, _pendingData.begin(), batchEnd, batchSize, timeStamp))
+		{
+			return;
+		}
+		pendingSize -= std::min(pendingSize, batchSize);
+	}
+
+	// Fill the bandwidth that is left with the backlog, newest data first, so that the most recent history is filled in first.
+	// The segments keep their time stamps, so the service instance can put the data back in order.
+	while (!_backlog.empty() && _client.get().connected())
+	{
+		const auto maxBatchSize = batchSizeLimit();
+
+		// Determine which segments go into the next batch, working backwards from the newest segment
+		auto batchBegin = _backlog.end();
+		std::size_t batchSize = 0;
+		do
+		{
+			--batchBegin;
+			batchSize += batchBegin->size();
+		} while (batchBegin != _backlog.begin() && batchSize + std::prev(batchBegin)->size() <= maxBatchSize);
+
+		if (!sendBatch(_backlog, batchBegin, _backlog.end(), batchSize, timeStamp))
+		{
+			return;
+		}
+	}
+}
+
+auto TemplateTransaction::batchSizeLimit() const noexcept -> std::size_t
+{
+	return _batchSizeController.enabled() ? std::min(_maxBatchSize, _batchSizeController.target()) : _maxBatchSize;
+}
+
+auto TemplateTransaction::sendBatch(SegmentQueue &queue,
+	SegmentQueue::iterator begin,
+	SegmentQueue::iterator end,
+	std::size_t size,
+	std::chrono::system_clock::time_point timeStamp) -> bool
+{
+	auto slot = acquireSlot(size, timeStamp);
+	if (!slot)
+	{
+		return false;
+	}
+
+	// Take the data
+	const auto inFlightCapacity = _inFlight.capacity();
+	_inFlight.assign(std::make_move_iterator(begin), std::make_move_iterator(end));
+	queue.erase(begin, end);
+	_hotPathMemory.recordGrowth(inFlightCapacity, _inFlight.capacity());
+
+	return startBatch(std::move(slot), size, timeStamp);
+}
+
+auto TemplateTransaction::acquireSlot(std::size_t size, std::chrono::system_clock::time_point timeStamp) -> SendScheduler::Slot
+{
+	// Wait for our turn to use the connection
+	auto slot = _client.get().acquireSendSlot(_sendRequest.priority(), size);
+	_waitTime.store(slot.waitTime().count(), std::memory_order_relaxed);
+	// If another transaction is still waiting to complete a batch, try again next time
+	if (!slot)
+	{
+		return {};
+	}
+
+	// Ask the client for permission, so we don't exceed the configured bandwidth
+	if (!_client.get().acquireSendBudget(_sendRequest, size, timeStamp))
+	{
+		// Keep the data and try again next time
+		return {};
+	}
+
+	return slot;
+}
+
+auto TemplateTransaction::startBatch(SendScheduler::Slot slot, std::size_t size, std::chrono::system_clock::time_point timeStamp)
+	-> bool
+{
+	// Make a buffer for each segment, and one for its payload, if any
+	const auto buffersCapacity = _inFlightBuffers.capacity();
+	_inFlightBuffers.clear();
+	for (auto &&segment : _inFlight)
+	{
+		_inFlightBuffers.emplace_back(
+			static_cast<const std::byte *>(static_cast<const void *>(segment._data.data())), segment._data.size());
+		if (!segment._payload.empty())
+		{
+			_inFlightBuffers.push_back(segment._payload);
+		}
+	}
+	_hotPathMemory.recordGrowth(buffersCapacity, _inFlightBuffers.capacity());
+	_writer.start(_inFlightBuffers);
+	_inFlightSize = size;
+	_inFlightStart = std::chrono::steady_clock::now();
+	_inFlightSlot = std::move(slot);
+	// Remember which connection the data is sent on, so late results can be recognized
+	_inFlightGeneration = _client.get().connectionGeneration();
+
+	// Write as much as possible
+	return writeBatch(timeStamp);
+}
+
+auto TemplateTransaction::dropExpired(SegmentQueue &queue, std::chrono::system_clock::time_point timeStamp) noexcept -> void
+{
+	if (_timeToLive <= std::chrono::nanoseconds::zero())
+	{
+		return;
+	}
+
+	// The segments are in the order they were collected, so the expired ones are all at the front
+	const auto expiryTime = timeStamp - _timeToLive;
+	const auto expiredEnd =
+		std::ranges::partition_point(queue, [&](const Segment &segment) { return segment._timeStamp < expiryTime; });
+	if (expiredEnd == queue.begin())
+	{
+		return;
+	}
+
+	_expiredSegments.fetch_add(std::uint64_t(expiredEnd - queue.begin()), std::memory_order_relaxed);
+	recycleSegments(std::ranges::subrange(queue.begin(), expiredEnd));
+	queue.erase(queue.begin(), expiredEnd);
+}
+
+auto TemplateTransaction::writeBatch(std::chrono::system_clock::time_point timeStamp) -> bool
+{
+	auto &client = _client.get();
+
+	// Pin the connection, so that it is not closed while we write to it, even if it is replaced in the meantime. If the client
+	// was disconnected, keep the batch for the next connection.
+	const auto handle = client.handle();
+	if (!handle)
+	{
+		requeueBatch();
+		return false;
+	}
+
+	// If the connection was replaced in the meantime, the batch must be sent again from the start
+	const auto generation = handle->generation();
+	if (generation != _inFlightGeneration)
+	{
+		_writer.rewind();
+		_inFlightGeneration = generation;
+	}
+
+	try
+	{
+		// Hand the batch to the send ring, if available. The result is passed to completeWrite() on a reactor thread.
+		if (client.writeAsync(handle,
+				_writer.remaining(),
+				[this](std::error_code error, std::size_t written) { completeWrite(error, written); }))
+		{
+			// Park the slot while the write is in progress, just like when the connection is not ready
+			_inFlightSlot.park();
+			_writeSubmitted = true;
+			return false;
+		}
+
+		// Write as much as the connection will take
+		if (!_writer.resume([&](std::span<const BatchWriter::Buffer> buffers) { return client.write(*handle, buffers); }))
+		{
+			// Keep the batch until the connection is ready again. Park the slot, so that no other transaction writes into the middle
+			// of our batch, but without making them wait.
+			_inFlightSlot.park();
+			// Have the client resume the batch as soon as the connection is ready. If it can't, the next send cycle will do it.
+			client.notifyWhenWritable([this] { resumeBatch(); });
+			return false;
+		}
+	}
+	catch (const std::exception &)
+	{
+		// Get the error from the current exception using this special utility function
+		const auto error = utils::eh::currentErrorCode();
+		// Keep the batch, so that it is sent again from the start, either on the replacement connection or once the client
+		// has reconnected
+		requeueBatch();
+		// Update the state
+		handleSendError(timeStamp, error, generation);
+
+		return false;
+	}
+
+	// The batch is complete. Let the adaptive batching know how long it took, including any time spent waiting for the
+	// connection to become ready again.
+	const auto batchDuration = std::chrono::steady_clock::now() - _inFlightStart;
+	if (_batchSizeController.enabled())
+	{
+		_batchSizeController.batchCompleted(_inFlightSize, batchDuration);
+		_batchSizeTarget.store(_batchSizeController.target(), std::memory_order_relaxed);
+	}
+	_client.get().flightRecorder().record(FlightEvent::Batch, *this, _inFlightStart, batchDuration, _inFlightSize);
+	recycleSegments(_inFlight);
+	_inFlight.clear();
+	_inFlightSlot.reset();
+	updateState(timeStamp);
+
+	return true;
+}
+
+auto TemplateTransaction::resumeBatch() -> void
+{
+	// If the send task is busy, leave the batch to it. We must not wait for it here, because it may be waiting for the
+	// client to unregister the connection from the reactor, which in turn waits for us.
+	std::unique_lock lock { _inFlightMutex, std::try_to_lock };
+	if (!lock || !_writer.pending() || _writeSubmitted)
+	{
+		return;
+	}
+
+	_inFlightSlot.unpark();
+	writeBatch(std::chrono::system_clock::now());
+}
+
+auto TemplateTransaction::completeWrite(std::error_code error, std::size_t written) -> void
+{
+	// We can wait for the send task here, because it never waits for the send ring
+	std::scoped_lock lock { _inFlightMutex };
+	_writeSubmitted = false;
+	// Waiters check the state again once we release the lock, so we can notify them right away
+	_writeCompleted.notify_all();
+
+	const auto timeStamp = std::chrono::system_clock::now();
+	auto &client = _client.get();
+
+	// If the client was disconnected in the meantime, keep the batch for the next connection
+	if (!client.connected())
+	{
+		requeueBatch();
+		return;
+	}
+
+	// If the connection was not ready, wait until it is
+	if (error == std::errc::resource_unavailable_try_again)
+	{
+		client.notifyWhenWritable([this] { resumeBatch(); });
+		return;
+	}
+
+	if (error)
+	{
+		// Keep the batch, so that it is sent again from the start
+		requeueBatch();
+		// Update the state
+		handleSendError(timeStamp, error, _inFlightGeneration);
+		return;
+	}
 
-			/// @todo set the appropriate member variables
-		}
-		else
+	// Continue with the rest of the batch
+	_writer.advance(written);
+	_inFlightSlot.unpark();
+	writeBatch(timeStamp);
+}
+
+auto TemplateTransaction::waitForSubmittedWrite() -> void
+{
+	std::unique_lock lock { _inFlightMutex };
+	_writeCompleted.wait(lock, [this] { return !_writeSubmitted; });
+}
+
+auto TemplateTransaction::startSending(std::chrono::system_clock::time_point timeStamp) -> void
+{
+	// Make sure the handles have been resolved
+	finishPreparation();
+
+	// Allow adaptive batching to flush held back data using a timer
+	{
+		std::scoped_lock lock { _flushTimerMutex };
+		_flushTimerStopped = false;
+	}
+
+	// Request a connection
+	requestConnect(timeStamp);
+}
+
+auto TemplateTransaction::stopSending(std::chrono::system_clock::time_point timeStamp) -> void
+{
+	// The remaining data is flushed by drain() below
+	stopFlushTimer();
+	// Send any remaining data, waiting at most for the drain timeout
+	drain();
+	// Keep the data alive until the send ring is done with it
+	waitForSubmittedWrite();
+	// Save whatever could not be sent, so that it can be sent after the next startup
+	saveResidue();
+
+	// Request a disconnect
+	requestDisconnect(timeStamp);
+}
+
+auto TemplateTransaction::scheduleFlush(std::chrono::nanoseconds delay) noexcept -> void
+{
+	std::scoped_lock lock { _flushTimerMutex };
+	if (_flushTimerPending || _flushTimerStopped)
+	{
+		return;
+	}
+
+	try
+	{
+		_flushTimer = _client.get().reactor().schedule(std::chrono::steady_clock::now() + delay, [this] { flushTimerExpired(); });
+		_flushTimerPending = true;
+	}
+	catch (const std::exception &)
+	{
+		// The next cycle of the task will send the data instead
+	}
+}
+
+auto TemplateTransaction::flushTimerExpired() -> void
+{
+	{
+		std::scoped_lock lock { _flushTimerMutex };
+		_flushTimerPending = false;
+		if (_flushTimerStopped)
 		{
-            config::throwUnknownParameterError(name);
+			return;
 		}
-    }
+	}
 
-	/// @todo perform consistency and completeness checks
-	if (!"TODO")
+	// If the task or the reactor are busy with the current batch, try again shortly. We must not wait for them here, because
+	// they may be waiting for another reactor callback, just like in resumeBatch().
+	std::unique_lock lock { _inFlightMutex, std::try_to_lock };
+	if (!lock)
 	{
-		/// @todo use an error message that tells the user exactly what is wrong
-		utils::json::decoder::throwWithLocation(jsonObject, std::runtime_error("TODO is wrong with template transaction"));
+		scheduleFlush(kFlushRetryDelay);
+		return;
 	}
+
+	// Adaptive batching decides again whether the data has waited long enough, and restarts the timer if it hasn't
+	sendOrDiscard(std::chrono::system_clock::now());
 }
 
-auto TemplateTransaction::performCollectTask(const process::ExecutionContext &context) -> void
+auto TemplateTransaction::stopFlushTimer() noexcept -> void
 {
-	// Collect the data
-	collectData(context.scheduledTime());
+	Reactor::TimerId flushTimer = 0;
+	{
+		std::scoped_lock lock { _flushTimerMutex };
+		_flushTimerStopped = true;
+		flushTimer = _flushTimer;
+	}
+	// This waits for the timer if it is running, so it can no longer use the transaction afterwards
+	_client.get().reactor().cancel(flushTimer);
 }
 
-auto TemplateTransaction::collectData(std::chrono::system_clock::time_point timeStamp) -> void
+auto TemplateTransaction::drain() -> void
 {
-	// Go through all the records and collect the data
-	for (auto &&record : _records)
+	const auto deadline = std::chrono::steady_clock::now() + _drainTimeout;
+
+	std::unique_lock lock { _inFlightMutex };
+	for (;;)
 	{
-		record.collect(timeStamp,  _pendingData);
+		// If the client is not connected, we keep the data for the residue file
+		if (!_client.get().connected())
+		{
+			return;
+		}
+
+		// Send as much as possible. We use the current time, so that the traffic shaper lets more data through as time passes.
+		send(std::chrono::system_clock::now(), true);
+
+		// Stop if everything has been sent, or if we have run out of time
+		if ((_pendingData.empty() && _backlog.empty() && _residue.empty() && !_writer.pending()) ||
+			std::chrono::steady_clock::now() >= deadline)
+		{
+			return;
+		}
+
+		// Give the send ring and the I/O reactor a chance to make progress
+		constexpr std::chrono::milliseconds kPollInterval { 10 };
+		_writeCompleted.wait_until(lock, std::min(deadline, std::chrono::steady_clock::now() + kPollInterval));
 	}
 }
 
-auto TemplateTransaction::performSendTask(const process::ExecutionContext &context) -> void
+auto TemplateTransaction::saveResidue() -> void
 {
-	// Only perform the read only if the client is connected
-	if (!_client.get().connected())
+	if (!_residueFile)
 	{
-		// Clear any pending data, so it doesn't accumulate indefinitely
-		_pendingData.clear();
+		return;
+	}
+
+	std::scoped_lock lock { _inFlightMutex };
+
+	// Save the data in the order it would have been sent. The current batch is saved as a whole, because an incomplete batch is
+	// always sent again from the start on a new connection.
+	std::vector<ResidueFile::Block> blocks;
+	const auto addBlocks = [&](const auto &segments) {
+		for (auto &&segment : segments)
+		{
+			blocks.push_back({ segment._timeStamp,
+				{ static_cast<const std::byte *>(static_cast<const void *>(segment._data.data())), segment._data.size() },
+				segment._payload });
+		}
+	};
+	addBlocks(_residue);
+	addBlocks(_backlog);
+	if (_writer.pending())
+	{
+		addBlocks(_inFlight);
+	}
+	addBlocks(_pendingData);
 
+	try
+	{
+		_residueFile->save(blocks);
+	}
+	catch (const std::exception &)
+	{
+		// The data stays where it is, and the failure is published in the error attribute and raises the sendError event
+		updateState(std::chrono::system_clock::now(), utils::eh::currentErrorCode());
 		return;
 	}
 
-	// Send the data
-	send(context.scheduledTime());
+	// The data now belongs to the residue file
+	_residue.clear();
+	_backlog.clear();
+	abandonBatch();
+	_pendingData.clear();
 }
 
-auto TemplateTransaction::send(std::chrono::system_clock::time_point timeStamp) -> void
+auto TemplateTransaction::loadResidue() -> void
 {
-	// See if we even have data
-	if (_pendingData.empty())
+	if (!_residueFile)
 	{
 		return;
 	}
 
-	// Take the data
-	decltype(_pendingData) data;
-	// Note: std::ranges::swap honours customization points and is thus preferrable to than std::swap
-	std::ranges::swap(_pendingData, data);
-	
 	try
 	{
-		/// @todo send the data
+		for (auto &&block : _residueFile->take())
+		{
+			Segment segment { block._timeStamp };
+			appendBytes(segment._data, block._data);
+			_residue.push_back(std::move(segment));
+		}
+	}
+	catch (const std::exception &)
+	{
+		// Publish the failure in the error attribute, and raise the sendError event
+		updateState(std::chrono::system_clock::now(), utils::eh::currentErrorCode());
+	}
+}
+
+auto TemplateTransaction::abandonBatch() noexcept -> void
+{
+	_writer.reset();
+	recycleSegments(_inFlight);
+	_inFlight.clear();
+	_inFlightSlot.reset();
+}
 
-		/// @todo if the data function does not throw errors, but uses return types or internal handle state,
-		// throw an std::system_error here on failure, or call handleSendError() directly.
+auto TemplateTransaction::requeueBatch() -> void
+{
+	if (_inFlight.empty())
+	{
+		abandonBatch();
+		return;
+	}
 
-		// The write was successful
-		updateState(timeStamp);
+	// An incomplete batch is always sent again from the start, so nothing is lost even if part of it was already written
+	if (_timeToLive > std::chrono::nanoseconds::zero())
+	{
+		// The batch may have come from the pending data or from anywhere in the backlog, so sort it in by time stamp, which keeps
+		// the backlog in the order dropExpired() relies on.
+		const auto position = std::ranges::upper_bound(_backlog, _inFlight.front()._timeStamp, {}, &Segment::_timeStamp);
+		_backlog.insert(position, std::make_move_iterator(_inFlight.begin()), std::make_move_iterator(_inFlight.end()));
 	}
-	catch (const std::exception &)
+	else
 	{
-		// Get the error from the current exception using this special utility function
-		const auto error = utils::eh::currentErrorCode();
-		// Update the state
-		handleSendError(timeStamp, error);
+		// Without a time to live, there is no backlog, and the batch is older than anything collected since, so it goes first
+		_pendingData.insert(_pendingData.begin(), std::make_move_iterator(_inFlight.begin()), std::make_move_iterator(_inFlight.end()));
 	}
+
+	_writer.reset();
+	_inFlight.clear();
+	_inFlightSlot.reset();
 }
 
-auto TemplateTransaction::handleSendError(std::chrono::system_clock::time_point timeStamp, std::error_code error)
+auto TemplateTransaction::handleSendError(std::chrono::system_clock::time_point timeStamp, std::error_code error, std::uint64_t generation)
 	-> void
 {
+	// Discard errors from a connection that has already been replaced, so they don't tear down the new one
+	if (_client.get().connectionGeneration() != generation)
+	{
+		return;
+	}
+	_client.get().flightRecorder().record(FlightEvent::SendError, *this, FlightRecorder::Clock::now(), {}, generation, error);
+
 	// Update our own state
 	updateState(timeStamp, error);
 	// Notify the client
-	_client.get().handleError(timeStamp, error, this);
+	_client.get().handleError(timeStamp, error, generation, this);
 }
 
 auto TemplateTransaction::updateState(std::chrono::system_clock::time_point timeStamp, std::error_code error) -> void
 {
+	// Decide whether to publish anything. This may be called from different threads, so we need a lock.
+	std::scoped_lock lock { _publishMutex };
+
+	// A change in state is always published, and raises an event. Errors always raise the sendError event, even if they are
+	// the same as last time.
+	const auto stateChanged = error != _publishedError;
+	bool raiseEvent = stateChanged || error;
+	if (!error && !stateChanged)
+	{
+		// Raise the sent event only once for every _sentEventInterval successful sends
+		raiseEvent = ++_unreportedSends >= _sentEventInterval;
+
+		// Only publish the new send time if the event is due, or if enough time has passed
+		if (!raiseEvent && (_publishOnChange || timeStamp < _lastPublishTime + _publishInterval))
+		{
+			return;
+		}
+	}
+
 	// Make a write sentinel
 	memory::WriteSentinel sentinel { _stateDataBlock };
 	auto &state = *sentinel;
@@ -154,8 +1228,25 @@ auto TemplateTransaction::updateState(std::chrono::system_clock::time_point time
 	state._transactionState = !error;
 	state._sendTime = timeStamp;
 	state._error = error;
+	state._waitTime =
+		std::chrono::duration<double>(std::chrono::nanoseconds(_waitTime.load(std::memory_order_relaxed))).count();
+	state._batchSizeTarget = _batchSizeTarget.load(std::memory_order_relaxed);
+	state._hotPathAllocations = _hotPathMemory.allocations();
+	state._expiredSegments = _expiredSegments.load(std::memory_order_relaxed);
+
+	// Remember what we published
+	_publishedError = error;
+	_lastPublishTime = timeStamp;
+
+	// Just commit the data if no event is due
+	if (!raiseEvent)
+	{
+		sentinel.commit(timeStamp);
+		return;
+	}
 
-	// Determine the correct event
+	// Determine the correct event. Errors always raise the sendError event.
+	_unreportedSends = 0;
 	const auto &event = error ? _sendErrorEvent : _sentEvent;
 	// Commit the data and raise the event
 	sentinel.commit(timeStamp, event);
@@ -167,7 +1258,11 @@ auto TemplateTransaction::forEachAttribute(const model::ForEachAttributeFunction
 	return
 		function(attributes::kTransactionState) ||
 		function(attributes::kSendTime) ||
-		function(attributes::kError);
+		function(attributes::kError) ||
+		function(attributes::kWaitTime) ||
+		function(attributes::kBatchSizeTarget) ||
+		function(attributes::kHotPathAllocations) ||
+		function(attributes::kExpiredSegments);
 }
 
 auto TemplateTransaction::forEachEvent(const model::ForEachEventFunction &function) -> bool
@@ -185,7 +1280,9 @@ auto TemplateTransaction::forEachTask(const model::ForEachTaskFunction &function
 	// Handle all the tasks we support
 	return
 		function(tasks::kCollect, sharedFromThis(&_collectTask)) ||
-		function(tasks::kSend, sharedFromThis(&_sendTask));
+		function(tasks::kSend, sharedFromThis(&_sendTask)) ||
+		function(tasks::kCollectAndSend, sharedFromThis(&_collectAndSendTask)) ||
+		function(tasks::kReloadRecords, sharedFromThis(&_reloadRecordsTask));
 
 	/// @todo handle any additional tasks this class supports
 }
@@ -205,6 +1302,22 @@ auto TemplateTransaction::makeReadHandle(const model::Attribute &attribute) cons
 	{
 		return _stateDataBlock.member(&State::_error);
 	}
+	else if (attribute == attributes::kWaitTime)
+	{
+		return _stateDataBlock.member(&State::_waitTime);
+	}
+	else if (attribute == attributes::kBatchSizeTarget)
+	{
+		return _stateDataBlock.member(&State::_batchSizeTarget);
+	}
+	else if (attribute == attributes::kHotPathAllocations)
+	{
+		return _stateDataBlock.member(&State::_hotPathAllocations);
+	}
+	else if (attribute == attributes::kExpiredSegments)
+	{
+		return _stateDataBlock.member(&State::_expiredSegments);
+	}
 
 	/// @todo add support for any additional attributes, including attributes inherited from the client
 
@@ -219,20 +1332,255 @@ auto TemplateTransaction::realize() -> void
 
 auto TemplateTransaction::prepare() -> void
 {
-	// Resolve all the handles for the records
-	for (auto &&record : _records)
+	_preparationStart = std::chrono::steady_clock::now();
+
+	// Pick up the data left over from last time
+	loadResidue();
+
+	// Set up the buffers for real-time memory mode
+	prepareRealTimeMemory();
+
+	// Resolve the handles of the records on the worker pool, so that the transactions of large models are prepared in parallel
+	_preparationJobs = submitPreparationJobs(_records);
+
+	// Build the record table. This only uses the configuration of the records, so it can be done while the handles are still
+	// being resolved.
+	const auto sortStart = std::chrono::steady_clock::now();
+	_recordTable = buildRecordTable(std::move(_records));
+	_recordTables.reset(_recordTable);
+	_sortTime = std::chrono::steady_clock::now() - sortStart;
+}
+
+auto TemplateTransaction::submitPreparationJobs(std::span<const std::shared_ptr<TemplateRecord>> records)
+	-> std::vector<std::shared_future<void>>
+{
+	// The records are split into jobs, so that the records of a single large transaction are also resolved in parallel
+	std::vector<std::shared_future<void>> jobs;
+	auto &workerPool = _client.get().workerPool();
+	for (std::size_t offset = 0; offset < records.size(); offset += kRecordsPerPreparationJob)
+	{
+		const auto chunk = records.subspan(offset, std::min(kRecordsPerPreparationJob, records.size() - offset));
+		jobs.push_back(workerPool.submit([this, jobRecords = std::vector(chunk.begin(), chunk.end())] {
+			const auto start = std::chrono::steady_clock::now();
+
+			for (auto &&record : jobRecords)
+			{
+				record->resolveHandles(_client.get().dataPointCache());
+				record->prepareEncoding(_wireFormat);
+			}
+
+			const auto end = std::chrono::steady_clock::now();
+			_resolveTime += (end - start).count();
+			const auto endOffset = (end - _preparationStart).count();
+			for (auto latest = _resolveEnd.load(); latest < endOffset && !_resolveEnd.compare_exchange_weak(latest, endOffset);)
+			{
+			}
+		}));
+	}
+
+	return jobs;
+}
+
+auto TemplateTransaction::buildRecordTable(std::vector<std::shared_ptr<TemplateRecord>> records) const -> std::shared_ptr<RecordTable>
+{
+	auto table = std::make_shared<RecordTable>();
+	table->_records = std::move(records);
+
+	// Sort the records by sample interval and data type, so that each data type can be encoded in a single run for each
+	// interval. We use a stable sort, so records of the same type keep their relative order.
+	auto &encodingOrder = table->_encodingOrder;
+	encodingOrder.reserve(table->_records.size());
+	for (auto &&record : table->_records)
+	{
+		encodingOrder.push_back(std::cref(*record));
+	}
+	std::ranges::stable_sort(encodingOrder, {}, [](const TemplateRecord &record) {
+		return std::pair(record.sampleInterval(), record.dataType());
+	});
+
+	// Make the groups and runs
+	auto &sampleGroups = table->_sampleGroups;
+	for (auto runStart = encodingOrder.begin(); runStart != encodingOrder.end();)
+	{
+		const auto interval = runStart->get().sampleInterval();
+		const auto dataType = runStart->get().dataType();
+		const auto runEnd = std::find_if(runStart, encodingOrder.end(), [&](const TemplateRecord &record) {
+			return record.sampleInterval() != interval || record.dataType() != dataType;
+		});
+
+		if (sampleGroups.empty() || sampleGroups.back()._interval != interval)
+		{
+			sampleGroups.emplace_back()._interval = interval;
+		}
+		// Arrays and blobs are streamed in chunks in the binary wire format. In JSON, they are encoded like any other record.
+		if (_wireFormat == WireFormat::Binary && isArrayType(dataType))
+		{
+			sampleGroups.back()._streamedRecords.insert(sampleGroups.back()._streamedRecords.end(), runStart, runEnd);
+		}
+		else
+		{
+			sampleGroups.back()._encodingRuns.push_back(
+				{ TemplateRecord::runEncoder(dataType, _wireFormat, _timeStampMode), { runStart, runEnd } });
+		}
+
+		runStart = runEnd;
+	}
+
+	// Add the aggregating records to their groups
+	for (auto &&record : table->_records)
+	{
+		if (record->aggregation() != TemplateRecord::Aggregation::None)
+		{
+			auto group = std::ranges::find(sampleGroups, record->sampleInterval(), &SampleGroup::_interval);
+			group->_aggregatingRecords.push_back(std::ref(*record));
+		}
+	}
+
+	return table;
+}
+
+auto TemplateTransaction::reloadRecords(std::vector<std::shared_ptr<TemplateRecord>> records) -> void
+{
+	// Make sure the original records are complete before we compare against them
+	finishPreparation();
+
+	std::scoped_lock lock { _reloadMutex };
+
+	// Keep the current record in place of every record that is unchanged
+	const auto current = _recordTables.latest();
+	const auto newRecords = carryOverRecords<TemplateRecord>(current->_records, records);
+
+	// Resolve the handles of the new records. This rethrows any errors, so that the current records are kept.
+	for (auto &&job : submitPreparationJobs(newRecords))
+	{
+		job.get();
+	}
+
+	// Hand the new table to the "collect" task
+	_recordTables.publish(buildRecordTable(std::move(records)));
+}
+
+auto TemplateTransaction::stageRecords(std::vector<std::shared_ptr<TemplateRecord>> records) -> void
+{
+	auto staged = std::make_shared<const std::vector<std::shared_ptr<TemplateRecord>>>(std::move(records));
+
+	std::scoped_lock lock { _stagedRecordsMutex };
+	_stagedRecords = std::move(staged);
+}
+
+auto TemplateTransaction::performReloadRecordsTask() -> void
+{
+	std::shared_ptr<const std::vector<std::shared_ptr<TemplateRecord>>> staged;
 	{
-		record.resolveHandles();
+		std::scoped_lock lock { _stagedRecordsMutex };
+		staged = _stagedRecords;
+	}
+	if (!staged)
+	{
+		return;
+	}
+
+	// Reload a copy, so that the staged records are kept if this fails. The exception is passed on to the scheduler.
+	reloadRecords(*staged);
+
+	// Unstage the records, unless new ones have been staged in the meantime
+	std::scoped_lock lock { _stagedRecordsMutex };
+	if (_stagedRecords == staged)
+	{
+		_stagedRecords = nullptr;
+	}
+}
+
+auto TemplateTransaction::switchRecordTable(std::shared_ptr<RecordTable> table) -> void
+{
+	// Keep the schedule of intervals that still exist, so that reloading does not cause extra sends
+	carryOverSchedule<SampleGroup>(_recordTable->_sampleGroups, table->_sampleGroups);
+
+	// Release the previous table. Records that are not used by the new table are destroyed with it.
+	_recordTable = std::move(table);
+}
+
+auto TemplateTransaction::finishPreparation() -> void
+{
+	std::call_once(_preparationFinished, [this] {
+		const auto waitStart = std::chrono::steady_clock::now();
+
+		// Wait for all the jobs. This rethrows any error resolving the handles.
+		for (auto &&job : _preparationJobs)
+		{
+			job.get();
+		}
+
+		const auto waitTime = std::chrono::steady_clock::now() - waitStart;
+
+		if (_logPreparation)
+		{
+			using Milliseconds = std::chrono::duration<double, std::milli>;
+			std::clog << std::format("{}: prepared {} records in {} sample groups. Sorting took {}, resolving handles took {} ({} in {} jobs), "
+									 "waited {} for the jobs to finish. {} handles were shared with other records so far.\n",
+				static_cast<const model::Element &>(*this),
+				_recordTable->_encodingOrder.size(),
+				_recordTable->_sampleGroups.size(),
+				Milliseconds(_sortTime),
+				Milliseconds(std::chrono::nanoseconds(_resolveEnd.load())),
+				Milliseconds(std::chrono::nanoseconds(_resolveTime.load())),
+				_preparationJobs.size(),
+				Milliseconds(waitTime),
+				_client.get().dataPointCache().sharedLookups());
+		}
+	});
+}
+
+TemplateTransaction::~TemplateTransaction()
+{
+	// The jobs use the records, so we must wait for them even if the tasks never ran
+	for (auto &&job : _preparationJobs)
+	{
+		job.wait();
 	}
 }
 
 auto TemplateTransaction::clientStateChanged(std::chrono::system_clock::time_point timeStamp, std::error_code error) -> void
+{
+	publishClientState(timeStamp, error);
+}
+
+auto TemplateTransaction::publishClientState(std::chrono::system_clock::time_point timeStamp, std::error_code error) -> void
 {
 	// We cannot reset the error to Ok because we haven't actually sent a request yet. So we use the appropriate custom error code instead.
-	auto effectiveError = error ? error : CustomError::Pending;
+	const auto effectiveError = error ? error : std::error_code(CustomError::Pending);
 
-	// Simply update the state
-	updateState(timeStamp, error);
+	std::scoped_lock lock { _publishMutex };
+
+	// Make a write sentinel
+	memory::WriteSentinel sentinel { _stateDataBlock };
+	auto &state = *sentinel;
+
+	// Update the state, but not the send time, as nothing was sent
+	state._transactionState = false;
+	state._error = effectiveError;
+
+	// Remember what we published, so that the next successful send is published as a change in state
+	_publishedError = effectiveError;
+	_lastPublishTime = timeStamp;
+
+	// Errors of the client always raise the sendError event. Connecting does not raise any event, as nothing was sent.
+	if (error)
+	{
+		sentinel.commit(timeStamp, _sendErrorEvent);
+	}
+	else
+	{
+		sentinel.commit(timeStamp);
+	}
+}
+
+auto TemplateTransaction::CollectTask::preparePreOperational([[maybe_unused]] const process::ExecutionContext &context) -> Status
+{
+	// Make sure the handles have been resolved
+	_target.get().finishPreparation();
+
+	return Status::Completed;
 }
 
 auto TemplateTransaction::CollectTask::operational(const process::ExecutionContext &context) -> void
@@ -240,10 +1588,14 @@ auto TemplateTransaction::CollectTask::operational(const process::ExecutionConte
 	_target.get().performCollectTask(context);
 }
 
+auto TemplateTransaction::ReloadRecordsTask::operational([[maybe_unused]] const process::ExecutionContext &context) -> void
+{
+	_target.get().performReloadRecordsTask();
+}
+
 auto TemplateTransaction::SendTask::preparePreOperational(const process::ExecutionContext &context) -> Status
 {
-	// Request a connection
-	_target.get().requestConnect(context.scheduledTime());
+	_target.get().startSending(context.scheduledTime());
 
 	return Status::Completed;
 }
@@ -255,11 +1607,26 @@ auto TemplateTransaction::SendTask::operational(const process::ExecutionContext
 
 auto TemplateTransaction::SendTask::preparePostOperational(const process::ExecutionContext &context) -> Status
 {
-	// Execute the task one more time to send any remaining data
-	_target.get().performSendTask(context);
+	_target.get().stopSending(context.scheduledTime());
 
-	// Request a disconnect
-	_target.get().requestDisconnect(context.scheduledTime());
+	return Status::Completed;
+}
+
+auto TemplateTransaction::CollectAndSendTask::preparePreOperational(const process::ExecutionContext &context) -> Status
+{
+	_target.get().startSending(context.scheduledTime());
+
+	return Status::Completed;
+}
+
+auto TemplateTransaction::CollectAndSendTask::operational(const process::ExecutionContext &context) -> void
+{
+	_target.get().performCollectAndSendTask(context);
+}
+
+auto TemplateTransaction::CollectAndSendTask::preparePostOperational(const process::ExecutionContext &context) -> Status
+{
+	_target.get().stopSending(context.scheduledTime());
 
 	return Status::Completed;
 }
@@ -1,9 +1,14 @@
 // Copyright (c) embedded ocean GmbH
 #pragma once
 
+#include "BatchSizeController.hpp"
+#include "BatchWriter.hpp"
+#include "RecordReload.hpp"
 #include "TemplateClient.hpp"
 #include "TemplateRecord.hpp"
 #include "CustomError.hpp"
+#include "RealTimeMemory.hpp"
+#include "ResidueFile.hpp"
 #include "Attributes.hpp"
 
 #include <xentara/memory/Array.hpp>
@@ -14,10 +19,23 @@
 #include <xentara/skill/EnableSharedFromThis.hpp>
 #include <xentara/utils/core/RawDataBlock.hpp>
 #include <xentara/utils/core/Uuid.hpp>
+#include <xentara/utils/json/decoder/Value.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <functional>
+#include <future>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <span>
 #include <string_view>
-#include <forward_list>
+#include <vector>
 
 namespace xentara::plugins::templateUplink
 {
@@ -44,6 +62,29 @@ public:
 		client.get().addErrorSink(*this);
 	}
 
+	/// @brief Destructor. Waits for any handle resolution still running on the worker pool.
+	~TemplateTransaction();
+
+	/// @brief Replaces the records while the transaction is running.
+	///
+	/// Records that are configured exactly like one of the current records are kept, together with their handles and aggregates.
+	/// Only the handles of new records are resolved. The new records are used from the next cycle of the "collect" task on. The
+	/// connection and any data that has already been collected are not affected.
+	///
+	/// This function may be called from any thread once the model has been prepared.
+	///
+	/// @param records The new records, loaded using TemplateRecord::load()
+	/// @throw std::system_error A handle of a new record could not be resolved. The current records are kept in this case.
+	auto reloadRecords(std::vector<std::shared_ptr<TemplateRecord>> records) -> void;
+
+	/// @brief Stages new records, to be reloaded by the next cycle of the "reloadRecords" task.
+	///
+	/// Records that were staged before, but have not been reloaded yet, are replaced. This function may be called from any thread.
+	///
+	/// @param records The new records, loaded using TemplateRecord::load()
+	/// @todo call this when the configuration of the records changes, using a mechanism suitable for the service
+	auto stageRecords(std::vector<std::shared_ptr<TemplateRecord>> records) -> void;
+
 	/// @name Virtual Overrides for skill::Element
 	/// @{
 
@@ -79,8 +120,38 @@ private:
 		std::chrono::system_clock::time_point _sendTime { std::chrono::system_clock::time_point::min() };
 		/// @brief The error code when sending the records, or a default constructed std::error_code object for none.
 		std::error_code _error { CustomError::NotConnected };
+		/// @brief The time the last batch had to wait for other transactions before it could be sent, in seconds
+		double _waitTime { 0 };
+		/// @brief The batch size the adaptive batching is currently aiming for, in bytes, or 0 if adaptive batching is off
+		std::uint64_t _batchSizeTarget { 0 };
+		/// @brief The number of allocations on the hot path in real-time memory mode
+		std::uint64_t _hotPathAllocations { 0 };
+		/// @brief The number of segments dropped because they outlived their time to live
+		std::uint64_t _expiredSegments { 0 };
+	};
+
+	/// @brief A block of data collected in a single cycle
+	struct Segment final
+	{
+		/// @brief The time stamp of the cycle the data was collected in
+		std::chrono::system_clock::time_point _timeStamp;
+		/// @brief The collected data
+		utils::core::RawDataBlock _data;
+		/// @brief Data that is sent directly after _data without being copied, like a chunk of an array record
+		std::span<const std::byte> _payload;
+		/// @brief Keeps the memory of _payload alive
+		std::shared_ptr<const void> _payloadOwner;
+
+		/// @brief Gets the number of bytes sent for the segment
+		auto size() const noexcept -> std::size_t
+		{
+			return _data.size() + _payload.size();
+		}
 	};
 
+	/// @brief A queue of segments, in the order they were collected
+	using SegmentQueue = std::pmr::deque<Segment>;
+
 	/// @brief This class providing callbacks for the Xentara scheduler for the "collect" task
 	class CollectTask final : public process::Task
 	{
@@ -93,6 +164,34 @@ private:
 		/// @name Virtual Overrides for process::Task
 		/// @{
 
+		auto stages() const -> Stages final
+		{
+			return Stage::PreOperational | Stage::Operational;
+		}
+
+		auto preparePreOperational(const process::ExecutionContext &context) -> Status final;
+
+		auto operational(const process::ExecutionContext &context) -> void final;
+
+		/// @}
+
+	private:
+		/// @brief A reference to the target element
+		std::reference_wrapper<TemplateTransaction> _target;
+	};
+
+	/// @brief This class providing callbacks for the Xentara scheduler for the "reloadRecords" task
+	class ReloadRecordsTask final : public process::Task
+	{
+	public:
+		/// @brief This constuctor attached the task to its target
+		ReloadRecordsTask(std::reference_wrapper<TemplateTransaction> target) : _target(target)
+		{
+		}
+
+		/// @name Virtual Overrides for process::Task
+		/// @{
+
 		auto operational(const process::ExecutionContext &context) -> void final;
 
 		/// @}
@@ -132,6 +231,36 @@ private:
 		std::reference_wrapper<TemplateTransaction> _target;
 	};
 
+	/// @brief This class providing callbacks for the Xentara scheduler for the "collectAndSend" task
+	class CollectAndSendTask final : public process::Task
+	{
+	public:
+		/// @brief This constuctor attached the task to its target
+		CollectAndSendTask(std::reference_wrapper<TemplateTransaction> target) : _target(target)
+		{
+		}
+
+		/// @name Virtual Overrides for process::Task
+		/// @{
+
+		auto stages() const -> Stages final
+		{
+			return Stage::PreOperational | Stage::Operational | Stage::PostOperational;
+		}
+
+		auto preparePreOperational(const process::ExecutionContext &context) -> Status final;
+
+		auto operational(const process::ExecutionContext &context) -> void final;
+
+		auto preparePostOperational(const process::ExecutionContext &context) -> Status final;
+
+		/// @}
+
+	private:
+		/// @brief A reference to the target element
+		std::reference_wrapper<TemplateTransaction> _target;
+	};
+
 	/// @brief This function is forwarded to the client.
 	auto requestConnect(std::chrono::system_clock::time_point timeStamp) noexcept -> void
 	{
@@ -144,24 +273,141 @@ private:
 		_client.get().requestDisconnect(timeStamp);
 	}
 
+	/// @brief Waits for the handle resolution started by prepare() to finish.
+	///
+	/// This is called by both tasks before they first run, and only does anything the first time it is called successfully.
+	/// Errors resolving the handles are reported here rather than by prepare().
+	///
+	/// @throw std::system_error A handle could not be resolved
+	auto finishPreparation() -> void;
+
 	/// @brief This function is called by the "collect" task.
 	///
 	/// This function collects data to be sent to the client.
 	auto performCollectTask(const process::ExecutionContext &context) -> void;
 	/// @brief Collects the data for all the records and appends it to the pending data
 	auto collectData(std::chrono::system_clock::time_point timeStamp) -> void;
+	/// @brief Collects the data for all the records into a new segment
+	/// @pre _collectMutex must be locked
+	///
+	/// Array and blob records are streamed in chunks in the binary wire format. Each chunk is put into a segment of its own, which
+	/// is appended to _streamedChunks, so that the chunks can be sent in separate batches.
+	///
+	/// @return The segment. The segment is empty if no records were due.
+	auto collectSegment(std::chrono::system_clock::time_point timeStamp) -> Segment;
+	/// @brief Splits the value of an array or blob record into chunks, and appends a segment for each chunk to _streamedChunks
+	auto streamRecord(const TemplateRecord &record, std::chrono::system_clock::time_point timeStamp) -> void;
 
 	/// @brief This function is called by the "send" task.
 	///
 	/// This function attempts to send the collected records if the client is up.
 	auto performSendTask(const process::ExecutionContext &context) -> void;
+	/// @brief This function is called by the "collectAndSend" task.
+	///
+	/// This function collects the data and starts sending it in the same cycle. If nothing else is waiting to be sent, the
+	/// collected segment is sent directly, without going through the pending data.
+	auto performCollectAndSendTask(const process::ExecutionContext &context) -> void;
+	/// @brief Sends the pending data if the client is connected, or discards it if it isn't
+	/// @pre _inFlightMutex must be locked
+	auto sendOrDiscard(std::chrono::system_clock::time_point timeStamp) -> void;
+	/// @brief Starts sending a freshly collected segment as a batch of its own, if nothing else is waiting to be sent
+	/// @return Returns true if the segment was taken, or false if it must be added to the pending data
+	/// @pre _inFlightMutex must be locked
+	auto sendDirectly(Segment &segment, std::chrono::system_clock::time_point timeStamp) -> bool;
+	/// @brief Prepares sending before the first cycle of the "send" or "collectAndSend" task
+	auto startSending(std::chrono::system_clock::time_point timeStamp) -> void;
+	/// @brief Sends or saves the remaining data after the last cycle of the "send" or "collectAndSend" task
+	auto stopSending(std::chrono::system_clock::time_point timeStamp) -> void;
 	/// @brief Attempts to write send the collected records to the client and updates the state accordingly.
-	auto send(std::chrono::system_clock::time_point timeStamp) -> void;	
+	/// @param flush Whether to send all pending data, even if adaptive batching would hold it back
+	auto send(std::chrono::system_clock::time_point timeStamp, bool flush = false) -> void;
+	/// @brief Gets the maximum size of the next batch
+	auto batchSizeLimit() const noexcept -> std::size_t;
+	/// @brief Takes a range of segments out of a queue and starts sending them as a batch
+	/// @param size The total size of the segments, in bytes
+	/// @return Returns true if the batch was sent completely, or false if it is still pending, failed, or could not be started
+	/// because the connection or the bandwidth are not available. If false is returned, nothing more should be sent this cycle.
+	auto sendBatch(SegmentQueue &queue,
+		SegmentQueue::iterator begin,
+		SegmentQueue::iterator end,
+		std::size_t size,
+		std::chrono::system_clock::time_point timeStamp) -> bool;
+	/// @brief Waits for our turn to use the connection, and asks the client for the bandwidth needed for a batch
+	/// @return The slot, or an empty slot if the connection or the bandwidth are not available
+	auto acquireSlot(std::size_t size, std::chrono::system_clock::time_point timeStamp) -> SendScheduler::Slot;
+	/// @brief Starts writing the segments in _inFlight as a batch
+	/// @param size The total size of the segments, in bytes
+	/// @return Returns true if the batch was sent completely, or false if it is still pending or failed
+	auto startBatch(SendScheduler::Slot slot, std::size_t size, std::chrono::system_clock::time_point timeStamp) -> bool;
+	/// @brief Drops the segments at the front of a queue that have outlived the time to live, if one is configured
+	auto dropExpired(SegmentQueue &queue, std::chrono::system_clock::time_point timeStamp) noexcept -> void;
+	/// @brief Continues writing the current batch, and updates the state if it is complete
+	/// @return Returns true if the batch is complete, or false if it is still pending or failed
+	auto writeBatch(std::chrono::system_clock::time_point timeStamp) -> bool;
+	/// @brief Called on a reactor thread when the connection is ready to take more of the current batch
+	auto resumeBatch() -> void;
+	/// @brief Called on a reactor thread when an asynchronous write of the current batch has completed
+	auto completeWrite(std::error_code error, std::size_t written) -> void;
+	/// @brief Waits for an asynchronous write of the current batch to complete
+	auto waitForSubmittedWrite() -> void;
+	/// @brief Starts the flush timer, unless it is already running or sending has stopped
+	/// @param delay The time until the oldest data held back by adaptive batching has waited for the maximum delay
+	auto scheduleFlush(std::chrono::nanoseconds delay) noexcept -> void;
+	/// @brief Called on a reactor thread when the flush timer expires, to send the data held back by adaptive batching
+	auto flushTimerExpired() -> void;
+	/// @brief Stops the flush timer, and waits for it if it is running
+	/// @pre _inFlightMutex must not be locked
+	auto stopFlushTimer() noexcept -> void;
+	/// @brief Sends the remaining data at shutdown, until everything has been sent or the drain timeout has expired
+	auto drain() -> void;
+	/// @brief Saves any data that could not be sent to the residue file, if one is configured.
+	///
+	/// If the file cannot be written, the error is published in the state, and the sendError event is raised.
+	auto saveResidue() -> void;
+	/// @brief Loads the data that could not be sent last time from the residue file, if one is configured.
+	///
+	/// If the file cannot be read, the error is published in the state, and the sendError event is raised.
+	auto loadResidue() -> void;
+
+	/// @brief Loads the adaptive batching configuration
+	auto loadAdaptiveBatching(utils::json::decoder::Value &value) -> void;
+	/// @brief Loads the real-time memory configuration
+	auto loadRealTimeMemory(utils::json::decoder::Value &value) -> void;
+
+	/// @brief Preallocates, locks and prefaults the buffers used on the hot path, if real-time memory mode is configured
+	/// @throw std::system_error The memory could not be locked
+	auto prepareRealTimeMemory() -> void;
+	/// @brief Gets an empty segment for a collect cycle, reusing a spare one if possible
+	auto takeSegment(std::chrono::system_clock::time_point timeStamp) -> Segment;
+	/// @brief Keeps the buffers of segments that are no longer needed for reuse, in real-time memory mode.
+	///
+	/// The segments are left empty, but are not removed from their container.
+	template <typename Segments>
+	auto recycleSegments(Segments &&segments) noexcept -> void;
+	/// @brief Discards the current batch
+	auto abandonBatch() noexcept -> void;
+	/// @brief Puts the current batch back, so that it is sent again from the start.
+	///
+	/// If a time to live is configured, the segments are sorted into the backlog by their time stamps. Otherwise, they are put
+	/// back at the front of the pending data.
+	/// @pre The send ring must not be writing the batch
+	auto requeueBatch() -> void;
 	/// @brief Handles a send error
-	auto handleSendError(std::chrono::system_clock::time_point timeStamp, std::error_code error) -> void;
+	/// @param generation The connection generation the data was sent on
+	auto handleSendError(std::chrono::system_clock::time_point timeStamp, std::error_code error, std::uint64_t generation) -> void;
 
-	/// @brief Updates the state and sends the correct event
+	/// @brief Updates the state and sends the correct event.
+	///
+	/// After a successful send, the state and the sent event may be held back, depending on the configuration. Errors and
+	/// changes in state are always published immediately.
 	auto updateState(std::chrono::system_clock::time_point timeStamp, std::error_code error = std::error_code()) -> void;
+	/// @brief Publishes a change in the state of the client.
+	///
+	/// This does not count as a send, so it neither counts towards the sent event interval nor raises the sent event. Errors
+	/// always raise the sendError event.
+	///
+	/// @param error The error of the client, or a default constructed std::error_code object if it has connected
+	auto publishClientState(std::chrono::system_clock::time_point timeStamp, std::error_code error) -> void;
 
 	/// @name Virtual Overrides for skill::Element
 	/// @{
@@ -176,12 +422,201 @@ private:
 
 	/// @brief The client this transaction belongs to
 	std::reference_wrapper<TemplateClient> _client;
-	/// @brief The records to be collected
-	std::forward_list<TemplateRecord> _records;
+	/// @brief The request used to obtain permission to send from the traffic shaper of the client.
+	///
+	/// This also holds the priority of the transaction.
+	TrafficShaper::Request _sendRequest;
+	/// @brief The records loaded from the configuration. These are moved into the record table by prepare().
+	std::vector<std::shared_ptr<TemplateRecord>> _records;
+
+	/// @brief A run of records with the same data type
+	struct EncodingRun
+	{
+		/// @brief The function that encodes the records
+		TemplateRecord::RunEncoder _encoder;
+		/// @brief The records, as a part of the encoding order of the record table
+		std::span<const std::reference_wrapper<const TemplateRecord>> _records;
+	};
+
+	/// @brief The format the records are encoded in
+	WireFormat _wireFormat { WireFormat::Binary };
+	/// @brief Which time stamp is sent with the records
+	TimeStampMode _timeStampMode { TimeStampMode::None };
+	/// @brief The records that are sent at the same interval
+	struct SampleGroup
+	{
+		/// @brief The interval, or 0 for records that are sent in every cycle
+		std::chrono::nanoseconds _interval { 0 };
+		/// @brief The time the records are next due to be sent
+		std::chrono::system_clock::time_point _nextDue {};
+		/// @brief The runs of records with the same data type
+		std::vector<EncodingRun> _encodingRuns;
+		/// @brief The records that aggregate the samples taken between sends, and thus must be sampled in every cycle
+		std::vector<std::reference_wrapper<TemplateRecord>> _aggregatingRecords;
+		/// @brief The array and blob records that are streamed in chunks rather than encoded in runs
+		std::vector<std::reference_wrapper<const TemplateRecord>> _streamedRecords;
+	};
 
-	/// @brief The data to be sent
-	/// @todo use a more appropriate type for buffering the data
-	utils::core::RawDataBlock _pendingData;
+	/// @brief The records, together with everything needed to collect them.
+	///
+	/// A table is never changed once it has been handed to the "collect" task, except for the schedule and aggregates that only
+	/// the "collect" task uses. When the records are reloaded, a new table is built and swapped in as a whole.
+	struct RecordTable final
+	{
+		/// @brief The records. Records that are unchanged by a reload are shared with the previous table.
+		std::vector<std::shared_ptr<TemplateRecord>> _records;
+		/// @brief The records sorted by sample interval and data type
+		std::vector<std::reference_wrapper<const TemplateRecord>> _encodingOrder;
+		/// @brief The records grouped by sample interval.
+		///
+		/// Each cycle of the "collect" task only checks whether each group is due, rather than each record.
+		std::vector<SampleGroup> _sampleGroups;
+	};
+
+	/// @brief Builds a record table. The handles of the records need not be resolved yet.
+	auto buildRecordTable(std::vector<std::shared_ptr<TemplateRecord>> records) const -> std::shared_ptr<RecordTable>;
+
+	/// @brief Resolves the handles of records on the worker pool, and prepares their encoding
+	/// @return The jobs
+	auto submitPreparationJobs(std::span<const std::shared_ptr<TemplateRecord>> records) -> std::vector<std::shared_future<void>>;
+
+	/// @brief Switches the "collect" task over to a reloaded record table
+	auto switchRecordTable(std::shared_ptr<RecordTable> table) -> void;
+
+	/// @brief This function is called by the "reloadRecords" task.
+	///
+	/// This function reloads the staged records, if there are any. If the reload fails, the records stay staged, so that the
+	/// next cycle tries again.
+	auto performReloadRecordsTask() -> void;
+
+	/// @brief The record table used by the "collect" task. This is only accessed by the "collect" task once it is running.
+	std::shared_ptr<RecordTable> _recordTable;
+	/// @brief Hands reloaded record tables over to the "collect" task
+	TableExchange<RecordTable> _recordTables;
+	/// @brief A mutex serializing reloads
+	std::mutex _reloadMutex;
+
+	/// @brief The records staged for the "reloadRecords" task, or nullptr if there are none
+	std::shared_ptr<const std::vector<std::shared_ptr<TemplateRecord>>> _stagedRecords;
+	/// @brief A mutex protecting _stagedRecords
+	std::mutex _stagedRecordsMutex;
+
+	/// @brief The number of records resolved by a single job on the worker pool
+	static constexpr std::size_t kRecordsPerPreparationJob = 1024;
+	/// @brief The jobs resolving the handles of the records on the worker pool. This is filled in by prepare().
+	std::vector<std::shared_future<void>> _preparationJobs;
+	/// @brief Used to finish the preparation only once
+	std::once_flag _preparationFinished;
+	/// @brief Whether a breakdown of the time taken to prepare the transaction should be logged
+	bool _logPreparation { false };
+	/// @brief The time prepare() was called
+	std::chrono::steady_clock::time_point _preparationStart;
+	/// @brief The time it took to sort the records
+	std::chrono::nanoseconds _sortTime { 0 };
+	/// @brief The total time spent by all jobs resolving handles, in nanoseconds
+	std::atomic<std::chrono::nanoseconds::rep> _resolveTime { 0 };
+	/// @brief The time the last job finished resolving handles, in nanoseconds after _preparationStart
+	std::atomic<std::chrono::nanoseconds::rep> _resolveEnd { 0 };
+
+	/// @brief The memory used for the containers on the hot path. In real-time memory mode, this is locked into RAM, and
+	/// counts any allocations made after the model was prepared.
+	RealTimeMemoryResource _hotPathMemory;
+	/// @brief A pool for the memory of _pendingData, so that memory freed by sent segments is reused
+	std::pmr::unsynchronized_pool_resource _pendingDataMemory { &_hotPathMemory };
+	/// @brief The data to be sent, one segment per collect cycle
+	SegmentQueue _pendingData { &_pendingDataMemory };
+	/// @brief Data collected while the client was not connected, which is sent using the bandwidth left over by _pendingData.
+	///
+	/// This is only used if a time to live is configured. Otherwise, data is discarded while the client is not connected.
+	SegmentQueue _backlog { &_pendingDataMemory };
+	/// @brief The time after which collected data is no longer sent, or 0 for no limit
+	std::chrono::nanoseconds _timeToLive { 0 };
+	/// @brief The number of segments dropped because they outlived the time to live
+	std::atomic<std::uint64_t> _expiredSegments { 0 };
+	/// @brief The number of segments to preallocate in real-time memory mode, or 0 if real-time memory mode is off
+	std::size_t _realTimeSegmentCount { 0 };
+	/// @brief The size of the preallocated segments in real-time memory mode, in bytes
+	std::size_t _realTimeSegmentSize { 0 };
+	/// @brief The segments holding the chunks of array and blob records collected in the current cycle
+	std::vector<Segment> _streamedChunks;
+	/// @brief Segments whose buffers can be reused, in real-time memory mode
+	std::vector<Segment> _spareSegments;
+	/// @brief A mutex protecting _spareSegments, which are returned by the I/O reactor when a batch completes
+	std::mutex _spareSegmentsMutex;
+	/// @brief Data left over from the last time the transaction was running, which is sent before any new data
+	std::vector<Segment> _residue;
+	/// @brief The maximum time spent sending the remaining data at shutdown
+	std::chrono::nanoseconds _drainTimeout { 0 };
+	/// @brief The file the data that could not be sent at shutdown is saved to, if any
+	std::optional<ResidueFile> _residueFile;
+
+	/// @brief The maximum number of bytes to send in a single batch.
+	///
+	/// Limiting the batch size allows other transactions to go in between batches when a large backlog is being sent.
+	std::size_t _maxBatchSize { std::numeric_limits<std::size_t>::max() };
+	/// @brief The time the last batch had to wait for other transactions, in nanoseconds.
+	///
+	/// This is written under _inFlightMutex, but published under _publishMutex, so it is atomic, just like _batchSizeTarget.
+	std::atomic<std::int64_t> _waitTime { 0 };
+	/// @brief The controller that adapts the batch size to the send latency. This is protected by _inFlightMutex.
+	BatchSizeController _batchSizeController;
+	/// @brief The current target of _batchSizeController, so that it can be published without locking _inFlightMutex
+	std::atomic<std::size_t> _batchSizeTarget { 0 };
+
+	/// @brief The batch currently being written. This is kept until the batch has been written completely.
+	std::vector<Segment> _inFlight;
+	/// @brief The buffers of the segments in _inFlight
+	std::vector<BatchWriter::Buffer> _inFlightBuffers;
+	/// @brief The writer used to write the current batch
+	BatchWriter _writer;
+	/// @brief The slot of the current batch. This is held until the batch has been written completely.
+	SendScheduler::Slot _inFlightSlot;
+	/// @brief The connection generation the current batch is being written to
+	std::uint64_t _inFlightGeneration { 0 };
+	/// @brief The size of the current batch, in bytes
+	std::size_t _inFlightSize { 0 };
+	/// @brief The time writing the current batch started
+	std::chrono::steady_clock::time_point _inFlightStart;
+	/// @brief Whether part of the current batch has been submitted to the send ring of the client and has not completed yet
+	bool _writeSubmitted { false };
+	/// @brief A mutex protecting the current batch, which may be resumed by the I/O reactor of the client
+	std::mutex _inFlightMutex;
+	/// @brief A mutex protecting the record table and _streamedChunks while data is being collected.
+	///
+	/// This is only ever contended if both the "collect" and the "collectAndSend" tasks are scheduled. It must be locked
+	/// before _inFlightMutex.
+	std::mutex _collectMutex;
+	/// @brief Used to wait for an asynchronous write to complete
+	std::condition_variable _writeCompleted;
+
+	/// @brief The time to wait before trying again if the flush timer expires while the current batch is busy
+	static constexpr std::chrono::milliseconds kFlushRetryDelay { 1 };
+
+	/// @brief The ID of the last flush timer started with the I/O reactor of the client
+	Reactor::TimerId _flushTimer { 0 };
+	/// @brief Whether _flushTimer has yet to expire
+	bool _flushTimerPending { false };
+	/// @brief Whether the flush timer is stopped because the transaction is not sending
+	bool _flushTimerStopped { true };
+	/// @brief A mutex protecting the flush timer. This may be locked while _inFlightMutex is locked, but not the other way around.
+	std::mutex _flushTimerMutex;
+
+	/// @brief The minimum time between publications of the state after successful sends
+	std::chrono::nanoseconds _publishInterval { 0 };
+	/// @brief Whether the state is only published after successful sends if it changed, or if the sent event is due
+	bool _publishOnChange { false };
+	/// @brief The number of successful sends per sent event
+	std::uint64_t _sentEventInterval { 1 };
+
+	/// @brief A mutex protecting the members used to decide what to publish
+	std::mutex _publishMutex;
+	/// @brief The error code last published, or std::nullopt if nothing has been published yet
+	std::optional<std::error_code> _publishedError;
+	/// @brief The time the state was last published. This starts at the epoch rather than at time_point::min(), so that adding
+	/// the publish interval cannot overflow.
+	std::chrono::system_clock::time_point _lastPublishTime {};
+	/// @brief The number of successful sends since the last sent event
+	std::uint64_t _unreportedSends { 0 };
 
 	/// @brief A Xentara event that is raised when the records were successfully sent to the client
 	process::Event _sentEvent;
@@ -192,6 +627,10 @@ private:
 	CollectTask _collectTask { *this };
 	/// @brief The "send" task
 	SendTask _sendTask { *this };
+	/// @brief The "collectAndSend" task
+	CollectAndSendTask _collectAndSendTask { *this };
+	/// @brief The "reloadRecords" task
+	ReloadRecordsTask _reloadRecordsTask { *this };
 
 	/// @brief The data block that contains the state
 	memory::ObjectBlock<State> _stateDataBlock;
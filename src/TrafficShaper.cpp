@@ -0,0 +1,128 @@
+// Copyright (c) embedded ocean GmbH
+#include "TrafficShaper.hpp"
+
+#include <algorithm>
+
+namespace xentara::plugins::templateUplink
+{
+
+auto TrafficShaper::setByteRate(double bytesPerSecond, double burstBytes) noexcept -> void
+{
+	_bytes._rate = bytesPerSecond;
+	_bytes._capacity = std::max(burstBytes, 1.0);
+	// Start with a full bucket, so that the first transactions are not throttled
+	_bytes._tokens = _bytes._capacity;
+}
+
+auto TrafficShaper::setMessageRate(double messagesPerSecond, double burstMessages) noexcept -> void
+{
+	_messages._rate = messagesPerSecond;
+	_messages._capacity = std::max(burstMessages, 1.0);
+	// Start with a full bucket, so that the first transactions are not throttled
+	_messages._tokens = _messages._capacity;
+}
+
+auto TrafficShaper::tryAcquire(Request &request, std::size_t size, std::chrono::system_clock::time_point timeStamp) -> bool
+{
+	// Add any tokens that have accumulated in the meantime
+	refill(timeStamp);
+
+	// Wait if there are not enough tokens, or if someone more important is waiting
+	if ((_strictPriority && higherPriorityQueued(request._priority)) ||
+		(_bytes.enabled() && !_bytes.sufficient(double(size))) ||
+		(_messages.enabled() && !_messages.sufficient(1.0)))
+	{
+		enqueue(request, timeStamp);
+		return false;
+	}
+
+	// Take the tokens
+	if (_bytes.enabled())
+	{
+		_bytes._tokens -= double(size);
+	}
+	if (_messages.enabled())
+	{
+		_messages._tokens -= 1.0;
+	}
+
+	// The request is no longer waiting
+	dequeue(request, timeStamp);
+
+	return true;
+}
+
+auto TrafficShaper::cancel(Request &request, std::chrono::system_clock::time_point timeStamp) noexcept -> void
+{
+	dequeue(request, timeStamp);
+}
+
+auto TrafficShaper::Bucket::refill(std::chrono::duration<double> elapsed) noexcept -> void
+{
+	_tokens = std::min(_tokens + elapsed.count() * _rate, _capacity);
+}
+
+auto TrafficShaper::Bucket::sufficient(double tokens) const noexcept -> bool
+{
+	return _tokens >= std::min(tokens, _capacity);
+}
+
+auto TrafficShaper::refill(std::chrono::system_clock::time_point timeStamp) noexcept -> void
+{
+	// The first call only sets the reference time
+	if (_lastRefill == std::chrono::system_clock::time_point())
+	{
+		_lastRefill = timeStamp;
+		return;
+	}
+
+	// Ignore clock jumps into the past
+	if (timeStamp <= _lastRefill)
+	{
+		return;
+	}
+
+	const std::chrono::duration<double> elapsed = timeStamp - _lastRefill;
+	_bytes.refill(elapsed);
+	_messages.refill(elapsed);
+	_lastRefill = timeStamp;
+}
+
+auto TrafficShaper::higherPriorityQueued(Priority priority) const noexcept -> bool
+{
+	return std::any_of(_queued.begin() + std::min<std::size_t>(priority, kMaxPriority) + 1, _queued.end(),
+		[](std::size_t count) { return count > 0; });
+}
+
+auto TrafficShaper::enqueue(Request &request, std::chrono::system_clock::time_point timeStamp) noexcept -> void
+{
+	if (request._queued)
+	{
+		return;
+	}
+
+	request._queued = true;
+	request._queuedSince = timeStamp;
+	++_queued[std::min<std::size_t>(request._priority, kMaxPriority)];
+	++_queueDepth;
+}
+
+auto TrafficShaper::dequeue(Request &request, std::chrono::system_clock::time_point timeStamp) noexcept -> void
+{
+	if (!request._queued)
+	{
+		return;
+	}
+
+	request._queued = false;
+	--_queued[std::min<std::size_t>(request._priority, kMaxPriority)];
+	--_queueDepth;
+
+	// Add the time the request spent waiting
+	if (timeStamp > request._queuedSince)
+	{
+		_throttleTime += std::chrono::duration_cast<std::chrono::nanoseconds>(timeStamp - request._queuedSince);
+	}
+}
+
+} // namespace xentara::plugins::templateUplink
@@ -0,0 +1,176 @@
+// Copyright (c) embedded ocean GmbH
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace xentara::plugins::templateUplink
+{
+
+/// @brief The priority of a transaction when competing for the bandwidth of its client.
+///
+/// Higher values are more urgent.
+using Priority = std::uint8_t;
+
+/// @brief A token bucket traffic shaper that limits the bandwidth used by all the transactions of a client
+///
+/// The shaper uses two token buckets, one for the number of bytes, and one for the number of messages. A message
+/// can only be sent if both buckets contain enough tokens, and if no request with a higher priority is waiting.
+///
+/// @note This class is not thread safe. The client protects it using a mutex.
+class TrafficShaper final
+{
+public:
+	/// @brief The number of supported priority levels
+	static constexpr std::size_t kPriorityLevels = 8;
+
+	/// @brief The highest supported priority
+	static constexpr Priority kMaxPriority = Priority(kPriorityLevels - 1);
+
+	/// @brief A request for sending a message.
+	///
+	/// Each transaction owns one of these objects, so that the shaper can remember which requests are waiting.
+	class Request final
+	{
+	public:
+		/// @brief Constructor
+		Request(Priority priority = 0) noexcept : _priority(priority)
+		{
+		}
+
+		/// @brief Gets the priority of the request
+		auto priority() const noexcept -> Priority
+		{
+			return _priority;
+		}
+
+		/// @brief Sets the priority of the request.
+		/// @pre This function must not be called while the request is queued.
+		auto setPriority(Priority priority) noexcept -> void
+		{
+			_priority = priority;
+		}
+
+		/// @brief Checks whether the request is waiting for tokens
+		auto queued() const noexcept -> bool
+		{
+			return _queued;
+		}
+
+	private:
+		/// @brief The priority of the request
+		Priority _priority { 0 };
+		/// @brief Whether the request is waiting for tokens
+		bool _queued { false };
+		/// @brief The time the request was queued
+		std::chrono::system_clock::time_point _queuedSince;
+
+		friend class TrafficShaper;
+	};
+
+	/// @brief Sets the byte rate.
+	/// @param bytesPerSecond The sustained number of bytes per second, or 0 for no limit
+	/// @param burstBytes The maximum number of bytes that can be sent in a single burst
+	auto setByteRate(double bytesPerSecond, double burstBytes) noexcept -> void;
+
+	/// @brief Sets the message rate.
+	/// @param messagesPerSecond The sustained number of messages per second, or 0 for no limit
+	/// @param burstMessages The maximum number of messages that can be sent in a single burst
+	auto setMessageRate(double messagesPerSecond, double burstMessages) noexcept -> void;
+
+	/// @brief Sets whether waiting requests with a higher priority hold back requests with a lower priority.
+	///
+	/// This is on by default. It should be turned off if the bandwidth is shared using a different policy.
+	auto setStrictPriority(bool strictPriority) noexcept -> void
+	{
+		_strictPriority = strictPriority;
+	}
+
+	/// @brief Checks whether any limits were configured
+	auto enabled() const noexcept -> bool
+	{
+		return _bytes.enabled() || _messages.enabled();
+	}
+
+	/// @brief Tries to acquire the tokens necessary for sending a message.
+	///
+	/// If the message cannot be sent yet, the request is queued, and the caller must try again later, using the
+	/// same request object.
+	///
+	/// @return Returns true if the message may be sent, or false if the caller must wait.
+	auto tryAcquire(Request &request, std::size_t size, std::chrono::system_clock::time_point timeStamp) -> bool;
+
+	/// @brief Removes a request from the queue, e.g. because the data it was waiting to send has been discarded.
+	auto cancel(Request &request, std::chrono::system_clock::time_point timeStamp) noexcept -> void;
+
+	/// @brief Gets the number of requests currently waiting for tokens
+	auto queueDepth() const noexcept -> std::size_t
+	{
+		return _queueDepth;
+	}
+
+	/// @brief Gets the total time requests have spent waiting for tokens
+	auto throttleTime() const noexcept -> std::chrono::nanoseconds
+	{
+		return _throttleTime;
+	}
+
+private:
+	/// @brief A single token bucket
+	struct Bucket final
+	{
+		/// @brief Checks whether the bucket imposes a limit
+		auto enabled() const noexcept -> bool
+		{
+			return _rate > 0;
+		}
+
+		/// @brief Adds the tokens accumulated over a certain period of time
+		auto refill(std::chrono::duration<double> elapsed) noexcept -> void;
+
+		/// @brief Checks whether there are enough tokens for a request.
+		///
+		/// Requests larger than the bucket capacity are allowed once the bucket is full, so they will not block forever.
+		auto sufficient(double tokens) const noexcept -> bool;
+
+		/// @brief The number of tokens added per second, or 0 for no limit
+		double _rate { 0 };
+		/// @brief The maximum number of tokens
+		double _capacity { 0 };
+		/// @brief The number of tokens currently available. This may be negative after an oversized request.
+		double _tokens { 0 };
+	};
+
+	/// @brief Adds the tokens accumulated since the last refill
+	auto refill(std::chrono::system_clock::time_point timeStamp) noexcept -> void;
+
+	/// @brief Checks whether a request with a higher priority is waiting
+	auto higherPriorityQueued(Priority priority) const noexcept -> bool;
+
+	/// @brief Puts a request into the queue, if it isn't already queued
+	auto enqueue(Request &request, std::chrono::system_clock::time_point timeStamp) noexcept -> void;
+	/// @brief Removes a request from the queue, if it is queued
+	auto dequeue(Request &request, std::chrono::system_clock::time_point timeStamp) noexcept -> void;
+
+	/// @brief The bucket for the number of bytes
+	Bucket _bytes;
+	/// @brief The bucket for the number of messages
+	Bucket _messages;
+
+	/// @brief Whether higher priorities hold back lower ones
+	bool _strictPriority { true };
+
+	/// @brief The last time the buckets were refilled, or a default constructed time point if they have never been refilled.
+	std::chrono::system_clock::time_point _lastRefill;
+
+	/// @brief The number of queued requests for each priority
+	std::array<std::size_t, kPriorityLevels> _queued {};
+	/// @brief The total number of queued requests
+	std::size_t _queueDepth { 0 };
+	/// @brief The total time requests have spent waiting
+	std::chrono::nanoseconds _throttleTime { 0 };
+};
+
+} // namespace xentara::plugins::templateUplink
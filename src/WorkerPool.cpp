@@ -0,0 +1,73 @@
+// Copyright (c) embedded ocean GmbH
+#include "WorkerPool.hpp"
+
+#include <algorithm>
+
+namespace xentara::plugins::templateUplink
+{
+
+WorkerPool::WorkerPool(std::size_t threadCount) noexcept :
+	_maxThreads(threadCount != 0 ? threadCount : std::max<std::size_t>(std::thread::hardware_concurrency(), 1))
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::scoped_lock lock { _mutex };
+		_stopping = true;
+	}
+	_condition.notify_all();
+
+	// Join the threads. This must be done explicitly, because the threads use the other members.
+	_threads.clear();
+}
+
+auto WorkerPool::submit(std::function<void()> function) -> std::future<void>
+{
+	std::packaged_task<void()> task { std::move(function) };
+	auto future = task.get_future();
+
+	{
+		std::scoped_lock lock { _mutex };
+		_queue.push_back(std::move(task));
+
+		// Start another thread if all the existing ones are busy
+		if (_idleThreads == 0 && _threads.size() < _maxThreads)
+		{
+			_threads.emplace_back([this] { run(); });
+			return future;
+		}
+	}
+
+	_condition.notify_one();
+	return future;
+}
+
+auto WorkerPool::run() -> void
+{
+	std::unique_lock lock { _mutex };
+	for (;;)
+	{
+		// Wait for work
+		++_idleThreads;
+		_condition.wait(lock, [this] { return _stopping || !_queue.empty(); });
+		--_idleThreads;
+
+		// Finish the queued work before stopping
+		if (_queue.empty())
+		{
+			return;
+		}
+
+		auto task = std::move(_queue.front());
+		_queue.pop_front();
+
+		// Execute the task without holding the lock. Exceptions are stored in the future by the task itself.
+		lock.unlock();
+		task();
+		lock.lock();
+	}
+}
+
+} // namespace xentara::plugins::templateUplink
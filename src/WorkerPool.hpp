@@ -0,0 +1,56 @@
+// Copyright (c) embedded ocean GmbH
+#pragma once
+
+#include <xentara/utils/tools/Unique.hpp>
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace xentara::plugins::templateUplink
+{
+
+/// @brief A pool of threads for CPU-bound work that can be done in parallel, like resolving handles while the model is prepared.
+///
+/// The threads are started on demand, up to one per CPU core, and then wait for more work until the pool is destroyed.
+class WorkerPool final : private utils::tools::Unique
+{
+public:
+	/// @brief Constructor
+	/// @param threadCount The maximum number of threads, or 0 to use one per CPU core
+	explicit WorkerPool(std::size_t threadCount = 0) noexcept;
+
+	/// @brief Destructor. Finishes any work that is still queued, and stops all threads.
+	~WorkerPool();
+
+	/// @brief Queues a function for execution on one of the threads
+	/// @return A future that becomes ready when the function has been executed, and that holds any exception it threw
+	auto submit(std::function<void()> function) -> std::future<void>;
+
+private:
+	/// @brief The main loop of a thread
+	auto run() -> void;
+
+	/// @brief The maximum number of threads
+	std::size_t _maxThreads;
+
+	/// @brief A mutex protecting the remaining members
+	std::mutex _mutex;
+	/// @brief Used to wake up threads when work is queued or when the pool is destroyed
+	std::condition_variable _condition;
+	/// @brief The queued work
+	std::deque<std::packaged_task<void()>> _queue;
+	/// @brief The number of threads currently waiting for work
+	std::size_t _idleThreads { 0 };
+	/// @brief Whether the threads should stop
+	bool _stopping { false };
+	/// @brief The threads
+	std::vector<std::jthread> _threads;
+};
+
+} // namespace xentara::plugins::templateUplink
@@ -0,0 +1,109 @@
+// Copyright (c) embedded ocean GmbH
+#include "BatchSizeController.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+
+namespace xentara::plugins::templateUplink
+{
+
+using namespace std::literals;
+
+namespace
+{
+
+	/// @brief Makes a controller with a small, easily checked configuration
+	auto makeController() -> BatchSizeController
+	{
+		BatchSizeController controller;
+		controller.configure({ ._minSize = 1000,
+			._maxSize = 10'000,
+			._latencyTarget = 50ms,
+			._maxDelay = 100ms,
+			._increase = 1000,
+			._decrease = 0.5 });
+		return controller;
+	}
+
+} // namespace
+
+TEST_CASE("BatchSizeController sends everything right away when disabled", "[BatchSizeController]")
+{
+	BatchSizeController controller;
+	CHECK_FALSE(controller.enabled());
+	CHECK(controller.shouldFlush(1, 0ns));
+
+	// Completed batches are ignored
+	controller.batchCompleted(1'000'000, 1s);
+	CHECK(controller.target() == 0);
+}
+
+TEST_CASE("BatchSizeController holds data back until the target size or the maximum delay is reached", "[BatchSizeController]")
+{
+	auto controller = makeController();
+	REQUIRE(controller.enabled());
+	REQUIRE(controller.target() == 1000);
+
+	CHECK_FALSE(controller.shouldFlush(999, 0ns));
+	CHECK_FALSE(controller.shouldFlush(999, 99ms));
+	CHECK(controller.shouldFlush(1000, 0ns));
+	CHECK(controller.target() == 1000);
+
+	// Data that has waited long enough is sent even if there is not enough of it
+	CHECK(controller.shouldFlush(1, 100ms));
+}
+
+TEST_CASE("BatchSizeController raises the target additively while batches are fast", "[BatchSizeController]")
+{
+	auto controller = makeController();
+
+	controller.batchCompleted(1000, 10ms);
+	CHECK(controller.target() == 2000);
+	controller.batchCompleted(2000, 10ms);
+	CHECK(controller.target() == 3000);
+
+	// A batch smaller than the target says nothing about whether a larger target would work
+	controller.batchCompleted(500, 10ms);
+	CHECK(controller.target() == 3000);
+
+	// The target never exceeds the maximum
+	for (int index = 0; index < 20; ++index)
+	{
+		controller.batchCompleted(controller.target(), 10ms);
+	}
+	CHECK(controller.target() == 10'000);
+}
+
+TEST_CASE("BatchSizeController lowers the target multiplicatively", "[BatchSizeController]")
+{
+	auto controller = makeController();
+	for (int index = 0; index < 7; ++index)
+	{
+		controller.batchCompleted(controller.target(), 10ms);
+	}
+	REQUIRE(controller.target() == 8000);
+
+	SECTION("when a batch is too slow")
+	{
+		controller.batchCompleted(8000, 51ms);
+		CHECK(controller.target() == 4000);
+		controller.batchCompleted(4000, 51ms);
+		CHECK(controller.target() == 2000);
+	}
+
+	SECTION("when the data does not come in fast enough to fill a batch")
+	{
+		CHECK(controller.shouldFlush(100, 100ms));
+		CHECK(controller.target() == 4000);
+	}
+
+	// The target never goes below the minimum
+	for (int index = 0; index < 10; ++index)
+	{
+		controller.batchCompleted(controller.target(), 1s);
+	}
+	CHECK(controller.target() == 1000);
+}
+
+} // namespace xentara::plugins::templateUplink
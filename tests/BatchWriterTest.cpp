@@ -0,0 +1,170 @@
+// Copyright (c) embedded ocean GmbH
+#include "BatchWriter.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace xentara::plugins::templateUplink
+{
+
+namespace
+{
+
+	/// @brief Gets the bytes of a string
+	auto bytes(std::string_view text) -> BatchWriter::Buffer
+	{
+		return { reinterpret_cast<const std::byte *>(text.data()), text.size() };
+	}
+
+	/// @brief A connection that takes a limited number of bytes per write
+	class LimitedConnection final
+	{
+	public:
+		/// @brief Constructor
+		/// @param limit The maximum number of bytes taken per write, or 0 to simulate a connection that is not ready
+		explicit LimitedConnection(std::size_t limit) : _limit(limit)
+		{
+		}
+
+		/// @brief Writes as much as the limit allows
+		auto operator()(std::span<const BatchWriter::Buffer> buffers) -> std::optional<std::size_t>
+		{
+			++_writes;
+			if (_limit == 0)
+			{
+				return std::nullopt;
+			}
+
+			std::size_t written = 0;
+			for (auto &&buffer : buffers)
+			{
+				const auto size = std::min(buffer.size(), _limit - written);
+				const auto data = reinterpret_cast<const char *>(buffer.data());
+				_received.append(data, size);
+				written += size;
+				if (written == _limit)
+				{
+					break;
+				}
+			}
+			return written;
+		}
+
+		/// @brief The maximum number of bytes taken per write
+		std::size_t _limit;
+		/// @brief The number of writes
+		std::size_t _writes { 0 };
+		/// @brief The data received
+		std::string _received;
+	};
+
+} // namespace
+
+TEST_CASE("BatchWriter writes a batch in one go if the connection takes it", "[BatchWriter]")
+{
+	const std::vector buffers { bytes("Hello"), bytes(", "), bytes("world") };
+
+	BatchWriter writer;
+	writer.start(buffers);
+	REQUIRE(writer.pending());
+
+	LimitedConnection connection(1024);
+	CHECK(writer.resume(connection));
+	CHECK_FALSE(writer.pending());
+	CHECK(connection._writes == 1);
+	CHECK(connection._received == "Hello, world");
+}
+
+TEST_CASE("BatchWriter resumes after short writes", "[BatchWriter]")
+{
+	const std::vector buffers { bytes("Hello"), bytes(", "), bytes("world") };
+
+	BatchWriter writer;
+	writer.start(buffers);
+
+	LimitedConnection connection(3);
+	CHECK(writer.resume(connection));
+	CHECK(connection._writes == 4);
+	CHECK(connection._received == "Hello, world");
+}
+
+TEST_CASE("BatchWriter keeps its position while the connection is not ready", "[BatchWriter]")
+{
+	const std::vector buffers { bytes("Hello"), bytes(", "), bytes("world") };
+
+	BatchWriter writer;
+	writer.start(buffers);
+
+	LimitedConnection connection(6);
+	REQUIRE(connection(writer.remaining()) == 6u);
+	writer.advance(6);
+	REQUIRE(writer.pending());
+
+	// The rest of the batch starts in the middle of the second buffer
+	const auto remaining = writer.remaining();
+	REQUIRE(remaining.size() == 2);
+	CHECK(remaining[0].size() == 1);
+
+	connection._limit = 0;
+	CHECK_FALSE(writer.resume(connection));
+	CHECK(writer.pending());
+
+	connection._limit = 1024;
+	CHECK(writer.resume(connection));
+	CHECK(connection._received == "Hello, world");
+}
+
+TEST_CASE("BatchWriter skips empty buffers", "[BatchWriter]")
+{
+	const std::vector buffers { bytes(""), bytes("a"), bytes(""), bytes("") };
+
+	BatchWriter writer;
+	writer.start(buffers);
+	CHECK(writer.remaining().size() == 3);
+
+	writer.advance(1);
+	CHECK_FALSE(writer.pending());
+
+	// A batch with no data at all is complete right away
+	const std::vector empty { bytes("") };
+	writer.start(empty);
+	CHECK_FALSE(writer.pending());
+}
+
+TEST_CASE("BatchWriter rewinds to the start of the batch", "[BatchWriter]")
+{
+	const std::vector buffers { bytes("Hello"), bytes(", "), bytes("world") };
+
+	BatchWriter writer;
+	writer.start(buffers);
+	writer.advance(8);
+
+	// The data must be sent again from the start on a new connection
+	writer.rewind();
+	LimitedConnection connection(1024);
+	CHECK(writer.resume(connection));
+	CHECK(connection._received == "Hello, world");
+}
+
+TEST_CASE("BatchWriter::reset() abandons the batch", "[BatchWriter]")
+{
+	const std::vector buffers { bytes("Hello") };
+
+	BatchWriter writer;
+	writer.start(buffers);
+	writer.reset();
+	CHECK_FALSE(writer.pending());
+
+	// Rewinding an abandoned batch must not bring it back
+	writer.rewind();
+	CHECK_FALSE(writer.pending());
+}
+
+} // namespace xentara::plugins::templateUplink
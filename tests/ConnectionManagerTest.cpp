@@ -0,0 +1,370 @@
+// Copyright (c) embedded ocean GmbH
+#include "ConnectionManager.hpp"
+#include "CustomError.hpp"
+#include "Endpoint.hpp"
+#include "Socket.hpp"
+#include "StandInServer.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <system_error>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+namespace xentara::plugins::templateUplink
+{
+
+using namespace std::literals;
+
+namespace
+{
+
+	/// @brief A state change reported to the listener
+	struct StateChange final
+	{
+		std::error_code _error;
+		std::uint64_t _generation { 0 };
+		const void *_origin { nullptr };
+	};
+
+	/// @brief A listener that records all notifications
+	class RecordingListener final : public ConnectionManager::Listener
+	{
+	public:
+		auto connectionAttempted(
+			std::chrono::steady_clock::time_point, std::size_t, std::error_code error) noexcept -> void final
+		{
+			{
+				std::scoped_lock lock { _mutex };
+				_attempts.push_back(error);
+			}
+			if (_onAttempt)
+			{
+				_onAttempt();
+			}
+		}
+
+		auto connectionErrorReported(std::error_code, std::uint64_t) noexcept -> void final
+		{
+			std::scoped_lock lock { _mutex };
+			++_reportedErrors;
+		}
+
+		auto releasingHandle() noexcept -> void final
+		{
+			std::scoped_lock lock { _mutex };
+			++_releases;
+		}
+
+		auto handlePublished(const ConnectionManager::Handle &handle, bool failover) noexcept -> void final
+		{
+			std::scoped_lock lock { _mutex };
+			_publishedEndpoints.push_back(handle.endpoint());
+			if (failover)
+			{
+				++_failovers;
+			}
+		}
+
+		auto stateChanged(std::chrono::system_clock::time_point,
+			std::error_code error,
+			std::uint64_t generation,
+			const void *origin) -> void final
+		{
+			std::scoped_lock lock { _mutex };
+			_stateChanges.push_back({ error, generation, origin });
+		}
+
+		auto reconnectRequested() noexcept -> void final
+		{
+			std::scoped_lock lock { _mutex };
+			++_reconnectRequests;
+		}
+
+		/// @brief Gets the last state change
+		auto lastStateChange() -> StateChange
+		{
+			std::scoped_lock lock { _mutex };
+			return _stateChanges.empty() ? StateChange {} : _stateChanges.back();
+		}
+
+		/// @brief A function called after each connection attempt, before the result is published
+		std::function<void()> _onAttempt;
+
+		std::mutex _mutex;
+		std::vector<std::error_code> _attempts;
+		std::size_t _reportedErrors { 0 };
+		std::size_t _releases { 0 };
+		std::vector<std::size_t> _publishedEndpoints;
+		std::size_t _failovers { 0 };
+		std::vector<StateChange> _stateChanges;
+		std::size_t _reconnectRequests { 0 };
+	};
+
+	/// @brief Makes an endpoint for a stand-in server
+	auto endpointOf(const StandInServer &server) -> Endpoint
+	{
+		return { "127.0.0.1", server.port() };
+	}
+
+	/// @brief Makes the connection settings for a list of endpoints. The timeouts are much shorter than the defaults, as
+	/// everything is local.
+	auto configFor(std::vector<Endpoint> endpoints) -> ConnectionManager::Config
+	{
+		ConnectionManager::Config config;
+		config._endpoints = std::move(endpoints);
+		config._connectionRace = { 20ms, 500ms };
+		config._failbackInterval = 1h;
+		return config;
+	}
+
+	/// @brief Makes an error code from a POSIX error number
+	auto systemError(int error) -> std::error_code
+	{
+		return { error, std::system_category() };
+	}
+
+} // namespace
+
+TEST_CASE("ConnectionManager classifies connection errors", "[ConnectionManager]")
+{
+	// Errors of the connection as a whole
+	CHECK(ConnectionManager::isConnectionError(systemError(ECONNRESET)));
+	CHECK(ConnectionManager::isConnectionError(systemError(EPIPE)));
+	CHECK(ConnectionManager::isConnectionError(systemError(ENETUNREACH)));
+	CHECK(ConnectionManager::isConnectionError(CustomError::NotConnected));
+	CHECK(ConnectionManager::isConnectionError(CustomError::ProtocolError));
+
+	// Errors that only affect a single request
+	CHECK_FALSE(ConnectionManager::isConnectionError(std::error_code()));
+	CHECK_FALSE(ConnectionManager::isConnectionError(systemError(EINVAL)));
+	CHECK_FALSE(ConnectionManager::isConnectionError(systemError(EMSGSIZE)));
+	CHECK_FALSE(ConnectionManager::isConnectionError(CustomError::Pending));
+	CHECK_FALSE(ConnectionManager::isConnectionError(std::make_error_code(std::errc::connection_reset)));
+}
+
+TEST_CASE("ConnectionManager connects on the first request and disconnects on the last", "[ConnectionManager][connection]")
+{
+	StandInServer server({});
+	RecordingListener listener;
+	ConnectionManager connection(listener);
+	connection.configure(configFor({ endpointOf(server) }));
+
+	const auto timeStamp = std::chrono::system_clock::now();
+	connection.requestConnect(timeStamp);
+	REQUIRE(connection.connected());
+	const auto handle = connection.handle();
+	REQUIRE(handle);
+	CHECK(handle->endpoint() == 0);
+	CHECK(handle->generation() == 1);
+	CHECK(connection.state().generation() == 1);
+	CHECK(listener._attempts == std::vector { std::error_code() });
+	CHECK(listener._publishedEndpoints == std::vector<std::size_t> { 0 });
+	CHECK(listener._failovers == 0);
+	CHECK(listener.lastStateChange()._error == std::error_code());
+	CHECK(listener.lastStateChange()._generation == 1);
+
+	// Further requests do not connect again
+	connection.requestConnect(timeStamp);
+	CHECK(listener._attempts.size() == 1);
+	connection.requestDisconnect(timeStamp);
+	CHECK(connection.connected());
+
+	// The last request closes the connection gracefully
+	connection.requestDisconnect(timeStamp);
+	CHECK_FALSE(connection.connected());
+	CHECK_FALSE(connection.handle());
+	CHECK(listener._releases == 1);
+	CHECK(listener.lastStateChange()._error == CustomError::NotConnected);
+	CHECK(listener.lastStateChange()._generation == 1);
+
+	// The connection is not reestablished once nobody needs it
+	connection.connect(timeStamp);
+	CHECK_FALSE(connection.connected());
+	CHECK(listener._attempts.size() == 1);
+}
+
+TEST_CASE("ConnectionManager reports failed connection attempts", "[ConnectionManager][connection]")
+{
+	// Reserve a port that nobody listens on. The socket stays bound, so that the connection attempt cannot be given the same
+	// port as its local port, and connect to itself.
+	Socket reserved(::socket(AF_INET, SOCK_STREAM, 0));
+	REQUIRE(reserved);
+	::sockaddr_in address {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	REQUIRE(::bind(reserved.native(), reinterpret_cast<const ::sockaddr *>(&address), sizeof(address)) == 0);
+	::socklen_t size = sizeof(address);
+	REQUIRE(::getsockname(reserved.native(), reinterpret_cast<::sockaddr *>(&address), &size) == 0);
+
+	RecordingListener listener;
+	ConnectionManager connection(listener);
+	connection.configure(configFor({ { "127.0.0.1", ntohs(address.sin_port) } }));
+
+	connection.requestConnect(std::chrono::system_clock::now());
+	CHECK_FALSE(connection.connected());
+	CHECK_FALSE(connection.handle());
+	CHECK(connection.state().generation() == 0);
+	REQUIRE(listener._attempts.size() == 1);
+	CHECK(listener._attempts.front());
+	CHECK(listener.lastStateChange()._error == listener._attempts.front());
+	CHECK(listener._publishedEndpoints.empty());
+
+	// The next attempt is made by the reconnect task, not right away
+	CHECK(listener._reconnectRequests == 0);
+}
+
+TEST_CASE("ConnectionManager does not hold up disconnect() while connecting", "[ConnectionManager][connection]")
+{
+	StandInServer server({});
+	RecordingListener listener;
+	ConnectionManager connection(listener);
+	connection.configure(configFor({ endpointOf(server) }));
+
+	// Disconnect while the connection attempt is still in progress. This must not wait for the attempt, which would deadlock
+	// here, as the attempt is made on the same thread.
+	listener._onAttempt = [&] {
+		listener._onAttempt = nullptr;
+		connection.requestDisconnect(std::chrono::system_clock::now());
+	};
+	connection.requestConnect(std::chrono::system_clock::now());
+
+	// The connection that was opened anyway is discarded
+	CHECK_FALSE(connection.connected());
+	CHECK_FALSE(connection.handle());
+	CHECK(listener._attempts == std::vector { std::error_code() });
+	CHECK(listener._publishedEndpoints.empty());
+	CHECK(listener.lastStateChange()._error == CustomError::NotConnected);
+	CHECK(connection.state().generation() == 0);
+}
+
+TEST_CASE("ConnectionManager only handles connection errors of the current connection", "[ConnectionManager][connection]")
+{
+	StandInServer server({});
+	RecordingListener listener;
+	ConnectionManager connection(listener);
+	connection.configure(configFor({ endpointOf(server) }));
+	connection.requestConnect(std::chrono::system_clock::now());
+	REQUIRE(connection.connected());
+	const auto generation = connection.state().generation();
+
+	// Errors of an older connection are not even reported
+	connection.handleError(std::chrono::system_clock::now(), systemError(ECONNRESET), generation - 1);
+	CHECK(connection.connected());
+	CHECK(listener._reportedErrors == 0);
+
+	// Errors that only affect a single request are reported, but leave the connection alone
+	connection.handleError(std::chrono::system_clock::now(), systemError(EINVAL), generation);
+	CHECK(connection.connected());
+	CHECK(connection.state().generation() == generation);
+	CHECK(listener._reportedErrors == 1);
+	CHECK(listener._releases == 0);
+
+	// A connection error closes the connection. With a single endpoint, the next reconnect is left to the client.
+	const int origin = 0;
+	connection.handleError(std::chrono::system_clock::now(), systemError(ECONNRESET), generation, &origin);
+	CHECK_FALSE(connection.connected());
+	CHECK_FALSE(connection.handle());
+	CHECK(listener._releases == 1);
+	CHECK(listener.lastStateChange()._error == systemError(ECONNRESET));
+	CHECK(listener.lastStateChange()._generation == generation);
+	CHECK(listener.lastStateChange()._origin == &origin);
+	CHECK(listener._reconnectRequests == 0);
+
+	// The first error wins
+	connection.handleError(std::chrono::system_clock::now(), systemError(EPIPE), generation);
+	CHECK(listener._reportedErrors == 2);
+	CHECK(listener._stateChanges.size() == 2);
+}
+
+TEST_CASE("ConnectionManager fails over to the next endpoint, and back", "[ConnectionManager][failover]")
+{
+	StandInServer primary({});
+	StandInServer secondary({});
+	RecordingListener listener;
+	ConnectionManager connection(listener);
+	connection.configure(configFor({ endpointOf(primary), endpointOf(secondary) }));
+	connection.requestConnect(std::chrono::system_clock::now());
+	REQUIRE(connection.connected());
+	CHECK(connection.activeEndpoint() == 0);
+	CHECK_FALSE(connection.failbackDue(std::chrono::steady_clock::now()));
+
+	// Take the primary endpoint down. As there is another endpoint, the client is asked to reconnect right away.
+	primary.stopListening();
+	connection.handleError(std::chrono::system_clock::now(), systemError(ECONNRESET), connection.state().generation());
+	CHECK_FALSE(connection.connected());
+	CHECK(listener._reconnectRequests == 1);
+
+	connection.connect(std::chrono::system_clock::now());
+	REQUIRE(connection.connected());
+	CHECK(connection.activeEndpoint() == 1);
+	CHECK(connection.handle()->generation() == 2);
+	CHECK(connection.failoverCount() == 1);
+	CHECK(listener._failovers == 1);
+
+	// Failback is due right away, and then only after the interval
+	const auto now = std::chrono::steady_clock::now();
+	CHECK(connection.failbackDue(now));
+	CHECK_FALSE(connection.failbackDue(now));
+
+	// Failback does nothing as long as the primary endpoint is down
+	connection.failback();
+	CHECK(connection.activeEndpoint() == 1);
+	CHECK(connection.state().generation() == 2);
+
+	// Once the primary endpoint is back, failback switches over under a new generation
+	primary.resumeListening();
+	connection.failback();
+	REQUIRE(connection.connected());
+	CHECK(connection.activeEndpoint() == 0);
+	CHECK(connection.handle()->generation() == 3);
+	CHECK(connection.failoverCount() == 2);
+	CHECK(listener._publishedEndpoints == std::vector<std::size_t> { 0, 1, 0 });
+	CHECK(listener.lastStateChange()._error == std::error_code());
+	CHECK(listener.lastStateChange()._generation == 3);
+}
+
+TEST_CASE("ConnectionManager swaps in the standby connection on connection errors", "[ConnectionManager][failover]")
+{
+	StandInServer primary({});
+	StandInServer secondary({});
+	RecordingListener listener;
+	ConnectionManager connection(listener);
+	auto config = configFor({ endpointOf(primary), endpointOf(secondary) });
+	config._warmStandby = true;
+	connection.configure(std::move(config));
+	connection.requestConnect(std::chrono::system_clock::now());
+	REQUIRE(connection.connected());
+	CHECK(connection.activeEndpoint() == 0);
+
+	// The standby connection prefers the other endpoint
+	connection.prepareStandby();
+
+	// The client stays connected across the error
+	const int origin = 0;
+	connection.handleError(std::chrono::system_clock::now(), systemError(EPIPE), 1, &origin);
+	REQUIRE(connection.connected());
+	CHECK(connection.activeEndpoint() == 1);
+	CHECK(connection.handle()->generation() == 2);
+	CHECK(listener._reconnectRequests == 0);
+	CHECK(listener._releases == 1);
+	CHECK(listener.lastStateChange()._error == std::error_code());
+	CHECK(listener.lastStateChange()._generation == 2);
+	CHECK(listener.lastStateChange()._origin == &origin);
+
+	// The standby connection was used up
+	connection.handleError(std::chrono::system_clock::now(), systemError(EPIPE), 2);
+	CHECK_FALSE(connection.connected());
+	CHECK(listener._reconnectRequests == 1);
+}
+
+} // namespace xentara::plugins::templateUplink
@@ -0,0 +1,229 @@
+// Copyright (c) embedded ocean GmbH
+#include "ConnectionState.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace xentara::plugins::templateUplink
+{
+
+using namespace std::literals;
+
+namespace
+{
+
+	/// @brief The number of threads used by the multi-threaded tests
+	constexpr std::size_t kThreadCount = 8;
+
+	/// @brief The number of state changes each thread makes
+	constexpr std::size_t kChangesPerThread = 10'000;
+
+} // namespace
+
+TEST_CASE("ConnectionState packs the generation and the phase into one word", "[ConnectionState]")
+{
+	const ConnectionState state { 42, ConnectionState::Phase::Connected };
+	CHECK(state.generation() == 42);
+	CHECK(state.phase() == ConnectionState::Phase::Connected);
+	CHECK(state.connected());
+	CHECK(ConnectionState::fromWord(state.word()).word() == state.word());
+
+	const auto changing = state.withPhase(ConnectionState::Phase::Changing);
+	CHECK(changing.generation() == 42);
+	CHECK_FALSE(changing.connected());
+
+	const auto next = state.nextGeneration(ConnectionState::Phase::Disconnected);
+	CHECK(next.generation() == 43);
+	CHECK(next.phase() == ConnectionState::Phase::Disconnected);
+}
+
+TEST_CASE("AtomicConnectionState only lets one thread change the state", "[ConnectionState]")
+{
+	AtomicConnectionState state;
+	REQUIRE(state.load().phase() == ConnectionState::Phase::Disconnected);
+
+	SECTION("tryBegin() requires the given phase")
+	{
+		CHECK_FALSE(state.tryBegin(ConnectionState::Phase::Connected));
+
+		const auto oldState = state.tryBegin(ConnectionState::Phase::Disconnected);
+		REQUIRE(oldState);
+		CHECK(state.load().phase() == ConnectionState::Phase::Changing);
+
+		// Nobody else can take ownership while the state is being changed
+		CHECK_FALSE(state.tryBegin(ConnectionState::Phase::Disconnected));
+		CHECK_FALSE(state.tryBegin(*oldState));
+
+		state.end(oldState->nextGeneration(ConnectionState::Phase::Connected));
+		CHECK(state.load().connected());
+		CHECK(state.load().generation() == 1);
+	}
+
+	SECTION("tryBegin() rejects an older generation")
+	{
+		state.end({ 5, ConnectionState::Phase::Connected });
+
+		CHECK_FALSE(state.tryBegin(ConnectionState { 4, ConnectionState::Phase::Connected }));
+		CHECK(state.load().word() == ConnectionState(5, ConnectionState::Phase::Connected).word());
+
+		CHECK(state.tryBegin(ConnectionState { 5, ConnectionState::Phase::Connected }));
+		CHECK(state.load().phase() == ConnectionState::Phase::Changing);
+		CHECK(state.load().generation() == 5);
+	}
+
+	SECTION("begin() takes ownership in any phase")
+	{
+		const auto oldState = state.begin();
+		CHECK(oldState.phase() == ConnectionState::Phase::Disconnected);
+		CHECK(state.load().phase() == ConnectionState::Phase::Changing);
+		state.end(oldState);
+		CHECK(state.load().word() == oldState.word());
+	}
+}
+
+TEST_CASE("AtomicConnectionState::begin() blocks until the owner publishes the new state", "[ConnectionState][multithreaded]")
+{
+	AtomicConnectionState state;
+	const auto oldState = state.begin();
+
+	std::atomic<bool> taken { false };
+	ConnectionState seen;
+	std::jthread waiter([&] {
+		seen = state.begin();
+		taken = true;
+		state.end(seen);
+	});
+
+	// The waiter cannot take ownership while we hold it
+	std::this_thread::sleep_for(50ms);
+	CHECK_FALSE(taken);
+
+	// Publishing the new state wakes the waiter up
+	const auto newState = oldState.nextGeneration(ConnectionState::Phase::Connected);
+	state.end(newState);
+	waiter.join();
+	CHECK(taken);
+	CHECK(seen.word() == newState.word());
+	CHECK(state.load().word() == newState.word());
+}
+
+TEST_CASE("AtomicConnectionState serializes state changes of many threads", "[ConnectionState][multithreaded]")
+{
+	AtomicConnectionState state;
+
+	// Each thread makes its changes alternately using begin() and tryBegin(). The counter is not atomic, so any overlapping
+	// changes would lose increments (and be reported by the thread sanitizer).
+	std::size_t changes = 0;
+	std::atomic<std::size_t> owners { 0 };
+	std::atomic<bool> overlapped { false };
+
+	std::vector<std::jthread> threads;
+	for (std::size_t thread = 0; thread < kThreadCount; ++thread)
+	{
+		threads.emplace_back([&] {
+			for (std::size_t change = 0; change < kChangesPerThread;)
+			{
+				ConnectionState oldState;
+				if (change % 2 == 0)
+				{
+					oldState = state.begin();
+				}
+				else
+				{
+					const auto phase = state.load().phase();
+					if (phase == ConnectionState::Phase::Changing)
+					{
+						std::this_thread::yield();
+						continue;
+					}
+					const auto taken = state.tryBegin(phase);
+					if (!taken)
+					{
+						continue;
+					}
+					oldState = *taken;
+				}
+
+				if (owners.fetch_add(1, std::memory_order_relaxed) != 0)
+				{
+					overlapped = true;
+				}
+				++changes;
+				owners.fetch_sub(1, std::memory_order_relaxed);
+
+				// Toggle between connected and disconnected, just like connect() and disconnect() would
+				state.end(oldState.nextGeneration(
+					oldState.connected() ? ConnectionState::Phase::Disconnected : ConnectionState::Phase::Connected));
+				++change;
+			}
+		});
+	}
+	threads.clear();
+
+	CHECK_FALSE(overlapped);
+	CHECK(changes == kThreadCount * kChangesPerThread);
+	CHECK(state.load().generation() == kThreadCount * kChangesPerThread);
+	CHECK(state.load().phase() != ConnectionState::Phase::Changing);
+}
+
+TEST_CASE("AtomicConnectionState lets only one thread handle an error per generation", "[ConnectionState][multithreaded]")
+{
+	constexpr std::uint64_t kGenerations = 1'000;
+
+	AtomicConnectionState state;
+	state.end({ 0, ConnectionState::Phase::Connected });
+
+	// Count how many threads handled an error for each generation. Like TemplateClient::handleError(), every thread reports
+	// an error for the generation it last saw, and the winner replaces the connection under a new generation.
+	std::vector<std::atomic<std::size_t>> winners(kGenerations);
+	std::atomic<std::size_t> staleRejections { 0 };
+
+	std::vector<std::jthread> threads;
+	for (std::size_t thread = 0; thread < kThreadCount; ++thread)
+	{
+		threads.emplace_back([&] {
+			for (;;)
+			{
+				const auto seen = state.load();
+				if (seen.generation() >= kGenerations)
+				{
+					return;
+				}
+				if (!seen.connected())
+				{
+					std::this_thread::yield();
+					continue;
+				}
+
+				if (!state.tryBegin(seen))
+				{
+					// Somebody else got there first, so our error belongs to a connection that is already being replaced
+					staleRejections.fetch_add(1, std::memory_order_relaxed);
+					continue;
+				}
+
+				winners[seen.generation()].fetch_add(1, std::memory_order_relaxed);
+				state.end(seen.nextGeneration(ConnectionState::Phase::Connected));
+			}
+		});
+	}
+	threads.clear();
+
+	CHECK(state.load().generation() == kGenerations);
+	for (auto &&count : winners)
+	{
+		REQUIRE(count.load() == 1);
+	}
+
+	// A late error for an old generation is always rejected
+	CHECK_FALSE(state.tryBegin(ConnectionState { kGenerations - 1, ConnectionState::Phase::Connected }));
+	CHECK(state.load().word() == ConnectionState(kGenerations, ConnectionState::Phase::Connected).word());
+}
+
+} // namespace xentara::plugins::templateUplink
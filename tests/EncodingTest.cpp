@@ -0,0 +1,110 @@
+// Copyright (c) embedded ocean GmbH
+#include "Encoding.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <cstddef>
+#include <random>
+#include <string>
+#include <string_view>
+
+namespace xentara::plugins::templateUplink
+{
+
+using namespace std::literals;
+
+namespace
+{
+
+	/// @brief Makes a string of printable characters, with a character that must be escaped every so often
+	/// @param escapeInterval The average distance between characters that must be escaped, or 0 for none
+	auto makeText(std::size_t size, std::size_t escapeInterval, std::mt19937 &random) -> std::string
+	{
+		constexpr std::string_view kSpecial = "\"\\\n\r\t\x01\x1f";
+
+		std::uniform_int_distribution<int> printable(' ' + 3, '~');
+		std::uniform_int_distribution<std::size_t> interval(0, escapeInterval * 2);
+		std::uniform_int_distribution<std::size_t> special(0, kSpecial.size() - 1);
+
+		std::string text(size, ' ');
+		auto nextEscape = escapeInterval > 0 ? interval(random) : size;
+		for (std::size_t index = 0; index < size; ++index)
+		{
+			if (index == nextEscape)
+			{
+				text[index] = kSpecial[special(random)];
+				nextEscape += 1 + interval(random);
+			}
+			else
+			{
+				// Include characters above 0x7f, which must not be mistaken for control characters by signed comparisons
+				text[index] = index % 17 == 16 ? char(0xc3) : char(printable(random));
+			}
+		}
+		return text;
+	}
+
+} // namespace
+
+TEST_CASE("jsonStringLiteral escapes special characters", "[Encoding]")
+{
+	CHECK(jsonStringLiteral("") == "\"\""sv);
+	CHECK(jsonStringLiteral("plain") == "\"plain\""sv);
+	CHECK(jsonStringLiteral("say \"hi\"\\") == R"("say \"hi\"\\")"sv);
+	CHECK(jsonStringLiteral("line\nfeed\r\ttab") == R"("line\nfeed\r\ttab")"sv);
+	CHECK(jsonStringLiteral("\x01\x1f\x7f\xc3\xa4"sv) == "\"\\u0001\\u001f\x7f\xc3\xa4\""sv);
+	CHECK(jsonStringLiteral("nul\0byte"sv) == R"("nul\u0000byte")"sv);
+}
+
+TEST_CASE("jsonStringLiteral gives the same result with and without SIMD instructions", "[Encoding]")
+{
+	std::mt19937 random(42);
+
+	// Use all sizes around the width of the vector registers, so that the scalar tail is exercised as well
+	for (std::size_t size = 0; size < 100; ++size)
+	{
+		for (const std::size_t escapeInterval : { 0, 1, 7, 40 })
+		{
+			const auto text = makeText(size, escapeInterval, random);
+			INFO("size " << size << ", escape interval " << escapeInterval);
+			CHECK(jsonStringLiteral(text) == jsonStringLiteralScalar(text));
+		}
+	}
+}
+
+TEST_CASE("Benchmark of JSON string escaping", "[Encoding][!benchmark]")
+{
+	std::mt19937 random(42);
+
+	// A typical remote ID, a longer text value, and a text with many characters to escape
+	const auto shortText = makeText(24, 0, random);
+	const auto longText = makeText(4096, 0, random);
+	const auto escapedText = makeText(4096, 8, random);
+
+	BENCHMARK("short text, SIMD")
+	{
+		return jsonStringLiteral(shortText);
+	};
+	BENCHMARK("short text, scalar")
+	{
+		return jsonStringLiteralScalar(shortText);
+	};
+	BENCHMARK("long text, SIMD")
+	{
+		return jsonStringLiteral(longText);
+	};
+	BENCHMARK("long text, scalar")
+	{
+		return jsonStringLiteralScalar(longText);
+	};
+	BENCHMARK("many escapes, SIMD")
+	{
+		return jsonStringLiteral(escapedText);
+	};
+	BENCHMARK("many escapes, scalar")
+	{
+		return jsonStringLiteralScalar(escapedText);
+	};
+}
+
+} // namespace xentara::plugins::templateUplink
@@ -0,0 +1,621 @@
+// Copyright (c) embedded ocean GmbH
+#include "BatchWriter.hpp"
+#include "ConnectionManager.hpp"
+#include "CustomError.hpp"
+#include "Encoding.hpp"
+#include "Endpoint.hpp"
+#include "FaultInjector.hpp"
+#include "StandInServer.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+
+namespace xentara::plugins::templateUplink
+{
+
+using namespace std::literals;
+
+namespace
+{
+
+	/// @brief The size of the payload of each frame, not including the sequence number
+	constexpr std::size_t kPayloadSize = 256;
+
+	/// @brief The maximum number of frames sent in one batch
+	constexpr std::size_t kFramesPerBatch = 64;
+
+	/// @brief The settings for connecting. These are much shorter than the defaults, as everything is local.
+	constexpr ConnectionRace kConnectionRace { 20ms, 500ms };
+
+	/// @brief Records the sequence numbers of the frames received by a stand-in server
+	class ReceivedFrames final
+	{
+	public:
+		/// @brief Gets a frame handler for the server
+		auto handler() -> StandInServer::FrameHandler
+		{
+			return [this](std::span<const std::byte> frame) { record(frame); };
+		}
+
+		/// @brief Gets the number of distinct frames received
+		auto distinct() const -> std::size_t
+		{
+			std::scoped_lock lock { _mutex };
+			return _distinct;
+		}
+
+		/// @brief Gets the number of frames that were received more than once
+		auto duplicates() const -> std::size_t
+		{
+			std::scoped_lock lock { _mutex };
+			return _duplicates;
+		}
+
+		/// @brief Checks whether a frame was received
+		auto contains(std::uint64_t sequence) const -> bool
+		{
+			std::scoped_lock lock { _mutex };
+			return sequence < _seen.size() && _seen[sequence];
+		}
+
+		/// @brief Gets the number of frames in a range of sequence numbers that were never received
+		auto missing(std::uint64_t begin, std::uint64_t end) const -> std::size_t
+		{
+			std::scoped_lock lock { _mutex };
+			std::size_t count = 0;
+			for (auto sequence = begin; sequence < end; ++sequence)
+			{
+				if (sequence >= _seen.size() || !_seen[sequence])
+				{
+					++count;
+				}
+			}
+			return count;
+		}
+
+	private:
+		auto record(std::span<const std::byte> frame) -> void
+		{
+			// This is called on the server thread, so we cannot use Catch2 assertions here. Malformed frames are simply not
+			// recorded, so they show up as missing.
+			if (frame.size() != sizeof(std::uint64_t) + kPayloadSize)
+			{
+				return;
+			}
+			const auto sequence = getLittleEndian<std::uint64_t>(frame.data());
+
+			std::scoped_lock lock { _mutex };
+			if (sequence >= _seen.size())
+			{
+				_seen.resize(sequence + 1);
+			}
+			if (_seen[sequence])
+			{
+				++_duplicates;
+				return;
+			}
+			_seen[sequence] = true;
+			++_distinct;
+		}
+
+		mutable std::mutex _mutex;
+		std::vector<bool> _seen;
+		std::size_t _distinct { 0 };
+		std::size_t _duplicates { 0 };
+	};
+
+	/// @brief A minimal uplink that sends frames the way the template client and transaction do.
+	///
+	/// The connection is managed by a ConnectionManager, just like in the client. Frames are queued, and sent in batches using a
+	/// BatchWriter on the non-blocking socket of the current handle, with faults injected by FaultInjector::truncate() exactly
+	/// like TemplateClient::write() does. Write errors are passed to ConnectionManager::handleError(), and if the connection
+	/// generation changes, the interrupted batch is sent again from the start, like the transaction does. Frames queued while
+	/// there is no connection are kept as backlog.
+	class TestUplink final : private ConnectionManager::Listener
+	{
+	public:
+		/// @brief Constructor
+		explicit TestUplink(std::vector<Endpoint> endpoints, const FaultInjector::Config &faults = {})
+		{
+			ConnectionManager::Config config;
+			config._endpoints = std::move(endpoints);
+			config._connectionRace = kConnectionRace;
+			_connection.configure(std::move(config));
+
+			_faultInjector.configure(faults);
+		}
+
+		/// @brief Queues a frame with the given sequence number
+		auto queue(std::uint64_t sequence) -> void
+		{
+			auto &frame = _queue.emplace_back(sizeof(std::uint32_t) + sizeof(std::uint64_t) + kPayloadSize);
+			auto position = putLittleEndian(frame.data(), std::uint32_t(sizeof(std::uint64_t) + kPayloadSize));
+			putLittleEndian(position, sequence);
+		}
+
+		/// @brief Gets the number of frames that have not been sent yet
+		auto backlog() const noexcept -> std::size_t
+		{
+			return _queue.size() + _inFlight.size();
+		}
+
+		/// @brief Connects to the first endpoint that answers, unless already connected
+		auto connect() -> bool
+		{
+			// The first call requests the connection, like a transaction does when it starts
+			if (!_connection.requested())
+			{
+				_connection.requestConnect(std::chrono::system_clock::now());
+			}
+			else
+			{
+				_connection.connect(std::chrono::system_clock::now());
+			}
+
+			return _connection.connected();
+		}
+
+		/// @brief Switches to a more preferred endpoint using ConnectionManager::failback()
+		auto failback() -> bool
+		{
+			const auto endpoint = this->endpoint();
+			if (!_connection.connected() || endpoint == 0 || _writer.pending())
+			{
+				return false;
+			}
+
+			_connection.failback();
+
+			return this->endpoint() != endpoint;
+		}
+
+		/// @brief Sends queued frames until the queue is empty, or the deadline has passed
+		/// @return Returns true if all the frames were sent
+		auto flush(std::chrono::steady_clock::time_point deadline) -> bool
+		{
+			while (backlog() > 0 && std::chrono::steady_clock::now() < deadline)
+			{
+				// Detect a connection closed by the service, like the I/O reactor does for the client
+				checkConnection();
+				if (!connect())
+				{
+					std::this_thread::sleep_for(10ms);
+					continue;
+				}
+				const auto handle = _connection.handle();
+				if (!handle)
+				{
+					continue;
+				}
+
+				// The interrupted batch must be sent again from the start on a new connection
+				if (!_writer.pending())
+				{
+					startBatch();
+				}
+				else if (handle->generation() != _batchGeneration)
+				{
+					_writer.rewind();
+				}
+				_batchGeneration = handle->generation();
+
+				try
+				{
+					if (_writer.resume([&](std::span<const BatchWriter::Buffer> buffers) { return write(*handle, buffers); }))
+					{
+						_inFlight.clear();
+						continue;
+					}
+
+					// Wait for the connection to become ready again
+					::pollfd pollEntry { handle->socket().native(), POLLOUT, 0 };
+					::poll(&pollEntry, 1, 10);
+				}
+				catch (const std::system_error &exception)
+				{
+					_connection.handleError(std::chrono::system_clock::now(), exception.code(), handle->generation());
+				}
+			}
+
+			return backlog() == 0;
+		}
+
+		/// @brief Discards all frames not sent yet, like a transaction whose drain timeout expired
+		/// @return The number of frames discarded
+		auto discard() -> std::size_t
+		{
+			const auto count = backlog();
+			_writer.reset();
+			_inFlight.clear();
+			_queue.clear();
+			return count;
+		}
+
+		/// @brief Gets the index of the endpoint the uplink is connected to
+		auto endpoint() const noexcept -> std::size_t
+		{
+			return _connection.activeEndpoint();
+		}
+
+		/// @brief Gets the number of times the connection was reestablished after a failure
+		auto reconnects() const noexcept -> std::size_t
+		{
+			return _reconnects;
+		}
+
+		/// @brief Gets the longest time it took to reestablish a connection
+		auto maxReconnectTime() const noexcept -> std::chrono::steady_clock::duration
+		{
+			return _maxReconnectTime;
+		}
+
+		/// @brief Checks whether the connection was closed by the service, like the I/O reactor does for the client
+		/// @return Returns true if the uplink is still connected
+		auto checkConnection() -> bool
+		{
+			const auto handle = _connection.handle();
+			if (!handle)
+			{
+				return false;
+			}
+
+			// The service never sends anything, so anything other than "no data" means the connection is gone
+			std::array<std::byte, 64> buffer;
+			try
+			{
+				if (handle->socket().readSome(buffer))
+				{
+					_connection.handleError(std::chrono::system_clock::now(), CustomError::NotConnected, handle->generation());
+				}
+			}
+			catch (const std::system_error &exception)
+			{
+				_connection.handleError(std::chrono::system_clock::now(), exception.code(), handle->generation());
+			}
+
+			return _connection.connected();
+		}
+
+	private:
+		auto startBatch() -> void
+		{
+			const auto count = std::min(_queue.size(), kFramesPerBatch);
+			_inFlight.assign(std::make_move_iterator(_queue.begin()), std::make_move_iterator(_queue.begin() + std::ptrdiff_t(count)));
+			_queue.erase(_queue.begin(), _queue.begin() + std::ptrdiff_t(count));
+
+			_buffers.clear();
+			for (auto &&frame : _inFlight)
+			{
+				_buffers.emplace_back(frame);
+			}
+			_writer.start(_buffers);
+		}
+
+		auto write(const ConnectionManager::Handle &handle, std::span<const BatchWriter::Buffer> buffers)
+			-> std::optional<std::size_t>
+		{
+			std::vector<BatchWriter::Buffer> truncated;
+			return handle.socket().writeSome(_faultInjector.truncate(buffers, truncated));
+		}
+
+		/// @name Virtual Overrides for ConnectionManager::Listener
+		/// @{
+
+		auto connectionAttempted(std::chrono::steady_clock::time_point, std::size_t, std::error_code) noexcept -> void final
+		{
+		}
+
+		auto connectionErrorReported(std::error_code, std::uint64_t) noexcept -> void final
+		{
+		}
+
+		auto releasingHandle() noexcept -> void final
+		{
+		}
+
+		auto handlePublished(const ConnectionManager::Handle &, bool) noexcept -> void final
+		{
+		}
+
+		auto stateChanged(std::chrono::system_clock::time_point, std::error_code error, std::uint64_t, const void *)
+			-> void final
+		{
+			// Measure the time from the loss of the connection to the new connection
+			if (error)
+			{
+				if (!_disconnectTime)
+				{
+					_disconnectTime = std::chrono::steady_clock::now();
+				}
+			}
+			else if (_disconnectTime)
+			{
+				const auto reconnectTime = std::chrono::steady_clock::now() - *_disconnectTime;
+				_maxReconnectTime = std::max(_maxReconnectTime, reconnectTime);
+				++_reconnects;
+				_disconnectTime.reset();
+			}
+		}
+
+		auto reconnectRequested() noexcept -> void final
+		{
+			// flush() reconnects on its next iteration
+		}
+
+		/// @}
+
+		ConnectionManager _connection { *this };
+		FaultInjector _faultInjector;
+
+		std::deque<std::vector<std::byte>> _queue;
+		std::vector<std::vector<std::byte>> _inFlight;
+		std::vector<BatchWriter::Buffer> _buffers;
+		BatchWriter _writer;
+		std::uint64_t _batchGeneration { 0 };
+
+		std::optional<std::chrono::steady_clock::time_point> _disconnectTime;
+		std::size_t _reconnects { 0 };
+		std::chrono::steady_clock::duration _maxReconnectTime { 0 };
+	};
+
+	/// @brief Makes an endpoint for a stand-in server
+	auto endpointOf(const StandInServer &server) -> Endpoint
+	{
+		return { "127.0.0.1", server.port() };
+	}
+
+	/// @brief Waits until a condition is true, or the timeout has expired
+	template <typename Condition>
+	auto waitFor(Condition &&condition, std::chrono::milliseconds timeout = 10s) -> bool
+	{
+		const auto deadline = std::chrono::steady_clock::now() + timeout;
+		while (!condition())
+		{
+			if (std::chrono::steady_clock::now() >= deadline)
+			{
+				return false;
+			}
+			std::this_thread::sleep_for(1ms);
+		}
+		return true;
+	}
+
+	/// @brief Converts a duration to milliseconds for reporting
+	auto milliseconds(std::chrono::steady_clock::duration duration) -> double
+	{
+		return std::chrono::duration<double, std::milli>(duration).count();
+	}
+
+} // namespace
+
+TEST_CASE("The uplink reconnects after the service resets the connection", "[FaultInjection][connection]")
+{
+	ReceivedFrames received;
+	StandInServer server({}, received.handler());
+	TestUplink uplink({ endpointOf(server) });
+
+	// Send some data on the first connection
+	constexpr std::uint64_t kFramesPerPhase = 1'000;
+	for (std::uint64_t sequence = 0; sequence < kFramesPerPhase; ++sequence)
+	{
+		uplink.queue(sequence);
+	}
+	REQUIRE(uplink.flush(std::chrono::steady_clock::now() + 10s));
+	REQUIRE(waitFor([&] { return received.distinct() == kFramesPerPhase; }));
+
+	// Drop the connection, and keep sending. The reset is only sent once the server thread has released the socket, so wait
+	// for it to arrive, or the data might all be written into the old connection before it is gone.
+	server.resetConnections();
+	REQUIRE(waitFor([&] { return !uplink.checkConnection(); }));
+	for (std::uint64_t sequence = kFramesPerPhase; sequence < 2 * kFramesPerPhase; ++sequence)
+	{
+		uplink.queue(sequence);
+	}
+	REQUIRE(uplink.flush(std::chrono::steady_clock::now() + 10s));
+	REQUIRE(waitFor([&] { return received.contains(2 * kFramesPerPhase - 1); }));
+
+	// Data written into the connection after it was reset, but before the reset was noticed, would be lost, as the protocol has
+	// no acknowledgements. This can be at most one batch.
+	const auto lost = received.missing(0, 2 * kFramesPerPhase);
+	WARN("reconnect time: " << milliseconds(uplink.maxReconnectTime()) << " ms, frames lost: " << lost);
+	CHECK(uplink.reconnects() == 1);
+	CHECK(uplink.maxReconnectTime() < 1s);
+	CHECK(lost <= kFramesPerBatch);
+	CHECK(server.statistics()._connections == 2);
+}
+
+TEST_CASE("The uplink loses no data with injected partial writes and connection errors", "[FaultInjection][throughput]")
+{
+	ReceivedFrames received;
+	StandInServer server({}, received.handler());
+
+	FaultInjector::Config faults;
+	faults._seed = 31;
+	faults._partialWriteProbability = 0.3;
+	faults._connectionResetProbability = 0.01;
+	faults._brokenPipeProbability = 0.005;
+	TestUplink uplink({ endpointOf(server) }, faults);
+
+	constexpr std::uint64_t kFrames = 20'000;
+	for (std::uint64_t sequence = 0; sequence < kFrames; ++sequence)
+	{
+		uplink.queue(sequence);
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	REQUIRE(uplink.flush(start + 60s));
+	REQUIRE(waitFor([&] { return received.distinct() == kFrames; }));
+	const auto duration = std::chrono::steady_clock::now() - start;
+
+	// Injected errors never lose data that was already written, because the interrupted batch is sent again in full
+	const auto bytes = double(kFrames * (sizeof(std::uint32_t) + sizeof(std::uint64_t) + kPayloadSize));
+	WARN("throughput: " << bytes / std::chrono::duration<double>(duration).count() / 1e6 << " MB/s, reconnects: "
+						<< uplink.reconnects() << ", max reconnect time: " << milliseconds(uplink.maxReconnectTime())
+						<< " ms, duplicate frames: " << received.duplicates());
+	CHECK(received.missing(0, kFrames) == 0);
+	CHECK(uplink.reconnects() > 0);
+	CHECK(uplink.maxReconnectTime() < 1s);
+}
+
+TEST_CASE("The uplink loses no data under packet loss", "[FaultInjection][throughput]")
+{
+	// Every lost segment stalls the connection for the retransmission delay, so the throughput drops with the loss rate
+	const auto lossProbability = GENERATE(0.0, 0.001, 0.01);
+
+	ReceivedFrames received;
+	StandInServer server({}, received.handler());
+
+	FaultInjector::Config faults;
+	faults._seed = 31;
+	faults._packetLossProbability = lossProbability;
+	faults._retransmissionDelay = 200ms;
+	TestUplink uplink({ endpointOf(server) }, faults);
+
+	constexpr std::uint64_t kFrames = 2'000;
+	for (std::uint64_t sequence = 0; sequence < kFrames; ++sequence)
+	{
+		uplink.queue(sequence);
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	REQUIRE(uplink.flush(start + 30s));
+	REQUIRE(waitFor([&] { return received.distinct() == kFrames; }));
+	const auto duration = std::chrono::steady_clock::now() - start;
+
+	// Lost segments are retransmitted by TCP, so they only cost time
+	const auto bytes = double(kFrames * (sizeof(std::uint32_t) + sizeof(std::uint64_t) + kPayloadSize));
+	WARN("packet loss: " << lossProbability * 100 << " %, throughput: "
+						 << bytes / std::chrono::duration<double>(duration).count() / 1e6 << " MB/s");
+	CHECK(received.missing(0, kFrames) == 0);
+	CHECK(received.duplicates() == 0);
+	CHECK(uplink.reconnects() == 0);
+}
+
+TEST_CASE("The uplink fails over to the next endpoint, and back", "[FaultInjection][failover]")
+{
+	ReceivedFrames receivedByPrimary;
+	ReceivedFrames receivedBySecondary;
+	StandInServer primary({}, receivedByPrimary.handler());
+	StandInServer secondary({}, receivedBySecondary.handler());
+	TestUplink uplink({ endpointOf(primary), endpointOf(secondary) });
+
+	REQUIRE(uplink.connect());
+	CHECK(uplink.endpoint() == 0);
+
+	// Take the primary endpoint down completely, and make sure the uplink has noticed before anything is sent
+	primary.stopListening();
+	primary.resetConnections();
+	REQUIRE(waitFor([&] { return !uplink.checkConnection(); }));
+
+	constexpr std::uint64_t kFrames = 500;
+	for (std::uint64_t sequence = 0; sequence < kFrames; ++sequence)
+	{
+		uplink.queue(sequence);
+	}
+	REQUIRE(uplink.flush(std::chrono::steady_clock::now() + 10s));
+	CHECK(uplink.endpoint() == 1);
+	REQUIRE(waitFor([&] { return receivedBySecondary.contains(kFrames - 1); }));
+	WARN("failover time: " << milliseconds(uplink.maxReconnectTime()) << " ms");
+	CHECK(uplink.maxReconnectTime() < 1s);
+
+	// Bring the primary endpoint back, and switch back to it
+	primary.resumeListening();
+	REQUIRE(uplink.failback());
+	CHECK(uplink.endpoint() == 0);
+	for (std::uint64_t sequence = kFrames; sequence < 2 * kFrames; ++sequence)
+	{
+		uplink.queue(sequence);
+	}
+	REQUIRE(uplink.flush(std::chrono::steady_clock::now() + 10s));
+	REQUIRE(waitFor([&] { return receivedByPrimary.distinct() == kFrames; }));
+	CHECK(receivedByPrimary.missing(kFrames, 2 * kFrames) == 0);
+}
+
+TEST_CASE("The uplink keeps a backlog while the service is down", "[FaultInjection][backlog]")
+{
+	ReceivedFrames received;
+	StandInServer server({}, received.handler());
+	TestUplink uplink({ endpointOf(server) });
+	REQUIRE(uplink.connect());
+
+	// Take the service down, and make sure the uplink has noticed before anything is sent
+	server.stopListening();
+	server.resetConnections();
+	REQUIRE(waitFor([&] { return !uplink.checkConnection(); }));
+
+	constexpr std::uint64_t kFrames = 2'000;
+	for (std::uint64_t sequence = 0; sequence < kFrames; ++sequence)
+	{
+		uplink.queue(sequence);
+	}
+	CHECK_FALSE(uplink.flush(std::chrono::steady_clock::now() + 200ms));
+	CHECK(uplink.backlog() == kFrames);
+
+	// Once the service is back, the whole backlog is sent
+	const auto outageEnd = std::chrono::steady_clock::now();
+	server.resumeListening();
+	REQUIRE(uplink.flush(std::chrono::steady_clock::now() + 10s));
+	REQUIRE(waitFor([&] { return received.distinct() == kFrames; }));
+	WARN("backlog of " << kFrames << " frames sent " << milliseconds(std::chrono::steady_clock::now() - outageEnd)
+					   << " ms after the service came back");
+	CHECK(received.missing(0, kFrames) == 0);
+	CHECK(received.duplicates() == 0);
+}
+
+TEST_CASE("The uplink drains its queue within the drain timeout", "[FaultInjection][drain]")
+{
+	ReceivedFrames received;
+	StandInServer server({}, received.handler());
+
+	// Limit the bandwidth, so that draining takes a noticeable amount of time
+	FaultInjector::Config faults;
+	faults._seed = 48;
+	faults._bytesPerSecond = 4e6;
+	TestUplink uplink({ endpointOf(server) }, faults);
+	REQUIRE(uplink.connect());
+
+	SECTION("a queue that fits into the drain timeout is sent completely")
+	{
+		constexpr std::uint64_t kFrames = 2'000;
+		for (std::uint64_t sequence = 0; sequence < kFrames; ++sequence)
+		{
+			uplink.queue(sequence);
+		}
+		REQUIRE(uplink.flush(std::chrono::steady_clock::now() + 5s));
+		REQUIRE(waitFor([&] { return received.distinct() == kFrames; }));
+	}
+
+	SECTION("the rest of a queue that does not fit is discarded")
+	{
+		constexpr std::uint64_t kFrames = 20'000;
+		for (std::uint64_t sequence = 0; sequence < kFrames; ++sequence)
+		{
+			uplink.queue(sequence);
+		}
+		CHECK_FALSE(uplink.flush(std::chrono::steady_clock::now() + 100ms));
+		const auto discarded = uplink.discard();
+		CHECK(discarded > 0);
+
+		// Everything that was not discarded arrives. The frames of the interrupted batch that were already written count as
+		// both.
+		REQUIRE(waitFor([&] { return received.distinct() + discarded >= kFrames; }));
+		CHECK(received.distinct() < kFrames);
+		WARN("drained " << received.distinct() << " frames, discarded " << discarded);
+	}
+}
+
+} // namespace xentara::plugins::templateUplink
@@ -0,0 +1,199 @@
+// Copyright (c) embedded ocean GmbH
+#include "Reactor.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#	include <sys/eventfd.h>
+#	include <unistd.h>
+#endif
+
+namespace xentara::plugins::templateUplink
+{
+
+using namespace std::literals;
+
+#ifdef __linux__
+
+TEST_CASE("Reactor never runs the callback of a watch concurrently", "[Reactor][multithreaded]")
+{
+	constexpr std::size_t kCallbacks = 2'000;
+
+	Reactor reactor(4);
+	REQUIRE(reactor.watchesSupported());
+
+	// An eventfd that is never read stays readable, so every time the watch is armed, the callback is called again
+	const auto eventFd = ::eventfd(1, EFD_CLOEXEC | EFD_NONBLOCK);
+	REQUIRE(eventFd >= 0);
+
+	std::atomic<bool> running { false };
+	std::atomic<bool> overlapped { false };
+	std::size_t calls = 0;
+	std::mutex mutex;
+	std::condition_variable done;
+
+	std::atomic<bool> stop { false };
+
+	Reactor::Watch watch;
+	watch = reactor.watch(eventFd, [&](Reactor::Events) {
+		if (running.exchange(true))
+		{
+			overlapped = true;
+		}
+
+		// Arm the watch again from within the callback, just like the client does while it is receiving commands
+		if (!stop)
+		{
+			watch.arm(Reactor::kReadable);
+		}
+		std::this_thread::yield();
+
+		running = false;
+
+		std::scoped_lock lock { mutex };
+		if (++calls == kCallbacks)
+		{
+			done.notify_all();
+		}
+	});
+	watch.arm(Reactor::kReadable);
+
+	// Arm the watch from another thread at the same time, like a transaction waiting for the connection to become writable
+	std::jthread armer([&] {
+		while (!stop)
+		{
+			watch.arm(Reactor::kReadable);
+		}
+	});
+
+	{
+		std::unique_lock lock { mutex };
+		REQUIRE(done.wait_for(lock, 30s, [&] { return calls >= kCallbacks; }));
+	}
+	stop = true;
+	armer.join();
+
+	// Let the last notification run out before unregistering, as the callback uses the watch object itself
+	std::this_thread::sleep_for(50ms);
+	{
+		std::scoped_lock lock { mutex };
+	}
+	watch.reset();
+	::close(eventFd);
+
+	CHECK_FALSE(overlapped);
+}
+
+TEST_CASE("Reactor::Watch::reset() can be called from within the callback", "[Reactor]")
+{
+	Reactor reactor(2);
+	REQUIRE(reactor.watchesSupported());
+
+	const auto eventFd = ::eventfd(1, EFD_CLOEXEC | EFD_NONBLOCK);
+	REQUIRE(eventFd >= 0);
+
+	std::atomic<std::size_t> calls { 0 };
+	Reactor::Watch watch;
+	watch = reactor.watch(eventFd, [&](Reactor::Events) {
+		// Re-arming and unregistering in the same callback must not call us again
+		watch.arm(Reactor::kReadable);
+		watch.reset();
+		++calls;
+	});
+	watch.arm(Reactor::kReadable);
+
+	const auto deadline = std::chrono::steady_clock::now() + 10s;
+	while (calls == 0 && std::chrono::steady_clock::now() < deadline)
+	{
+		std::this_thread::sleep_for(1ms);
+	}
+	std::this_thread::sleep_for(20ms);
+	::close(eventFd);
+
+	CHECK(calls == 1);
+}
+
+#endif
+
+TEST_CASE("Reactor runs timers in order of their deadlines", "[Reactor]")
+{
+	Reactor reactor(1);
+
+	std::mutex mutex;
+	std::condition_variable done;
+	std::vector<int> order;
+	const auto fire = [&](int timer) {
+		return [&, timer] {
+			std::scoped_lock lock { mutex };
+			order.push_back(timer);
+			done.notify_all();
+		};
+	};
+
+	const auto now = std::chrono::steady_clock::now();
+	reactor.schedule(now + 60ms, fire(3));
+	reactor.schedule(now + 20ms, fire(1));
+	const auto cancelled = reactor.schedule(now + 30ms, fire(0));
+	reactor.schedule(now + 40ms, fire(2));
+	reactor.cancel(cancelled);
+
+	std::unique_lock lock { mutex };
+	CHECK(done.wait_for(lock, 10s, [&] { return order.size() == 3; }));
+	CHECK(order == std::vector { 1, 2, 3 });
+}
+
+TEST_CASE("Reactor::cancel() waits for a timer that is running", "[Reactor][multithreaded]")
+{
+	Reactor reactor(2);
+
+	std::atomic<bool> started { false };
+	std::atomic<bool> finished { false };
+	const auto timer = reactor.schedule(std::chrono::steady_clock::now(), [&] {
+		started = true;
+		std::this_thread::sleep_for(50ms);
+		finished = true;
+	});
+
+	const auto deadline = std::chrono::steady_clock::now() + 10s;
+	while (!started && std::chrono::steady_clock::now() < deadline)
+	{
+		std::this_thread::yield();
+	}
+	REQUIRE(started);
+
+	reactor.cancel(timer);
+	CHECK(finished);
+}
+
+TEST_CASE("Reactor::cancel() can be called from within the timer function", "[Reactor]")
+{
+	Reactor reactor(1);
+
+	std::atomic<bool> finished { false };
+	Reactor::TimerId timer = 0;
+	std::mutex mutex;
+	std::unique_lock lock { mutex };
+	timer = reactor.schedule(std::chrono::steady_clock::now(), [&] {
+		std::scoped_lock timerLock { mutex };
+		reactor.cancel(timer);
+		finished = true;
+	});
+	lock.unlock();
+
+	const auto deadline = std::chrono::steady_clock::now() + 10s;
+	while (!finished && std::chrono::steady_clock::now() < deadline)
+	{
+		std::this_thread::sleep_for(1ms);
+	}
+	CHECK(finished);
+}
+
+} // namespace xentara::plugins::templateUplink
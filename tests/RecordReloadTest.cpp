@@ -0,0 +1,154 @@
+// Copyright (c) embedded ocean GmbH
+#include "RecordReload.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace xentara::plugins::templateUplink
+{
+
+using namespace std::literals;
+
+namespace
+{
+
+/// @brief A record with just the members used to compare records
+struct FakeRecord final
+{
+	auto remoteId() const noexcept -> const std::string &
+	{
+		return _remoteId;
+	}
+
+	auto sameConfiguration(const FakeRecord &other) const noexcept -> bool
+	{
+		return _remoteId == other._remoteId && _interval == other._interval;
+	}
+
+	std::string _remoteId;
+	std::chrono::milliseconds _interval { 0 };
+};
+
+/// @brief A sample group with just the schedule
+struct FakeGroup final
+{
+	std::chrono::milliseconds _interval { 0 };
+	std::chrono::steady_clock::time_point _nextDue;
+};
+
+auto record(std::string remoteId, std::chrono::milliseconds interval = 0ms) -> std::shared_ptr<FakeRecord>
+{
+	return std::make_shared<FakeRecord>(FakeRecord { std::move(remoteId), interval });
+}
+
+} // namespace
+
+TEST_CASE("carryOverRecords() keeps unchanged records and returns the new ones", "[RecordReload]")
+{
+	const auto kept = record("kept");
+	const auto changed = record("changed", 10ms);
+	const auto removed = record("removed");
+	const std::vector current { kept, changed, removed };
+
+	const auto changedAgain = record("changed", 20ms);
+	const auto added = record("added");
+	std::vector records { record("kept"), changedAgain, added };
+
+	const auto newRecords = carryOverRecords<FakeRecord>(current, records);
+
+	// The unchanged record is replaced by the current one, so that it keeps its state
+	REQUIRE(records.size() == 3);
+	CHECK(records[0] == kept);
+	CHECK(records[1] == changedAgain);
+	CHECK(records[2] == added);
+	CHECK(newRecords == std::vector { changedAgain, added });
+}
+
+TEST_CASE("carryOverRecords() uses each current record only once", "[RecordReload]")
+{
+	const auto kept = record("duplicate");
+	const std::vector current { kept };
+
+	const auto duplicate = record("duplicate");
+	std::vector records { record("duplicate"), duplicate };
+
+	const auto newRecords = carryOverRecords<FakeRecord>(current, records);
+
+	CHECK(records[0] == kept);
+	CHECK(records[1] == duplicate);
+	CHECK(newRecords == std::vector { duplicate });
+}
+
+TEST_CASE("carryOverSchedule() keeps the schedule of intervals that still exist", "[RecordReload]")
+{
+	const auto now = std::chrono::steady_clock::now();
+	const std::vector previous { FakeGroup { 10ms, now + 1ms }, FakeGroup { 20ms, now + 2ms } };
+	std::vector groups { FakeGroup { 20ms, now }, FakeGroup { 30ms, now } };
+
+	carryOverSchedule<FakeGroup>(previous, groups);
+
+	CHECK(groups[0]._nextDue == now + 2ms);
+	CHECK(groups[1]._nextDue == now);
+}
+
+TEST_CASE("TableExchange hands each published table over once", "[RecordReload]")
+{
+	TableExchange<int> exchange;
+	const auto initial = std::make_shared<int>(0);
+	exchange.reset(initial);
+
+	// Nothing has been published yet
+	CHECK(exchange.latest() == initial);
+	CHECK_FALSE(exchange.take());
+
+	// Only the last of several tables published between two takes is handed over
+	exchange.publish(std::make_shared<int>(1));
+	const auto second = std::make_shared<int>(2);
+	exchange.publish(second);
+	CHECK(exchange.latest() == second);
+	CHECK(exchange.take() == second);
+	CHECK_FALSE(exchange.take());
+
+	// Reloads are compared against the latest table, even after it has been taken
+	CHECK(exchange.latest() == second);
+}
+
+TEST_CASE("TableExchange hands tables over between threads", "[RecordReload][multithreaded]")
+{
+	constexpr int kTables = 10'000;
+
+	TableExchange<int> exchange;
+	exchange.reset(std::make_shared<int>(0));
+
+	std::jthread publisher([&] {
+		for (int table = 1; table <= kTables; ++table)
+		{
+			exchange.publish(std::make_shared<int>(table));
+		}
+	});
+
+	// The tables must arrive in order, and the last one must always arrive
+	int last = 0;
+	bool ordered = true;
+	const auto deadline = std::chrono::steady_clock::now() + 10s;
+	while (last != kTables && std::chrono::steady_clock::now() < deadline)
+	{
+		if (const auto table = exchange.take())
+		{
+			ordered = ordered && *table > last;
+			last = *table;
+		}
+	}
+	publisher.join();
+
+	CHECK(ordered);
+	CHECK(last == kTables);
+}
+
+} // namespace xentara::plugins::templateUplink
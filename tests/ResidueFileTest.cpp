@@ -0,0 +1,117 @@
+// Copyright (c) embedded ocean GmbH
+#include "ResidueFile.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace xentara::plugins::templateUplink
+{
+
+namespace
+{
+
+	/// @brief Converts a string to bytes
+	auto bytes(std::string_view text) -> std::vector<std::byte>
+	{
+		const auto data = reinterpret_cast<const std::byte *>(text.data());
+		return { data, data + text.size() };
+	}
+
+	/// @brief A residue file in the temporary directory that is removed again at the end of the test
+	struct TemporaryResidueFile final
+	{
+		TemporaryResidueFile() : _path(std::filesystem::temp_directory_path() / "template-uplink-residue-test.bin")
+		{
+			std::filesystem::remove(_path);
+		}
+
+		~TemporaryResidueFile()
+		{
+			std::error_code error;
+			std::filesystem::remove(_path, error);
+			auto temporaryPath = _path;
+			temporaryPath += ".tmp";
+			std::filesystem::remove(temporaryPath, error);
+		}
+
+		std::filesystem::path _path;
+	};
+
+} // namespace
+
+TEST_CASE("ResidueFile returns the saved blocks and deletes the file", "[ResidueFile]")
+{
+	TemporaryResidueFile temporary;
+	ResidueFile file(temporary._path);
+
+	// Time stamps are saved in microseconds
+	const auto timeStamp = std::chrono::system_clock::time_point(std::chrono::microseconds(1'700'000'000'123'456));
+	const auto first = bytes("first");
+	const auto second = bytes("second");
+	const auto payload = bytes(" with payload");
+	const std::vector<ResidueFile::Block> blocks {
+		{ timeStamp, first },
+		{ timeStamp + std::chrono::seconds(1), second, payload },
+		{ timeStamp + std::chrono::seconds(2), {} },
+	};
+	file.save(blocks);
+
+	// The temporary file must have been renamed
+	auto temporaryPath = temporary._path;
+	temporaryPath += ".tmp";
+	CHECK_FALSE(std::filesystem::exists(temporaryPath));
+
+	const auto loaded = file.take();
+	REQUIRE(loaded.size() == 3);
+	CHECK(loaded[0]._timeStamp == timeStamp);
+	CHECK(loaded[0]._data == first);
+	// The payload is saved as part of the same block
+	CHECK(loaded[1]._timeStamp == timeStamp + std::chrono::seconds(1));
+	CHECK(loaded[1]._data == bytes("second with payload"));
+	CHECK(loaded[2]._data.empty());
+
+	// The data now belongs to the caller
+	CHECK_FALSE(std::filesystem::exists(temporary._path));
+	CHECK(file.take().empty());
+}
+
+TEST_CASE("ResidueFile keeps the complete blocks of a truncated file", "[ResidueFile]")
+{
+	TemporaryResidueFile temporary;
+	ResidueFile file(temporary._path);
+
+	const auto timeStamp = std::chrono::system_clock::time_point(std::chrono::seconds(1'700'000'000));
+	const auto complete = bytes("complete");
+	const auto truncated = bytes("truncated block");
+	const std::vector<ResidueFile::Block> blocks { { timeStamp, complete }, { timeStamp, truncated } };
+	file.save(blocks);
+
+	// Cut off the end of the last block, like a crash in the middle of a write would
+	std::filesystem::resize_file(temporary._path, std::filesystem::file_size(temporary._path) - 4);
+
+	const auto loaded = file.take();
+	REQUIRE(loaded.size() == 1);
+	CHECK(loaded[0]._data == complete);
+}
+
+TEST_CASE("ResidueFile rejects files that are not residue files", "[ResidueFile]")
+{
+	TemporaryResidueFile temporary;
+	{
+		std::ofstream stream(temporary._path, std::ios::binary);
+		stream << "not a residue file";
+	}
+
+	ResidueFile file(temporary._path);
+	CHECK_THROWS_AS(file.take(), std::system_error);
+}
+
+} // namespace xentara::plugins::templateUplink
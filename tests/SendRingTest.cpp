@@ -0,0 +1,266 @@
+// Copyright (c) embedded ocean GmbH
+#include "BatchWriter.hpp"
+#include "Encoding.hpp"
+#include "Endpoint.hpp"
+#include "Reactor.hpp"
+#include "SendRing.hpp"
+#include "Socket.hpp"
+#include "StandInServer.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+
+namespace xentara::plugins::templateUplink
+{
+
+using namespace std::literals;
+
+namespace
+{
+
+	/// @brief The settings for connecting. These are much shorter than the defaults, as everything is local.
+	constexpr ConnectionRace kConnectionRace { 20ms, 500ms };
+
+	/// @brief Makes a frame for the stand-in server, with a payload filled with a pattern derived from a number
+	auto makeFrame(std::size_t payloadSize, std::uint32_t number) -> std::vector<std::byte>
+	{
+		std::vector<std::byte> frame(sizeof(std::uint32_t) + payloadSize);
+		putLittleEndian(frame.data(), std::uint32_t(payloadSize));
+		for (std::size_t index = 0; index < payloadSize; ++index)
+		{
+			frame[sizeof(std::uint32_t) + index] = std::byte((number + index) & 0xff);
+		}
+		return frame;
+	}
+
+	/// @brief Checks whether a frame received by the stand-in server has the pattern made by makeFrame()
+	auto checkPayload(std::span<const std::byte> payload, std::uint32_t number) -> bool
+	{
+		for (std::size_t index = 0; index < payload.size(); ++index)
+		{
+			if (payload[index] != std::byte((number + index) & 0xff))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/// @brief Connects a number of sockets to a stand-in server
+	auto connect(const StandInServer &server, std::size_t count) -> std::vector<std::shared_ptr<const Socket>>
+	{
+		const std::vector<Endpoint> endpoints { { "127.0.0.1", server.port() } };
+		const std::vector<std::size_t> order { 0 };
+
+		std::vector<std::shared_ptr<const Socket>> sockets;
+		for (std::size_t index = 0; index < count; ++index)
+		{
+			sockets.push_back(std::make_shared<const Socket>(connectToFirst(endpoints, order, kConnectionRace).first));
+		}
+		return sockets;
+	}
+
+	/// @brief Waits until a socket is ready for writing
+	auto waitUntilWritable(const Socket &socket) -> void
+	{
+		::pollfd entry { socket.native(), POLLOUT, 0 };
+		::poll(&entry, 1, 1000);
+	}
+
+	/// @brief Writes the same frame to a number of sockets using Socket::writeSome(), one system call per socket
+	auto writeDirect(std::span<const std::shared_ptr<const Socket>> sockets, std::span<const std::byte> frame) -> void
+	{
+		const std::vector<BatchWriter::Buffer> buffers { frame };
+		for (auto &&socket : sockets)
+		{
+			BatchWriter writer;
+			writer.start(buffers);
+			while (!writer.resume([&](std::span<const BatchWriter::Buffer> remaining) { return socket->writeSome(remaining); }))
+			{
+				waitUntilWritable(*socket);
+			}
+		}
+	}
+
+	/// @brief Writes the same frame to a number of sockets using a send ring, submitting all the writes together
+	class RingWriter final
+	{
+	public:
+		/// @brief Constructor
+		explicit RingWriter(SendRing &ring) : _ring(ring)
+		{
+		}
+
+		/// @brief Writes the frame to all the sockets, and waits until it has been written completely
+		auto write(std::span<const std::shared_ptr<const Socket>> sockets, std::span<const std::byte> frame) -> void
+		{
+			const std::vector<BatchWriter::Buffer> buffers { frame };
+
+			std::unique_lock lock { _mutex };
+			_writers.resize(sockets.size());
+			for (auto &&writer : _writers)
+			{
+				writer.start(buffers);
+			}
+			_again.assign(sockets.size(), false);
+			_error = {};
+
+			// Queue the writes for all sockets at once, like the transactions of a cycle do, and wait for all of them
+			while (submit(sockets))
+			{
+				_completed.wait(lock, [&] { return _outstanding == 0; });
+				if (_error)
+				{
+					throw std::system_error(_error, "write failed");
+				}
+			}
+		}
+
+	private:
+		/// @brief Queues writes for all sockets that still have data to write
+		/// @pre _mutex must be locked
+		/// @return Returns false if there was nothing left to write
+		auto submit(std::span<const std::shared_ptr<const Socket>> sockets) -> bool
+		{
+			for (std::size_t index = 0; index < sockets.size(); ++index)
+			{
+				auto &writer = _writers[index];
+				if (!writer.pending())
+				{
+					continue;
+				}
+
+				if (_again[index])
+				{
+					waitUntilWritable(*sockets[index]);
+				}
+				// The completion cannot run before we release the lock, so the count can be updated afterwards
+				_ring.write(sockets[index], writer.remaining(), [this, index](std::error_code error, std::size_t written) {
+					complete(index, error, written);
+				});
+				++_outstanding;
+			}
+			return _outstanding > 0;
+		}
+
+		/// @brief Handles the completion of a write
+		auto complete(std::size_t index, std::error_code error, std::size_t written) -> void
+		{
+			std::scoped_lock lock { _mutex };
+
+			_again[index] = error == std::errc::resource_unavailable_try_again;
+			if (error && !_again[index])
+			{
+				_error = error;
+			}
+			_writers[index].advance(written);
+
+			if (--_outstanding == 0)
+			{
+				_completed.notify_all();
+			}
+		}
+
+		SendRing &_ring;
+		std::mutex _mutex;
+		std::condition_variable _completed;
+		std::vector<BatchWriter> _writers;
+		std::vector<bool> _again;
+		std::size_t _outstanding { 0 };
+		std::error_code _error;
+	};
+
+} // namespace
+
+TEST_CASE("SendRing writes all data intact and in order", "[SendRing]")
+{
+	constexpr std::uint32_t kFrames = 200;
+
+	std::mutex mutex;
+	std::uint32_t received = 0;
+	bool intact = true;
+	StandInServer server({}, [&](std::span<const std::byte> frame) {
+		std::scoped_lock lock { mutex };
+		intact = intact && checkPayload(frame, received);
+		++received;
+	});
+
+	Reactor reactor(2);
+	SendRing ring(reactor);
+	if (!ring.available())
+	{
+		WARN("io_uring is not available, so the send ring cannot be tested");
+		return;
+	}
+
+	const auto sockets = connect(server, 1);
+	RingWriter writer(ring);
+	for (std::uint32_t number = 0; number < kFrames; ++number)
+	{
+		// Alternate between small writes, which are sent using sendmsg(), and large ones, which may be sent from a registered buffer
+		const auto size = number % 2 == 0 ? std::size_t(100) : std::size_t(300 * 1024);
+		writer.write(sockets, makeFrame(size, number));
+	}
+
+	const auto deadline = std::chrono::steady_clock::now() + 10s;
+	while (server.statistics()._frames < kFrames && std::chrono::steady_clock::now() < deadline)
+	{
+		std::this_thread::sleep_for(1ms);
+	}
+
+	std::scoped_lock lock { mutex };
+	CHECK(received == kFrames);
+	CHECK(intact);
+}
+
+TEST_CASE("Benchmark of the send ring against writing directly", "[SendRing][!benchmark]")
+{
+	// One connection for each transaction sending in the same cycle
+	constexpr std::size_t kConnections = 16;
+
+	StandInServer server({});
+	Reactor reactor(2);
+	SendRing ring(reactor);
+	if (!ring.available())
+	{
+		WARN("io_uring is not available, so only writing directly is measured");
+	}
+
+	const auto directSockets = connect(server, kConnections);
+	const auto ringSockets = connect(server, kConnections);
+	RingWriter ringWriter(ring);
+
+	for (const std::size_t size : { 1024, 64 * 1024 })
+	{
+		const auto frame = makeFrame(size, 0);
+		const auto name = std::to_string(kConnections) + " connections, " + std::to_string(size / 1024) + " KiB each, ";
+
+		BENCHMARK(name + "writeSome()")
+		{
+			writeDirect(directSockets, frame);
+		};
+
+		if (ring.available())
+		{
+			BENCHMARK(name + "SendRing")
+			{
+				ringWriter.write(ringSockets, frame);
+			};
+		}
+	}
+}
+
+} // namespace xentara::plugins::templateUplink
@@ -0,0 +1,175 @@
+// Copyright (c) embedded ocean GmbH
+#include "SendScheduler.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace xentara::plugins::templateUplink
+{
+
+using namespace std::literals;
+
+namespace
+{
+
+	/// @brief The time given to the waiting threads to start waiting
+	constexpr auto kSettleTime = 100ms;
+
+	/// @brief Records the order in which transactions got their turn
+	class TurnRecorder final
+	{
+	public:
+		/// @brief Starts a thread that waits for its turn, records it, and gives the slot back right away
+		auto wait(SendScheduler &scheduler, Priority priority, std::size_t size) -> void
+		{
+			_threads.emplace_back([this, &scheduler, priority, size] {
+				auto slot = scheduler.acquire(priority, size);
+				std::scoped_lock lock { _mutex };
+				_turns.push_back(slot ? int(priority) : -1);
+			});
+		}
+
+		/// @brief Waits for all threads and gets the order
+		auto turns() -> std::vector<int>
+		{
+			_threads.clear();
+			return _turns;
+		}
+
+	private:
+		std::mutex _mutex;
+		std::vector<int> _turns;
+		std::vector<std::jthread> _threads;
+	};
+
+} // namespace
+
+TEST_CASE("SendScheduler gives out one slot at a time", "[SendScheduler][multithreaded]")
+{
+	constexpr std::size_t kThreads = 8;
+	constexpr std::size_t kIterations = 1'000;
+
+	SendScheduler scheduler;
+	std::atomic<std::size_t> holders { 0 };
+	std::atomic<bool> overlapped { false };
+
+	{
+		std::vector<std::jthread> threads;
+		for (std::size_t thread = 0; thread < kThreads; ++thread)
+		{
+			threads.emplace_back([&, thread] {
+				for (std::size_t iteration = 0; iteration < kIterations; ++iteration)
+				{
+					auto slot = scheduler.acquire(Priority(thread % TrafficShaper::kPriorityLevels), 100);
+					if (!slot)
+					{
+						continue;
+					}
+					if (holders.fetch_add(1) != 0)
+					{
+						overlapped = true;
+					}
+					holders.fetch_sub(1);
+				}
+			});
+		}
+	}
+
+	CHECK_FALSE(overlapped);
+}
+
+TEST_CASE("SendScheduler lets the highest priority go first with the strict priority policy", "[SendScheduler][multithreaded]")
+{
+	SendScheduler scheduler;
+	TurnRecorder recorder;
+
+	auto slot = scheduler.acquire(0, 100);
+	REQUIRE(slot);
+
+	recorder.wait(scheduler, 1, 100);
+	std::this_thread::sleep_for(kSettleTime);
+	recorder.wait(scheduler, 6, 100);
+	std::this_thread::sleep_for(kSettleTime);
+	recorder.wait(scheduler, 3, 100);
+	std::this_thread::sleep_for(kSettleTime);
+
+	slot.reset();
+	CHECK(recorder.turns() == std::vector { 6, 3, 1 });
+}
+
+TEST_CASE("SendScheduler shares the connection by weight with the weighted fair policy", "[SendScheduler][multithreaded]")
+{
+	SendScheduler scheduler;
+	scheduler.setPolicy(SendScheduler::Policy::WeightedFair);
+	TurnRecorder recorder;
+
+	// A large batch in the high priority lane uses up its share for a while
+	auto slot = scheduler.acquire(7, 1'000'000);
+	REQUIRE(slot);
+
+	recorder.wait(scheduler, 7, 100);
+	std::this_thread::sleep_for(kSettleTime);
+	recorder.wait(scheduler, 0, 100);
+	std::this_thread::sleep_for(kSettleTime);
+
+	// The low priority lane has not had its share yet, so it goes first
+	slot.reset();
+	CHECK(recorder.turns() == std::vector { 0, 7 });
+}
+
+TEST_CASE("SendScheduler does not make others wait for a parked slot", "[SendScheduler][multithreaded]")
+{
+	SendScheduler scheduler;
+
+	auto slot = scheduler.acquire(0, 100);
+	REQUIRE(slot);
+
+	SECTION("when parked before others start waiting")
+	{
+		slot.park();
+		CHECK_FALSE(scheduler.acquire(7, 100));
+	}
+
+	SECTION("when parked while others are waiting")
+	{
+		TurnRecorder recorder;
+		recorder.wait(scheduler, 7, 100);
+		std::this_thread::sleep_for(kSettleTime);
+
+		slot.park();
+		CHECK(recorder.turns() == std::vector { -1 });
+	}
+
+	// Once unparked, the slot is exclusive again
+	slot.unpark();
+	{
+		TurnRecorder recorder;
+		recorder.wait(scheduler, 7, 100);
+		std::this_thread::sleep_for(kSettleTime);
+		slot.reset();
+		CHECK(recorder.turns() == std::vector { 7 });
+	}
+}
+
+TEST_CASE("SendScheduler reports the time a transaction had to wait", "[SendScheduler][multithreaded]")
+{
+	SendScheduler scheduler;
+
+	auto slot = scheduler.acquire(0, 100);
+	CHECK(slot.waitTime() < kSettleTime);
+
+	std::jthread releaser([&] {
+		std::this_thread::sleep_for(kSettleTime);
+		slot.reset();
+	});
+	const auto second = scheduler.acquire(0, 100);
+	CHECK(second.waitTime() >= kSettleTime);
+}
+
+} // namespace xentara::plugins::templateUplink
@@ -0,0 +1,262 @@
+// Copyright (c) embedded ocean GmbH
+#include "StandInServer.hpp"
+
+#include "Encoding.hpp"
+
+#include <algorithm>
+#include <array>
+#include <system_error>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+namespace xentara::plugins::templateUplink
+{
+
+using namespace std::literals;
+
+namespace
+{
+
+	/// @brief The size of the length field of a frame
+	constexpr std::size_t kLengthSize = sizeof(std::uint32_t);
+
+	/// @brief The maximum number of bytes read at once
+	constexpr std::size_t kReadSize = 64 * 1024;
+
+	/// @brief The time the server thread waits for activity before checking whether it should stop
+	constexpr auto kPollInterval = 10ms;
+
+	/// @brief Throws the last socket error
+	[[noreturn]] auto throwLastError(const char *what) -> void
+	{
+		throw std::system_error(errno, std::system_category(), what);
+	}
+
+} // namespace
+
+StandInServer::StandInServer(const Config &config, FrameHandler frameHandler) :
+	_config(config), _frameHandler(std::move(frameHandler)), _port(config._port)
+{
+	{
+		std::scoped_lock lock { _mutex };
+		listen();
+	}
+
+	_thread = std::jthread([this](std::stop_token stopToken) { run(stopToken); });
+}
+
+StandInServer::~StandInServer()
+{
+	// Stop the thread before the sockets are closed
+	_thread.request_stop();
+	_thread = {};
+}
+
+auto StandInServer::statistics() const -> Statistics
+{
+	std::scoped_lock lock { _mutex };
+	return _statistics;
+}
+
+auto StandInServer::connectionCount() const -> std::size_t
+{
+	std::scoped_lock lock { _mutex };
+	return _connections.size();
+}
+
+auto StandInServer::resetConnections() -> void
+{
+	std::scoped_lock lock { _mutex };
+
+	for (auto &&connection : _connections)
+	{
+		// Closing a socket with a zero linger time sends a reset instead of a graceful shutdown
+		const ::linger linger { 1, 0 };
+		::setsockopt(connection._socket.native(), SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+		_statistics._discardedBytes += connection._buffer.size();
+	}
+	_connections.clear();
+}
+
+auto StandInServer::stopListening() -> void
+{
+	std::scoped_lock lock { _mutex };
+	_listener.close();
+}
+
+auto StandInServer::resumeListening() -> void
+{
+	std::scoped_lock lock { _mutex };
+	if (!_listener)
+	{
+		listen();
+	}
+}
+
+auto StandInServer::listen() -> void
+{
+	Socket listener(::socket(AF_INET, SOCK_STREAM, 0));
+	if (!listener)
+	{
+		throwLastError("could not create the listening socket");
+	}
+
+	// Allow listening on the same port again after stopListening(), even if old connections are still lingering
+	const int reuse = 1;
+	::setsockopt(listener.native(), SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	::sockaddr_in address {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons(_port);
+	if (::bind(listener.native(), reinterpret_cast<const ::sockaddr *>(&address), sizeof(address)) != 0)
+	{
+		throwLastError("could not bind the listening socket");
+	}
+	if (::listen(listener.native(), SOMAXCONN) != 0)
+	{
+		throwLastError("could not listen for connections");
+	}
+	listener.setNonBlocking();
+
+	// Find out which port was chosen
+	::socklen_t size = sizeof(address);
+	if (::getsockname(listener.native(), reinterpret_cast<::sockaddr *>(&address), &size) != 0)
+	{
+		throwLastError("could not get the port of the listening socket");
+	}
+	_port = ntohs(address.sin_port);
+
+	_listener = std::move(listener);
+}
+
+auto StandInServer::run(std::stop_token stopToken) -> void
+{
+	std::vector<::pollfd> pollList;
+	while (!stopToken.stop_requested())
+	{
+		// Collect the sockets to wait for
+		pollList.clear();
+		{
+			std::scoped_lock lock { _mutex };
+			if (_listener)
+			{
+				pollList.push_back({ _listener.native(), POLLIN, 0 });
+			}
+			for (auto &&connection : _connections)
+			{
+				pollList.push_back({ connection._socket.native(), POLLIN, 0 });
+			}
+		}
+
+		// Wait for activity. The sockets may be closed by another thread in the meantime, which poll() simply reports.
+		::poll(pollList.data(), ::nfds_t(pollList.size()), int(kPollInterval.count()));
+
+		// Simulate a slow service
+		if (_config._readDelay.count() > 0)
+		{
+			std::this_thread::sleep_for(_config._readDelay);
+		}
+		if (_config._bytesPerSecond > 0)
+		{
+			std::this_thread::sleep_until(_nextRead);
+		}
+
+		std::scoped_lock lock { _mutex };
+		accept();
+		std::erase_if(_connections, [this](Connection &connection) { return !receive(connection); });
+	}
+}
+
+auto StandInServer::accept() -> void
+{
+	if (!_listener)
+	{
+		return;
+	}
+
+	for (;;)
+	{
+		Socket socket(::accept(_listener.native(), nullptr, nullptr));
+		if (!socket)
+		{
+			return;
+		}
+		socket.setNonBlocking();
+
+		_connections.push_back({ std::move(socket), {} });
+		++_statistics._connections;
+	}
+}
+
+auto StandInServer::receive(Connection &connection) -> bool
+{
+	std::array<std::byte, kReadSize> buffer;
+	std::optional<std::size_t> received;
+	try
+	{
+		received = connection._socket.readSome(buffer);
+	}
+	catch (const std::system_error &)
+	{
+		received = 0;
+	}
+
+	// Nothing to read
+	if (!received)
+	{
+		return true;
+	}
+
+	// The connection was closed, or failed
+	if (*received == 0)
+	{
+		_statistics._discardedBytes += connection._buffer.size();
+		return false;
+	}
+
+	_statistics._bytes += *received;
+	throttle(*received);
+
+	// Split the data into frames
+	connection._buffer.insert(connection._buffer.end(), buffer.begin(), buffer.begin() + std::ptrdiff_t(*received));
+	std::size_t position = 0;
+	while (connection._buffer.size() - position >= kLengthSize)
+	{
+		const auto size = getLittleEndian<std::uint32_t>(connection._buffer.data() + position);
+		if (connection._buffer.size() - position - kLengthSize < size)
+		{
+			break;
+		}
+
+		++_statistics._frames;
+		if (_frameHandler)
+		{
+			_frameHandler(std::span(connection._buffer).subspan(position + kLengthSize, size));
+		}
+		position += kLengthSize + size;
+	}
+	connection._buffer.erase(connection._buffer.begin(), connection._buffer.begin() + std::ptrdiff_t(position));
+
+	return true;
+}
+
+auto StandInServer::throttle(std::size_t size) -> void
+{
+	if (_config._bytesPerSecond <= 0)
+	{
+		return;
+	}
+
+	// Don't let an idle period build up credit for a burst
+	const auto now = std::chrono::steady_clock::now();
+	_nextRead = std::max(_nextRead, now) +
+		std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::duration<double>(double(size) / _config._bytesPerSecond));
+}
+
+} // namespace xentara::plugins::templateUplink
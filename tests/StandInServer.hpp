@@ -0,0 +1,142 @@
+// Copyright (c) embedded ocean GmbH
+#pragma once
+
+#include "Socket.hpp"
+
+#include <xentara/utils/tools/Unique.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace xentara::plugins::templateUplink
+{
+
+/// @brief A local stand-in for the remote service, used to test the uplink without any external services.
+///
+/// The server listens on a loopback port, and accepts any number of connections. It splits the data it receives into
+/// frames consisting of a 4 byte little endian length followed by that many bytes, just like the command messages described
+/// in CommandReceiver. A partial frame left over when a connection is closed is discarded, just as a real service would.
+///
+/// The server can simulate a slow or unreliable service by delaying its reads, by limiting the rate at which it reads, and by
+/// resetting all connections, or refusing new ones, on request.
+///
+/// All the work is done on a single background thread, which is started by the constructor.
+class StandInServer final : private utils::tools::Unique
+{
+public:
+	/// @brief A function called on the server thread for every complete frame received, without the length field
+	using FrameHandler = std::function<void(std::span<const std::byte> frame)>;
+
+	/// @brief The configuration of the server
+	struct Config final
+	{
+		/// @brief The port to listen on, or 0 to choose a free port
+		std::uint16_t _port { 0 };
+		/// @brief A delay added before every read
+		std::chrono::microseconds _readDelay { 0 };
+		/// @brief The maximum number of bytes read per second, or 0 for unlimited
+		double _bytesPerSecond { 0 };
+	};
+
+	/// @brief Statistics about the data received so far
+	struct Statistics final
+	{
+		/// @brief The number of connections accepted
+		std::size_t _connections { 0 };
+		/// @brief The number of bytes received
+		std::uint64_t _bytes { 0 };
+		/// @brief The number of complete frames received
+		std::uint64_t _frames { 0 };
+		/// @brief The number of bytes in partial frames that were discarded because the connection was closed
+		std::uint64_t _discardedBytes { 0 };
+	};
+
+	/// @brief Constructor. Starts listening and runs the server on a background thread.
+	/// @param frameHandler The function to call for each frame, or nullptr to just count the frames
+	/// @throw std::system_error The server could not listen on the requested port
+	explicit StandInServer(const Config &config, FrameHandler frameHandler = nullptr);
+
+	/// @brief Destructor. Stops the server and closes all connections.
+	~StandInServer();
+
+	/// @brief Gets the port the server listens on
+	auto port() const noexcept -> std::uint16_t
+	{
+		return _port;
+	}
+
+	/// @brief Gets the statistics
+	auto statistics() const -> Statistics;
+
+	/// @brief Gets the number of currently open connections
+	auto connectionCount() const -> std::size_t;
+
+	/// @brief Resets all open connections, so that the uplink sees a connection reset
+	auto resetConnections() -> void;
+
+	/// @brief Stops accepting new connections, so that connection attempts are refused
+	auto stopListening() -> void;
+
+	/// @brief Starts accepting new connections again on the same port
+	/// @throw std::system_error The port could not be listened on again
+	auto resumeListening() -> void;
+
+private:
+	/// @brief An accepted connection
+	struct Connection final
+	{
+		/// @brief The socket
+		Socket _socket;
+		/// @brief The data received that does not yet form a complete frame
+		std::vector<std::byte> _buffer;
+	};
+
+	/// @brief Opens the listening socket
+	/// @pre _mutex must be locked
+	auto listen() -> void;
+
+	/// @brief The main loop of the server thread
+	auto run(std::stop_token stopToken) -> void;
+
+	/// @brief Accepts all pending connections
+	/// @pre _mutex must be locked
+	auto accept() -> void;
+
+	/// @brief Reads from a connection
+	/// @pre _mutex must be locked
+	/// @return Returns false if the connection was closed
+	auto receive(Connection &connection) -> bool;
+
+	/// @brief Works out when the next read is allowed by the configured bandwidth
+	auto throttle(std::size_t size) -> void;
+
+	/// @brief The configuration
+	Config _config;
+	/// @brief The function to call for each frame
+	FrameHandler _frameHandler;
+	/// @brief The port
+	std::uint16_t _port { 0 };
+
+	/// @brief A mutex protecting the sockets and the statistics
+	mutable std::mutex _mutex;
+	/// @brief The listening socket, or an invalid socket if the server is not listening
+	Socket _listener;
+	/// @brief The open connections
+	std::vector<Connection> _connections;
+	/// @brief The statistics
+	Statistics _statistics;
+
+	/// @brief The time the bandwidth limit allows the next read
+	std::chrono::steady_clock::time_point _nextRead;
+
+	/// @brief The server thread
+	std::jthread _thread;
+};
+
+} // namespace xentara::plugins::templateUplink
@@ -0,0 +1,114 @@
+// Copyright (c) embedded ocean GmbH
+#include "StandInServer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string_view>
+#include <thread>
+
+using namespace std::literals;
+using namespace xentara::plugins::templateUplink;
+
+namespace
+{
+
+	/// @brief Set by the signal handler when the server should stop
+	volatile std::sig_atomic_t gStopRequested = 0;
+
+	/// @brief Handles SIGINT and SIGTERM
+	auto handleSignal(int) -> void
+	{
+		gStopRequested = 1;
+	}
+
+	/// @brief Prints the usage
+	auto printUsage(std::string_view program) -> void
+	{
+		std::cerr << "usage: " << program << " [--port PORT] [--read-delay MICROSECONDS] [--bandwidth BYTES_PER_SECOND]\n"
+				  << "       [--reset-every SECONDS]\n";
+	}
+
+} // namespace
+
+/// @brief Runs a local stand-in for the remote service, so that the uplink can be run against it without external services.
+///
+/// The server prints the statistics once a second. With --reset-every, it resets all connections at the given interval, so
+/// that the reconnect behaviour of the uplink can be observed.
+auto main(int argc, char *argv[]) -> int
+{
+	StandInServer::Config config;
+	std::chrono::seconds resetInterval { 0 };
+
+	for (int index = 1; index < argc; ++index)
+	{
+		const std::string_view argument = argv[index];
+		if (index + 1 >= argc)
+		{
+			printUsage(argv[0]);
+			return EXIT_FAILURE;
+		}
+		const auto value = std::strtoull(argv[++index], nullptr, 10);
+
+		if (argument == "--port"sv)
+		{
+			config._port = std::uint16_t(value);
+		}
+		else if (argument == "--read-delay"sv)
+		{
+			config._readDelay = std::chrono::microseconds(value);
+		}
+		else if (argument == "--bandwidth"sv)
+		{
+			config._bytesPerSecond = double(value);
+		}
+		else if (argument == "--reset-every"sv)
+		{
+			resetInterval = std::chrono::seconds(value);
+		}
+		else
+		{
+			printUsage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::signal(SIGINT, handleSignal);
+	std::signal(SIGTERM, handleSignal);
+
+	try
+	{
+		StandInServer server(config);
+		std::cout << "listening on 127.0.0.1:" << server.port() << std::endl;
+
+		auto last = server.statistics();
+		auto nextReset = std::chrono::steady_clock::now() + resetInterval;
+		while (gStopRequested == 0)
+		{
+			std::this_thread::sleep_for(1s);
+
+			if (resetInterval.count() > 0 && std::chrono::steady_clock::now() >= nextReset)
+			{
+				server.resetConnections();
+				nextReset += resetInterval;
+				std::cout << "reset all connections" << std::endl;
+			}
+
+			const auto statistics = server.statistics();
+			std::cout << "connections: " << statistics._connections << ", frames: " << statistics._frames
+					  << ", bytes: " << statistics._bytes << ", discarded: " << statistics._discardedBytes
+					  << ", throughput: " << (statistics._bytes - last._bytes) << " B/s" << std::endl;
+			last = statistics;
+		}
+	}
+	catch (const std::exception &exception)
+	{
+		std::cerr << exception.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,145 @@
+// Copyright (c) embedded ocean GmbH
+#include "TrafficShaper.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+
+namespace xentara::plugins::templateUplink
+{
+
+using namespace std::literals;
+
+namespace
+{
+
+	/// @brief An arbitrary starting time
+	const auto kStart = std::chrono::system_clock::time_point(1'700'000'000s);
+
+} // namespace
+
+TEST_CASE("TrafficShaper without limits lets everything through", "[TrafficShaper]")
+{
+	TrafficShaper shaper;
+	CHECK_FALSE(shaper.enabled());
+
+	TrafficShaper::Request request;
+	for (int index = 0; index < 100; ++index)
+	{
+		CHECK(shaper.tryAcquire(request, 1'000'000, kStart));
+	}
+	CHECK(shaper.queueDepth() == 0);
+}
+
+TEST_CASE("TrafficShaper limits the byte rate", "[TrafficShaper]")
+{
+	TrafficShaper shaper;
+	shaper.setByteRate(1000, 500);
+	REQUIRE(shaper.enabled());
+
+	TrafficShaper::Request request;
+
+	// The bucket starts full
+	CHECK(shaper.tryAcquire(request, 500, kStart));
+	CHECK_FALSE(shaper.tryAcquire(request, 100, kStart));
+	CHECK(request.queued());
+	CHECK(shaper.queueDepth() == 1);
+
+	// 100 bytes take 100ms to accumulate at 1000 bytes per second
+	CHECK_FALSE(shaper.tryAcquire(request, 100, kStart + 50ms));
+	CHECK(shaper.tryAcquire(request, 100, kStart + 100ms));
+	CHECK_FALSE(request.queued());
+	CHECK(shaper.queueDepth() == 0);
+
+	// The time spent waiting is accounted for
+	CHECK(shaper.throttleTime() == 100ms);
+}
+
+TEST_CASE("TrafficShaper does not let an idle period build up more than a burst", "[TrafficShaper]")
+{
+	TrafficShaper shaper;
+	shaper.setByteRate(1000, 500);
+
+	TrafficShaper::Request request;
+	CHECK(shaper.tryAcquire(request, 500, kStart));
+
+	// A long pause only refills the bucket up to its capacity
+	CHECK(shaper.tryAcquire(request, 500, kStart + 10s));
+	CHECK_FALSE(shaper.tryAcquire(request, 1, kStart + 10s));
+}
+
+TEST_CASE("TrafficShaper lets an oversized message through once the bucket is full", "[TrafficShaper]")
+{
+	TrafficShaper shaper;
+	shaper.setByteRate(1000, 500);
+
+	TrafficShaper::Request request;
+	CHECK(shaper.tryAcquire(request, 100, kStart));
+
+	// The message is larger than the burst size, so it must only wait for a full bucket
+	CHECK_FALSE(shaper.tryAcquire(request, 2000, kStart));
+	CHECK(shaper.tryAcquire(request, 2000, kStart + 100ms));
+
+	// The bucket is now in debt
+	CHECK_FALSE(shaper.tryAcquire(request, 1, kStart + 1s));
+	CHECK(shaper.tryAcquire(request, 1, kStart + 1700ms));
+}
+
+TEST_CASE("TrafficShaper limits the message rate", "[TrafficShaper]")
+{
+	TrafficShaper shaper;
+	shaper.setMessageRate(10, 2);
+
+	TrafficShaper::Request request;
+	CHECK(shaper.tryAcquire(request, 1'000'000, kStart));
+	CHECK(shaper.tryAcquire(request, 1'000'000, kStart));
+	CHECK_FALSE(shaper.tryAcquire(request, 1, kStart));
+	CHECK(shaper.tryAcquire(request, 1, kStart + 100ms));
+}
+
+TEST_CASE("TrafficShaper holds back lower priorities while a higher priority is waiting", "[TrafficShaper]")
+{
+	TrafficShaper shaper;
+	shaper.setByteRate(1000, 100);
+
+	TrafficShaper::Request low(1);
+	TrafficShaper::Request high(5);
+
+	// Use up the bucket, and have the high priority request wait
+	CHECK(shaper.tryAcquire(low, 100, kStart));
+	CHECK_FALSE(shaper.tryAcquire(high, 100, kStart));
+
+	// There would be enough tokens for a small low priority message, but the high priority one goes first
+	CHECK_FALSE(shaper.tryAcquire(low, 10, kStart + 50ms));
+	CHECK(shaper.tryAcquire(high, 100, kStart + 100ms));
+	CHECK(shaper.tryAcquire(low, 10, kStart + 110ms));
+
+	SECTION("unless strict priority is turned off")
+	{
+		shaper.setStrictPriority(false);
+		CHECK_FALSE(shaper.tryAcquire(high, 100, kStart + 110ms));
+		CHECK(shaper.tryAcquire(low, 10, kStart + 200ms));
+	}
+
+	SECTION("until the higher priority request is cancelled")
+	{
+		CHECK_FALSE(shaper.tryAcquire(high, 100, kStart + 110ms));
+		CHECK_FALSE(shaper.tryAcquire(low, 10, kStart + 200ms));
+		shaper.cancel(high, kStart + 200ms);
+		CHECK_FALSE(high.queued());
+		CHECK(shaper.tryAcquire(low, 10, kStart + 200ms));
+	}
+}
+
+TEST_CASE("TrafficShaper ignores clock jumps into the past", "[TrafficShaper]")
+{
+	TrafficShaper shaper;
+	shaper.setByteRate(1000, 100);
+
+	TrafficShaper::Request request;
+	CHECK(shaper.tryAcquire(request, 100, kStart));
+	CHECK_FALSE(shaper.tryAcquire(request, 100, kStart - 1h));
+	CHECK(shaper.tryAcquire(request, 100, kStart + 100ms));
+}
+
+} // namespace xentara::plugins::templateUplink
@@ -0,0 +1,3 @@
+// Copyright (c) embedded ocean GmbH
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch.hpp>